@@ -0,0 +1,136 @@
+#include "arm_benchmarks.h"
+
+/*
+ * Fixed workloads for vm_bench, assembled for ARMv7. Each kernel is called
+ * with r0 pointing at an ARM_BENCHMARK_BUFFER_SIZE buffer and returns a
+ * checksum in r0 that is checked before its timing is trusted.
+ */
+
+/* Fills the buffer with 256 words from an LCG, then folds them 2000 times. */
+static const unsigned int sum_code[] =
+{
+  0xe92d40f0,  /*         push {r4-r7, lr} */
+  0xe3a01c01,  /*         mov  r1, #256 */
+  0xe3033039,  /*         ldr  r3, =12345 */
+  0xe59f4044,  /*         ldr  r4, =1103515245 */
+  0xe3a02000,  /*         mov  r2, #0 */
+  0xe0231493,  /* fill:   mla  r3, r3, r4, r1 */
+  0xe7803102,  /*         str  r3, [r0, r2, lsl #2] */
+  0xe2822001,  /*         add  r2, r2, #1 */
+  0xe1520001,  /*         cmp  r2, r1 */
+  0xbafffffa,  /*         blt  fill */
+  0xe3a05e7d,  /*         mov  r5, #2000 */
+  0xe3a06000,  /*         mov  r6, #0 */
+  0xe1a02000,  /* outer:  mov  r2, r0 */
+  0xe1a03001,  /*         mov  r3, r1 */
+  0xe4927004,  /* inner:  ldr  r7, [r2], #4 */
+  0xe08761e6,  /*         add  r6, r7, r6, ror #3 */
+  0xe2533001,  /*         subs r3, r3, #1 */
+  0x1afffffb,  /*         bne  inner */
+  0xe2555001,  /*         subs r5, r5, #1 */
+  0x1afffff7,  /*         bne  outer */
+  0xe1a00006,  /*         mov  r0, r6 */
+  0xe8bd80f0,  /*         pop  {r4-r7, pc} */
+  0x41c64e6d,  /* literal pool */
+};
+
+/* Sums fib(n) mod 2^32 for n = 1..1000, computing each from scratch. */
+static const unsigned int fibonacci_code[] =
+{
+  0xe92d4010,  /*         push {r4, lr} */
+  0xe3a04000,  /*         mov  r4, #0 */
+  0xe3a01001,  /*         mov  r1, #1 */
+  0xe3a02000,  /* next:   mov  r2, #0 */
+  0xe3a03001,  /*         mov  r3, #1 */
+  0xe1a0c001,  /*         mov  r12, r1 */
+  0xe0820003,  /* loop:   add  r0, r2, r3 */
+  0xe1a02003,  /*         mov  r2, r3 */
+  0xe1a03000,  /*         mov  r3, r0 */
+  0xe25cc001,  /*         subs r12, r12, #1 */
+  0x1afffffa,  /*         bne  loop */
+  0xe0844002,  /*         add  r4, r4, r2 */
+  0xe2811001,  /*         add  r1, r1, #1 */
+  0xe3510ffa,  /*         cmp  r1, #1000 */
+  0xdafffff3,  /*         ble  next */
+  0xe1a00004,  /*         mov  r0, r4 */
+  0xe8bd8010,  /*         pop  {r4, pc} */
+};
+
+/* Bubble sort of 64 pseudo-random words in the buffer, 400 times. */
+static const unsigned int sort_code[] =
+{
+  0xe92d43f0,  /*         push {r4-r9, lr} */
+  0xe3038039,  /*         ldr  r8, =12345 */
+  0xe59f9074,  /*         ldr  r9, =1103515245 */
+  0xe3a0c000,  /*         mov  r12, #0 */
+  0xe3a0ee19,  /*         mov  lr, #400 */
+  0xe3a02000,  /* rep:    mov  r2, #0 */
+  0xe0282998,  /* fill:   mla  r8, r8, r9, r2 */
+  0xe7808102,  /*         str  r8, [r0, r2, lsl #2] */
+  0xe2822001,  /*         add  r2, r2, #1 */
+  0xe3520040,  /*         cmp  r2, #64 */
+  0xbafffffa,  /*         blt  fill */
+  0xe3a0303f,  /*         mov  r3, #63 */
+  0xe1a01000,  /* pass:   mov  r1, r0 */
+  0xe1a02003,  /*         mov  r2, r3 */
+  0xe8910030,  /* inner:  ldm  r1, {r4, r5} */
+  0xe1540005,  /*         cmp  r4, r5 */
+  0x85815000,  /*         strhi r5, [r1] */
+  0x85814004,  /*         strhi r4, [r1, #4] */
+  0xe2811004,  /*         add  r1, r1, #4 */
+  0xe2522001,  /*         subs r2, r2, #1 */
+  0x1afffff8,  /*         bne  inner */
+  0xe2533001,  /*         subs r3, r3, #1 */
+  0x1afffff4,  /*         bne  pass */
+  0xe5904000,  /*         ldr  r4, [r0] */
+  0xe5905080,  /*         ldr  r5, [r0, #128] */
+  0xe59060fc,  /*         ldr  r6, [r0, #252] */
+  0xe08cc004,  /*         add  r12, r12, r4 */
+  0xe08cc005,  /*         add  r12, r12, r5 */
+  0xe08cc006,  /*         add  r12, r12, r6 */
+  0xe25ee001,  /*         subs lr, lr, #1 */
+  0x1affffe5,  /*         bne  rep */
+  0xe1a0000c,  /*         mov  r0, r12 */
+  0xe8bd83f0,  /*         pop  {r4-r9, pc} */
+  0x41c64e6d,  /* literal pool */
+};
+
+/* Copies the first 2 KB of the buffer onto the second with LDM/STM, 8000 times. */
+static const unsigned int memcpy_code[] =
+{
+  0xe92d4ff0,  /*         push {r4-r11, lr} */
+  0xe3a02000,  /*         mov  r2, #0 */
+  0xe7802102,  /* fill:   str  r2, [r0, r2, lsl #2] */
+  0xe2822001,  /*         add  r2, r2, #1 */
+  0xe3520b01,  /*         cmp  r2, #1024 */
+  0xbafffffb,  /*         blt  fill */
+  0xe3a0cd7d,  /*         mov  r12, #8000 */
+  0xe3a0e000,  /*         mov  lr, #0 */
+  0xe1a01000,  /* rep:    mov  r1, r0 */
+  0xe2802b02,  /*         add  r2, r0, #2048 */
+  0xe3a03040,  /*         mov  r3, #64 */
+  0xe8b10ff0,  /* copy:   ldm  r1!, {r4-r11} */
+  0xe8a20ff0,  /*         stm  r2!, {r4-r11} */
+  0xe2533001,  /*         subs r3, r3, #1 */
+  0x1afffffb,  /*         bne  copy */
+  0xe5904804,  /*         ldr  r4, [r0, #2052] */
+  0xe08ee004,  /*         add  lr, lr, r4 */
+  0xe2844001,  /*         add  r4, r4, #1 */
+  0xe5804004,  /*         str  r4, [r0, #4] */
+  0xe25cc001,  /*         subs r12, r12, #1 */
+  0x1afffff2,  /*         bne  rep */
+  0xe1a0000e,  /*         mov  r0, lr */
+  0xe8bd8ff0,  /*         pop  {r4-r11, pc} */
+};
+
+#define KERNEL(name)  name##_code, sizeof(name##_code) / sizeof(name##_code[0])
+
+const struct arm_benchmark arm_benchmarks[] =
+{
+  {"sum",       KERNEL(sum),       0x4bcb60ee},
+  {"fibonacci", KERNEL(fibonacci), 0xab55c137},
+  {"sort",      KERNEL(sort),      0xb1e1a7be},
+  {"memcpy",    KERNEL(memcpy),    0x01e857a0},
+};
+
+const int arm_num_benchmarks = sizeof(arm_benchmarks) / sizeof(arm_benchmarks[0]);
@@ -0,0 +1,18 @@
+#ifndef ARM_BENCHMARKS_H
+#define ARM_BENCHMARKS_H
+
+#define ARM_BENCHMARK_CODE_ADDRESS  0x8000
+#define ARM_BENCHMARK_BUFFER_SIZE  4096
+
+struct arm_benchmark
+{
+  const char* name;
+  const unsigned int* code;
+  unsigned int size;
+  unsigned int expected;
+};
+
+extern const struct arm_benchmark arm_benchmarks[];
+extern const int arm_num_benchmarks;
+
+#endif
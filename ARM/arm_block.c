@@ -0,0 +1,338 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arm_vm.h"
+#include "arm_block.h"
+#include "arm_decode.h"
+#include "arm_jit.h"
+#include "arm_thumb.h"
+
+#define TCACHE_HASH(pc)  (((pc) >> 2) & (TCACHE_BUCKETS - 1))
+
+struct arm_tcache* new_arm_tcache(void)
+{
+  struct arm_tcache* tc;
+
+  tc = (struct arm_tcache*)calloc(1, sizeof(struct arm_tcache));
+  if(tc == NULL)
+  {
+    printf("Unable to allocate memory failed, exiting.\n");
+    exit(-1);
+  }
+
+  tc->code_pages = (unsigned char*)calloc(TCACHE_NUM_PAGES / 8, 1);
+  if(tc->code_pages == NULL)
+  {
+    printf("Unable to allocate memory failed, exiting.\n");
+    exit(-1);
+  }
+
+  return tc;
+}
+
+/* Blocks translated from now on are also compiled to host code. */
+void arm_tcache_enable_jit(struct arm_tcache* tc)
+{
+  if(tc->jit == NULL)
+  {
+    tc->jit = new_arm_jit();
+  }
+}
+
+void arm_tcache_flush(struct arm_tcache* tc)
+{
+  while(tc->all_blocks != NULL)
+  {
+    struct arm_block* next = tc->all_blocks->all_next;
+    free(tc->all_blocks);
+    tc->all_blocks = next;
+  }
+
+  arm_thumb_flush(tc);
+  tc->current = NULL;
+  memset(tc->buckets, 0, sizeof(tc->buckets));
+  memset(tc->code_pages, 0, TCACHE_NUM_PAGES / 8);
+  tc->num_blocks = 0;
+  tc->dirty = 0;
+  if(tc->jit != NULL)
+  {
+    arm_jit_reset(tc->jit);
+  }
+  tc->flushes++;
+}
+
+void free_arm_tcache(struct arm_tcache* tc)
+{
+  arm_tcache_flush(tc);
+  if(tc->jit != NULL)
+  {
+    free_arm_jit(tc->jit);
+  }
+  free(tc->thumb);
+  free(tc->code_pages);
+  free(tc);
+}
+
+int arm_block_ends(unsigned int cls, unsigned int iw)
+{
+  unsigned int rd = (iw >> 12) & 0xF;
+
+  switch(cls)
+  {
+    case ARM_CLASS_DATA_PROCESSING:
+      return rd == PC && ((iw >> 21) & 0xC) != 0x8;
+
+    case ARM_CLASS_DATA_TRANSFER:
+      return rd == PC && ((iw >> 20) & 0b1);
+
+    case ARM_CLASS_POP:
+      return (iw >> PC) & 0b1;
+
+    case ARM_CLASS_MRS:
+    case ARM_CLASS_MSR:
+    case ARM_CLASS_PUSH:
+    case ARM_CLASS_MULTIPLY:
+    case ARM_CLASS_MOVE_WIDE:
+    case ARM_CLASS_EXCLUSIVE:
+    case ARM_CLASS_HALFWORD_TRANSFER:
+    case ARM_CLASS_EXTEND:
+    case ARM_CLASS_COPROCESSOR_TRANSFER:
+      return 0;
+
+    /* Only CP15 writes can change how the following code runs. */
+    case ARM_CLASS_COPROCESSOR:
+      return ((iw >> 9) & 0x7) != 0x5;
+
+    case ARM_CLASS_UNCONDITIONAL:
+      return (iw >> 25) == 0x7D;
+  }
+  return 1;
+}
+
+void arm_tcache_mark_code(struct arm_tcache* tc, unsigned int address)
+{
+  unsigned int page = address >> TCACHE_PAGE_BITS;
+  tc->code_pages[page >> 3] |= 1 << (page & 7);
+}
+
+static struct arm_block* translate(struct arm_state* arm_s, struct arm_tcache* tc, unsigned int pc)
+{
+  struct arm_uop uops[TCACHE_MAX_BLOCK];
+  struct arm_block* block;
+  unsigned int comp_count = 0;
+  unsigned int mem_count = 0;
+  unsigned int br_count = 0;
+  unsigned int n = 0;
+  unsigned int address = pc;
+
+  tc->current = NULL;
+  for(;;)
+  {
+    unsigned int iw = *((unsigned int *)(arm_s->mem_base + address));
+    unsigned int cls = ARM_CLASSIFY(iw);
+
+    arm_uop_decode(&uops[n], iw, address);
+    n++;
+
+    switch(arm_class_counter[cls])
+    {
+      case ARM_COUNT_COMP:
+        comp_count++;
+        break;
+      case ARM_COUNT_MEM:
+        mem_count++;
+        break;
+      case ARM_COUNT_BR:
+        br_count++;
+        break;
+    }
+
+    arm_tcache_mark_code(tc, address);
+    /* The next page may not be mapped, and must only fault once it is reached. */
+    if(arm_block_ends(cls, iw) || n == TCACHE_MAX_BLOCK || ((address + 4) & (GUEST_PAGE_SIZE - 1)) == 0)
+    {
+      break;
+    }
+    address += 4;
+  }
+
+  block = (struct arm_block*)malloc(sizeof(struct arm_block) + n * sizeof(struct arm_uop));
+  if(block == NULL)
+  {
+    printf("Unable to allocate memory failed, exiting.\n");
+    exit(-1);
+  }
+
+  block->pc = pc;
+  block->num_uops = n;
+  block->comp_count = comp_count;
+  block->mem_count = mem_count;
+  block->br_count = br_count;
+  block->succ[0] = NULL;
+  block->succ[1] = NULL;
+  memcpy(block->uops, uops, n * sizeof(struct arm_uop));
+  block->code = tc->jit != NULL ? arm_jit_compile(tc->jit, tc, block) : NULL;
+
+  block->hash_next = tc->buckets[TCACHE_HASH(pc)];
+  tc->buckets[TCACHE_HASH(pc)] = block;
+  block->all_next = tc->all_blocks;
+  tc->all_blocks = block;
+  tc->num_blocks++;
+
+  return block;
+}
+
+static struct arm_block* lookup(struct arm_state* arm_s, struct arm_tcache* tc, unsigned int pc)
+{
+  struct arm_block* block;
+
+  for(block = tc->buckets[TCACHE_HASH(pc)]; block != NULL; block = block->hash_next)
+  {
+    if(block->pc == pc)
+    {
+      return block;
+    }
+  }
+  return translate(arm_s, tc, pc);
+}
+
+/*
+ * Counters are bumped once per block; instructions whose condition fails
+ * count as executed, as they do in the interpreter.
+ */
+static void run_block(struct arm_state* arm_s, struct arm_tcache* tc, struct arm_block* block)
+{
+  struct arm_uop* uop = block->uops;
+  struct arm_uop* end = uop + block->num_uops;
+
+  arm_s->comp_count += block->comp_count;
+  arm_s->mem_count += block->mem_count;
+  arm_s->br_count += block->br_count;
+  tc->current = block;
+
+  if(block->code != NULL)
+  {
+    block->code(arm_s);
+    return;
+  }
+
+  for(; uop != end; uop++)
+  {
+    if((uop->iw >> 28) != COND_AL && !check_cpsr_flags(arm_s, uop->iw))
+    {
+      arm_s->regs[PC] += 4;
+      continue;
+    }
+    uop->run(arm_s, uop);
+  }
+}
+
+/*
+ * One block of the arm_tcache_run loop. The block at PC is looked for among
+ * the successors of the previous block before the hash table, and becomes
+ * the previous block for the next call unless the cache was flushed.
+ */
+static inline struct arm_block* run_next(struct arm_state* arm_s, struct arm_tcache* tc, struct arm_block* block)
+{
+  unsigned int pc = arm_s->regs[PC];
+  struct arm_block* next;
+
+  if(arm_s->cpsr & CPSR_T)
+  {
+    tc->current = NULL;
+    arm_thumb_run_block(arm_s, tc);
+    if(tc->dirty)
+    {
+      arm_tcache_flush(tc);
+    }
+    return NULL;
+  }
+
+  if(block != NULL && block->succ[0] != NULL && block->succ[0]->pc == pc)
+  {
+    next = block->succ[0];
+  }
+  else if(block != NULL && block->succ[1] != NULL && block->succ[1]->pc == pc)
+  {
+    next = block->succ[1];
+  }
+  else
+  {
+    next = lookup(arm_s, tc, pc);
+    if(block != NULL)
+    {
+      block->succ[block->succ[0] != NULL] = next;
+    }
+  }
+
+  run_block(arm_s, tc, next);
+
+  if(tc->dirty)
+  {
+    arm_tcache_flush(tc);
+    return NULL;
+  }
+  return next;
+}
+
+/*
+ * Block-at-a-time replacement for the arm_state_first_execute loop. A store
+ * into a page holding translated code flushes the whole cache once the
+ * current block has finished.
+ */
+void arm_tcache_run(struct arm_state* arm_s)
+{
+  struct arm_tcache* tc = arm_s->tcache;
+  struct arm_block* block = NULL;
+
+  tc->current = NULL;
+  while(arm_s->regs[PC] != 0)
+  {
+    block = run_next(arm_s, tc, block);
+  }
+}
+
+/*
+ * Runs a single block. tc->current is left on the block that ran, so
+ * consecutive calls follow the same chains as arm_tcache_run.
+ */
+void arm_tcache_step(struct arm_state* arm_s)
+{
+  run_next(arm_s, arm_s->tcache, arm_s->tcache->current);
+}
+
+/*
+ * A guest fault leaves the block at the faulting instruction; take back the
+ * counts bumped on entry for the instructions that never ran.
+ */
+void arm_tcache_fault(struct arm_state* arm_s)
+{
+  struct arm_block* block = arm_s->tcache->current;
+  unsigned int i;
+
+  if(block == NULL)
+  {
+    return;
+  }
+
+  for(i = (arm_s->regs[PC] - block->pc) / 4 + 1; i < block->num_uops; i++)
+  {
+    unsigned int cls = ARM_CLASSIFY(block->uops[i].iw);
+
+    switch(arm_class_counter[cls])
+    {
+      case ARM_COUNT_COMP:
+        arm_s->comp_count--;
+        break;
+      case ARM_COUNT_MEM:
+        arm_s->mem_count--;
+        break;
+      case ARM_COUNT_BR:
+        arm_s->br_count--;
+        break;
+    }
+  }
+  arm_s->tcache->current = NULL;
+}
@@ -0,0 +1,86 @@
+#ifndef ARM_BLOCK_H
+#define ARM_BLOCK_H
+
+#include "arm_memory.h"
+#include "arm_jit.h"
+
+struct arm_state;
+struct thumb_cache;
+
+#define TCACHE_BUCKETS  4096
+#define TCACHE_MAX_BLOCK  64
+#define TCACHE_PAGE_BITS  12
+#define TCACHE_NUM_PAGES  (1u << (32 - TCACHE_PAGE_BITS))
+
+/*
+ * An instruction decoded for the translation caches. run is a handler for
+ * the instruction's exact form, which reads its registers, immediate and
+ * shift from the uop; forms without one run the class handler on iw, which
+ * is also what the JIT calls.
+ */
+struct arm_uop
+{
+  void (*run)(struct arm_state*, const struct arm_uop*);
+  void (*handler)(struct arm_state*, unsigned int);
+  unsigned int iw;
+  unsigned int imm;
+  unsigned char rd;
+  unsigned char rn;
+  unsigned char rm;
+  unsigned char shift;
+};
+
+/*
+ * A guest basic block decoded once. Blocks end at the first instruction
+ * that can write PC. succ[] caches the blocks execution last continued
+ * into, so a hot loop goes block to block without a hash lookup.
+ */
+struct arm_block
+{
+  unsigned int pc;
+  unsigned int num_uops;
+  unsigned int comp_count;
+  unsigned int mem_count;
+  unsigned int br_count;
+  arm_jit_fn code;
+  struct arm_block* succ[2];
+  struct arm_block* hash_next;
+  struct arm_block* all_next;
+  struct arm_uop uops[];
+};
+
+struct arm_tcache
+{
+  struct arm_block* buckets[TCACHE_BUCKETS];
+  struct arm_block* all_blocks;
+  struct arm_block* current;
+  unsigned char* code_pages;
+  struct arm_jit* jit;
+  struct thumb_cache* thumb;
+  unsigned int dirty;
+  unsigned int num_blocks;
+  unsigned int flushes;
+};
+
+struct arm_tcache* new_arm_tcache(void);
+void free_arm_tcache(struct arm_tcache* tc);
+void arm_tcache_enable_jit(struct arm_tcache* tc);
+void arm_tcache_flush(struct arm_tcache* tc);
+void arm_tcache_run(struct arm_state* arm_s);
+void arm_tcache_step(struct arm_state* arm_s);
+void arm_tcache_fault(struct arm_state* arm_s);
+int arm_block_ends(unsigned int cls, unsigned int iw);
+void arm_tcache_mark_code(struct arm_tcache* tc, unsigned int address);
+void arm_uop_decode(struct arm_uop* uop, unsigned int iw, unsigned int address);
+
+/* Called for every guest store while a translation cache is attached. */
+static inline void arm_tcache_note_store(struct arm_tcache* tc, unsigned int address)
+{
+  unsigned int page = address >> TCACHE_PAGE_BITS;
+  if(tc->code_pages[page >> 3] & (1 << (page & 7)))
+  {
+    tc->dirty = 1;
+  }
+}
+
+#endif
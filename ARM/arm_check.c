@@ -0,0 +1,1303 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arm_vm.h"
+#include "arm_block.h"
+#include "arm_decode.h"
+#include "arm_memory.h"
+#include "arm_mmu.h"
+#include "arm_smp.h"
+#include "arm_vfp.h"
+
+/*
+ * Lock-step differential checker. Random programs run on the interpreter
+ * (arm_state_first_execute and arm_thumb_step) and on each fast engine, and
+ * the two are stopped and compared every --interval instructions, at the
+ * first block boundary of the fast engine past that many. A difference is
+ * narrowed down to the first block that diverged by running the program
+ * again one block at a time.
+ */
+
+#define CODE_ADDRESS  0x8000
+#define CODE_SIZE  (16 * 1024)
+#define DATA_SIZE  4096
+#define BODY_SIZE  200
+
+#define DEFAULT_PROGRAMS  1000
+#define DEFAULT_INTERVAL  1
+#define DEFAULT_STEPS  1000000
+
+struct engine
+{
+  const char* name;
+  int tcache;
+  int jit;
+};
+
+static const struct engine engines[] =
+{
+  {"interpreter", 0, 0},
+  {"tcache", 1, 0},
+  {"jit", 1, 1},
+};
+
+#define NUM_ENGINES  (sizeof(engines) / sizeof(engines[0]))
+
+struct side
+{
+  const struct engine* engine;
+  struct arm_memory* mem;
+  struct arm_tcache* tc;
+  struct arm_state* arm_s;
+  unsigned int data;
+};
+
+struct program
+{
+  unsigned char code[CODE_SIZE];
+  unsigned int size;
+  unsigned int data[DATA_SIZE / 4];
+  unsigned int thumb;
+};
+
+enum outcome
+{
+  OUTCOME_RETURNED = 0,
+  OUTCOME_FAULTED,
+  OUTCOME_STEP_LIMIT,
+  OUTCOME_DIVERGED,
+  OUTCOME_COUNT
+};
+
+static const char* const outcome_names[OUTCOME_COUNT] =
+{
+  "returned",
+  "faulted",
+  "hit the step limit",
+  "diverged"
+};
+
+static unsigned long long rng;
+
+static unsigned int rnd(unsigned int n)
+{
+  rng ^= rng >> 12;
+  rng ^= rng << 25;
+  rng ^= rng >> 27;
+  return (unsigned int)((rng * 0x2545F4914F6CDD1DULL) >> 32) % n;
+}
+
+static void emit32(struct program* p, unsigned int iw)
+{
+  memcpy(&p->code[p->size], &iw, 4);
+  p->size += 4;
+}
+
+static void emit16(struct program* p, unsigned int hw)
+{
+  unsigned short h = (unsigned short) hw;
+
+  memcpy(&p->code[p->size], &h, 2);
+  p->size += 2;
+}
+
+/* Thumb-2 wide instructions are stored as two halfwords, high one first. */
+static void emit_wide(struct program* p, unsigned int iw)
+{
+  emit16(p, iw >> 16);
+  emit16(p, iw & 0xFFFF);
+}
+
+/* Half the instructions are conditional. */
+static unsigned int arm_cond(void)
+{
+  return (rnd(2) ? COND_AL : rnd(COND_AL)) << 28;
+}
+
+/* Anything but the data pointer in r8, the loop count in r11, SP, LR and PC. */
+static unsigned int arm_dest(void)
+{
+  unsigned int r = rnd(9);
+
+  return r == 8 ? 12 : r;
+}
+
+/* D and S registers are split differently between the 4-bit field and the extra bit. */
+static unsigned int vfp_reg(unsigned int dbl, unsigned int r, unsigned int shift, unsigned int bit)
+{
+  return dbl ? ((r & 0xF) << shift) | ((r >> 4) << bit) : ((r >> 1) << shift) | ((r & 1) << bit);
+}
+
+#define VFP_D(dbl, r)  vfp_reg(dbl, r, 12, 22)
+#define VFP_N(dbl, r)  vfp_reg(dbl, r, 16, 7)
+#define VFP_M(dbl, r)  vfp_reg(dbl, r, 0, 5)
+
+/*
+ * A VFP instruction with cond in its top four bits, addressing data through
+ * base. Thumb code passes COND_AL and emits the result as a wide instruction.
+ */
+static unsigned int vfp_instruction(unsigned int cond, unsigned int base, unsigned int rt)
+{
+  static const unsigned int arith[] =
+  {
+    0x0E300A00, 0x0E300A40, 0x0E200A00, 0x0E800A00,
+    0x0E000A00, 0x0E000A40, 0x0E200A40, 0x0E100A00
+  };
+  static const unsigned int other[] = {0x0EB00AC0, 0x0EB10A40, 0x0EB10AC0, 0x0EB40A40, 0x0EB40AC0, 0x0EB50A40};
+  unsigned int dbl = rnd(2);
+  unsigned int sz = dbl << 8;
+
+  switch(rnd(8))
+  {
+    case 0:
+      return cond | 0x0D900A00 | sz | VFP_D(dbl, rnd(32)) | (base << 16) | rnd(256);
+    case 1:
+      return cond | 0x0D800A00 | sz | VFP_D(dbl, rnd(32)) | (base << 16) | rnd(256);
+    case 2:
+    case 3:
+    case 4:
+      return cond | arith[rnd(8)] | sz | VFP_D(dbl, rnd(32)) | VFP_N(dbl, rnd(32)) | VFP_M(dbl, rnd(32));
+    case 5:
+      return cond | other[rnd(6)] | sz | VFP_D(dbl, rnd(32)) | VFP_M(dbl, rnd(32));
+    case 6:
+      /* VCVT between precisions, or between floating point and integers. */
+      switch(rnd(3))
+      {
+        case 0:
+          return cond | 0x0EB70AC0 | sz | VFP_D(!dbl, rnd(32)) | VFP_M(dbl, rnd(32));
+        case 1:
+          return cond | 0x0EB80A40 | (rnd(2) << 7) | sz | VFP_D(dbl, rnd(32)) | VFP_M(0, rnd(32));
+        default:
+          return cond | 0x0EBC0A40 | (rnd(2) << 16) | (rnd(2) << 7) | sz | VFP_D(0, rnd(32)) | VFP_M(dbl, rnd(32));
+      }
+    default:
+      if(rnd(4) == 0)
+      {
+        /* VMRS APSR_nzcv, FPSCR */
+        return cond | 0x0EF1FA10;
+      }
+      if(rnd(2))
+      {
+        return cond | 0x0E100A10 | VFP_N(0, rnd(32)) | (rt << 12);
+      }
+      return cond | 0x0E000A10 | VFP_N(0, rnd(32)) | (rnd(8) << 12);
+  }
+}
+
+static void arm_data_processing(struct program* p)
+{
+  unsigned int op = rnd(16);
+  unsigned int s = (op >> 2) == 0x2 ? 1 : rnd(2);
+  unsigned int op2;
+
+  switch(rnd(3))
+  {
+    case 0:
+      op2 = (1 << 25) | (rnd(16) << 8) | rnd(256);
+      break;
+    case 1:
+      op2 = (rnd(32) << 7) | (rnd(4) << 5) | rnd(13);
+      break;
+    default:
+      op2 = (rnd(8) << 8) | (rnd(4) << 5) | (1 << 4) | rnd(13);
+      break;
+  }
+  emit32(p, arm_cond() | (op << 21) | (s << 20) | (rnd(13) << 16) | (arm_dest() << 12) | op2);
+}
+
+static void arm_instruction(struct program* p)
+{
+  unsigned int cond = arm_cond();
+  unsigned int load = rnd(2);
+  unsigned int byte = rnd(2);
+  unsigned int list = 1 + rnd(0xFF);
+  unsigned int rd = load ? arm_dest() : rnd(13);
+  unsigned int i;
+
+  switch(rnd(16))
+  {
+    case 0:
+    case 1:
+    case 2:
+    case 3:
+      arm_data_processing(p);
+      break;
+
+    case 4:
+      if(rnd(2))
+      {
+        emit32(p, cond | (rnd(4) << 20) | (arm_dest() << 16) | (rnd(8) << 12) | (rnd(8) << 8) | 0x90 | rnd(8));
+      }
+      else
+      {
+        unsigned int lo = rnd(8);
+        unsigned int hi = (lo + 1 + rnd(7)) % 8;
+        emit32(p, cond | 0x00800090 | (rnd(8) << 20) | (hi << 16) | (lo << 12) | (rnd(8) << 8) | rnd(8));
+      }
+      break;
+
+    case 5:
+      emit32(p, cond | (rnd(2) ? 0x03400000 : 0x03000000) | (rnd(16) << 16) | (arm_dest() << 12) | rnd(4096));
+      break;
+
+    case 6:
+    {
+      /* SXTB, SXTH, UXTB, UXTH and their accumulating forms */
+      unsigned int rn = rnd(2) ? PC : rnd(13);
+      emit32(p, cond | 0x06800070 | ((2 + rnd(2) + 4 * rnd(2)) << 20) | (rn << 16) | (arm_dest() << 12) | (rnd(4) << 10) | rnd(13));
+      break;
+    }
+
+    case 7:
+    case 8:
+      if(rnd(3))
+      {
+        emit32(p, cond | 0x05800000 | (byte << 22) | (load << 20) | (8 << 16) | (rd << 12) | (byte ? rnd(DATA_SIZE) : rnd(DATA_SIZE / 4) * 4));
+      }
+      else
+      {
+        /* mov r10, #index then a register offset scaled by 4 */
+        emit32(p, 0xE3A0A000 | rnd(256));
+        emit32(p, cond | 0x07800000 | (byte << 22) | (load << 20) | (8 << 16) | (rd << 12) | (2 << 7) | 10);
+      }
+      break;
+
+    case 9:
+    {
+      unsigned int sh = load ? 1 + rnd(3) : 1;
+      unsigned int offset = sh == 2 ? rnd(256) : rnd(128) * 2;
+
+      emit32(p, cond | 0x01C00090 | (load << 20) | (8 << 16) | (rd << 12) | ((offset >> 4) << 8) | (sh << 5) | (offset & 0xF));
+      break;
+    }
+
+    case 10:
+      /* add r9, r8, #64 then LDM/STM r9 in any of the four modes */
+      emit32(p, 0xE2889040);
+      emit32(p, cond | 0x08000000 | (rnd(4) << 23) | (rnd(2) << 21) | (load << 20) | (9 << 16) | list);
+      break;
+
+    case 11:
+      emit32(p, 0xE92D0000 | list);
+      arm_data_processing(p);
+      emit32(p, 0xE8BD0000 | list);
+      break;
+
+    case 12:
+    {
+      unsigned int n = 1 + rnd(3);
+
+      emit32(p, cond | 0x0A000000 | (n - 1));
+      for(i = 0; i < n; i++)
+      {
+        arm_data_processing(p);
+      }
+      break;
+    }
+
+    case 13:
+    case 14:
+      emit32(p, vfp_instruction(cond, 8, arm_dest()));
+      break;
+
+    default:
+      switch(rnd(3))
+      {
+        case 0:
+          /* MRS rd, APSR */
+          emit32(p, cond | 0x010F0000 | (arm_dest() << 12));
+          break;
+        case 1:
+          /* MSR APSR_nzcvq, rm */
+          emit32(p, cond | 0x0128F000 | rnd(13));
+          break;
+        default:
+          /* mov r10, #mode << 22 then VMSR FPSCR, r10 for RMode, FZ and DN */
+          emit32(p, 0xE3A0A500 | rnd(16));
+          emit32(p, cond | 0x0EE1AA10);
+          break;
+      }
+      break;
+  }
+}
+
+/*
+ * r8 points at the data, r11 counts the loop down and the body may use
+ * the other registers below SP. The program returns through LR.
+ */
+static void arm_program(struct program* p)
+{
+  unsigned int start;
+  unsigned int r;
+
+  emit32(p, 0xE1A08000);
+  emit32(p, 0xE3A0B001 + rnd(16));
+  for(r = 1; r < 13; r++)
+  {
+    if(r != 8 && r != 11)
+    {
+      emit32(p, 0xE3A00000 | (r << 12) | (rnd(16) << 8) | rnd(256));
+    }
+  }
+
+  start = p->size;
+  while(p->size < start + BODY_SIZE * 4)
+  {
+    arm_instruction(p);
+  }
+
+  emit32(p, 0xE25BB001);
+  emit32(p, 0x1A000000 | (((start - (p->size + 8)) / 4) & 0xFFFFFF));
+  emit32(p, 0xE12FFF1E);
+}
+
+/* One 16-bit instruction that writes at most r0-r5 and does not branch. */
+static void thumb_simple(struct program* p)
+{
+  unsigned int rd = rnd(6);
+
+  switch(rnd(5))
+  {
+    case 0:
+      emit16(p, 0x2000 | (rnd(4) << 11) | (rd << 8) | rnd(256));
+      break;
+    case 1:
+      emit16(p, (rnd(3) << 11) | (rnd(32) << 6) | (rnd(8) << 3) | rd);
+      break;
+    case 2:
+      emit16(p, 0x1800 | (rnd(4) << 9) | (rnd(8) << 6) | (rnd(8) << 3) | rd);
+      break;
+    default:
+      emit16(p, 0x4000 | (rnd(16) << 6) | (rnd(8) << 3) | rd);
+      break;
+  }
+}
+
+static void thumb_instruction(struct program* p)
+{
+  static const unsigned int transfers[] = {0x6000, 0x6800, 0x7000, 0x7800, 0x8000, 0x8800};
+  unsigned int list = 1 + rnd(0x3F);
+  unsigned int rd = rnd(6);
+  unsigned int i;
+
+  switch(rnd(12))
+  {
+    case 0:
+    case 1:
+    case 2:
+      thumb_simple(p);
+      break;
+
+    case 3:
+    {
+      unsigned int op = transfers[rnd(6)];
+      emit16(p, op | (rnd(32) << 6) | (7 << 3) | ((op & 0x0800) ? rd : rnd(8)));
+      break;
+    }
+
+    case 4:
+      emit16(p, 0xB400 | list);
+      thumb_simple(p);
+      emit16(p, 0xBC00 | list);
+      break;
+
+    case 5:
+    {
+      unsigned int n = 1 + rnd(3);
+
+      emit16(p, 0xD000 | (rnd(COND_AL) << 8) | (n - 1));
+      for(i = 0; i < n; i++)
+      {
+        thumb_simple(p);
+      }
+      break;
+    }
+
+    case 6:
+      /* IT with a single instruction */
+      emit16(p, 0xBF08 | (rnd(COND_AL + 1) << 4));
+      thumb_simple(p);
+      break;
+
+    case 7:
+    case 8:
+      emit_wide(p, vfp_instruction(COND_AL << 28, 7, rd));
+      break;
+
+    case 9:
+    {
+      /* MOVW or MOVT */
+      unsigned int imm = rnd(0x10000);
+      emit_wide(p, (rnd(2) ? 0xF2400000 : 0xF2C00000) | ((imm >> 11) & 1) << 26 | (imm >> 12) << 16 |
+                   ((imm >> 8) & 0x7) << 12 | (rd << 8) | (imm & 0xFF));
+      break;
+    }
+
+    case 10:
+    {
+      /* Data processing with a modified immediate, but not ORN */
+      static const unsigned int ops[] = {0, 1, 2, 4, 8, 10, 11, 13, 14};
+      emit_wide(p, 0xF0000000 | (rnd(2) << 26) | (ops[rnd(9)] << 21) | (rnd(2) << 20) | (rnd(8) << 16) |
+                   (rnd(8) << 12) | (rd << 8) | rnd(256));
+      break;
+    }
+
+    default:
+      switch(rnd(4))
+      {
+        case 0:
+          /* MUL or MLA */
+          emit_wide(p, 0xFB000000 | (rnd(8) << 16) | ((rnd(2) ? 0xF : rnd(8)) << 12) | (rd << 8) | rnd(8));
+          break;
+        case 1:
+        {
+          /* UMULL, SMULL, UMLAL or SMLAL */
+          static const unsigned int ops[] = {0xFB800000, 0xFBA00000, 0xFBC00000, 0xFBE00000};
+          unsigned int lo = rnd(6);
+          unsigned int hi = (lo + 1 + rnd(5)) % 6;
+          emit_wide(p, ops[rnd(4)] | (rnd(8) << 16) | (lo << 12) | (hi << 8) | rnd(8));
+          break;
+        }
+        default:
+          /* SDIV or UDIV */
+          emit_wide(p, (rnd(2) ? 0xFB90F0F0 : 0xFBB0F0F0) | (rnd(8) << 16) | (rd << 8) | rnd(8));
+          break;
+      }
+      break;
+  }
+}
+
+/* As arm_program, with the data pointer in r7 and the loop count in r6. */
+static void thumb_program(struct program* p)
+{
+  unsigned int start;
+  unsigned int r;
+
+  emit16(p, 0x4607);
+  emit16(p, 0x2601 + rnd(16));
+  for(r = 0; r < 6; r++)
+  {
+    emit16(p, 0x2000 | (r << 8) | rnd(256));
+  }
+
+  start = p->size;
+  while(p->size < start + BODY_SIZE)
+  {
+    thumb_instruction(p);
+  }
+
+  emit16(p, 0x3E01);
+  emit16(p, 0xD100 | (((start - (p->size + 4)) / 2) & 0xFF));
+  emit16(p, 0x4770);
+}
+
+/* Data is a mix of raw bits and small integers as float and double. */
+static void generate(struct program* p, unsigned long long seed)
+{
+  unsigned int i;
+
+  rng = seed * 0x9E3779B97F4A7C15ULL + 1;
+  memset(p, 0, sizeof(*p));
+  for(i = 0; i < DATA_SIZE / 4; i++)
+  {
+    switch(rnd(4))
+    {
+      case 0:
+      {
+        float f = (float)((int) rnd(200) - 100) / (float)(1 + rnd(8));
+        memcpy(&p->data[i], &f, 4);
+        break;
+      }
+      case 1:
+        if(i % 2 == 0 && i + 1 < DATA_SIZE / 4)
+        {
+          double d = (double)((int) rnd(2000) - 1000) / (double)(1 + rnd(16));
+          memcpy(&p->data[i], &d, 8);
+          i++;
+          break;
+        }
+        p->data[i] = rnd(256);
+        break;
+      default:
+        p->data[i] = rnd(0x10000) | rnd(0x10000) << 16;
+        break;
+    }
+  }
+
+  p->thumb = rnd(2);
+  if(p->thumb)
+  {
+    thumb_program(p);
+  }
+  else
+  {
+    arm_program(p);
+  }
+}
+
+static void open_side(struct side* side, const struct engine* engine)
+{
+  side->engine = engine;
+  side->mem = new_arm_memory();
+  arm_memory_map(side->mem, CODE_ADDRESS, CODE_SIZE);
+  side->data = arm_memory_alloc(side->mem, DATA_SIZE);
+  side->arm_s = new_arm_state(side->mem, CODE_ADDRESS, 0, 0, 0, 0);
+  side->tc = NULL;
+  if(engine->tcache)
+  {
+    side->tc = new_arm_tcache();
+    if(engine->jit)
+    {
+      arm_tcache_enable_jit(side->tc);
+    }
+    arm_state_attach_tcache(side->arm_s, side->tc);
+  }
+}
+
+static void close_side(struct side* side)
+{
+  free_arm_state(side->arm_s);
+  if(side->tc != NULL)
+  {
+    free_arm_tcache(side->tc);
+  }
+  free_arm_memory(side->mem);
+}
+
+static void load(struct side* side, const struct program* p)
+{
+  arm_memory_write(side->mem, CODE_ADDRESS, p->code, CODE_SIZE);
+  arm_memory_write(side->mem, side->data, p->data, DATA_SIZE);
+  if(side->tc != NULL)
+  {
+    arm_tcache_flush(side->tc);
+  }
+  arm_state_reset(side->arm_s, CODE_ADDRESS | p->thumb, side->data, 0, 0, 0);
+}
+
+static int same_memory(struct side* a, struct side* b, unsigned int address, unsigned int size, unsigned int* first)
+{
+  static unsigned char ma[DATA_SIZE];
+  static unsigned char mb[DATA_SIZE];
+  unsigned int i;
+
+  arm_memory_read(a->mem, address, ma, size);
+  arm_memory_read(b->mem, address, mb, size);
+  if(memcmp(ma, mb, size) == 0)
+  {
+    return 1;
+  }
+  i = 0;
+  while(ma[i] == mb[i])
+  {
+    i++;
+  }
+  *first = address + (i & ~3u);
+  return 0;
+}
+
+static int same(struct side* a, struct side* b)
+{
+  struct arm_state* x = a->arm_s;
+  struct arm_state* y = b->arm_s;
+  unsigned int first;
+
+  return memcmp(x->regs, y->regs, sizeof(x->regs)) == 0 &&
+         arm_cpsr(x) == arm_cpsr(y) &&
+         x->it_state == y->it_state &&
+         arm_fpscr(x) == arm_fpscr(y) &&
+         memcmp(&x->vfp, &y->vfp, sizeof(x->vfp)) == 0 &&
+         x->fault.kind == y->fault.kind &&
+         (x->fault.kind == GUEST_FAULT_NONE || x->fault.address == y->fault.address) &&
+         arm_state_instructions(x) == arm_state_instructions(y) &&
+         same_memory(a, b, a->data, DATA_SIZE, &first) &&
+         same_memory(a, b, x->stack, STACK_SIZE, &first);
+}
+
+static void print_differences(struct side* a, struct side* b)
+{
+  struct arm_state* x = a->arm_s;
+  struct arm_state* y = b->arm_s;
+  unsigned int first;
+  unsigned int va;
+  unsigned int vb;
+  int i;
+
+  printf("  %-12s %-18s %-18s\n", "", a->engine->name, b->engine->name);
+  printf("  %-12s %-18u %-18u\n", "instructions", arm_state_instructions(x), arm_state_instructions(y));
+  for(i = 0; i < MAX_REGS; i++)
+  {
+    if(x->regs[i] != y->regs[i])
+    {
+      printf("  r%-11d %08x           %08x\n", i, x->regs[i], y->regs[i]);
+    }
+  }
+  if(arm_cpsr(x) != arm_cpsr(y) || x->it_state != y->it_state)
+  {
+    printf("  %-12s %08x it %02x        %08x it %02x\n", "cpsr", arm_cpsr(x), x->it_state, arm_cpsr(y), y->it_state);
+  }
+  if(arm_fpscr(x) != arm_fpscr(y))
+  {
+    printf("  %-12s %08x           %08x\n", "fpscr", arm_fpscr(x), arm_fpscr(y));
+  }
+  for(i = 0; i < 32; i++)
+  {
+    if(x->vfp.x[i] != y->vfp.x[i])
+    {
+      printf("  d%-11d %016llx   %016llx\n", i, x->vfp.x[i], y->vfp.x[i]);
+    }
+  }
+  if(x->fault.kind != y->fault.kind || x->fault.address != y->fault.address)
+  {
+    printf("  %-12s %d at %08x      %d at %08x\n", "fault", x->fault.kind, x->fault.address, y->fault.kind, y->fault.address);
+  }
+  if(!same_memory(a, b, a->data, DATA_SIZE, &first) || !same_memory(a, b, x->stack, STACK_SIZE, &first))
+  {
+    arm_memory_read(a->mem, first, &va, 4);
+    arm_memory_read(b->mem, first, &vb, 4);
+    printf("  [%08x]   %08x           %08x\n", first, va, vb);
+  }
+}
+
+static int stopped(struct arm_state* arm_s)
+{
+  return arm_s->regs[PC] == 0 || arm_s->fault.kind != GUEST_FAULT_NONE;
+}
+
+static enum outcome lockstep(struct side* ref, struct side* fast, const struct program* p, unsigned int interval, unsigned int steps)
+{
+  load(ref, p);
+  load(fast, p);
+  for(;;)
+  {
+    arm_state_execute_until(fast->arm_s, arm_state_instructions(fast->arm_s) + interval);
+    arm_state_execute_until(ref->arm_s, arm_state_instructions(fast->arm_s));
+    if(!same(ref, fast))
+    {
+      return OUTCOME_DIVERGED;
+    }
+    if(fast->arm_s->fault.kind != GUEST_FAULT_NONE)
+    {
+      return OUTCOME_FAULTED;
+    }
+    if(fast->arm_s->regs[PC] == 0)
+    {
+      return OUTCOME_RETURNED;
+    }
+    if(arm_state_instructions(fast->arm_s) >= steps)
+    {
+      return OUTCOME_STEP_LIMIT;
+    }
+  }
+}
+
+/*
+ * Runs the program again a block at a time to find the first block after
+ * which the two differ, then lists what the interpreter ran in that block.
+ */
+static void pinpoint(struct side* ref, struct side* fast, const struct program* p)
+{
+  unsigned int before = 0;
+  unsigned int pc = 0;
+
+  load(ref, p);
+  load(fast, p);
+  for(;;)
+  {
+    if(stopped(fast->arm_s))
+    {
+      printf("The difference did not show up when run a block at a time.\n");
+      return;
+    }
+    before = arm_state_instructions(fast->arm_s);
+    pc = fast->arm_s->regs[PC];
+    arm_state_execute_until(fast->arm_s, before + 1);
+    arm_state_execute_until(ref->arm_s, arm_state_instructions(fast->arm_s));
+    if(!same(ref, fast))
+    {
+      break;
+    }
+  }
+
+  printf("First difference after the block at 0x%08x, from instruction %u:\n", pc, before + 1);
+  print_differences(ref, fast);
+
+  printf("The block as run by the %s:\n", ref->engine->name);
+  load(ref, p);
+  arm_state_execute_until(ref->arm_s, before);
+  while(!stopped(ref->arm_s) && arm_state_instructions(ref->arm_s) < arm_state_instructions(fast->arm_s))
+  {
+    unsigned int at = ref->arm_s->regs[PC];
+    unsigned short hw[2];
+
+    arm_memory_read(ref->mem, at, hw, 4);
+    if(!(ref->arm_s->cpsr & CPSR_T))
+    {
+      printf("  %08x: %08x\n", at, (unsigned int) hw[1] << 16 | hw[0]);
+    }
+    else if((hw[0] >> 11) >= 0x1D)
+    {
+      printf("  %08x: %04x %04x\n", at, hw[0], hw[1]);
+    }
+    else
+    {
+      printf("  %08x: %04x\n", at, hw[0]);
+    }
+    arm_state_execute_until(ref->arm_s, arm_state_instructions(ref->arm_s) + 1);
+  }
+}
+
+static void print_program(const struct program* p)
+{
+  unsigned int i;
+
+  printf("Program (%s, at 0x%x):\n", p->thumb ? "Thumb" : "ARM", CODE_ADDRESS);
+  for(i = 0; i < p->size; i += 4)
+  {
+    unsigned int iw;
+
+    memcpy(&iw, &p->code[i], 4);
+    printf("%08x%s", iw, (i / 4) % 8 == 7 ? "\n" : " ");
+  }
+  printf("\n");
+}
+
+/*
+ * Directed checks for what random programs do not reach, run on every
+ * engine after them. Each guest program is called like a benchmark kernel
+ * and leaves what it saw in a results buffer.
+ */
+
+#define SYSCALL_HEAP_SIZE  (1024 * 1024)
+#define SMP_CORES  8
+#define SMP_INCREMENTS  20000
+
+static void expect(const char* check, const char* what, unsigned int value, unsigned int expected)
+{
+  if(value != expected)
+  {
+    printf("%s: %s is 0x%x, expected 0x%x.\n", check, what, value, expected);
+    exit(-1);
+  }
+}
+
+static struct arm_state* directed_state(const struct engine* engine, struct arm_memory* mem, const unsigned int* code, unsigned int size,
+                                        unsigned int arg0, unsigned int arg1, struct arm_tcache** tc)
+{
+  struct arm_state* arm_s;
+
+  arm_memory_map(mem, CODE_ADDRESS, size);
+  arm_memory_write(mem, CODE_ADDRESS, code, size);
+  arm_s = new_arm_state(mem, CODE_ADDRESS, arg0, arg1, 0, 0);
+  *tc = NULL;
+  if(engine->tcache)
+  {
+    *tc = new_arm_tcache();
+    if(engine->jit)
+    {
+      arm_tcache_enable_jit(*tc);
+    }
+    arm_state_attach_tcache(arm_s, *tc);
+  }
+  return arm_s;
+}
+
+/*
+ * Grows the break, shrinks it and grows it again, asks for more than the
+ * heap holds, then maps two anonymous pages and writes a word from each
+ * region to a pipe. Called with the pipe in r0 and the results in r1.
+ */
+static const unsigned int syscall_code[] =
+{
+  0xe92d43f0,  /* push {r4-r9, lr} */
+  0xe1a08000,  /* mov r8, r0 */
+  0xe1a09001,  /* mov r9, r1 */
+  0xe3a0702d,  /* mov r7, #45 */
+  0xe3a00000,  /* mov r0, #0 */
+  0xef000000,  /* svc #0 */
+  0xe5890000,  /* str r0, [r9] */
+  0xe1a06000,  /* mov r6, r0 */
+  0xe2860801,  /* add r0, r6, #0x10000 */
+  0xef000000,  /* svc #0 */
+  0xe5890004,  /* str r0, [r9, #4] */
+  0xe3061b6f,  /* movw r1, #0x6b6f */
+  0xe3401a21,  /* movt r1, #0x0a21 */
+  0xe5861000,  /* str r1, [r6] */
+  0xe5001004,  /* str r1, [r0, #-4] */
+  0xe2860a01,  /* add r0, r6, #0x1000 */
+  0xef000000,  /* svc #0 */
+  0xe5890008,  /* str r0, [r9, #8] */
+  0xe3e00000,  /* mvn r0, #0 */
+  0xef000000,  /* svc #0 */
+  0xe589000c,  /* str r0, [r9, #12] */
+  0xe2860801,  /* add r0, r6, #0x10000 */
+  0xef000000,  /* svc #0 */
+  0xe5100004,  /* ldr r0, [r0, #-4] */
+  0xe5890010,  /* str r0, [r9, #16] */
+  0xe3a00000,  /* mov r0, #0 */
+  0xe3a01a02,  /* mov r1, #8192 */
+  0xe3a02003,  /* mov r2, #3 */
+  0xe3a03022,  /* mov r3, #0x22 */
+  0xe3e04000,  /* mvn r4, #0 */
+  0xe3a05000,  /* mov r5, #0 */
+  0xe3a070c0,  /* mov r7, #192 */
+  0xef000000,  /* svc #0 */
+  0xe5890014,  /* str r0, [r9, #20] */
+  0xe3061d6d,  /* movw r1, #0x6d6d */
+  0xe3471061,  /* movt r1, #0x7061 */
+  0xe2800a01,  /* add r0, r0, #4096 */
+  0xe5801000,  /* str r1, [r0] */
+  0xe1a01000,  /* mov r1, r0 */
+  0xe1a00008,  /* mov r0, r8 */
+  0xe3a02004,  /* mov r2, #4 */
+  0xe3a07004,  /* mov r7, #4 */
+  0xef000000,  /* svc #0 */
+  0xe5890018,  /* str r0, [r9, #24] */
+  0xe1a00008,  /* mov r0, r8 */
+  0xe1a01006,  /* mov r1, r6 */
+  0xe3a02004,  /* mov r2, #4 */
+  0xef000000,  /* svc #0 */
+  0xe589001c,  /* str r0, [r9, #28] */
+  0xe8bd83f0,  /* pop {r4-r9, pc} */
+};
+
+static void check_syscalls(const struct engine* engine)
+{
+  static const char expected_output[] = "mmapok!\n";
+  struct arm_memory* mem = new_arm_memory();
+  struct arm_tcache* tc;
+  struct arm_state* arm_s;
+  unsigned int results[8];
+  char output[sizeof(expected_output)] = {0};
+  unsigned int heap;
+  unsigned int buffer;
+  int fds[2];
+  char check[64];
+
+  if(pipe(fds) != 0)
+  {
+    printf("Unable to create a pipe, exiting.\n");
+    exit(-1);
+  }
+  arm_memory_reserve_heap(mem, SYSCALL_HEAP_SIZE);
+  heap = mem->brk;
+  buffer = arm_memory_alloc(mem, sizeof(results));
+  arm_s = directed_state(engine, mem, syscall_code, sizeof(syscall_code), fds[1], buffer, &tc);
+  arm_state_execute(arm_s);
+  arm_memory_read(mem, buffer, results, sizeof(results));
+  close(fds[1]);
+
+  snprintf(check, sizeof(check), "System call check on %s", engine->name);
+  expect(check, "the fault", arm_s->fault.kind, GUEST_FAULT_NONE);
+  expect(check, "the first break", results[0], heap);
+  expect(check, "the grown break", results[1], heap + 0x10000);
+  expect(check, "the shrunk break", results[2], heap + 0x1000);
+  expect(check, "the break past the heap", results[3], heap + 0x1000);
+  expect(check, "a word the shrink gave back", results[4], 0);
+  expect(check, "the mapping overlapping the heap", results[5] + 2 * GUEST_PAGE_SIZE > heap && results[5] < heap + SYSCALL_HEAP_SIZE, 0);
+  expect(check, "the mapping alignment", results[5] % GUEST_PAGE_SIZE, 0);
+  expect(check, "the first write", results[6], 4);
+  expect(check, "the second write", results[7], 4);
+  expect(check, "the pipe output", read(fds[0], output, sizeof(output)) == 8 && !strcmp(output, expected_output), 1);
+  close(fds[0]);
+
+  free_arm_state(arm_s);
+  if(tc != NULL)
+  {
+    free_arm_tcache(tc);
+  }
+  free_arm_memory(mem);
+}
+
+/*
+ * Each core adds 1 to a shared counter r2 times with LDREX/STREX, so the
+ * count only comes out right if no increment is lost. Called with the
+ * counter in r1 and the number of increments in r2.
+ */
+static const unsigned int exclusive_counter_code[] =
+{
+  0xe1913f9f,  /* retry:  ldrex r3, [r1] */
+  0xe2833001,  /*         add   r3, r3, #1 */
+  0xe181cf93,  /*         strex r12, r3, [r1] */
+  0xe35c0000,  /*         cmp   r12, #0 */
+  0x1afffffa,  /*         bne   retry */
+  0xe2522001,  /*         subs  r2, r2, #1 */
+  0x1afffff8,  /*         bne   retry */
+  0xf57ff05b,  /*         dmb   ish */
+  0xe3a00000,  /*         mov   r0, #0 */
+  0xe12fff1e,  /*         bx    lr */
+};
+
+static void check_exclusive_counter(const struct engine* engine)
+{
+  struct arm_memory* mem = new_arm_memory();
+  struct arm_tcache* tc[SMP_CORES] = {NULL};
+  struct arm_smp* smp;
+  unsigned int counter = arm_memory_alloc(mem, 4);
+  unsigned int count;
+  unsigned int i;
+  char check[64];
+
+  arm_memory_map(mem, CODE_ADDRESS, sizeof(exclusive_counter_code));
+  arm_memory_write(mem, CODE_ADDRESS, exclusive_counter_code, sizeof(exclusive_counter_code));
+  smp = new_arm_smp(mem, SMP_CORES, CODE_ADDRESS, counter, SMP_INCREMENTS, 0);
+  for(i = 0; engine->tcache && i < SMP_CORES; i++)
+  {
+    tc[i] = new_arm_tcache();
+    if(engine->jit)
+    {
+      arm_tcache_enable_jit(tc[i]);
+    }
+    arm_state_attach_tcache(smp->cores[i], tc[i]);
+  }
+  arm_smp_run(smp);
+  arm_memory_read(mem, counter, &count, 4);
+
+  snprintf(check, sizeof(check), "Exclusive counter check on %s", engine->name);
+  for(i = 0; i < SMP_CORES; i++)
+  {
+    expect(check, "a core's fault", smp->cores[i]->fault.kind, GUEST_FAULT_NONE);
+  }
+  expect(check, "the count", count, SMP_CORES * SMP_INCREMENTS);
+
+  free_arm_smp(smp);
+  for(i = 0; i < SMP_CORES; i++)
+  {
+    if(tc[i] != NULL)
+    {
+      free_arm_tcache(tc[i]);
+    }
+  }
+  free_arm_memory(mem);
+}
+
+/*
+ * Page tables for the MMU check, all at fixed physical addresses:
+ *
+ *   VA 0x000xxxxx  section, PA 0x00000000, read/write (the code)
+ *   VA 0x001xxxxx  section, PA 0x00100000, read/write (the tables)
+ *   VA 0x00300000  small page, PA 0x00200000, read/write
+ *   VA 0x00301000  small page, PA 0x00200000 again, read/write
+ *   VA 0x00302000  small page, PA 0x00201000, read/write (the results)
+ *   VA 0x004xxxxx  section, PA 0x00200000, read-only
+ *
+ * and nothing else mapped.
+ */
+#define MMU_L1_TABLE  0x00100000
+#define MMU_L2_TABLE  0x00104000
+#define MMU_PAGES  0x00200000
+#define MMU_RESULTS  (MMU_PAGES + GUEST_PAGE_SIZE)
+#define MMU_MARKER  0xC0DE
+
+static const unsigned int mmu_l1_entries[][2] =
+{
+  {0x000, 0x00000C02},
+  {0x001, 0x00100C02},
+  {0x003, MMU_L2_TABLE | 0x1},
+  {0x004, MMU_PAGES | 0x8402},
+};
+
+static const unsigned int mmu_l2_entries[] =
+{
+  MMU_PAGES | 0x32,
+  MMU_PAGES | 0x32,
+  MMU_RESULTS | 0x32,
+};
+
+/*
+ * Turns the MMU on and stores through one page, reading the word back
+ * through the page that aliases it and the read-only section, and reads a
+ * word that runs from the end of the page into the alias. Then it points
+ * the alias at the results page and reads it before and after flushing
+ * the TLB. Last it stores to r1, which must fault.
+ */
+static const unsigned int mmu_code[] =
+{
+  0xe3004000,  /* movw r4, #0 */
+  0xe3404010,  /* movt r4, #0x10 */
+  0xee024f10,  /* mcr p15, 0, r4, c2, c0, 0 */
+  0xe3a04001,  /* mov r4, #1 */
+  0xee034f10,  /* mcr p15, 0, r4, c3, c0, 0 */
+  0xee114f10,  /* mrc p15, 0, r4, c1, c0, 0 */
+  0xe3844001,  /* orr r4, r4, #1 */
+  0xee014f10,  /* mcr p15, 0, r4, c1, c0, 0 */
+  0xe3a00603,  /* mov r0, #0x300000 */
+  0xe2803a01,  /* add r3, r0, #0x1000 */
+  0xe2807a02,  /* add r7, r0, #0x2000 */
+  0xe3a0404d,  /* mov r4, #77 */
+  0xe5804000,  /* str r4, [r0] */
+  0xe5935000,  /* ldr r5, [r3] */
+  0xe5875010,  /* str r5, [r7, #16] */
+  0xe590cffe,  /* ldr r12, [r0, #0xffe] */
+  0xe587c020,  /* str r12, [r7, #32] */
+  0xe3a06501,  /* mov r6, #0x400000 */
+  0xe5966000,  /* ldr r6, [r6] */
+  0xe5876014,  /* str r6, [r7, #20] */
+  0xe3048004,  /* movw r8, #0x4004 */
+  0xe3408010,  /* movt r8, #0x10 */
+  0xe3019032,  /* movw r9, #0x1032 */
+  0xe3409020,  /* movt r9, #0x20 */
+  0xe5889000,  /* str r9, [r8] */
+  0xe593a000,  /* ldr r10, [r3] */
+  0xe587a018,  /* str r10, [r7, #24] */
+  0xee084f17,  /* mcr p15, 0, r4, c8, c7, 0 */
+  0xe593b000,  /* ldr r11, [r3] */
+  0xe587b01c,  /* str r11, [r7, #28] */
+  0xe5814000,  /* str r4, [r1] */
+  0xe3a00000,  /* mov r0, #0 */
+  0xe12fff1e,  /* bx lr */
+};
+
+static void check_mmu(const struct engine* engine, unsigned int store_address, unsigned int fault_address, int fault_kind)
+{
+  struct arm_memory* mem = new_arm_memory();
+  struct arm_mmu* mmu = new_arm_mmu(mem);
+  struct arm_tcache* tc;
+  struct arm_state* arm_s;
+  unsigned int marker = MMU_MARKER;
+  unsigned int results[5];
+  unsigned int results_end;
+  unsigned int i;
+  char check[64];
+
+  arm_memory_map(mem, MMU_L1_TABLE, 0x8000);
+  arm_memory_map(mem, MMU_PAGES, 2 * GUEST_PAGE_SIZE);
+  for(i = 0; i < sizeof(mmu_l1_entries) / sizeof(mmu_l1_entries[0]); i++)
+  {
+    arm_memory_write(mem, MMU_L1_TABLE + mmu_l1_entries[i][0] * 4, &mmu_l1_entries[i][1], 4);
+  }
+  arm_memory_write(mem, MMU_L2_TABLE, mmu_l2_entries, sizeof(mmu_l2_entries));
+  arm_memory_write(mem, MMU_RESULTS, &marker, 4);
+
+  arm_s = directed_state(engine, mem, mmu_code, sizeof(mmu_code), 0, store_address, &tc);
+  arm_state_attach_mmu(arm_s, mmu);
+  arm_state_execute(arm_s);
+  arm_memory_read(mem, MMU_RESULTS + 16, results, sizeof(results));
+  arm_memory_read(mem, MMU_RESULTS + GUEST_PAGE_SIZE - 4, &results_end, 4);
+
+  snprintf(check, sizeof(check), "MMU check on %s", engine->name);
+  expect(check, "the word through the aliasing page", results[0], 77);
+  expect(check, "the word through the section", results[1], 77);
+  expect(check, "the remapped page before the flush", results[2], 77);
+  expect(check, "the remapped page after the flush", results[3], MMU_MARKER);
+  expect(check, "the word running into the aliasing page", results[4], 77 << 16);
+  expect(check, "the end of the page before a faulting store", results_end, 0);
+  expect(check, "the fault", arm_s->fault.kind, fault_kind);
+  expect(check, "the fault address", arm_s->fault.address, fault_address);
+
+  free_arm_state(arm_s);
+  if(tc != NULL)
+  {
+    free_arm_tcache(tc);
+  }
+  free_arm_mmu(mmu);
+  free_arm_memory(mem);
+}
+
+/*
+ * Runs the last instructions of a code page whose next page is unmapped,
+ * ending in a load through a null r1. The load must be what faults, not a
+ * block that reads on past the page. In Thumb the load sits in the last
+ * halfword.
+ */
+static void check_page_end(const struct engine* engine, unsigned int thumb)
+{
+  static unsigned int page[GUEST_PAGE_SIZE / 4];
+  unsigned int entry = CODE_ADDRESS + GUEST_PAGE_SIZE - (thumb ? 4 : 8);
+  struct arm_memory* mem = new_arm_memory();
+  struct arm_tcache* tc;
+  struct arm_state* arm_s;
+  char check[64];
+
+  memset(page, 0, sizeof(page));
+  if(thumb)
+  {
+    page[GUEST_PAGE_SIZE / 4 - 1] = 0x68082205;  /* movs r2, #5; ldr r0, [r1] */
+  }
+  else
+  {
+    page[GUEST_PAGE_SIZE / 4 - 2] = 0xe3a02005;  /* mov r2, #5 */
+    page[GUEST_PAGE_SIZE / 4 - 1] = 0xe5910000;  /* ldr r0, [r1] */
+  }
+
+  arm_s = directed_state(engine, mem, page, sizeof(page), 0, 0, &tc);
+  arm_state_reset(arm_s, entry | thumb, 0, 0, 0, 0);
+  arm_state_execute(arm_s);
+
+  snprintf(check, sizeof(check), "%s page end check on %s", thumb ? "Thumb" : "ARM", engine->name);
+  expect(check, "the fault", arm_s->fault.kind, GUEST_FAULT_ACCESS);
+  expect(check, "the fault address", arm_s->fault.address, 0);
+  expect(check, "r2", arm_s->regs[2], 5);
+  expect(check, "the instruction count", arm_state_instructions(arm_s), 2);
+
+  free_arm_state(arm_s);
+  if(tc != NULL)
+  {
+    free_arm_tcache(tc);
+  }
+  free_arm_memory(mem);
+}
+
+/*
+ * A state freed and created again on the same memory is the same instance
+ * with the same stack, even once the pool has filled up with states of
+ * memories that are gone, so creating and freeing in a loop takes no
+ * address space.
+ */
+static void check_state_pool(void)
+{
+  const char* check = "State pool check";
+  struct arm_memory* mem;
+  struct arm_state* arm_s;
+  struct arm_state* first;
+  unsigned int next_alloc;
+  unsigned int i;
+
+  for(i = 0; i < ARM_STATE_POOL_MAX; i++)
+  {
+    mem = new_arm_memory();
+    free_arm_state(new_arm_state(mem, CODE_ADDRESS, 0, 0, 0, 0));
+    free_arm_memory(mem);
+  }
+
+  mem = new_arm_memory();
+  first = new_arm_state(mem, CODE_ADDRESS, 0, 0, 0, 0);
+  free_arm_state(first);
+  next_alloc = mem->next_alloc;
+  for(i = 0; i < 1000; i++)
+  {
+    arm_s = new_arm_state(mem, CODE_ADDRESS, i, 0, 0, 0);
+    expect(check, "the reused instance", arm_s == first, 1);
+    expect(check, "r0 of the reused instance", arm_s->regs[0], i);
+    free_arm_state(arm_s);
+  }
+  expect(check, "the allocator top", mem->next_alloc, next_alloc);
+
+  arm_state_pool_drain();
+  free_arm_memory(mem);
+}
+
+int main(int argc, char* argv[])
+{
+  unsigned long long seed = 1;
+  unsigned int num_programs = DEFAULT_PROGRAMS;
+  unsigned int interval = DEFAULT_INTERVAL;
+  unsigned int steps = DEFAULT_STEPS;
+  const char* only = NULL;
+  unsigned int outcomes[OUTCOME_COUNT] = {0};
+  unsigned long long instructions = 0;
+  struct side sides[NUM_ENGINES];
+  static struct program program;
+  unsigned int e;
+  unsigned int i;
+
+  for(i = 1; i < (unsigned int) argc; i++)
+  {
+    if(!strncmp(argv[i], "--seed=", 7))
+    {
+      seed = strtoull(argv[i] + 7, NULL, 0);
+    }
+    else if(!strncmp(argv[i], "--programs=", 11))
+    {
+      num_programs = strtoul(argv[i] + 11, NULL, 0);
+    }
+    else if(!strncmp(argv[i], "--interval=", 11))
+    {
+      interval = strtoul(argv[i] + 11, NULL, 0);
+    }
+    else if(!strncmp(argv[i], "--steps=", 8))
+    {
+      steps = strtoul(argv[i] + 8, NULL, 0);
+    }
+    else if(!strncmp(argv[i], "--engine=", 9))
+    {
+      only = argv[i] + 9;
+    }
+    else
+    {
+      printf("Usage: arm_check [--seed=<n>] [--programs=<n>] [--interval=<instructions>] [--steps=<n>] [--engine=tcache|jit]\n");
+      exit(-1);
+    }
+  }
+  if(interval < 1)
+  {
+    interval = 1;
+  }
+
+  for(e = 0; e < NUM_ENGINES; e++)
+  {
+    open_side(&sides[e], &engines[e]);
+  }
+
+  for(i = 0; i < num_programs; i++)
+  {
+    generate(&program, seed + i);
+    for(e = 1; e < NUM_ENGINES; e++)
+    {
+      enum outcome outcome;
+
+      if(only != NULL && strcmp(only, engines[e].name))
+      {
+        continue;
+      }
+
+      outcome = lockstep(&sides[0], &sides[e], &program, interval, steps);
+      outcomes[outcome]++;
+      instructions += arm_state_instructions(sides[e].arm_s);
+      if(outcome == OUTCOME_DIVERGED)
+      {
+        printf("%s and %s diverged on program %u (--seed=%llu --programs=1).\n", engines[0].name, engines[e].name, i, seed + i);
+        pinpoint(&sides[0], &sides[e], &program);
+        print_program(&program);
+        exit(-1);
+      }
+    }
+  }
+
+  printf("%u programs, %u runs, %llu instructions:", num_programs, outcomes[OUTCOME_RETURNED] + outcomes[OUTCOME_FAULTED] + outcomes[OUTCOME_STEP_LIMIT],
+         instructions);
+  for(i = 0; i < OUTCOME_DIVERGED; i++)
+  {
+    printf("%s %u %s", i ? "," : "", outcomes[i], outcome_names[i]);
+  }
+  printf("\n");
+
+  for(e = 0; e < NUM_ENGINES; e++)
+  {
+    close_side(&sides[e]);
+  }
+
+  for(e = 0; e < NUM_ENGINES; e++)
+  {
+    check_syscalls(&engines[e]);
+  }
+  printf("System calls agree on %u engines.\n", (unsigned int) NUM_ENGINES);
+
+  for(e = 0; e < NUM_ENGINES; e++)
+  {
+    check_exclusive_counter(&engines[e]);
+  }
+  printf("%u cores counted to %u with LDREX/STREX on %u engines.\n", SMP_CORES, SMP_CORES * SMP_INCREMENTS, (unsigned int) NUM_ENGINES);
+
+  for(e = 0; e < NUM_ENGINES; e++)
+  {
+    check_mmu(&engines[e], 0x00400000, 0x00400000, GUEST_FAULT_PERMISSION);
+    check_mmu(&engines[e], 0x00500000, 0x00500000, GUEST_FAULT_TRANSLATION);
+    check_mmu(&engines[e], 0x00302FFE, 0x00303000, GUEST_FAULT_TRANSLATION);
+  }
+  printf("Page tables translate and fault on %u engines.\n", (unsigned int) NUM_ENGINES);
+
+  for(e = 0; e < NUM_ENGINES; e++)
+  {
+    check_page_end(&engines[e], 0);
+    check_page_end(&engines[e], 1);
+  }
+  printf("Blocks stop at the end of a page on %u engines.\n", (unsigned int) NUM_ENGINES);
+
+  check_state_pool();
+  printf("Freed states are reused.\n");
+  return 0;
+}
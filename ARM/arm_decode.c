@@ -0,0 +1,112 @@
+#include "arm_decode.h"
+
+#define OP(i)  ((i) >> 4)
+#define LO(i)  ((i) & 0xF)
+
+/* Multiplies and extra load/stores share bits 27:25 = 000 with bits 7 and 4 set. */
+#define IS_MULTIPLY_SPACE(i)  ((OP(i) >> 5) == 0x0 && (LO(i) & 0x9) == 0x9)
+#define IS_MULTIPLY(i)  (LO(i) == 0x9 && ((OP(i) >> 2) == 0x0 || (OP(i) >> 3) == 0x1))
+
+/* LDREX/STREX and their doubleword, byte and halfword forms. */
+#define IS_EXCLUSIVE(i)  ((OP(i) & 0xF8) == 0x18 && LO(i) == 0x9)
+
+/* SXTB, SXTH, UXTB and UXTH, and their forms that add to a register. */
+#define IS_EXTEND(i)  ((OP(i) & 0xFA) == 0x6A && LO(i) == 0x7)
+
+/* TST, TEQ, CMP and CMN without S are not data processing. */
+#define IS_MISC(i)  ((OP(i) & 0xF9) == 0x10)
+
+/* Only the CPSR forms; SPSR does not exist in user mode. */
+#define IS_MRS(i)  (OP(i) == 0x10 && LO(i) == 0x0)
+#define IS_MSR(i)  ((OP(i) == 0x12 && LO(i) == 0x0) || OP(i) == 0x32)
+
+#define CLASSIFY(i)                                                      \
+  (OP(i) == 0x12 && (LO(i) == 0x1 || LO(i) == 0x3) ? ARM_CLASS_BX :      \
+   IS_MRS(i) ? ARM_CLASS_MRS :                                           \
+   IS_MSR(i) ? ARM_CLASS_MSR :                                           \
+   (OP(i) >> 5) == 0x5 ? ARM_CLASS_BRANCH :                              \
+   IS_MULTIPLY(i) ? ARM_CLASS_MULTIPLY :                                 \
+   IS_EXCLUSIVE(i) ? ARM_CLASS_EXCLUSIVE :                               \
+   IS_MULTIPLY_SPACE(i) && LO(i) != 0x9 ? ARM_CLASS_HALFWORD_TRANSFER :  \
+   IS_MULTIPLY_SPACE(i) ? ARM_CLASS_UNDEFINED :                          \
+   IS_MISC(i) ? ARM_CLASS_UNDEFINED :                                    \
+   OP(i) == 0x30 || OP(i) == 0x34 ? ARM_CLASS_MOVE_WIDE :                \
+   OP(i) == 0x36 ? ARM_CLASS_UNDEFINED :                                 \
+   (OP(i) >> 6) == 0x0 ? ARM_CLASS_DATA_PROCESSING :                     \
+   IS_EXTEND(i) ? ARM_CLASS_EXTEND :                                     \
+   (OP(i) >> 5) == 0x3 && (LO(i) & 0x1) ? ARM_CLASS_UNDEFINED :          \
+   (OP(i) >> 6) == 0x1 ? ARM_CLASS_DATA_TRANSFER :                       \
+   (OP(i) >> 5) == 0x4 ? ((OP(i) & 0x1) ? ARM_CLASS_POP : ARM_CLASS_PUSH) : \
+   (OP(i) >> 4) == 0xF ? ARM_CLASS_SVC :                                 \
+   (OP(i) >> 4) == 0xE ? ARM_CLASS_COPROCESSOR :                         \
+   (OP(i) >> 5) == 0x6 ? ARM_CLASS_COPROCESSOR_TRANSFER :                \
+   ARM_CLASS_UNDEFINED)
+
+#define ROW1(i)     CLASSIFY(i),
+#define ROW4(i)     ROW1(i) ROW1((i) + 1) ROW1((i) + 2) ROW1((i) + 3)
+#define ROW16(i)    ROW4(i) ROW4((i) + 4) ROW4((i) + 8) ROW4((i) + 12)
+#define ROW64(i)    ROW16(i) ROW16((i) + 16) ROW16((i) + 32) ROW16((i) + 48)
+#define ROW256(i)   ROW64(i) ROW64((i) + 64) ROW64((i) + 128) ROW64((i) + 192)
+#define ROW1024(i)  ROW256(i) ROW256((i) + 256) ROW256((i) + 512) ROW256((i) + 768)
+#define ROW4096(i)  ROW1024(i) ROW1024((i) + 1024) ROW1024((i) + 2048) ROW1024((i) + 3072)
+
+const unsigned char arm_decode_table[4096] =
+{
+  ROW4096(0)
+};
+
+const unsigned char arm_class_counter[ARM_CLASS_COUNT] =
+{
+  [ARM_CLASS_UNDEFINED] = ARM_COUNT_COMP,
+  [ARM_CLASS_DATA_PROCESSING] = ARM_COUNT_COMP,
+  [ARM_CLASS_MRS] = ARM_COUNT_COMP,
+  [ARM_CLASS_MSR] = ARM_COUNT_COMP,
+  [ARM_CLASS_BX] = ARM_COUNT_BR,
+  [ARM_CLASS_BRANCH] = ARM_COUNT_BR,
+  [ARM_CLASS_DATA_TRANSFER] = ARM_COUNT_MEM,
+  [ARM_CLASS_PUSH] = ARM_COUNT_MEM,
+  [ARM_CLASS_POP] = ARM_COUNT_MEM,
+  [ARM_CLASS_MULTIPLY] = ARM_COUNT_COMP,
+  [ARM_CLASS_MOVE_WIDE] = ARM_COUNT_COMP,
+  [ARM_CLASS_SVC] = ARM_COUNT_COMP,
+  [ARM_CLASS_EXCLUSIVE] = ARM_COUNT_MEM,
+  [ARM_CLASS_UNCONDITIONAL] = ARM_COUNT_MEM,
+  [ARM_CLASS_COPROCESSOR] = ARM_COUNT_COMP,
+  [ARM_CLASS_HALFWORD_TRANSFER] = ARM_COUNT_MEM,
+  [ARM_CLASS_EXTEND] = ARM_COUNT_COMP,
+  [ARM_CLASS_COPROCESSOR_TRANSFER] = ARM_COUNT_MEM,
+};
+
+#define N(f)  (((f) >> 3) & 1)
+#define Z(f)  (((f) >> 2) & 1)
+#define C(f)  (((f) >> 1) & 1)
+#define V(f)  ((f) & 1)
+
+/* Condition 15 always passes; see ARM_CLASSIFY. */
+#define CONDITION(c, f)                                                  \
+  ((c) == 0 ? Z(f) :                                                     \
+   (c) == 1 ? !Z(f) :                                                    \
+   (c) == 2 ? C(f) :                                                     \
+   (c) == 3 ? !C(f) :                                                    \
+   (c) == 4 ? N(f) :                                                     \
+   (c) == 5 ? !N(f) :                                                    \
+   (c) == 6 ? V(f) :                                                     \
+   (c) == 7 ? !V(f) :                                                    \
+   (c) == 8 ? C(f) && !Z(f) :                                            \
+   (c) == 9 ? !C(f) || Z(f) :                                            \
+   (c) == 10 ? N(f) == V(f) :                                            \
+   (c) == 11 ? N(f) != V(f) :                                            \
+   (c) == 12 ? !Z(f) && N(f) == V(f) :                                   \
+   (c) == 13 ? Z(f) || N(f) != V(f) :                                    \
+   (c) >= 14)
+
+#define FLAGS4(c, f)  CONDITION(c, f), CONDITION(c, (f) + 1), CONDITION(c, (f) + 2), CONDITION(c, (f) + 3)
+#define FLAGS16(c)    {FLAGS4(c, 0), FLAGS4(c, 4), FLAGS4(c, 8), FLAGS4(c, 12)}
+
+const unsigned char arm_condition_table[16][16] =
+{
+  FLAGS16(0), FLAGS16(1), FLAGS16(2), FLAGS16(3),
+  FLAGS16(4), FLAGS16(5), FLAGS16(6), FLAGS16(7),
+  FLAGS16(8), FLAGS16(9), FLAGS16(10), FLAGS16(11),
+  FLAGS16(12), FLAGS16(13), FLAGS16(14), FLAGS16(15)
+};
@@ -0,0 +1,59 @@
+#ifndef ARM_DECODE_H
+#define ARM_DECODE_H
+
+/*
+ * Instruction classes, looked up by bits 27:20 and 7:4 of the instruction
+ * word. Every class has a handler in arm_vm.c, so dispatch is one table
+ * load and one indirect call however many classes there are.
+ */
+enum arm_class
+{
+  ARM_CLASS_UNDEFINED = 0,
+  ARM_CLASS_DATA_PROCESSING,
+  ARM_CLASS_MRS,
+  ARM_CLASS_MSR,
+  ARM_CLASS_BX,
+  ARM_CLASS_BRANCH,
+  ARM_CLASS_DATA_TRANSFER,
+  ARM_CLASS_PUSH,
+  ARM_CLASS_POP,
+  ARM_CLASS_MULTIPLY,
+  ARM_CLASS_MOVE_WIDE,
+  ARM_CLASS_SVC,
+  ARM_CLASS_EXCLUSIVE,
+  ARM_CLASS_UNCONDITIONAL,
+  ARM_CLASS_COPROCESSOR,
+  ARM_CLASS_HALFWORD_TRANSFER,
+  ARM_CLASS_EXTEND,
+  ARM_CLASS_COPROCESSOR_TRANSFER,
+  ARM_CLASS_COUNT
+};
+
+/* Which of comp_count, mem_count and br_count an instruction bumps. */
+enum arm_counter
+{
+  ARM_COUNT_NONE = 0,
+  ARM_COUNT_COMP,
+  ARM_COUNT_MEM,
+  ARM_COUNT_BR
+};
+
+#define ARM_DECODE_INDEX(iw)  ((((iw) >> 16) & 0xFF0) | (((iw) >> 4) & 0xF))
+
+#define COND_AL  14
+#define COND_NV  15
+
+/*
+ * Condition 15 selects the unconditional space, whose instructions are one
+ * class whatever their other bits. The interpreter loop only tests for it
+ * once the condition is known not to be AL.
+ */
+#define ARM_CLASSIFY(iw)  ((iw) >> 28 == COND_NV ? ARM_CLASS_UNCONDITIONAL : arm_decode_table[ARM_DECODE_INDEX(iw)])
+
+extern const unsigned char arm_decode_table[4096];
+extern const unsigned char arm_class_counter[ARM_CLASS_COUNT];
+
+/* Indexed by the condition field and cpsr bits 31:28 (NZCV). */
+extern const unsigned char arm_condition_table[16][16];
+
+#endif
@@ -0,0 +1,231 @@
+#define _GNU_SOURCE
+#include <elf.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "arm_vm.h"
+#include "arm_elf.h"
+
+/* HWCAP_VFP, HWCAP_VFPv3 and HWCAP_VFPD32 of the ARM Linux kernel. */
+#define ELF_HWCAP  ((1u << 6) | (1u << 13) | (1u << 19))
+
+/*
+ * The file part of a segment is mapped straight from the executable,
+ * private so guest writes are copy-on-write. The rest of its last file page
+ * is cleared and whole pages of .bss come from an anonymous mapping.
+ */
+static void map_segment(struct arm_memory* mem, int fd, const Elf32_Phdr* ph, const char* path)
+{
+  uint64_t start = GUEST_PAGE_DOWN(ph->p_vaddr);
+  uint64_t file_end = (uint64_t)ph->p_vaddr + ph->p_filesz;
+  uint64_t mem_end = (uint64_t)ph->p_vaddr + ph->p_memsz;
+  int prot = arm_memory_prot(ph->p_flags & PF_R, ph->p_flags & PF_W, ph->p_flags & PF_X);
+
+  if(mem_end > GUEST_ADDRESS_SPACE || ph->p_filesz > ph->p_memsz)
+  {
+    printf("Segment at 0x%x in %s does not fit the guest, exiting.\n", ph->p_vaddr, path);
+    exit(-1);
+  }
+  if((ph->p_vaddr - ph->p_offset) % GUEST_PAGE_SIZE != 0)
+  {
+    printf("Segment at 0x%x in %s is not page aligned, exiting.\n", ph->p_vaddr, path);
+    exit(-1);
+  }
+
+  if(ph->p_filesz != 0)
+  {
+    uint64_t length = file_end - start;
+    int writable = prot | (ph->p_memsz > ph->p_filesz ? PROT_WRITE : 0);
+
+    if(mmap(mem->base + start, length, writable, MAP_FIXED | MAP_PRIVATE, fd, ph->p_offset - (ph->p_vaddr - start)) == MAP_FAILED)
+    {
+      printf("Unable to map segment at 0x%x in %s, exiting.\n", ph->p_vaddr, path);
+      exit(-1);
+    }
+    if(ph->p_memsz > ph->p_filesz)
+    {
+      memset(mem->base + file_end, 0, GUEST_PAGE_UP(file_end) - file_end);
+      mprotect(mem->base + start, length, prot);
+    }
+    start = GUEST_PAGE_UP(file_end);
+  }
+
+  if(GUEST_PAGE_UP(mem_end) > start)
+  {
+    if(mmap(mem->base + start, GUEST_PAGE_UP(mem_end) - start, prot, MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) == MAP_FAILED)
+    {
+      printf("Unable to map segment at 0x%x in %s, exiting.\n", ph->p_vaddr, path);
+      exit(-1);
+    }
+  }
+}
+
+/* Maps the PT_LOAD segments of a static little-endian ARM executable. */
+void arm_elf_load(struct arm_memory* mem, const char* path, struct arm_elf_image* image)
+{
+  Elf32_Ehdr eh;
+  Elf32_Phdr* phdrs;
+  uint64_t end = 0;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if(fd < 0)
+  {
+    printf("Unable to open %s, exiting.\n", path);
+    exit(-1);
+  }
+
+  if(pread(fd, &eh, sizeof(eh), 0) != sizeof(eh) || memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 || eh.e_ident[EI_CLASS] != ELFCLASS32 || eh.e_ident[EI_DATA] != ELFDATA2LSB || eh.e_machine != EM_ARM)
+  {
+    printf("%s is not a 32-bit little-endian ARM ELF file, exiting.\n", path);
+    exit(-1);
+  }
+  if(eh.e_type != ET_EXEC || eh.e_phentsize != sizeof(Elf32_Phdr))
+  {
+    printf("%s is not a statically linked executable, exiting.\n", path);
+    exit(-1);
+  }
+
+  phdrs = (Elf32_Phdr*)malloc(eh.e_phnum * sizeof(Elf32_Phdr));
+  if(phdrs == NULL)
+  {
+    printf("Unable to allocate memory failed, exiting.\n");
+    exit(-1);
+  }
+  if(pread(fd, phdrs, eh.e_phnum * sizeof(Elf32_Phdr), eh.e_phoff) != (ssize_t)(eh.e_phnum * sizeof(Elf32_Phdr)))
+  {
+    printf("Unable to read program headers of %s, exiting.\n", path);
+    exit(-1);
+  }
+
+  image->entry = eh.e_entry;
+  image->phdr = 0;
+  image->phnum = eh.e_phnum;
+
+  for(int i = 0; i < eh.e_phnum; i++)
+  {
+    const Elf32_Phdr* ph = &phdrs[i];
+
+    if(ph->p_type == PT_INTERP)
+    {
+      printf("%s needs a dynamic linker, exiting.\n", path);
+      exit(-1);
+    }
+    if(ph->p_type == PT_PHDR)
+    {
+      image->phdr = ph->p_vaddr;
+    }
+    if(ph->p_type != PT_LOAD || ph->p_memsz == 0)
+    {
+      continue;
+    }
+
+    map_segment(mem, fd, ph, path);
+    if(image->phdr == 0 && eh.e_phoff >= ph->p_offset && eh.e_phoff < ph->p_offset + ph->p_filesz)
+    {
+      image->phdr = ph->p_vaddr + (eh.e_phoff - ph->p_offset);
+    }
+    if((uint64_t)ph->p_vaddr + ph->p_memsz > end)
+    {
+      end = (uint64_t)ph->p_vaddr + ph->p_memsz;
+    }
+  }
+
+  /* The mappings keep the file alive. */
+  close(fd);
+  free(phdrs);
+
+  if(GUEST_PAGE_UP(end) + GUEST_PAGE_SIZE > mem->next_alloc)
+  {
+    mem->next_alloc = (unsigned int)(GUEST_PAGE_UP(end) + GUEST_PAGE_SIZE);
+  }
+
+  /* The heap is reserved before the stacks, which are allocated above it. */
+  arm_memory_reserve_heap(mem, ELF_HEAP_SIZE);
+  image->brk = mem->brk;
+}
+
+static unsigned int push_bytes(struct arm_memory* mem, unsigned int sp, const void* src, unsigned int size)
+{
+  sp -= size;
+  arm_memory_write(mem, sp, src, size);
+  return sp;
+}
+
+/*
+ * The Linux process stack: argc, argv, an empty environment and the
+ * auxiliary vector, with the strings and AT_RANDOM bytes above them.
+ */
+unsigned int arm_elf_setup_stack(struct arm_memory* mem, const struct arm_elf_image* image, int argc, char** argv)
+{
+  unsigned int top = arm_memory_alloc(mem, ELF_STACK_SIZE) + ELF_STACK_SIZE;
+  unsigned int sp = top;
+  unsigned int* vector;
+  unsigned int random_bytes;
+  unsigned int words;
+  unsigned int n = 0;
+  unsigned char random_seed[16];
+
+  for(int i = 0; i < 16; i++)
+  {
+    random_seed[i] = (unsigned char) rand();
+  }
+  random_bytes = sp = push_bytes(mem, sp, random_seed, sizeof(random_seed));
+
+  words = 1 + argc + 1 + 1 + 2 * 8;
+  vector = (unsigned int*)malloc(words * sizeof(unsigned int));
+  if(vector == NULL)
+  {
+    printf("Unable to allocate memory failed, exiting.\n");
+    exit(-1);
+  }
+
+  vector[n++] = argc;
+  for(int i = argc - 1; i >= 0; i--)
+  {
+    sp = push_bytes(mem, sp, argv[i], strlen(argv[i]) + 1);
+    vector[1 + i] = sp;
+  }
+  n += argc;
+  vector[n++] = 0;
+  vector[n++] = 0;
+
+  vector[n++] = AT_PHDR;
+  vector[n++] = image->phdr;
+  vector[n++] = AT_PHENT;
+  vector[n++] = sizeof(Elf32_Phdr);
+  vector[n++] = AT_PHNUM;
+  vector[n++] = image->phnum;
+  vector[n++] = AT_PAGESZ;
+  vector[n++] = GUEST_PAGE_SIZE;
+  vector[n++] = AT_ENTRY;
+  vector[n++] = image->entry;
+  vector[n++] = AT_RANDOM;
+  vector[n++] = random_bytes;
+  vector[n++] = AT_HWCAP;
+  vector[n++] = ELF_HWCAP;
+  vector[n++] = AT_NULL;
+  vector[n++] = 0;
+
+  sp = (sp - n * 4) & ~7u;
+  arm_memory_write(mem, sp, vector, n * 4);
+  free(vector);
+
+  return sp;
+}
+
+struct arm_state* new_arm_state_from_elf(struct arm_memory* mem, const char* path, int argc, char** argv)
+{
+  struct arm_elf_image image;
+  struct arm_state* arm_s;
+
+  arm_elf_load(mem, path, &image);
+  arm_s = new_arm_state(mem, image.entry, 0, 0, 0, 0);
+  arm_s->regs[SP] = arm_elf_setup_stack(mem, &image, argc, argv);
+
+  return arm_s;
+}
@@ -0,0 +1,24 @@
+#ifndef ARM_ELF_H
+#define ARM_ELF_H
+
+#include "arm_memory.h"
+
+struct arm_state;
+
+#define ELF_STACK_SIZE  (8 * 1024 * 1024)
+#define ELF_HEAP_SIZE  (256 * 1024 * 1024)
+
+/* Where a loaded executable ended up in guest memory. */
+struct arm_elf_image
+{
+  unsigned int entry;
+  unsigned int phdr;
+  unsigned int phnum;
+  unsigned int brk;
+};
+
+void arm_elf_load(struct arm_memory* mem, const char* path, struct arm_elf_image* image);
+unsigned int arm_elf_setup_stack(struct arm_memory* mem, const struct arm_elf_image* image, int argc, char** argv);
+struct arm_state* new_arm_state_from_elf(struct arm_memory* mem, const char* path, int argc, char** argv);
+
+#endif
@@ -0,0 +1,1187 @@
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "arm_vm.h"
+#include "arm_decode.h"
+#include "arm_block.h"
+#include "arm_jit.h"
+#include "arm_vfp.h"
+
+struct arm_jit* new_arm_jit(void)
+{
+  struct arm_jit* jit;
+
+  jit = (struct arm_jit*)calloc(1, sizeof(struct arm_jit));
+  if(jit == NULL)
+  {
+    printf("Unable to allocate memory failed, exiting.\n");
+    exit(-1);
+  }
+
+#if defined(__x86_64__)
+  jit->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(jit->code == MAP_FAILED)
+  {
+    printf("Unable to map JIT code buffer, exiting.\n");
+    exit(-1);
+  }
+#endif
+
+  return jit;
+}
+
+void free_arm_jit(struct arm_jit* jit)
+{
+  if(jit->code != NULL)
+  {
+    munmap(jit->code, JIT_CODE_SIZE);
+  }
+  free(jit);
+}
+
+void arm_jit_reset(struct arm_jit* jit)
+{
+  jit->used = 0;
+}
+
+#if defined(__x86_64__)
+
+enum host_reg
+{
+  RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+enum host_cc
+{
+  CC_O = 0x0, CC_NO = 0x1, CC_B = 0x2, CC_AE = 0x3,
+  CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7,
+  CC_S = 0x8, CC_NS = 0x9, CC_P = 0xA, CC_L = 0xC, CC_GE = 0xD,
+  CC_LE = 0xE, CC_G = 0xF
+};
+
+#define OP_ADD  0x01
+#define OP_OR  0x09
+#define OP_AND  0x21
+#define OP_SUB  0x29
+#define OP_XOR  0x31
+#define OP_CMP  0x39
+#define OP_TEST  0x85
+
+#define STATE(field)  ((unsigned int)offsetof(struct arm_state, field))
+#define GUEST_REG(r)  (STATE(regs) + (r) * 4)
+
+/*
+ * Guest registers live in callee-saved host registers, so helper calls
+ * leave them alone. rbx holds the arm_state and r15 the guest memory base.
+ */
+static const unsigned char host_pool[JIT_HOST_REGS] = {RBP, R12, R13, R14};
+
+/*
+ * ARM conditions as x86 conditions on the flags of cmp/add/test replayed
+ * from flag_a, flag_b and flag_result. -1 means the helper has to decide.
+ */
+static const signed char sub_cc[16] = {CC_E, CC_NE, CC_AE, CC_B, CC_S, CC_NS, CC_O, CC_NO, CC_A, CC_BE, CC_GE, CC_L, CC_G, CC_LE, -1, -1};
+static const signed char add_cc[16] = {CC_E, CC_NE, CC_B, CC_AE, CC_S, CC_NS, CC_O, CC_NO, -1, -1, CC_GE, CC_L, CC_G, CC_LE, -1, -1};
+static const signed char logic_cc[16] = {CC_E, CC_NE, -1, -1, CC_S, CC_NS, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+
+enum jit_kind
+{
+  JIT_HELPER = 0,
+  JIT_DATA_PROCESSING,
+  JIT_DATA_TRANSFER,
+  JIT_MULTIPLE,
+  JIT_BRANCH,
+  JIT_BX,
+  JIT_MULTIPLY,
+  JIT_MOVE_WIDE,
+  JIT_VFP_ARITH
+};
+
+struct emitter
+{
+  unsigned char* p;
+  unsigned char* end;
+  struct arm_tcache* tc;
+  signed char host[MAX_REGS];
+  unsigned int dirty;
+  unsigned int flags;
+};
+
+static void emit8(struct emitter* e, unsigned int byte)
+{
+  if(e->p < e->end)
+  {
+    *e->p = (unsigned char) byte;
+  }
+  e->p++;
+}
+
+static void emit32(struct emitter* e, unsigned int value)
+{
+  for(int i = 0; i < 4; i++)
+  {
+    emit8(e, value >> (i * 8));
+  }
+}
+
+static void emit64(struct emitter* e, uint64_t value)
+{
+  emit32(e, (unsigned int) value);
+  emit32(e, (unsigned int) (value >> 32));
+}
+
+static void emit_rex(struct emitter* e, int w, int reg, int rm)
+{
+  unsigned int rex = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+  if(rex != 0x40)
+  {
+    emit8(e, rex);
+  }
+}
+
+static void emit_modrm(struct emitter* e, int mod, int reg, int rm)
+{
+  emit8(e, (mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void mov_rr(struct emitter* e, int dst, int src)
+{
+  emit_rex(e, 0, src, dst);
+  emit8(e, 0x89);
+  emit_modrm(e, 3, src, dst);
+}
+
+static void mov_ri(struct emitter* e, int dst, unsigned int imm)
+{
+  emit_rex(e, 0, 0, dst);
+  emit8(e, 0xB8 + (dst & 7));
+  emit32(e, imm);
+}
+
+static void mov_ri64(struct emitter* e, int dst, uint64_t imm)
+{
+  emit_rex(e, 1, 0, dst);
+  emit8(e, 0xB8 + (dst & 7));
+  emit64(e, imm);
+}
+
+static void alu_rr(struct emitter* e, int op, int dst, int src)
+{
+  emit_rex(e, 0, src, dst);
+  emit8(e, op);
+  emit_modrm(e, 3, src, dst);
+}
+
+/* op is the /digit of the 0x81 group: 0 add, 1 or, 4 and, 5 sub, 7 cmp. */
+static void alu_ri(struct emitter* e, int op, int dst, unsigned int imm)
+{
+  emit_rex(e, 0, 0, dst);
+  emit8(e, 0x81);
+  emit_modrm(e, 3, op, dst);
+  emit32(e, imm);
+}
+
+static void shift_ri(struct emitter* e, int op, int dst, unsigned int amount)
+{
+  emit_rex(e, 0, 0, dst);
+  emit8(e, 0xC1);
+  emit_modrm(e, 3, op, dst);
+  emit8(e, amount);
+}
+
+static void unary_r(struct emitter* e, int op, int dst)
+{
+  emit_rex(e, 0, 0, dst);
+  emit8(e, 0xF7);
+  emit_modrm(e, 3, op, dst);
+}
+
+static void load_state(struct emitter* e, int dst, unsigned int offset)
+{
+  emit_rex(e, 0, dst, RBX);
+  emit8(e, 0x8B);
+  emit_modrm(e, 2, dst, RBX);
+  emit32(e, offset);
+}
+
+static void store_state(struct emitter* e, unsigned int offset, int src)
+{
+  emit_rex(e, 0, src, RBX);
+  emit8(e, 0x89);
+  emit_modrm(e, 2, src, RBX);
+  emit32(e, offset);
+}
+
+/* op is the /digit of the 0x81 group: 1 or, 4 and. */
+static void alu_state_imm(struct emitter* e, int op, unsigned int offset, unsigned int imm)
+{
+  emit8(e, 0x81);
+  emit_modrm(e, 2, op, RBX);
+  emit32(e, offset);
+  emit32(e, imm);
+}
+
+static void store_state_imm(struct emitter* e, unsigned int offset, unsigned int imm)
+{
+  emit8(e, 0xC7);
+  emit_modrm(e, 2, 0, RBX);
+  emit32(e, offset);
+  emit32(e, imm);
+}
+
+/* op [r15 + rax], reg: the guest address is always in eax. */
+static void guest_access(struct emitter* e, unsigned int opcode, int reg)
+{
+  emit8(e, 0x41 | ((reg >> 3) << 2));
+  if(opcode > 0xFF)
+  {
+    emit8(e, opcode >> 8);
+  }
+  emit8(e, opcode & 0xFF);
+  emit_modrm(e, 0, reg, 4);
+  emit8(e, (RAX << 3) | (R15 & 7));
+}
+
+static void guest_access_disp(struct emitter* e, unsigned int opcode, int reg, unsigned int disp)
+{
+  emit8(e, 0x41 | ((reg >> 3) << 2));
+  emit8(e, opcode);
+  emit_modrm(e, 1, reg, 4);
+  emit8(e, (RAX << 3) | (R15 & 7));
+  emit8(e, disp);
+}
+
+static void call_helper(struct emitter* e, void* fn, int pass_iw, unsigned int iw)
+{
+  emit8(e, 0x48);
+  emit8(e, 0x89);
+  emit_modrm(e, 3, RBX, RDI);
+  if(pass_iw)
+  {
+    mov_ri(e, RSI, iw);
+  }
+  mov_ri64(e, RAX, (uint64_t)(uintptr_t) fn);
+  emit8(e, 0xFF);
+  emit_modrm(e, 3, 2, RAX);
+}
+
+static unsigned char* jcc_forward(struct emitter* e, int cc)
+{
+  emit8(e, 0x0F);
+  emit8(e, 0x80 + cc);
+  emit32(e, 0);
+  return e->p;
+}
+
+static unsigned char* jmp_forward(struct emitter* e)
+{
+  emit8(e, 0xE9);
+  emit32(e, 0);
+  return e->p;
+}
+
+static void patch(struct emitter* e, unsigned char* after)
+{
+  int rel = (int)(e->p - after);
+
+  if(after <= e->end)
+  {
+    for(int i = 0; i < 4; i++)
+    {
+      after[i - 4] = (unsigned char) (rel >> (i * 8));
+    }
+  }
+}
+
+static void load_guest(struct emitter* e, int dst, unsigned int r)
+{
+  if(e->host[r] >= 0)
+  {
+    mov_rr(e, dst, e->host[r]);
+  }
+  else
+  {
+    load_state(e, dst, GUEST_REG(r));
+  }
+}
+
+static void store_guest(struct emitter* e, unsigned int r, int src)
+{
+  if(e->host[r] >= 0)
+  {
+    mov_rr(e, e->host[r], src);
+    e->dirty |= 1u << r;
+  }
+  else
+  {
+    store_state(e, GUEST_REG(r), src);
+  }
+}
+
+/* Writes both copies, for stores that must be visible if the next access faults. */
+static void store_guest_through(struct emitter* e, unsigned int r, int src)
+{
+  store_state(e, GUEST_REG(r), src);
+  if(e->host[r] >= 0)
+  {
+    mov_rr(e, e->host[r], src);
+  }
+}
+
+static void spill(struct emitter* e)
+{
+  for(unsigned int r = 0; r < MAX_REGS; r++)
+  {
+    if((e->dirty >> r) & 0b1)
+    {
+      store_state(e, GUEST_REG(r), e->host[r]);
+    }
+  }
+  e->dirty = 0;
+}
+
+static void reload(struct emitter* e)
+{
+  for(unsigned int r = 0; r < MAX_REGS; r++)
+  {
+    if(e->host[r] >= 0)
+    {
+      load_state(e, e->host[r], GUEST_REG(r));
+    }
+  }
+}
+
+/* Sets the translation cache's dirty flag if the page of eax holds code. */
+static void note_store(struct emitter* e)
+{
+  unsigned char* skip;
+
+  mov_rr(e, RDX, RAX);
+  shift_ri(e, 5, RDX, TCACHE_PAGE_BITS);
+  mov_ri64(e, RSI, (uint64_t)(uintptr_t) e->tc->code_pages);
+  emit8(e, 0x48);
+  emit8(e, 0x0F);
+  emit8(e, 0xA3);
+  emit_modrm(e, 0, RDX, RSI);
+  skip = jcc_forward(e, CC_AE);
+  mov_ri64(e, RSI, (uint64_t)(uintptr_t) &e->tc->dirty);
+  emit8(e, 0xC7);
+  emit_modrm(e, 0, 0, RSI);
+  emit32(e, 1);
+  patch(e, skip);
+}
+
+/*
+ * Which ARM logical operation, add or subtract an opcode is, for replaying
+ * its flags. ADC, SBC and RSC are never compiled.
+ */
+static unsigned int flag_kind(unsigned int opcode)
+{
+  switch(opcode)
+  {
+    case 0x2:
+    case 0x3:
+    case 0xA:
+      return FLAGS_SUB;
+    case 0x4:
+    case 0xB:
+      return FLAGS_ADD;
+  }
+  return FLAGS_LOGIC;
+}
+
+/*
+ * Operand 2 forms the JIT can do: any immediate, and registers shifted by
+ * an immediate other than RRX. The shifter carry is only known at compile
+ * time for immediates and unshifted registers.
+ */
+static int compiled_operand2(unsigned int iw, int need_carry)
+{
+  if((iw >> 25) & 0b1)
+  {
+    return 1;
+  }
+  if((iw & 0xF) == PC || ((iw >> 4) & 0b1))
+  {
+    return 0;
+  }
+  if(need_carry)
+  {
+    return (iw & 0xFF0) == 0;
+  }
+  return (iw & 0xFF0) != 0x060;
+}
+
+/* The SSE opcode for a VADD, VSUB, VMUL or VDIV, or 0 for anything else. */
+static unsigned int sse_opcode(unsigned int iw)
+{
+  if(((iw >> 9) & 0x7) != 0x5 || ((iw >> 4) & 0b1))
+  {
+    return 0;
+  }
+
+  switch((((iw >> 20) & 0xB) << 1) | ((iw >> 6) & 0b1))
+  {
+    case 0x4:
+      return 0x59;
+
+    case 0x6:
+      return 0x58;
+
+    case 0x7:
+      return 0x5C;
+
+    case 0x10:
+      return 0x5E;
+  }
+  return 0;
+}
+
+static enum jit_kind classify(unsigned int cls, unsigned int iw)
+{
+  unsigned int rd = (iw >> 12) & 0xF;
+  unsigned int rn = (iw >> 16) & 0xF;
+  unsigned int rm = iw & 0xF;
+  unsigned int opcode = (iw >> 21) & 0xF;
+  unsigned int s_bit = (iw >> 20) & 0b1;
+  unsigned int i_bit = (iw >> 25) & 0b1;
+  unsigned int list = iw & 0xFFFF;
+
+  switch(cls)
+  {
+    case ARM_CLASS_DATA_PROCESSING:
+      if(opcode >= 0x5 && opcode <= 0x7)
+      {
+        return JIT_HELPER;
+      }
+      if(!compiled_operand2(iw, s_bit && flag_kind(opcode) == FLAGS_LOGIC))
+      {
+        return JIT_HELPER;
+      }
+      if((opcode & 0xC) != 0x8 && rd == PC)
+      {
+        return JIT_HELPER;
+      }
+      if(opcode != 0xD && opcode != 0xF && rn == PC)
+      {
+        return JIT_HELPER;
+      }
+      return JIT_DATA_PROCESSING;
+
+    case ARM_CLASS_DATA_TRANSFER:
+      if(rd == PC || rn == PC || (i_bit == 1 && ((iw & 0x70) != 0 || rm == PC)))
+      {
+        return JIT_HELPER;
+      }
+      return JIT_DATA_TRANSFER;
+
+    case ARM_CLASS_PUSH:
+    case ARM_CLASS_POP:
+      if(list == 0 || rn == PC || ((list >> PC) & 0b1) || ((list >> rn) & 0b1))
+      {
+        return JIT_HELPER;
+      }
+      return JIT_MULTIPLE;
+
+    case ARM_CLASS_BRANCH:
+      return JIT_BRANCH;
+
+    case ARM_CLASS_BX:
+      return rm == PC ? JIT_HELPER : JIT_BX;
+
+    case ARM_CLASS_MULTIPLY:
+      if(((iw >> 23) & 0b1) || s_bit || rn == PC || rd == PC || rm == PC || ((iw >> 8) & 0xF) == PC)
+      {
+        return JIT_HELPER;
+      }
+      return JIT_MULTIPLY;
+
+    case ARM_CLASS_MOVE_WIDE:
+      return rd == PC ? JIT_HELPER : JIT_MOVE_WIDE;
+
+    case ARM_CLASS_COPROCESSOR:
+      return sse_opcode(iw) != 0 ? JIT_VFP_ARITH : JIT_HELPER;
+  }
+  return JIT_HELPER;
+}
+
+static void count_uses(unsigned int* uses, enum jit_kind kind, unsigned int iw)
+{
+  switch(kind)
+  {
+    case JIT_DATA_PROCESSING:
+    case JIT_DATA_TRANSFER:
+      uses[(iw >> 12) & 0xF]++;
+      uses[(iw >> 16) & 0xF]++;
+      if(((iw >> 25) & 0b1) == (kind == JIT_DATA_TRANSFER))
+      {
+        uses[iw & 0xF]++;
+      }
+      break;
+
+    case JIT_MULTIPLE:
+      uses[(iw >> 16) & 0xF] += 2;
+      break;
+
+    case JIT_BX:
+      uses[iw & 0xF]++;
+      break;
+
+    case JIT_MULTIPLY:
+      uses[(iw >> 16) & 0xF]++;
+      uses[(iw >> 12) & 0xF] += (iw >> 21) & 0b1;
+      uses[(iw >> 8) & 0xF]++;
+      uses[iw & 0xF]++;
+      break;
+
+    case JIT_MOVE_WIDE:
+      uses[(iw >> 12) & 0xF]++;
+      break;
+
+    default:
+      break;
+  }
+}
+
+/* Instructions that touch neither guest memory nor the interpreter. */
+static int register_only(enum jit_kind kind)
+{
+  return kind == JIT_DATA_PROCESSING || kind == JIT_MULTIPLY || kind == JIT_MOVE_WIDE;
+}
+
+/* Emits a jump taken when the condition of iw fails, or returns NULL for AL. */
+static unsigned char* emit_condition(struct emitter* e, unsigned int iw)
+{
+  unsigned int cond = iw >> 28;
+  int cc = -1;
+
+  if(cond == COND_AL)
+  {
+    return NULL;
+  }
+
+  switch(e->flags)
+  {
+    case FLAGS_SUB:
+      cc = sub_cc[cond];
+      break;
+    case FLAGS_ADD:
+      cc = add_cc[cond];
+      break;
+    case FLAGS_LOGIC:
+      cc = logic_cc[cond];
+      break;
+  }
+
+  if(cc < 0)
+  {
+    call_helper(e, (void*) check_cpsr_flags, 1, iw);
+    alu_rr(e, OP_TEST, RAX, RAX);
+    return jcc_forward(e, CC_E);
+  }
+
+  if(e->flags == FLAGS_LOGIC)
+  {
+    load_state(e, RAX, STATE(flag_result));
+    alu_rr(e, OP_TEST, RAX, RAX);
+  }
+  else
+  {
+    load_state(e, RAX, STATE(flag_a));
+    load_state(e, RCX, STATE(flag_b));
+    alu_rr(e, e->flags == FLAGS_SUB ? OP_CMP : OP_ADD, RAX, RCX);
+  }
+  return jcc_forward(e, cc ^ 1);
+}
+
+/* Operand 2 into ecx. */
+static void emit_operand2(struct emitter* e, unsigned int iw)
+{
+  unsigned int amount = (iw >> 7) & 0x1F;
+
+  if((iw >> 25) & 0b1)
+  {
+    unsigned int rotate = (iw >> 7) & 0x1E;
+    unsigned int value = iw & 0xFF;
+    mov_ri(e, RCX, (value >> rotate) | (value << ((32 - rotate) & 31)));
+    return;
+  }
+
+  load_guest(e, RCX, iw & 0xF);
+  switch((iw >> 5) & 0b11)
+  {
+    case 0:
+      if(amount != 0)
+      {
+        shift_ri(e, 4, RCX, amount);
+      }
+      break;
+    case 1:
+      if(amount == 0)
+      {
+        mov_ri(e, RCX, 0);
+      }
+      else
+      {
+        shift_ri(e, 5, RCX, amount);
+      }
+      break;
+    case 2:
+      shift_ri(e, 7, RCX, amount ? amount : 31);
+      break;
+    default:
+      shift_ri(e, 1, RCX, amount);
+      break;
+  }
+}
+
+/* Mirrors execute_process_data_instruction for the forms classify accepts. */
+static void emit_data_processing(struct emitter* e, unsigned int iw)
+{
+  unsigned int opcode = (iw >> 21) & 0xF;
+  unsigned int s_bit = (iw >> 20) & 0b1;
+  unsigned int rd = (iw >> 12) & 0xF;
+  unsigned int rn = (iw >> 16) & 0xF;
+  unsigned int kind = flag_kind(opcode);
+  int result = RAX;
+
+  if(s_bit && kind == FLAGS_LOGIC)
+  {
+    call_helper(e, (void*) arm_cpsr, 0, 0);
+    if(((iw >> 25) & 0b1) && ((iw >> 8) & 0xF))
+    {
+      unsigned int rotate = (iw >> 7) & 0x1E;
+      unsigned int value = iw & 0xFF;
+      if(((value >> rotate) | (value << ((32 - rotate) & 31))) >> 31)
+      {
+        alu_state_imm(e, 1, STATE(cpsr), CPSR_C);
+      }
+      else
+      {
+        alu_state_imm(e, 4, STATE(cpsr), ~CPSR_C);
+      }
+    }
+  }
+
+  emit_operand2(e, iw);
+  if(opcode != 0xD && opcode != 0xF)
+  {
+    load_guest(e, RAX, rn);
+  }
+  if(s_bit && kind != FLAGS_LOGIC)
+  {
+    store_state(e, STATE(flag_a), opcode == 0x3 ? RCX : RAX);
+    store_state(e, STATE(flag_b), opcode == 0x3 ? RAX : RCX);
+  }
+
+  switch(opcode)
+  {
+    case 0x0:
+    case 0x8:
+      alu_rr(e, OP_AND, RAX, RCX);
+      break;
+    case 0x1:
+    case 0x9:
+      alu_rr(e, OP_XOR, RAX, RCX);
+      break;
+    case 0x2:
+    case 0xA:
+      alu_rr(e, OP_SUB, RAX, RCX);
+      break;
+    case 0x3:
+      alu_rr(e, OP_SUB, RCX, RAX);
+      result = RCX;
+      break;
+    case 0x4:
+    case 0xB:
+      alu_rr(e, OP_ADD, RAX, RCX);
+      break;
+    case 0xC:
+      alu_rr(e, OP_OR, RAX, RCX);
+      break;
+    case 0xD:
+      result = RCX;
+      break;
+    case 0xE:
+      unary_r(e, 2, RCX);
+      alu_rr(e, OP_AND, RAX, RCX);
+      break;
+    default:
+      unary_r(e, 2, RCX);
+      result = RCX;
+      break;
+  }
+
+  if(s_bit)
+  {
+    store_state(e, STATE(flag_result), result);
+    store_state_imm(e, STATE(flag_op), kind);
+  }
+  if((opcode & 0xC) != 0x8)
+  {
+    store_guest(e, rd, result);
+  }
+}
+
+static void emit_multiply(struct emitter* e, unsigned int iw)
+{
+  load_guest(e, RAX, iw & 0xF);
+  load_guest(e, RCX, (iw >> 8) & 0xF);
+  emit_rex(e, 0, RAX, RCX);
+  emit8(e, 0x0F);
+  emit8(e, 0xAF);
+  emit_modrm(e, 3, RAX, RCX);
+  if((iw >> 21) & 0b1)
+  {
+    load_guest(e, RCX, (iw >> 12) & 0xF);
+    alu_rr(e, OP_ADD, RAX, RCX);
+  }
+  store_guest(e, (iw >> 16) & 0xF, RAX);
+}
+
+static void emit_move_wide(struct emitter* e, unsigned int iw)
+{
+  unsigned int rd = (iw >> 12) & 0xF;
+  unsigned int imm16 = ((iw >> 4) & 0xF000) | (iw & 0xFFF);
+
+  if((iw >> 22) & 0b1)
+  {
+    load_guest(e, RAX, rd);
+    alu_ri(e, 4, RAX, 0xFFFF);
+    alu_ri(e, 1, RAX, imm16 << 16);
+  }
+  else
+  {
+    mov_ri(e, RAX, imm16);
+  }
+  store_guest(e, rd, RAX);
+}
+
+/* Mirrors execute_data_transfer_instruction, including its LSL-only register offsets. */
+/* movss/movsd or a scalar SSE operation between xmm0 and [rbx + offset]. */
+static void sse_state(struct emitter* e, int dbl, unsigned int opcode, unsigned int offset)
+{
+  emit8(e, dbl ? 0xF2 : 0xF3);
+  emit8(e, 0x0F);
+  emit8(e, opcode);
+  emit_modrm(e, 2, 0, RBX);
+  emit32(e, offset);
+}
+
+/*
+ * VADD, VSUB, VMUL and VDIV on xmm0. A NaN result is not stored but left to
+ * arm_vfp_execute, which knows which NaN ARM would produce, as is the
+ * undefined instruction of a disabled VFP.
+ */
+static void emit_vfp_arith(struct emitter* e, unsigned int pc, unsigned int iw)
+{
+  unsigned int dbl = (iw >> 8) & 0b1;
+  unsigned int size = dbl ? 8 : 4;
+  unsigned int d = dbl ? ((iw >> 18) & 0x10) | ((iw >> 12) & 0xF) : ((iw >> 11) & 0x1E) | ((iw >> 22) & 0b1);
+  unsigned int n = dbl ? ((iw >> 3) & 0x10) | ((iw >> 16) & 0xF) : ((iw >> 15) & 0x1E) | ((iw >> 7) & 0b1);
+  unsigned int m = dbl ? ((iw >> 1) & 0x10) | (iw & 0xF) : ((iw << 1) & 0x1E) | ((iw >> 5) & 0b1);
+  unsigned char* disabled;
+  unsigned char* nan;
+  unsigned char* done;
+
+  emit8(e, 0xF7);
+  emit_modrm(e, 2, 0, RBX);
+  emit32(e, STATE(fpexc));
+  emit32(e, FPEXC_EN);
+  disabled = jcc_forward(e, CC_E);
+
+  sse_state(e, dbl, 0x10, STATE(vfp) + n * size);
+  sse_state(e, dbl, sse_opcode(iw), STATE(vfp) + m * size);
+  if(dbl)
+  {
+    emit8(e, 0x66);
+  }
+  emit8(e, 0x0F);
+  emit8(e, 0x2E);
+  emit_modrm(e, 3, 0, 0);
+  nan = jcc_forward(e, CC_P);
+  sse_state(e, dbl, 0x11, STATE(vfp) + d * size);
+  done = jmp_forward(e);
+
+  patch(e, disabled);
+  patch(e, nan);
+  store_state_imm(e, GUEST_REG(PC), pc);
+  call_helper(e, (void*) arm_vfp_execute, 1, iw);
+  patch(e, done);
+}
+
+static void emit_data_transfer(struct emitter* e, unsigned int pc, unsigned int iw)
+{
+  unsigned int rd = (iw >> 12) & 0xF;
+  unsigned int rn = (iw >> 16) & 0xF;
+  unsigned int l_bit = (iw >> 20) & 0b1;
+  unsigned int w_bit = (iw >> 21) & 0b1;
+  unsigned int b_bit = (iw >> 22) & 0b1;
+  unsigned int u_bit = (iw >> 23) & 0b1;
+  unsigned int p_bit = (iw >> 24) & 0b1;
+  unsigned int i_bit = (iw >> 25) & 0b1;
+  unsigned int offset = iw & 0xFFF;
+
+  store_state_imm(e, GUEST_REG(PC), pc);
+  load_guest(e, RAX, rn);
+  if(i_bit == 1)
+  {
+    load_guest(e, RCX, iw & 0xF);
+    if((iw >> 7) & 0x1F)
+    {
+      shift_ri(e, 4, RCX, (iw >> 7) & 0x1F);
+    }
+    if(u_bit == 0)
+    {
+      unary_r(e, 3, RCX);
+    }
+  }
+  else if(u_bit == 0)
+  {
+    offset = -offset;
+  }
+
+  if(p_bit == 1)
+  {
+    if(i_bit == 1)
+    {
+      alu_rr(e, OP_ADD, RAX, RCX);
+    }
+    else if(offset != 0)
+    {
+      alu_ri(e, 0, RAX, offset);
+    }
+  }
+
+  if(l_bit == 1)
+  {
+    guest_access(e, b_bit ? 0x0FB6 : 0x8B, RDX);
+    store_guest(e, rd, RDX);
+  }
+  else
+  {
+    load_guest(e, RDX, rd);
+    guest_access(e, b_bit ? 0x88 : 0x89, RDX);
+    note_store(e);
+  }
+
+  if(p_bit == 0)
+  {
+    if(i_bit == 1)
+    {
+      alu_rr(e, OP_ADD, RAX, RCX);
+    }
+    else if(offset != 0)
+    {
+      alu_ri(e, 0, RAX, offset);
+    }
+  }
+  if(p_bit == 0 || w_bit == 1)
+  {
+    store_guest(e, rn, RAX);
+  }
+}
+
+/* Mirrors execute_push and execute_pop: one start address, one writeback. */
+static void emit_multiple(struct emitter* e, unsigned int pc, unsigned int iw, int load)
+{
+  unsigned int list = iw & 0xFFFF;
+  unsigned int rn = (iw >> 16) & 0xF;
+  unsigned int w_bit = (iw >> 21) & 0b1;
+  unsigned int u_bit = (iw >> 23) & 0b1;
+  unsigned int p_bit = (iw >> 24) & 0b1;
+  unsigned int count = __builtin_popcount(list);
+  unsigned int start = u_bit ? (p_bit ? 4 : 0) : -count * 4 + (p_bit ? 0 : 4);
+  unsigned int disp = 0;
+
+  store_state_imm(e, GUEST_REG(PC), pc);
+  load_guest(e, RAX, rn);
+  if(start != 0)
+  {
+    alu_ri(e, 0, RAX, start);
+  }
+  if(!load)
+  {
+    note_store(e);
+  }
+
+  for(unsigned int i = 0; i < MAX_REGS; i++)
+  {
+    if(((list >> i) & 0b1) == 0)
+    {
+      continue;
+    }
+    if(load)
+    {
+      guest_access_disp(e, 0x8B, RDX, disp);
+      store_guest_through(e, i, RDX);
+    }
+    else
+    {
+      load_guest(e, RDX, i);
+      guest_access_disp(e, 0x89, RDX, disp);
+    }
+    disp += 4;
+  }
+
+  if(!load)
+  {
+    alu_ri(e, 0, RAX, disp - 4);
+    note_store(e);
+  }
+  if(w_bit == 1)
+  {
+    load_guest(e, RAX, rn);
+    alu_ri(e, 0, RAX, u_bit ? count * 4 : -count * 4);
+    store_guest(e, rn, RAX);
+  }
+}
+
+static void emit_branch(struct emitter* e, unsigned int pc, unsigned int iw)
+{
+  unsigned int offset = iw & 0xFFFFFF;
+
+  if((offset >> 23) & 0b1)
+  {
+    offset |= 0xFF000000;
+  }
+  if((iw >> 24) & 0b1)
+  {
+    store_state_imm(e, GUEST_REG(LR), pc + 4);
+    if(e->host[LR] >= 0)
+    {
+      mov_ri(e, e->host[LR], pc + 4);
+    }
+  }
+  store_state_imm(e, GUEST_REG(PC), pc + 8 + (offset << 2));
+}
+
+static void emit_prologue(struct emitter* e)
+{
+  emit8(e, 0x53);
+  emit8(e, 0x55);
+  for(int r = R12; r <= R15; r++)
+  {
+    emit8(e, 0x41);
+    emit8(e, 0x50 + (r & 7));
+  }
+  emit8(e, 0x48);
+  emit8(e, 0x83);
+  emit_modrm(e, 3, 5, RSP);
+  emit8(e, 8);
+
+  emit8(e, 0x48);
+  emit8(e, 0x89);
+  emit_modrm(e, 3, RDI, RBX);
+  emit8(e, 0x4C);
+  emit8(e, 0x8B);
+  emit_modrm(e, 2, R15, RBX);
+  emit32(e, STATE(mem_base));
+  reload(e);
+}
+
+static void emit_epilogue(struct emitter* e)
+{
+  emit8(e, 0x48);
+  emit8(e, 0x83);
+  emit_modrm(e, 3, 0, RSP);
+  emit8(e, 8);
+  for(int r = R15; r >= R12; r--)
+  {
+    emit8(e, 0x41);
+    emit8(e, 0x58 + (r & 7));
+  }
+  emit8(e, 0x5D);
+  emit8(e, 0x5B);
+  emit8(e, 0xC3);
+}
+
+/*
+ * The four guest registers used most by natively compiled instructions get
+ * host registers. Everything the JIT does not compile is a call to the
+ * interpreter's handler, with the cached registers written back first, so
+ * the two always agree on the result, the counters and where a fault hits.
+ */
+arm_jit_fn arm_jit_compile(struct arm_jit* jit, struct arm_tcache* tc, struct arm_block* block)
+{
+  struct emitter e;
+  unsigned int uses[MAX_REGS] = {0};
+  enum jit_kind kinds[TCACHE_MAX_BLOCK];
+  unsigned char* start = jit->code + jit->used;
+
+  e.p = start;
+  e.end = jit->code + JIT_CODE_SIZE;
+  e.tc = tc;
+  e.dirty = 0;
+  e.flags = FLAGS_CLEAN;
+
+  for(unsigned int i = 0; i < block->num_uops; i++)
+  {
+    unsigned int iw = block->uops[i].iw;
+    kinds[i] = classify(ARM_CLASSIFY(iw), iw);
+    count_uses(uses, kinds[i], iw);
+  }
+
+  for(unsigned int r = 0; r < MAX_REGS; r++)
+  {
+    e.host[r] = -1;
+  }
+  uses[PC] = 0;
+  for(int h = 0; h < JIT_HOST_REGS; h++)
+  {
+    unsigned int best = PC;
+    for(unsigned int r = 0; r < PC; r++)
+    {
+      if(e.host[r] < 0 && uses[r] > 1 && uses[r] > uses[best])
+      {
+        best = r;
+      }
+    }
+    if(best == PC)
+    {
+      break;
+    }
+    e.host[best] = host_pool[h];
+  }
+
+  emit_prologue(&e);
+
+  for(unsigned int i = 0; i < block->num_uops; i++)
+  {
+    unsigned int pc = block->pc + i * 4;
+    unsigned int iw = block->uops[i].iw;
+    unsigned int last = i + 1 == block->num_uops;
+    unsigned int flags = e.flags;
+    unsigned char* skip;
+    unsigned char* done = NULL;
+    unsigned char* thumb;
+
+    if(!register_only(kinds[i]) || last)
+    {
+      spill(&e);
+    }
+    skip = emit_condition(&e, iw);
+
+    switch(kinds[i])
+    {
+      case JIT_DATA_PROCESSING:
+        emit_data_processing(&e, iw);
+        if((iw >> 20) & 0b1)
+        {
+          flags = flag_kind((iw >> 21) & 0xF);
+        }
+        break;
+
+      case JIT_MULTIPLY:
+        emit_multiply(&e, iw);
+        break;
+
+      case JIT_MOVE_WIDE:
+        emit_move_wide(&e, iw);
+        break;
+
+      case JIT_VFP_ARITH:
+        emit_vfp_arith(&e, pc, iw);
+        break;
+
+      case JIT_DATA_TRANSFER:
+        emit_data_transfer(&e, pc, iw);
+        break;
+
+      case JIT_MULTIPLE:
+        emit_multiple(&e, pc, iw, (iw >> 20) & 0b1);
+        break;
+
+      case JIT_BRANCH:
+        emit_branch(&e, pc, iw);
+        break;
+
+      case JIT_BX:
+        load_guest(&e, RAX, iw & 0xF);
+        if((iw >> 5) & 0b1)
+        {
+          store_state_imm(&e, GUEST_REG(LR), pc + 4);
+          if(e.host[LR] >= 0)
+          {
+            mov_ri(&e, e.host[LR], pc + 4);
+          }
+        }
+        store_state(&e, GUEST_REG(PC), RAX);
+
+        /* An odd destination enters Thumb, which arm_tcache_run looks at. */
+        alu_ri(&e, 4, RAX, 0b1);
+        thumb = jcc_forward(&e, CC_E);
+        alu_state_imm(&e, 4, GUEST_REG(PC), ~1u);
+        alu_state_imm(&e, 1, STATE(cpsr), CPSR_T);
+        patch(&e, thumb);
+        break;
+
+      case JIT_HELPER:
+        store_state_imm(&e, GUEST_REG(PC), pc);
+        call_helper(&e, (void*) block->uops[i].handler, 1, iw);
+        if(!last)
+        {
+          reload(&e);
+        }
+        flags = FLAGS_CLEAN;
+        jit->helper++;
+        break;
+    }
+    if(kinds[i] != JIT_HELPER)
+    {
+      jit->native++;
+    }
+
+    /* A flag-setting instruction that may not run leaves the flags unknown. */
+    e.flags = (skip != NULL && flags != e.flags) ? FLAGS_CLEAN : flags;
+
+    if(last && skip != NULL && (kinds[i] == JIT_BRANCH || kinds[i] == JIT_BX || kinds[i] == JIT_HELPER))
+    {
+      done = jmp_forward(&e);
+      patch(&e, skip);
+      store_state_imm(&e, GUEST_REG(PC), pc + 4);
+      patch(&e, done);
+    }
+    else if(skip != NULL)
+    {
+      patch(&e, skip);
+    }
+
+    if(last)
+    {
+      spill(&e);
+      if(kinds[i] != JIT_BRANCH && kinds[i] != JIT_BX && kinds[i] != JIT_HELPER)
+      {
+        store_state_imm(&e, GUEST_REG(PC), pc + 4);
+      }
+    }
+  }
+
+  emit_epilogue(&e);
+
+  if(e.p > e.end)
+  {
+    return NULL;
+  }
+  jit->used = (unsigned int)(e.p - jit->code + 15) & ~15u;
+  jit->compiled++;
+
+  return (arm_jit_fn) start;
+}
+
+#else
+
+arm_jit_fn arm_jit_compile(struct arm_jit* jit, struct arm_tcache* tc, struct arm_block* block)
+{
+  (void) jit;
+  (void) tc;
+  (void) block;
+  return NULL;
+}
+
+#endif
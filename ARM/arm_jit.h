@@ -0,0 +1,32 @@
+#ifndef ARM_JIT_H
+#define ARM_JIT_H
+
+struct arm_state;
+struct arm_tcache;
+struct arm_block;
+
+#define JIT_CODE_SIZE  (16 * 1024 * 1024)
+#define JIT_HOST_REGS  4
+
+typedef void (*arm_jit_fn)(struct arm_state*);
+
+/*
+ * x86-64 code for translated blocks, bump allocated from one executable
+ * mapping and thrown away with the translation cache. On other hosts
+ * arm_jit_compile always returns NULL and blocks are interpreted.
+ */
+struct arm_jit
+{
+  unsigned char* code;
+  unsigned int used;
+  unsigned int compiled;
+  unsigned int native;
+  unsigned int helper;
+};
+
+struct arm_jit* new_arm_jit(void);
+void free_arm_jit(struct arm_jit* jit);
+void arm_jit_reset(struct arm_jit* jit);
+arm_jit_fn arm_jit_compile(struct arm_jit* jit, struct arm_tcache* tc, struct arm_block* block);
+
+#endif
@@ -0,0 +1,189 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "arm_memory.h"
+
+static _Thread_local struct guest_fault* active_fault;
+static atomic_uint next_memory_id;
+static struct sigaction previous_segv;
+static pthread_once_t handler_once = PTHREAD_ONCE_INIT;
+
+static void segv_handler(int sig, siginfo_t* info, void* context)
+{
+  struct guest_fault* fault = active_fault;
+  unsigned char* address = info->si_addr;
+
+  (void) context;
+
+  if(fault != NULL && address >= fault->mem->base && address < fault->mem->base + GUEST_ADDRESS_SPACE + GUEST_GUARD_SIZE)
+  {
+    guest_fault_raise(GUEST_FAULT_ACCESS, (unsigned int)(address - fault->mem->base));
+  }
+
+  /* Not a guest access: let the fault happen again with the old handler. */
+  sigaction(sig, &previous_segv, NULL);
+}
+
+static void install_handler(void)
+{
+  struct sigaction sa;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = segv_handler;
+  sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGSEGV, &sa, &previous_segv);
+}
+
+struct arm_memory* new_arm_memory(void)
+{
+  struct arm_memory* mem;
+
+  pthread_once(&handler_once, install_handler);
+
+  mem = (struct arm_memory*)malloc(sizeof(struct arm_memory));
+  if(mem == NULL)
+  {
+    printf("Unable to allocate memory failed, exiting.\n");
+    exit(-1);
+  }
+
+  mem->base = mmap(NULL, GUEST_ADDRESS_SPACE + GUEST_GUARD_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if(mem->base == MAP_FAILED)
+  {
+    printf("Unable to reserve guest address space, exiting.\n");
+    exit(-1);
+  }
+  mem->next_alloc = GUEST_ALLOC_BASE;
+  mem->brk = 0;
+  mem->brk_start = 0;
+  mem->brk_limit = 0;
+  mem->id = atomic_fetch_add(&next_memory_id, 1) + 1;
+
+  return mem;
+}
+
+void free_arm_memory(struct arm_memory* mem)
+{
+  munmap(mem->base, GUEST_ADDRESS_SPACE + GUEST_GUARD_SIZE);
+  free(mem);
+}
+
+void arm_memory_map(struct arm_memory* mem, unsigned int address, unsigned int size)
+{
+  uint64_t start = GUEST_PAGE_DOWN(address);
+  uint64_t end = GUEST_PAGE_UP((uint64_t)address + size);
+
+  if(end > GUEST_ADDRESS_SPACE || mprotect(mem->base + start, end - start, PROT_READ | PROT_WRITE) != 0)
+  {
+    printf("Unable to map guest memory at 0x%x, exiting.\n", address);
+    exit(-1);
+  }
+}
+
+/* Host protection for guest pages. Guest code is read by the emulator, so executable means readable. */
+int arm_memory_prot(bool read, bool write, bool exec)
+{
+  return (read || exec ? PROT_READ : 0) | (write ? PROT_WRITE : 0);
+}
+
+/*
+ * Takes size bytes, rounded up to pages, plus an unmapped guard page from
+ * the top of the allocated region. Cores may allocate concurrently. Fails
+ * rather than wrap once the address space is used up.
+ */
+bool arm_memory_reserve(struct arm_memory* mem, uint64_t size, unsigned int* address)
+{
+  uint64_t length = GUEST_PAGE_UP(size) + GUEST_PAGE_SIZE;
+  unsigned int next = __atomic_load_n(&mem->next_alloc, __ATOMIC_RELAXED);
+
+  do
+  {
+    if(length >= GUEST_ADDRESS_SPACE - next)
+    {
+      return false;
+    }
+  }
+  while(!__atomic_compare_exchange_n(&mem->next_alloc, &next, (unsigned int)(next + length), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  *address = next;
+  return true;
+}
+
+unsigned int arm_memory_alloc(struct arm_memory* mem, unsigned int size)
+{
+  unsigned int address;
+
+  if(!arm_memory_reserve(mem, size, &address))
+  {
+    printf("Guest address space exhausted allocating 0x%x bytes, exiting.\n", size);
+    exit(-1);
+  }
+  arm_memory_map(mem, address, size);
+
+  return address;
+}
+
+/*
+ * Sets aside size bytes of address space for the brk heap, unmapped until
+ * the break moves up into it. The break starts at its bottom.
+ */
+void arm_memory_reserve_heap(struct arm_memory* mem, unsigned int size)
+{
+  unsigned int address;
+
+  if(!arm_memory_reserve(mem, size, &address))
+  {
+    printf("Guest address space exhausted reserving a 0x%x byte heap, exiting.\n", size);
+    exit(-1);
+  }
+  mem->brk = address;
+  mem->brk_start = address;
+  mem->brk_limit = address + size;
+}
+
+void arm_memory_write(struct arm_memory* mem, unsigned int address, const void* src, size_t size)
+{
+  memcpy(mem->base + address, src, size);
+}
+
+void arm_memory_read(struct arm_memory* mem, unsigned int address, void* dst, size_t size)
+{
+  memcpy(dst, mem->base + address, size);
+}
+
+void guest_fault_enter(struct guest_fault* fault, const struct arm_memory* mem)
+{
+  fault->mem = mem;
+  fault->kind = GUEST_FAULT_NONE;
+  fault->address = 0;
+  active_fault = fault;
+}
+
+void guest_fault_leave(void)
+{
+  active_fault = NULL;
+}
+
+_Noreturn void guest_fault_raise(int kind, unsigned int address)
+{
+  struct guest_fault* fault = active_fault;
+
+  if(fault == NULL)
+  {
+    printf("Guest fault %d at 0x%x outside arm_state_execute, exiting.\n", kind, address);
+    exit(-1);
+  }
+
+  active_fault = NULL;
+  fault->kind = kind;
+  fault->address = address;
+  siglongjmp(fault->env, 1);
+}
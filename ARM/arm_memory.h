@@ -0,0 +1,65 @@
+#ifndef ARM_MEMORY_H
+#define ARM_MEMORY_H
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define GUEST_PAGE_SIZE  4096
+#define GUEST_ADDRESS_SPACE  (1ULL << 32)
+#define GUEST_GUARD_SIZE  (64 * 1024)
+#define GUEST_ALLOC_BASE  0x10000000
+
+#define GUEST_PAGE_DOWN(a)  ((a) & ~(uint64_t)(GUEST_PAGE_SIZE - 1))
+#define GUEST_PAGE_UP(a)  GUEST_PAGE_DOWN((uint64_t)(a) + GUEST_PAGE_SIZE - 1)
+
+enum guest_fault_kind
+{
+  GUEST_FAULT_NONE = 0,
+  GUEST_FAULT_ACCESS,
+  GUEST_FAULT_UNDEFINED,
+  GUEST_FAULT_TRANSLATION,
+  GUEST_FAULT_DOMAIN,
+  GUEST_FAULT_PERMISSION
+};
+
+/*
+ * The whole 32-bit guest address space is one reserved host mapping, so a
+ * guest address becomes a host pointer by adding base. Nothing is readable
+ * until it is mapped; touching anything else raises SIGSEGV, which is turned
+ * into a guest fault for the thread that entered the memory.
+ */
+struct arm_memory
+{
+  unsigned char* base;
+  unsigned int next_alloc;
+  unsigned int brk;
+  unsigned int brk_start;
+  unsigned int brk_limit;
+  unsigned int id;
+};
+
+struct guest_fault
+{
+  sigjmp_buf env;
+  const struct arm_memory* mem;
+  int kind;
+  unsigned int address;
+};
+
+struct arm_memory* new_arm_memory(void);
+void free_arm_memory(struct arm_memory* mem);
+void arm_memory_map(struct arm_memory* mem, unsigned int address, unsigned int size);
+int arm_memory_prot(bool read, bool write, bool exec);
+bool arm_memory_reserve(struct arm_memory* mem, uint64_t size, unsigned int* address);
+unsigned int arm_memory_alloc(struct arm_memory* mem, unsigned int size);
+void arm_memory_reserve_heap(struct arm_memory* mem, unsigned int size);
+void arm_memory_write(struct arm_memory* mem, unsigned int address, const void* src, size_t size);
+void arm_memory_read(struct arm_memory* mem, unsigned int address, void* dst, size_t size);
+
+void guest_fault_enter(struct guest_fault* fault, const struct arm_memory* mem);
+void guest_fault_leave(void);
+_Noreturn void guest_fault_raise(int kind, unsigned int address);
+
+#endif
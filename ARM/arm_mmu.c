@@ -0,0 +1,281 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arm_mmu.h"
+
+#define PERMIT(kind)  (1u << (kind))
+#define PERMIT_ALL  (PERMIT(MMU_READ) | PERMIT(MMU_WRITE) | PERMIT(MMU_FETCH))
+
+/* Reported by MIDR: an ARM Cortex-A7. */
+#define MMU_MIDR  0x410FC075
+
+struct arm_mmu* new_arm_mmu(struct arm_memory* mem)
+{
+  struct arm_mmu* mmu;
+
+  mmu = (struct arm_mmu*)calloc(1, sizeof(struct arm_mmu));
+  if(mmu == NULL)
+  {
+    printf("Unable to allocate memory failed, exiting.\n");
+    exit(-1);
+  }
+
+  mmu->mem = mem;
+  arm_mmu_flush(mmu);
+  mmu->flushes = 0;
+
+  return mmu;
+}
+
+void free_arm_mmu(struct arm_mmu* mmu)
+{
+  free(mmu);
+}
+
+void arm_mmu_flush(struct arm_mmu* mmu)
+{
+  for(unsigned int i = 0; i < ARM_TLB_SIZE; i++)
+  {
+    for(unsigned int kind = 0; kind < MMU_ACCESS_KINDS; kind++)
+    {
+      mmu->tlb[i].tag[kind] = ARM_TLB_INVALID;
+    }
+  }
+  mmu->flushes++;
+}
+
+static unsigned int read_physical(const struct arm_mmu* mmu, unsigned int address)
+{
+  return *((const unsigned int *)(mmu->mem->base + address));
+}
+
+/* PL1 permissions from AP[2] and AP[1:0], with the access flag disabled. */
+static unsigned int access_permissions(unsigned int ap2, unsigned int ap, unsigned int xn)
+{
+  unsigned int perms;
+
+  if(ap == 0)
+  {
+    return 0;
+  }
+  perms = ap2 ? PERMIT(MMU_READ) : PERMIT(MMU_READ) | PERMIT(MMU_WRITE);
+  if(!xn)
+  {
+    perms |= PERMIT(MMU_FETCH);
+  }
+  return perms;
+}
+
+/*
+ * Walks the short-descriptor tables for the page holding address. Sections,
+ * supersections, large and small pages are supported; TTBCR.N splits the
+ * address space between TTBR0 and TTBR1.
+ */
+static int walk(struct arm_mmu* mmu, unsigned int address, unsigned int* physical, unsigned int* perms)
+{
+  unsigned int n = mmu->ttbcr & 0x7;
+  unsigned int l1_address;
+  unsigned int l1;
+  unsigned int l2;
+  unsigned int domain;
+  unsigned int access;
+  unsigned int ap;
+  unsigned int ap2;
+  unsigned int xn;
+
+  if(n == 0 || (address >> (32 - n)) == 0)
+  {
+    l1_address = (mmu->ttbr0 & (0xFFFFFFFFu << (14 - n))) | (((address >> 20) & (0xFFFu >> n)) << 2);
+  }
+  else
+  {
+    l1_address = (mmu->ttbr1 & 0xFFFFC000) | ((address >> 20) << 2);
+  }
+  l1 = read_physical(mmu, l1_address);
+  domain = (l1 >> 5) & 0xF;
+
+  switch(l1 & 0x3)
+  {
+    case 1:
+      l2 = read_physical(mmu, (l1 & 0xFFFFFC00) | (((address >> 12) & 0xFF) << 2));
+      if((l2 & 0x3) == 0)
+      {
+        mmu->fault = GUEST_FAULT_TRANSLATION;
+        return 0;
+      }
+      if(l2 & 0x2)
+      {
+        *physical = l2 & 0xFFFFF000;
+        xn = l2 & 0b1;
+      }
+      else
+      {
+        *physical = (l2 & 0xFFFF0000) | (address & 0xF000);
+        xn = (l2 >> 15) & 0b1;
+      }
+      ap = (l2 >> 4) & 0x3;
+      ap2 = (l2 >> 9) & 0b1;
+      break;
+
+    case 2:
+      if((l1 >> 18) & 0b1)
+      {
+        *physical = (l1 & 0xFF000000) | (address & 0x00FFF000);
+        domain = 0;
+      }
+      else
+      {
+        *physical = (l1 & 0xFFF00000) | (address & 0x000FF000);
+      }
+      ap = (l1 >> 10) & 0x3;
+      ap2 = (l1 >> 15) & 0b1;
+      xn = (l1 >> 4) & 0b1;
+      break;
+
+    default:
+      mmu->fault = GUEST_FAULT_TRANSLATION;
+      return 0;
+  }
+
+  access = (mmu->dacr >> (domain * 2)) & 0x3;
+  if(access == 0 || access == 2)
+  {
+    mmu->fault = GUEST_FAULT_DOMAIN;
+    return 0;
+  }
+  *perms = access == 3 ? PERMIT_ALL : access_permissions(ap2, ap, xn);
+  return 1;
+}
+
+/*
+ * Translates address and refills its TLB entry, or returns NULL with the
+ * fault kind in mmu->fault. With SCTLR.M clear addresses are physical.
+ */
+unsigned char* arm_mmu_lookup(struct arm_mmu* mmu, unsigned int address, unsigned int kind)
+{
+  unsigned int page = address & ~(GUEST_PAGE_SIZE - 1);
+  struct arm_tlb_entry* entry = &mmu->tlb[(address / GUEST_PAGE_SIZE) % ARM_TLB_SIZE];
+  unsigned int physical = page;
+  unsigned int perms = PERMIT_ALL;
+
+  if((mmu->sctlr & SCTLR_M) && !walk(mmu, address, &physical, &perms))
+  {
+    return NULL;
+  }
+  if(!(perms & PERMIT(kind)))
+  {
+    mmu->fault = GUEST_FAULT_PERMISSION;
+    return NULL;
+  }
+
+  for(unsigned int k = 0; k < MMU_ACCESS_KINDS; k++)
+  {
+    entry->tag[k] = (perms & PERMIT(k)) ? page : ARM_TLB_INVALID;
+  }
+  entry->addend = (uintptr_t)(mmu->mem->base + physical) - page;
+
+  return (unsigned char*)(entry->addend + address);
+}
+
+unsigned char* arm_mmu_fill(struct arm_mmu* mmu, unsigned int address, unsigned int kind)
+{
+  unsigned char* host = arm_mmu_lookup(mmu, address, kind);
+
+  if(host == NULL)
+  {
+    guest_fault_raise(mmu->fault, address);
+  }
+  return host;
+}
+
+/* Both pages are translated before a byte moves, so a fault on the second leaves the first untouched. */
+unsigned int arm_mmu_read_split(struct arm_mmu* mmu, unsigned int address, unsigned int size)
+{
+  unsigned int first = GUEST_PAGE_SIZE - (address & (GUEST_PAGE_SIZE - 1));
+  unsigned char* low = arm_mmu_translate(mmu, address, MMU_READ);
+  unsigned char* high = arm_mmu_translate(mmu, address + first, MMU_READ);
+  unsigned int value = 0;
+
+  memcpy(&value, low, first);
+  memcpy((unsigned char*)&value + first, high, size - first);
+  return value;
+}
+
+void arm_mmu_write_split(struct arm_mmu* mmu, unsigned int address, unsigned int value, unsigned int size)
+{
+  unsigned int first = GUEST_PAGE_SIZE - (address & (GUEST_PAGE_SIZE - 1));
+  unsigned char* low = arm_mmu_translate(mmu, address, MMU_WRITE);
+  unsigned char* high = arm_mmu_translate(mmu, address + first, MMU_WRITE);
+
+  memcpy(low, &value, first);
+  memcpy(high, (unsigned char*)&value + first, size - first);
+}
+
+int arm_mmu_read_cp15(struct arm_mmu* mmu, unsigned int reg, unsigned int* value)
+{
+  switch(reg)
+  {
+    case CP15_MIDR:
+      *value = MMU_MIDR;
+      return 1;
+    case CP15_SCTLR:
+      *value = mmu->sctlr;
+      return 1;
+    case CP15_TTBR0:
+      *value = mmu->ttbr0;
+      return 1;
+    case CP15_TTBR1:
+      *value = mmu->ttbr1;
+      return 1;
+    case CP15_TTBCR:
+      *value = mmu->ttbcr;
+      return 1;
+    case CP15_DACR:
+      *value = mmu->dacr;
+      return 1;
+    case CP15_CONTEXTIDR:
+      *value = mmu->contextidr;
+      return 1;
+  }
+  return 0;
+}
+
+/*
+ * Entries are not tagged with an ASID, so any change to the tables, the
+ * domains or the ASID flushes the TLB, as do all TLB maintenance
+ * operations (c8).
+ */
+int arm_mmu_write_cp15(struct arm_mmu* mmu, unsigned int reg, unsigned int value)
+{
+  switch(reg)
+  {
+    case CP15_SCTLR:
+      mmu->sctlr = value;
+      break;
+    case CP15_TTBR0:
+      mmu->ttbr0 = value;
+      break;
+    case CP15_TTBR1:
+      mmu->ttbr1 = value;
+      break;
+    case CP15_TTBCR:
+      mmu->ttbcr = value;
+      break;
+    case CP15_DACR:
+      mmu->dacr = value;
+      break;
+    case CP15_CONTEXTIDR:
+      mmu->contextidr = value;
+      break;
+    default:
+      if((reg >> 12) != 8)
+      {
+        return 0;
+      }
+      break;
+  }
+  arm_mmu_flush(mmu);
+  return 1;
+}
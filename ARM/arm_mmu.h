@@ -0,0 +1,120 @@
+#ifndef ARM_MMU_H
+#define ARM_MMU_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "arm_memory.h"
+
+#define ARM_TLB_SIZE  256
+#define ARM_TLB_INVALID  1
+
+#define CP15(crn, opc1, crm, opc2)  (((crn) << 12) | ((opc1) << 8) | ((crm) << 4) | (opc2))
+#define CP15_MIDR  CP15(0, 0, 0, 0)
+#define CP15_SCTLR  CP15(1, 0, 0, 0)
+#define CP15_TTBR0  CP15(2, 0, 0, 0)
+#define CP15_TTBR1  CP15(2, 0, 0, 1)
+#define CP15_TTBCR  CP15(2, 0, 0, 2)
+#define CP15_DACR  CP15(3, 0, 0, 0)
+#define CP15_CONTEXTIDR  CP15(13, 0, 0, 1)
+
+#define SCTLR_M  0x1
+
+enum mmu_access
+{
+  MMU_READ = 0,
+  MMU_WRITE,
+  MMU_FETCH,
+  MMU_ACCESS_KINDS
+};
+
+/*
+ * One direct-mapped entry per virtual page number modulo ARM_TLB_SIZE.
+ * tag[kind] is the virtual page when that kind of access is allowed and
+ * ARM_TLB_INVALID otherwise; addend turns the virtual address into a host
+ * pointer.
+ */
+struct arm_tlb_entry
+{
+  unsigned int tag[MMU_ACCESS_KINDS];
+  uintptr_t addend;
+};
+
+/*
+ * An ARMv7 short-descriptor MMU over the guest's flat memory, which it
+ * treats as physical. The core has no exception model, so every access is
+ * checked with PL1 permissions and a translation, domain or permission
+ * fault stops the run like any other guest fault.
+ */
+struct arm_mmu
+{
+  struct arm_memory* mem;
+  unsigned int sctlr;
+  unsigned int ttbr0;
+  unsigned int ttbr1;
+  unsigned int ttbcr;
+  unsigned int dacr;
+  unsigned int contextidr;
+  unsigned int fault;
+  unsigned int flushes;
+  struct arm_tlb_entry tlb[ARM_TLB_SIZE];
+};
+
+struct arm_mmu* new_arm_mmu(struct arm_memory* mem);
+void free_arm_mmu(struct arm_mmu* mmu);
+void arm_mmu_flush(struct arm_mmu* mmu);
+unsigned char* arm_mmu_lookup(struct arm_mmu* mmu, unsigned int address, unsigned int kind);
+unsigned char* arm_mmu_fill(struct arm_mmu* mmu, unsigned int address, unsigned int kind);
+unsigned int arm_mmu_read_split(struct arm_mmu* mmu, unsigned int address, unsigned int size);
+void arm_mmu_write_split(struct arm_mmu* mmu, unsigned int address, unsigned int value, unsigned int size);
+int arm_mmu_read_cp15(struct arm_mmu* mmu, unsigned int reg, unsigned int* value);
+int arm_mmu_write_cp15(struct arm_mmu* mmu, unsigned int reg, unsigned int value);
+
+/* The hit path: one compare and one add. */
+static inline unsigned char* arm_mmu_translate(struct arm_mmu* mmu, unsigned int address, unsigned int kind)
+{
+  struct arm_tlb_entry* entry = &mmu->tlb[(address / GUEST_PAGE_SIZE) % ARM_TLB_SIZE];
+
+  if(entry->tag[kind] == (address & ~(GUEST_PAGE_SIZE - 1)))
+  {
+    return (unsigned char*)(entry->addend + address);
+  }
+  return arm_mmu_fill(mmu, address, kind);
+}
+
+/* A guest access by a core; with an MMU attached the address is virtual and goes through its TLB. */
+#define GUEST_ACCESS(arm_s, address, kind)  \
+  ((arm_s)->mmu == NULL ? (arm_s)->mem_base + (unsigned int)(address) : arm_mmu_translate((arm_s)->mmu, (unsigned int)(address), (kind)))
+
+/* Word and halfword accesses can be unaligned, and one that runs into the next page has that page translated too. */
+static inline unsigned int arm_mmu_read(struct arm_mmu* mmu, unsigned int address, unsigned int size)
+{
+  unsigned int value = 0;
+
+  if((address & (GUEST_PAGE_SIZE - 1)) + size > GUEST_PAGE_SIZE)
+  {
+    return arm_mmu_read_split(mmu, address, size);
+  }
+  memcpy(&value, arm_mmu_translate(mmu, address, MMU_READ), size);
+  return value;
+}
+
+static inline void arm_mmu_write(struct arm_mmu* mmu, unsigned int address, unsigned int value, unsigned int size)
+{
+  if((address & (GUEST_PAGE_SIZE - 1)) + size > GUEST_PAGE_SIZE)
+  {
+    arm_mmu_write_split(mmu, address, value, size);
+    return;
+  }
+  memcpy(arm_mmu_translate(mmu, address, MMU_WRITE), &value, size);
+}
+
+#define GUEST_READ(arm_s, type, address)  \
+  ((arm_s)->mmu == NULL ? *((type *)((arm_s)->mem_base + (unsigned int)(address))) :  \
+   (type) arm_mmu_read((arm_s)->mmu, (unsigned int)(address), sizeof(type)))
+
+#define GUEST_WRITE(arm_s, type, address, value)  \
+  ((arm_s)->mmu == NULL ? (void)(*((type *)((arm_s)->mem_base + (unsigned int)(address))) = (type)(value)) :  \
+   arm_mmu_write((arm_s)->mmu, (unsigned int)(address), (type)(value), sizeof(type)))
+
+#endif
@@ -0,0 +1,456 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arm_vm.h"
+#include "arm_profile.h"
+#include "arm_mmu.h"
+#include "arm_thumb.h"
+
+static const char* const class_names[ARM_CLASS_COUNT] =
+{
+  [ARM_CLASS_UNDEFINED] = "undefined",
+  [ARM_CLASS_DATA_PROCESSING] = "data_processing",
+  [ARM_CLASS_MRS] = "mrs",
+  [ARM_CLASS_MSR] = "msr",
+  [ARM_CLASS_BX] = "bx",
+  [ARM_CLASS_BRANCH] = "branch",
+  [ARM_CLASS_DATA_TRANSFER] = "data_transfer",
+  [ARM_CLASS_PUSH] = "push",
+  [ARM_CLASS_POP] = "pop",
+  [ARM_CLASS_MULTIPLY] = "multiply",
+  [ARM_CLASS_MOVE_WIDE] = "move_wide",
+  [ARM_CLASS_SVC] = "svc",
+  [ARM_CLASS_EXCLUSIVE] = "exclusive",
+  [ARM_CLASS_UNCONDITIONAL] = "unconditional",
+  [ARM_CLASS_COPROCESSOR] = "coprocessor",
+  [ARM_CLASS_HALFWORD_TRANSFER] = "halfword_transfer",
+  [ARM_CLASS_EXTEND] = "extend",
+  [ARM_CLASS_COPROCESSOR_TRANSFER] = "coprocessor_transfer",
+};
+
+static void table_init(struct profile_table* table, unsigned int size)
+{
+  table->entries = (struct profile_entry*)calloc(size, sizeof(struct profile_entry));
+  if(table->entries == NULL)
+  {
+    printf("Unable to allocate memory failed, exiting.\n");
+    exit(-1);
+  }
+  table->size = size;
+  table->used = 0;
+}
+
+static unsigned int table_hash(unsigned int key)
+{
+  key ^= key >> 16;
+  key *= 0x45D9F3B;
+  key ^= key >> 16;
+  return key;
+}
+
+static struct profile_entry* table_slot(struct profile_table* table, unsigned int key)
+{
+  unsigned int i = table_hash(key) & (table->size - 1);
+
+  while(table->entries[i].used && table->entries[i].key != key)
+  {
+    i = (i + 1) & (table->size - 1);
+  }
+  return &table->entries[i];
+}
+
+static struct profile_entry* table_lookup(struct profile_table* table, unsigned int key)
+{
+  struct profile_entry* entry = table_slot(table, key);
+
+  if(entry->used)
+  {
+    return entry;
+  }
+
+  if(2 * (table->used + 1) > table->size)
+  {
+    struct profile_entry* old = table->entries;
+    unsigned int old_size = table->size;
+
+    table_init(table, 2 * old_size);
+    for(unsigned int i = 0; i < old_size; i++)
+    {
+      if(old[i].used)
+      {
+        *table_slot(table, old[i].key) = old[i];
+        table->used++;
+      }
+    }
+    free(old);
+    entry = table_slot(table, key);
+  }
+
+  entry->key = key;
+  entry->used = 1;
+  table->used++;
+  return entry;
+}
+
+struct arm_profile* new_arm_profile(void)
+{
+  struct arm_profile* prof;
+
+  prof = (struct arm_profile*)calloc(1, sizeof(struct arm_profile));
+  if(prof == NULL)
+  {
+    printf("Unable to allocate memory failed, exiting.\n");
+    exit(-1);
+  }
+
+  table_init(&prof->pcs, PROFILE_INITIAL_SIZE);
+  table_init(&prof->pages, PROFILE_INITIAL_SIZE);
+
+  return prof;
+}
+
+void free_arm_profile(struct arm_profile* prof)
+{
+  free(prof->pcs.entries);
+  free(prof->pages.entries);
+  free(prof);
+}
+
+static void note_access(struct arm_profile* prof, unsigned int address, unsigned int load)
+{
+  struct profile_entry* entry = table_lookup(&prof->pages, address >> PROFILE_PAGE_BITS);
+  entry->count[load ? PROFILE_LOADS : PROFILE_STORES]++;
+}
+
+static unsigned int profile_reg(const struct arm_state* arm_s, unsigned int r)
+{
+  return arm_s->regs[r] + (r == PC) * 8;
+}
+
+/* The same offset execute_data_transfer_instruction computes, without side effects. */
+static unsigned int transfer_offset(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int rm;
+  unsigned int amount = (iw >> 7) & 0x1F;
+
+  if(((iw >> 25) & 0b1) == 0)
+  {
+    return iw & 0xFFF;
+  }
+
+  rm = profile_reg(arm_s, iw & 0xF);
+  switch((iw >> 5) & 0x3)
+  {
+    case 0:
+      return rm << amount;
+
+    case 1:
+      return amount ? rm >> amount : 0;
+
+    case 2:
+      return (unsigned int)((int)rm >> (amount ? amount : 31));
+  }
+  if(amount == 0)
+  {
+    return (rm >> 1) | ((arm_cpsr(arm_s) & CPSR_C) << 2);
+  }
+  return (rm >> amount) | (rm << (32 - amount));
+}
+
+/* Records the addresses an instruction is about to load from or store to. */
+static void note_memory(struct arm_state* arm_s, struct arm_profile* prof, unsigned int cls, unsigned int iw)
+{
+  unsigned int base = profile_reg(arm_s, (iw >> 16) & 0xF);
+  unsigned int p_bit = (iw >> 24) & 0b1;
+  unsigned int u_bit = (iw >> 23) & 0b1;
+  unsigned int load = (iw >> 20) & 0b1;
+
+  if(cls == ARM_CLASS_DATA_TRANSFER)
+  {
+    unsigned int offset = transfer_offset(arm_s, iw);
+
+    if(p_bit)
+    {
+      base = u_bit ? base + offset : base - offset;
+    }
+    note_access(prof, base, load);
+  }
+  else if(cls == ARM_CLASS_HALFWORD_TRANSFER)
+  {
+    unsigned int offset = ((iw >> 22) & 0b1) ? ((iw >> 4) & 0xF0) | (iw & 0xF) : profile_reg(arm_s, iw & 0xF);
+    unsigned int op = ((iw >> 4) & 0x6) | load;
+
+    if(p_bit)
+    {
+      base = u_bit ? base + offset : base - offset;
+    }
+    /* LDRD and STRD both have L clear. */
+    note_access(prof, base, op != 0x2 && op != 0x6);
+    if(op == 0x4 || op == 0x6)
+    {
+      note_access(prof, base + 4, op == 0x4);
+    }
+  }
+  else if(cls == ARM_CLASS_EXCLUSIVE)
+  {
+    note_access(prof, base, load);
+  }
+  else if(cls == ARM_CLASS_COPROCESSOR_TRANSFER && (p_bit || u_bit || ((iw >> 21) & 0b1)))
+  {
+    unsigned int offset = (iw & 0xFF) * 4;
+    unsigned int words = (((iw >> 8) & 0b1) ? offset & ~7u : offset) / 4;
+
+    if(((iw >> 16) & 0xF) == PC)
+    {
+      base &= ~3u;
+    }
+    if(p_bit && ((iw >> 21) & 0b1) == 0)
+    {
+      base = u_bit ? base + offset : base - offset;
+      words = ((iw >> 8) & 0b1) ? 2 : 1;
+    }
+    else if(!u_bit)
+    {
+      base -= offset;
+    }
+    for(unsigned int i = 0; i < words; i++)
+    {
+      note_access(prof, base + i * 4, load);
+    }
+  }
+  else if(cls == ARM_CLASS_PUSH || cls == ARM_CLASS_POP)
+  {
+    unsigned int count = __builtin_popcount(iw & 0xFFFF);
+    unsigned int start = u_bit ? base + p_bit * 4 : base - count * 4 + !p_bit * 4;
+
+    for(unsigned int i = 0; i < count; i++)
+    {
+      note_access(prof, start + i * 4, load);
+    }
+  }
+}
+
+/*
+ * Branch-class instructions count as taken when they leave PC anywhere but
+ * the next instruction, so a failed condition is not-taken.
+ */
+static void profile_step(struct arm_state* arm_s, struct arm_profile* prof)
+{
+  unsigned int pc = arm_s->regs[PC];
+  unsigned int iw = *((unsigned int *)(arm_s->mmu != NULL ? arm_mmu_translate(arm_s->mmu, pc, MMU_FETCH) : arm_s->mem_base + pc));
+  unsigned int cls = ARM_CLASSIFY(iw);
+  struct profile_entry* entry = table_lookup(&prof->pcs, pc);
+
+  entry->count[PROFILE_EXECUTED]++;
+  prof->classes[cls]++;
+  prof->instructions++;
+
+  if((iw >> 28) == COND_AL || check_cpsr_flags(arm_s, iw))
+  {
+    note_memory(arm_s, prof, cls, iw);
+  }
+  arm_state_first_execute(arm_s);
+
+  if(arm_class_counter[cls] == ARM_COUNT_BR)
+  {
+    entry->count[arm_s->regs[PC] == pc + 4 ? PROFILE_NOT_TAKEN : PROFILE_TAKEN]++;
+  }
+}
+
+void arm_profile_step(struct arm_state* arm_s)
+{
+  if(arm_s->cpsr & CPSR_T)
+  {
+    arm_thumb_step(arm_s);
+  }
+  else
+  {
+    profile_step(arm_s, arm_s->profile);
+  }
+}
+
+void arm_profile_run(struct arm_state* arm_s)
+{
+  while(arm_s->regs[PC] != 0)
+  {
+    arm_profile_step(arm_s);
+  }
+}
+
+static int compare_entries(const void* a, const void* b)
+{
+  unsigned int ka = ((const struct profile_entry*)a)->key;
+  unsigned int kb = ((const struct profile_entry*)b)->key;
+  return (ka > kb) - (ka < kb);
+}
+
+/* The used entries of a table in address order; the caller frees them. */
+static struct profile_entry* sorted_entries(const struct profile_table* table)
+{
+  struct profile_entry* sorted;
+  unsigned int n = 0;
+
+  sorted = (struct profile_entry*)malloc((table->used + 1) * sizeof(struct profile_entry));
+  if(sorted == NULL)
+  {
+    printf("Unable to allocate memory failed, exiting.\n");
+    exit(-1);
+  }
+  for(unsigned int i = 0; i < table->size; i++)
+  {
+    if(table->entries[i].used)
+    {
+      sorted[n++] = table->entries[i];
+    }
+  }
+  qsort(sorted, n, sizeof(struct profile_entry), compare_entries);
+  return sorted;
+}
+
+void arm_profile_write_json(const struct arm_profile* prof, FILE* out)
+{
+  struct profile_entry* pcs = sorted_entries(&prof->pcs);
+  struct profile_entry* pages = sorted_entries(&prof->pages);
+
+  fprintf(out, "{\n  \"instructions\": %llu,\n  \"classes\": {", prof->instructions);
+  for(int i = 0; i < ARM_CLASS_COUNT; i++)
+  {
+    fprintf(out, "%s\n    \"%s\": %llu", i ? "," : "", class_names[i], prof->classes[i]);
+  }
+
+  fprintf(out, "\n  },\n  \"pcs\": [");
+  for(unsigned int i = 0; i < prof->pcs.used; i++)
+  {
+    fprintf(out, "%s\n    {\"pc\": \"0x%08x\", \"count\": %llu, \"taken\": %llu, \"not_taken\": %llu}", i ? "," : "",
+            pcs[i].key, pcs[i].count[PROFILE_EXECUTED], pcs[i].count[PROFILE_TAKEN], pcs[i].count[PROFILE_NOT_TAKEN]);
+  }
+
+  fprintf(out, "\n  ],\n  \"pages\": [");
+  for(unsigned int i = 0; i < prof->pages.used; i++)
+  {
+    fprintf(out, "%s\n    {\"page\": \"0x%08x\", \"loads\": %llu, \"stores\": %llu}", i ? "," : "",
+            pages[i].key << PROFILE_PAGE_BITS, pages[i].count[PROFILE_LOADS], pages[i].count[PROFILE_STORES]);
+  }
+  fprintf(out, "\n  ]\n}\n");
+
+  free(pcs);
+  free(pages);
+}
+
+/* Just enough protobuf encoding for an uncompressed pprof profile.proto. */
+struct pb
+{
+  unsigned char* data;
+  size_t len;
+  size_t cap;
+};
+
+static void pb_bytes(struct pb* b, const void* src, size_t size)
+{
+  if(b->len + size > b->cap)
+  {
+    b->cap = 2 * (b->len + size) + 64;
+    b->data = (unsigned char*)realloc(b->data, b->cap);
+    if(b->data == NULL)
+    {
+      printf("Unable to allocate memory failed, exiting.\n");
+      exit(-1);
+    }
+  }
+  memcpy(b->data + b->len, src, size);
+  b->len += size;
+}
+
+static void pb_varint(struct pb* b, unsigned long long value)
+{
+  unsigned char byte;
+
+  while(value >= 0x80)
+  {
+    byte = (unsigned char)(value | 0x80);
+    pb_bytes(b, &byte, 1);
+    value >>= 7;
+  }
+  byte = (unsigned char)value;
+  pb_bytes(b, &byte, 1);
+}
+
+static void pb_uint(struct pb* b, unsigned int field, unsigned long long value)
+{
+  pb_varint(b, field << 3);
+  pb_varint(b, value);
+}
+
+static void pb_message(struct pb* b, unsigned int field, const void* src, size_t size)
+{
+  pb_varint(b, (field << 3) | 2);
+  pb_varint(b, size);
+  pb_bytes(b, src, size);
+}
+
+static void pb_submessage(struct pb* b, unsigned int field, struct pb* sub)
+{
+  pb_message(b, field, sub->data, sub->len);
+  sub->len = 0;
+}
+
+/*
+ * One location per guest PC, addressed but unsymbolized, and one sample per
+ * location carrying its executed, taken and not-taken counts.
+ */
+void arm_profile_write_pprof(const struct arm_profile* prof, FILE* out)
+{
+  static const char* const strings[] = {"", "executed", "taken", "not_taken", "count", "guest"};
+  struct profile_entry* pcs = sorted_entries(&prof->pcs);
+  struct pb profile = {0};
+  struct pb sub = {0};
+  struct pb packed = {0};
+
+  for(unsigned int i = 1; i <= 3; i++)
+  {
+    pb_uint(&sub, 1, i);
+    pb_uint(&sub, 2, 4);
+    pb_submessage(&profile, 1, &sub);
+  }
+
+  for(unsigned int i = 0; i < prof->pcs.used; i++)
+  {
+    pb_varint(&packed, i + 1);
+    pb_submessage(&sub, 1, &packed);
+    pb_varint(&packed, pcs[i].count[PROFILE_EXECUTED]);
+    pb_varint(&packed, pcs[i].count[PROFILE_TAKEN]);
+    pb_varint(&packed, pcs[i].count[PROFILE_NOT_TAKEN]);
+    pb_submessage(&sub, 2, &packed);
+    pb_submessage(&profile, 2, &sub);
+  }
+
+  pb_uint(&sub, 1, 1);
+  pb_uint(&sub, 3, 0xFFFFFFFF);
+  pb_uint(&sub, 5, 5);
+  pb_submessage(&profile, 3, &sub);
+
+  for(unsigned int i = 0; i < prof->pcs.used; i++)
+  {
+    pb_uint(&sub, 1, i + 1);
+    pb_uint(&sub, 2, 1);
+    pb_uint(&sub, 3, pcs[i].key);
+    pb_submessage(&profile, 4, &sub);
+  }
+
+  for(unsigned int i = 0; i < sizeof(strings) / sizeof(strings[0]); i++)
+  {
+    pb_message(&profile, 6, strings[i], strlen(strings[i]));
+  }
+  /* default_sample_type, or pprof shows the last one, not_taken. */
+  pb_uint(&profile, 14, 1);
+
+  fwrite(profile.data, 1, profile.len, out);
+
+  free(profile.data);
+  free(sub.data);
+  free(packed.data);
+  free(pcs);
+}
@@ -0,0 +1,57 @@
+#ifndef ARM_PROFILE_H
+#define ARM_PROFILE_H
+
+#include <stdio.h>
+
+#include "arm_decode.h"
+
+struct arm_state;
+
+#define PROFILE_INITIAL_SIZE  1024
+#define PROFILE_PAGE_BITS  12
+
+/* Per-PC entries count executions, taken and not-taken; per-page entries loads and stores. */
+#define PROFILE_EXECUTED  0
+#define PROFILE_TAKEN  1
+#define PROFILE_NOT_TAKEN  2
+#define PROFILE_LOADS  0
+#define PROFILE_STORES  1
+
+struct profile_entry
+{
+  unsigned int key;
+  unsigned int used;
+  unsigned long long count[3];
+};
+
+/* Open addressing on the guest address, doubled when half full. */
+struct profile_table
+{
+  struct profile_entry* entries;
+  unsigned int size;
+  unsigned int used;
+};
+
+/*
+ * A profiled run steps the interpreter one instruction at a time and
+ * records every PC, every instruction class and the page of every guest
+ * load and store of ARM code; Thumb code runs but is not recorded. Nothing
+ * is recorded unless a profile is attached, and the unprofiled paths do not
+ * look at it.
+ */
+struct arm_profile
+{
+  struct profile_table pcs;
+  struct profile_table pages;
+  unsigned long long classes[ARM_CLASS_COUNT];
+  unsigned long long instructions;
+};
+
+struct arm_profile* new_arm_profile(void);
+void free_arm_profile(struct arm_profile* prof);
+void arm_profile_step(struct arm_state* arm_s);
+void arm_profile_run(struct arm_state* arm_s);
+void arm_profile_write_json(const struct arm_profile* prof, FILE* out);
+void arm_profile_write_pprof(const struct arm_profile* prof, FILE* out);
+
+#endif
@@ -0,0 +1,72 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arm_vm.h"
+#include "arm_smp.h"
+
+/* Every core starts at func with its core number in r0. */
+struct arm_smp* new_arm_smp(struct arm_memory* mem, unsigned int num_cores, unsigned int func, unsigned int arg1, unsigned int arg2, unsigned int arg3)
+{
+  struct arm_smp* smp;
+
+  if(num_cores == 0 || num_cores > SMP_MAX_CORES)
+  {
+    printf("Unsupported number of cores %u, exiting.\n", num_cores);
+    exit(-1);
+  }
+
+  smp = (struct arm_smp*)malloc(sizeof(struct arm_smp));
+  if(smp == NULL)
+  {
+    printf("Unable to allocate memory failed, exiting.\n");
+    exit(-1);
+  }
+
+  smp->mem = mem;
+  smp->num_cores = num_cores;
+  for(unsigned int i = 0; i < num_cores; i++)
+  {
+    smp->cores[i] = new_arm_state(mem, func, i, arg1, arg2, arg3);
+  }
+
+  return smp;
+}
+
+void free_arm_smp(struct arm_smp* smp)
+{
+  for(unsigned int i = 0; i < smp->num_cores; i++)
+  {
+    free_arm_state(smp->cores[i]);
+  }
+  free(smp);
+}
+
+static void* core_thread(void* arg)
+{
+  arm_state_execute((struct arm_state*)arg);
+  return NULL;
+}
+
+/* Returns once every core has returned to address 0 or faulted. */
+void arm_smp_run(struct arm_smp* smp)
+{
+  pthread_t threads[SMP_MAX_CORES];
+
+  for(unsigned int i = 1; i < smp->num_cores; i++)
+  {
+    if(pthread_create(&threads[i], NULL, core_thread, smp->cores[i]) != 0)
+    {
+      printf("Unable to start core %u, exiting.\n", i);
+      exit(-1);
+    }
+  }
+
+  arm_state_execute(smp->cores[0]);
+
+  for(unsigned int i = 1; i < smp->num_cores; i++)
+  {
+    pthread_join(threads[i], NULL);
+  }
+}
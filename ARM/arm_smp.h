@@ -0,0 +1,26 @@
+#ifndef ARM_SMP_H
+#define ARM_SMP_H
+
+#include "arm_memory.h"
+
+struct arm_state;
+
+#define SMP_MAX_CORES  64
+
+/*
+ * Cores are ordinary arm_states over one arm_memory, each run to completion
+ * on its own host thread. A core may have its own tcache attached; code
+ * written by one core is not invalidated in another core's cache.
+ */
+struct arm_smp
+{
+  struct arm_memory* mem;
+  unsigned int num_cores;
+  struct arm_state* cores[SMP_MAX_CORES];
+};
+
+struct arm_smp* new_arm_smp(struct arm_memory* mem, unsigned int num_cores, unsigned int func, unsigned int arg1, unsigned int arg2, unsigned int arg3);
+void free_arm_smp(struct arm_smp* smp);
+void arm_smp_run(struct arm_smp* smp);
+
+#endif
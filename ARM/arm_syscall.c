@@ -0,0 +1,293 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arm_vm.h"
+#include "arm_block.h"
+#include "arm_mmu.h"
+#include "arm_syscall.h"
+
+/* Guest iovecs hold 32-bit pointers; at most this many go to one writev. */
+#define SYSCALL_MAX_IOV  64
+
+/*
+ * Guest buffers are handed to the host as they are, without copying. Under
+ * an MMU a buffer must be mapped and physically contiguous.
+ */
+static int guest_range(struct arm_state* arm_s, unsigned int address, unsigned int size, unsigned int kind, void** host)
+{
+  if((uint64_t)address + size > GUEST_ADDRESS_SPACE)
+  {
+    return 0;
+  }
+  if(arm_s->mmu == NULL)
+  {
+    *host = arm_s->mem->base + address;
+    return 1;
+  }
+
+  *host = arm_mmu_lookup(arm_s->mmu, address, kind);
+  for(uint64_t page = GUEST_PAGE_DOWN(address) + GUEST_PAGE_SIZE; *host != NULL && page < (uint64_t)address + size; page += GUEST_PAGE_SIZE)
+  {
+    if(arm_mmu_lookup(arm_s->mmu, (unsigned int)page, kind) != (unsigned char*)*host + (page - address))
+    {
+      return 0;
+    }
+  }
+  return *host != NULL;
+}
+
+/* The host kernel writes guest memory behind the translation cache's back. */
+static void note_guest_write(struct arm_state* arm_s, unsigned int address, uint64_t size)
+{
+  if(arm_s->tcache == NULL)
+  {
+    return;
+  }
+  for(uint64_t page = GUEST_PAGE_DOWN(address); page < (uint64_t)address + size; page += GUEST_PAGE_SIZE)
+  {
+    arm_tcache_note_store(arm_s->tcache, (unsigned int)page);
+  }
+}
+
+static unsigned int result(long value)
+{
+  return value < 0 ? (unsigned int)-errno : (unsigned int)value;
+}
+
+static unsigned int sys_read(struct arm_state* arm_s)
+{
+  void* buf;
+
+  if(!guest_range(arm_s, arm_s->regs[1], arm_s->regs[2], MMU_WRITE, &buf))
+  {
+    return -EFAULT;
+  }
+  note_guest_write(arm_s, arm_s->regs[1], arm_s->regs[2]);
+  return result(read((int)arm_s->regs[0], buf, arm_s->regs[2]));
+}
+
+static unsigned int sys_write(struct arm_state* arm_s)
+{
+  void* buf;
+
+  if(!guest_range(arm_s, arm_s->regs[1], arm_s->regs[2], MMU_READ, &buf))
+  {
+    return -EFAULT;
+  }
+  return result(write((int)arm_s->regs[0], buf, arm_s->regs[2]));
+}
+
+static unsigned int sys_writev(struct arm_state* arm_s)
+{
+  struct iovec iov[SYSCALL_MAX_IOV];
+  unsigned int* guest_iov;
+  unsigned int count = arm_s->regs[2];
+
+  if(count > SYSCALL_MAX_IOV)
+  {
+    return -EINVAL;
+  }
+  if(!guest_range(arm_s, arm_s->regs[1], count * 8, MMU_READ, (void**)&guest_iov))
+  {
+    return -EFAULT;
+  }
+  for(unsigned int i = 0; i < count; i++)
+  {
+    if(!guest_range(arm_s, guest_iov[2 * i], guest_iov[2 * i + 1], MMU_READ, &iov[i].iov_base))
+    {
+      return -EFAULT;
+    }
+    iov[i].iov_len = guest_iov[2 * i + 1];
+  }
+  return result(writev((int)arm_s->regs[0], iov, (int)count));
+}
+
+/* Unmapped guest pages go back to being reserved and unreadable. */
+static int release_pages(struct arm_state* arm_s, unsigned int address, uint64_t size)
+{
+  note_guest_write(arm_s, address, size);
+  return mmap(arm_s->mem->base + address, size, PROT_NONE, MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0) != MAP_FAILED;
+}
+
+/*
+ * The break moves within the heap reserved when the executable was loaded,
+ * and cores may move it concurrently. Pages it gives back are released, so
+ * they read as zero when it grows again. A failed request returns the old
+ * break, as Linux does.
+ */
+static unsigned int sys_brk(struct arm_state* arm_s)
+{
+  struct arm_memory* mem = arm_s->mem;
+  unsigned int request = arm_s->regs[0];
+  unsigned int old = __atomic_load_n(&mem->brk, __ATOMIC_RELAXED);
+
+  do
+  {
+    if(mem->brk_limit == 0 || request < mem->brk_start || request > mem->brk_limit)
+    {
+      return old;
+    }
+  }
+  while(!__atomic_compare_exchange_n(&mem->brk, &old, request, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  if(GUEST_PAGE_UP(request) > GUEST_PAGE_UP(old))
+  {
+    arm_memory_map(mem, (unsigned int)GUEST_PAGE_UP(old), (unsigned int)(GUEST_PAGE_UP(request) - GUEST_PAGE_UP(old)));
+  }
+  else if(GUEST_PAGE_UP(request) < GUEST_PAGE_UP(old))
+  {
+    release_pages(arm_s, (unsigned int)GUEST_PAGE_UP(request), GUEST_PAGE_UP(old) - GUEST_PAGE_UP(request));
+  }
+  return request;
+}
+
+/*
+ * Anonymous memory comes from the guest allocator unless MAP_FIXED names
+ * the address. File mappings are host mappings of the file at that address.
+ * The guest's PROT_* and MAP_* values are the same as the host's.
+ */
+static unsigned int sys_mmap2(struct arm_state* arm_s)
+{
+  struct arm_memory* mem = arm_s->mem;
+  unsigned int address = arm_s->regs[0];
+  unsigned int length = arm_s->regs[1];
+  int prot = arm_memory_prot(arm_s->regs[2] & PROT_READ, arm_s->regs[2] & PROT_WRITE, arm_s->regs[2] & PROT_EXEC);
+  int flags = (int)arm_s->regs[3];
+  int fd = (int)arm_s->regs[4];
+  off_t offset = (off_t)arm_s->regs[5] * GUEST_PAGE_SIZE;
+  uint64_t size = GUEST_PAGE_UP(length);
+
+  if(length == 0)
+  {
+    return -EINVAL;
+  }
+  if(flags & MAP_FIXED)
+  {
+    if(address % GUEST_PAGE_SIZE != 0 || address + size > GUEST_ADDRESS_SPACE)
+    {
+      return -EINVAL;
+    }
+    note_guest_write(arm_s, address, size);
+  }
+  else
+  {
+    if(!arm_memory_reserve(mem, size, &address))
+    {
+      return -ENOMEM;
+    }
+  }
+
+  if(flags & MAP_ANONYMOUS)
+  {
+    fd = -1;
+    offset = 0;
+  }
+  if(mmap(mem->base + address, size, prot, MAP_FIXED | (flags & (MAP_SHARED | MAP_PRIVATE | MAP_ANONYMOUS)), fd, offset) == MAP_FAILED)
+  {
+    return -errno;
+  }
+  return address;
+}
+
+static unsigned int sys_munmap(struct arm_state* arm_s)
+{
+  unsigned int address = arm_s->regs[0];
+  uint64_t size = GUEST_PAGE_UP(arm_s->regs[1]);
+
+  if(address % GUEST_PAGE_SIZE != 0 || address + size > GUEST_ADDRESS_SPACE)
+  {
+    return -EINVAL;
+  }
+  if(!release_pages(arm_s, address, size))
+  {
+    return -errno;
+  }
+  return 0;
+}
+
+/* clock_gettime fills a 32-bit timespec, clock_gettime64 a 64-bit one. */
+static unsigned int sys_clock_gettime(struct arm_state* arm_s, int wide)
+{
+  struct timespec ts;
+  void* guest_ts;
+
+  if(!guest_range(arm_s, arm_s->regs[1], wide ? 16 : 8, MMU_WRITE, &guest_ts))
+  {
+    return -EFAULT;
+  }
+  if(clock_gettime((clockid_t)arm_s->regs[0], &ts) != 0)
+  {
+    return -errno;
+  }
+
+  if(wide)
+  {
+    int64_t* out = (int64_t*)guest_ts;
+    out[0] = ts.tv_sec;
+    out[1] = ts.tv_nsec;
+  }
+  else
+  {
+    int32_t* out = (int32_t*)guest_ts;
+    out[0] = (int32_t)ts.tv_sec;
+    out[1] = (int32_t)ts.tv_nsec;
+  }
+  return 0;
+}
+
+int arm_syscall(struct arm_state* arm_s)
+{
+  unsigned int ret;
+
+  switch(arm_s->regs[7])
+  {
+    case ARM_SYS_EXIT:
+    case ARM_SYS_EXIT_GROUP:
+      return 0;
+
+    case ARM_SYS_READ:
+      ret = sys_read(arm_s);
+      break;
+
+    case ARM_SYS_WRITE:
+      ret = sys_write(arm_s);
+      break;
+
+    case ARM_SYS_WRITEV:
+      ret = sys_writev(arm_s);
+      break;
+
+    /* These work on physical memory, which a guest with an MMU manages itself. */
+    case ARM_SYS_BRK:
+      ret = arm_s->mmu == NULL ? sys_brk(arm_s) : (unsigned int)-ENOSYS;
+      break;
+
+    case ARM_SYS_MMAP2:
+      ret = arm_s->mmu == NULL ? sys_mmap2(arm_s) : (unsigned int)-ENOSYS;
+      break;
+
+    case ARM_SYS_MUNMAP:
+      ret = arm_s->mmu == NULL ? sys_munmap(arm_s) : (unsigned int)-ENOSYS;
+      break;
+
+    case ARM_SYS_CLOCK_GETTIME:
+      ret = sys_clock_gettime(arm_s, 0);
+      break;
+
+    case ARM_SYS_CLOCK_GETTIME64:
+      ret = sys_clock_gettime(arm_s, 1);
+      break;
+
+    default:
+      ret = -ENOSYS;
+      break;
+  }
+
+  arm_s->regs[0] = ret;
+  return 1;
+}
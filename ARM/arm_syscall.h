@@ -0,0 +1,25 @@
+#ifndef ARM_SYSCALL_H
+#define ARM_SYSCALL_H
+
+struct arm_state;
+
+/* Linux ARM EABI system call numbers, passed in r7. */
+#define ARM_SYS_EXIT  1
+#define ARM_SYS_READ  3
+#define ARM_SYS_WRITE  4
+#define ARM_SYS_BRK  45
+#define ARM_SYS_MUNMAP  91
+#define ARM_SYS_WRITEV  146
+#define ARM_SYS_MMAP2  192
+#define ARM_SYS_EXIT_GROUP  248
+#define ARM_SYS_CLOCK_GETTIME  263
+#define ARM_SYS_CLOCK_GETTIME64  403
+
+/*
+ * Runs the system call in r7 with arguments in r0-r6 and leaves the result,
+ * or -errno, in r0. Returns 0 when the guest asked to exit, with the exit
+ * status in r0.
+ */
+int arm_syscall(struct arm_state* arm_s);
+
+#endif
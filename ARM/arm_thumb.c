@@ -0,0 +1,1357 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arm_vm.h"
+#include "arm_decode.h"
+#include "arm_block.h"
+#include "arm_mmu.h"
+#include "arm_thumb.h"
+
+#define THUMB_HASH(pc)  (((pc) >> 1) & (TCACHE_BUCKETS - 1))
+
+/* The ARM encodings Thumb instructions are re-encoded as, all with condition AL. */
+#define ARM_DP_REG(op, s, rn, rd, rm, type, amount)  \
+  (0xE0000000 | ((op) << 21) | ((s) << 20) | ((rn) << 16) | ((rd) << 12) | ((amount) << 7) | ((type) << 5) | (rm))
+#define ARM_DP_RSR(op, s, rd, rm, type, rs)  \
+  (0xE0000010 | ((op) << 21) | ((s) << 20) | ((rd) << 12) | ((rs) << 8) | ((type) << 5) | (rm))
+#define ARM_DP_IMM(op, s, rn, rd, operand)  \
+  (0xE2000000 | ((op) << 21) | ((s) << 20) | ((rn) << 16) | ((rd) << 12) | (operand))
+#define ARM_TRANSFER_IMM(p, u, b, w, l, rn, rt, offset)  \
+  (0xE4000000 | ((p) << 24) | ((u) << 23) | ((b) << 22) | ((w) << 21) | ((l) << 20) | ((rn) << 16) | ((rt) << 12) | (offset))
+#define ARM_TRANSFER_REG(b, l, rn, rt, rm, amount)  \
+  (0xE7800000 | ((b) << 22) | ((l) << 20) | ((rn) << 16) | ((rt) << 12) | ((amount) << 7) | (rm))
+#define ARM_HALFWORD(p, u, i, w, l, sh, rn, rt, low)  \
+  (0xE0000090 | ((p) << 24) | ((u) << 23) | ((i) << 22) | ((w) << 21) | ((l) << 20) | ((rn) << 16) | ((rt) << 12) | \
+   (((low) & 0xF0) << 4) | ((sh) << 5) | ((low) & 0xF))
+#define ARM_EXTEND(op, rn, rd, rotate, rm)  \
+  (0xE0000070 | ((op) << 20) | ((rn) << 16) | ((rd) << 12) | ((rotate) << 10) | (rm))
+
+#define SIGN_EXTEND(value, bits)  ((unsigned int)((int)((value) << (32 - (bits))) >> (32 - (bits))))
+
+enum data_op
+{
+  DP_AND = 0x0, DP_EOR = 0x1, DP_SUB = 0x2, DP_RSB = 0x3,
+  DP_ADD = 0x4, DP_ADC = 0x5, DP_SBC = 0x6, DP_TST = 0x8,
+  DP_TEQ = 0x9, DP_CMP = 0xA, DP_CMN = 0xB, DP_ORR = 0xC,
+  DP_MOV = 0xD, DP_BIC = 0xE, DP_MVN = 0xF
+};
+
+/* Thumb bit-field and byte-order ops, in bits 21:20 of a Thumb handler's iw. */
+enum thumb_bit_op
+{
+  BITS_SBFX = 0, BITS_UBFX, BITS_BFI, BITS_BFC
+};
+
+enum thumb_reverse_op
+{
+  REVERSE_REV = 0, REVERSE_REV16, REVERSE_RBIT, REVERSE_REVSH
+};
+
+/* Format 4 (16-bit register data processing) to ARM; -1 marks the shifts, NEG and MUL. */
+static const signed char narrow_data_op[16] =
+{
+  DP_AND, DP_EOR, -1, -1, -1, DP_ADC, DP_SBC, -1,
+  DP_TST, -1, DP_CMP, DP_CMN, DP_ORR, -1, DP_BIC, DP_MVN
+};
+
+/* Thumb-2 data processing to ARM. ORN has no ARM equivalent. */
+static const signed char wide_data_op[16] =
+{
+  DP_AND, DP_BIC, DP_ORR, -1, DP_EOR, -1, -1, -1,
+  DP_ADD, -1, DP_ADC, DP_SBC, -1, DP_SUB, DP_RSB, -1
+};
+
+/* SXTH, UXTH, -, -, SXTB, UXTB by the Thumb-2 op; the ARM op is bits 27:20. */
+static const unsigned char wide_extend_op[8] = {0x6B, 0x6F, 0, 0, 0x6A, 0x6E, 0, 0};
+
+/* SXTH, SXTB, UXTH, UXTB by the 16-bit op. */
+static const unsigned char narrow_extend_op[4] = {0x6B, 0x6A, 0x6F, 0x6E};
+
+static void thumb_undefined(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  (void) arm_s;
+  guest_fault_raise(GUEST_FAULT_UNDEFINED, uop->pc);
+}
+
+/* IT and the hints. */
+static void thumb_nop(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  (void) uop;
+  arm_s->regs[PC] += 4;
+}
+
+static void thumb_branch(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  arm_s->regs[PC] = uop->imm;
+}
+
+/* BL, and BLX to ARM code when iw is set. */
+static void thumb_call(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  arm_s->regs[LR] = (uop->pc + uop->len) | 0b1;
+  arm_s->regs[PC] = uop->imm;
+  if(uop->iw)
+  {
+    arm_s->cpsr &= ~CPSR_T;
+  }
+}
+
+/* CBZ, and CBNZ when bit 4 of iw is set. */
+static void thumb_compare_branch(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  if((arm_s->regs[uop->iw & 0x7] == 0) != ((uop->iw >> 4) & 0b1))
+  {
+    arm_s->regs[PC] = uop->imm;
+  }
+  else
+  {
+    arm_s->regs[PC] += 4;
+  }
+}
+
+/*
+ * ADR and the ADD and MOV forms that read PC: rd (bits 7:4) gets imm plus
+ * rn (bits 3:0) unless rn is PC. Writing PC branches and stays in Thumb.
+ */
+static void thumb_address(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  unsigned int rd = (uop->iw >> 4) & 0xF;
+  unsigned int rn = uop->iw & 0xF;
+  unsigned int value = uop->imm + (rn != PC ? arm_s->regs[rn] : 0);
+
+  if(rd == PC)
+  {
+    arm_s->regs[PC] = value & ~1u;
+    return;
+  }
+  arm_s->regs[rd] = value;
+  arm_s->regs[PC] += 4;
+}
+
+/* LDR from a PC-relative address known when the instruction was decoded. */
+static void thumb_load_literal(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  arm_s->regs[uop->iw] = *((unsigned int *) GUEST_ACCESS(arm_s, uop->imm, MMU_READ));
+  arm_s->regs[PC] += 4;
+}
+
+/* Data processing with a modified immediate ARM cannot encode. */
+static void thumb_data_value(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  arm_process_data_value(arm_s, uop->iw, uop->imm);
+}
+
+/* The same for a rotated immediate of a logical op with S, whose carry-out is bit 31. */
+static void thumb_data_value_carry(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  arm_s->cpsr = (arm_cpsr(arm_s) & ~CPSR_C) | ((uop->imm >> 31) << 29);
+  arm_process_data_value(arm_s, uop->iw, uop->imm);
+}
+
+/* LDRH and the rest with an offset ARM cannot encode: imm, or rm and a shift when I is clear. */
+static void thumb_halfword(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  if((uop->iw >> 22) & 0b1)
+  {
+    arm_halfword_transfer(arm_s, uop->iw, uop->imm);
+  }
+  else
+  {
+    arm_halfword_transfer(arm_s, uop->iw, arm_s->regs[uop->imm & 0xF] << (uop->imm >> 4));
+  }
+}
+
+/* LDRD and STRD, whose second register need not follow the first in Thumb. */
+static void thumb_dual(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  unsigned int rn = (uop->iw >> 16) & 0xF;
+  unsigned int rt = (uop->iw >> 12) & 0xF;
+  unsigned int rt2 = (uop->iw >> 8) & 0xF;
+  unsigned int base = arm_s->regs[rn];
+  unsigned int offset = ((uop->iw >> 23) & 0b1) ? uop->imm : -uop->imm;
+  unsigned int address = ((uop->iw >> 24) & 0b1) ? base + offset : base;
+
+  if((uop->iw >> 20) & 0b1)
+  {
+    unsigned int low = GUEST_READ(arm_s, unsigned int, address);
+    unsigned int high = GUEST_READ(arm_s, unsigned int, address + 4);
+
+    arm_s->regs[rt] = low;
+    arm_s->regs[rt2] = high;
+  }
+  else
+  {
+    GUEST_WRITE(arm_s, unsigned int, address, arm_s->regs[rt]);
+    GUEST_WRITE(arm_s, unsigned int, address + 4, arm_s->regs[rt2]);
+    if(arm_s->tcache != NULL)
+    {
+      arm_tcache_note_store(arm_s->tcache, address);
+      arm_tcache_note_store(arm_s->tcache, address + 4);
+    }
+  }
+
+  if((uop->iw >> 21) & 0b1)
+  {
+    arm_s->regs[rn] = base + offset;
+  }
+  arm_s->regs[PC] += 4;
+}
+
+/* TBB, and TBH when bit 4 of iw is set. A PC base is the table right after. */
+static void thumb_table_branch(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  unsigned int rn = (uop->iw >> 16) & 0xF;
+  unsigned int base = rn == PC ? uop->pc + 4 : arm_s->regs[rn];
+  unsigned int index = arm_s->regs[uop->iw & 0xF];
+  unsigned int offset;
+
+  if((uop->iw >> 4) & 0b1)
+  {
+    offset = GUEST_READ(arm_s, uint16_t, base + index * 2);
+  }
+  else
+  {
+    offset = *GUEST_ACCESS(arm_s, base + index, MMU_READ);
+  }
+  arm_s->regs[PC] = uop->pc + 4 + offset * 2;
+}
+
+/* SDIV, and UDIV when bit 4 of iw is clear. Dividing by zero gives zero. */
+static void thumb_divide(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  unsigned int n = arm_s->regs[(uop->iw >> 16) & 0xF];
+  unsigned int m = arm_s->regs[uop->iw & 0xF];
+  unsigned int result;
+
+  if(m == 0)
+  {
+    result = 0;
+  }
+  else if((uop->iw >> 4) & 0b1)
+  {
+    result = (n == 0x80000000 && m == 0xFFFFFFFF) ? n : (unsigned int)((int)n / (int)m);
+  }
+  else
+  {
+    result = n / m;
+  }
+  arm_s->regs[(uop->iw >> 12) & 0xF] = result;
+  arm_s->regs[PC] += 4;
+}
+
+/* SBFX, UBFX, BFI and BFC; imm is the lsb and the width above it. */
+static void thumb_bit_field(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  unsigned int rd = (uop->iw >> 12) & 0xF;
+  unsigned int lsb = uop->imm & 0x1F;
+  unsigned int width = uop->imm >> 8;
+  unsigned int mask = width == 32 ? 0xFFFFFFFF : (1u << width) - 1;
+  unsigned int value = arm_s->regs[(uop->iw >> 16) & 0xF];
+
+  switch((uop->iw >> 20) & 0x3)
+  {
+    case BITS_SBFX:
+      value = (value >> lsb) & mask;
+      if(width < 32 && ((value >> (width - 1)) & 0b1))
+      {
+        value |= ~mask;
+      }
+      break;
+
+    case BITS_UBFX:
+      value = (value >> lsb) & mask;
+      break;
+
+    case BITS_BFI:
+      value = (arm_s->regs[rd] & ~(mask << lsb)) | ((value & mask) << lsb);
+      break;
+
+    default:
+      value = arm_s->regs[rd] & ~(mask << lsb);
+      break;
+  }
+  arm_s->regs[rd] = value;
+  arm_s->regs[PC] += 4;
+}
+
+static void thumb_reverse(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  unsigned int value = arm_s->regs[uop->iw & 0xF];
+
+  switch((uop->iw >> 20) & 0x3)
+  {
+    case REVERSE_REV:
+      value = __builtin_bswap32(value);
+      break;
+
+    case REVERSE_REV16:
+      value = ((value >> 8) & 0x00FF00FF) | ((value << 8) & 0xFF00FF00);
+      break;
+
+    case REVERSE_RBIT:
+      value = ((value >> 1) & 0x55555555) | ((value & 0x55555555) << 1);
+      value = ((value >> 2) & 0x33333333) | ((value & 0x33333333) << 2);
+      value = ((value >> 4) & 0x0F0F0F0F) | ((value & 0x0F0F0F0F) << 4);
+      value = __builtin_bswap32(value);
+      break;
+
+    default:
+      value = (unsigned int)(int)(int16_t) __builtin_bswap16((uint16_t) value);
+      break;
+  }
+  arm_s->regs[(uop->iw >> 12) & 0xF] = value;
+  arm_s->regs[PC] += 4;
+}
+
+static void thumb_count_zeros(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  unsigned int value = arm_s->regs[uop->iw & 0xF];
+
+  arm_s->regs[(uop->iw >> 12) & 0xF] = value == 0 ? 32 : __builtin_clz(value);
+  arm_s->regs[PC] += 4;
+}
+
+static void use_arm(struct thumb_uop* uop, unsigned int iw)
+{
+  unsigned int cls = ARM_CLASSIFY(iw);
+
+  arm_uop_decode(&uop->arm, iw, uop->pc + uop->len - 4);
+  uop->thumb = NULL;
+  uop->iw = iw;
+  uop->imm = 0;
+  uop->counter = arm_class_counter[cls];
+  uop->ends = arm_block_ends(cls, iw);
+}
+
+static void use_thumb(struct thumb_uop* uop, void (*handler)(struct arm_state*, const struct thumb_uop*),
+                      unsigned int iw, unsigned int imm, unsigned int counter, unsigned int ends)
+{
+  uop->arm.run = NULL;
+  uop->thumb = handler;
+  uop->iw = iw;
+  uop->imm = imm;
+  uop->counter = counter;
+  uop->ends = ends;
+}
+
+static void use_undefined(struct thumb_uop* uop)
+{
+  use_thumb(uop, thumb_undefined, 0, 0, ARM_COUNT_COMP, 1);
+}
+
+/* The ARM rotated-immediate form of value, or -1 if there is none. */
+static int arm_immediate(unsigned int value)
+{
+  for(unsigned int rotate = 0; rotate < 32; rotate += 2)
+  {
+    unsigned int imm8 = (value << rotate) | (value >> ((32 - rotate) & 31));
+
+    if(imm8 <= 0xFF)
+    {
+      return (int)((rotate / 2) << 8 | imm8);
+    }
+  }
+  return -1;
+}
+
+static unsigned int thumb_expand_imm(unsigned int imm12)
+{
+  unsigned int imm8 = imm12 & 0xFF;
+  unsigned int rotate = imm12 >> 7;
+
+  if((imm12 >> 10) == 0)
+  {
+    switch((imm12 >> 8) & 0x3)
+    {
+      case 0:
+        return imm8;
+      case 1:
+        return (imm8 << 16) | imm8;
+      case 2:
+        return (imm8 << 24) | (imm8 << 8);
+    }
+    return imm8 * 0x01010101;
+  }
+  imm8 = 0x80 | (imm12 & 0x7F);
+  return (imm8 >> rotate) | (imm8 << (32 - rotate));
+}
+
+/* rd = rn op value, through the ARM handler when ARM can encode value. */
+static void use_data_value(struct thumb_uop* uop, unsigned int op, unsigned int s, unsigned int rn, unsigned int rd, unsigned int value)
+{
+  int operand = arm_immediate(value);
+
+  if(operand >= 0)
+  {
+    use_arm(uop, ARM_DP_IMM(op, s, rn, rd, (unsigned int) operand));
+  }
+  else
+  {
+    use_thumb(uop, thumb_data_value, ARM_DP_REG(op, s, rn, rd, 0, 0, 0), value, ARM_COUNT_COMP, 0);
+  }
+}
+
+/*
+ * The ARM opcode for a Thumb-2 data processing op, or -1. A PC rn turns ORR
+ * and ORN into MOV and MVN; a PC rd with S turns AND, EOR, ADD and SUB into
+ * the compares.
+ */
+static int wide_data_op_for(unsigned int op, unsigned int rn, unsigned int rd, unsigned int s)
+{
+  if(rn == PC)
+  {
+    return op == 0x2 ? DP_MOV : op == 0x3 ? DP_MVN : -1;
+  }
+  if(rd == PC)
+  {
+    if(s == 0)
+    {
+      return -1;
+    }
+    return op == 0x0 ? DP_TST : op == 0x4 ? DP_TEQ : op == 0x8 ? DP_CMN : op == 0xD ? DP_CMP : -1;
+  }
+  return wide_data_op[op];
+}
+
+static void decode_narrow_data(struct thumb_uop* uop, unsigned int hw, unsigned int s)
+{
+  unsigned int op = (hw >> 6) & 0xF;
+  unsigned int rdn = hw & 0x7;
+  unsigned int rm = (hw >> 3) & 0x7;
+
+  switch(op)
+  {
+    case 0x2:
+      use_arm(uop, ARM_DP_RSR(DP_MOV, s, rdn, rdn, 0, rm));
+      break;
+    case 0x3:
+      use_arm(uop, ARM_DP_RSR(DP_MOV, s, rdn, rdn, 1, rm));
+      break;
+    case 0x4:
+      use_arm(uop, ARM_DP_RSR(DP_MOV, s, rdn, rdn, 2, rm));
+      break;
+    case 0x7:
+      use_arm(uop, ARM_DP_RSR(DP_MOV, s, rdn, rdn, 3, rm));
+      break;
+
+    case 0x9:
+      use_arm(uop, ARM_DP_IMM(DP_RSB, s, rm, rdn, 0));
+      break;
+
+    case 0xD:
+      use_arm(uop, 0xE0000090 | (s << 20) | (rdn << 16) | (rdn << 8) | rm);
+      break;
+
+    case 0x8:
+    case 0xA:
+    case 0xB:
+      use_arm(uop, ARM_DP_REG(narrow_data_op[op], 1, rdn, 0, rm, 0, 0));
+      break;
+
+    default:
+      use_arm(uop, ARM_DP_REG(narrow_data_op[op], s, rdn, rdn, rm, 0, 0));
+      break;
+  }
+}
+
+/* ADD, CMP, MOV on any registers, and BX and BLX. */
+static void decode_high_registers(struct thumb_uop* uop, unsigned int hw)
+{
+  unsigned int rd = ((hw >> 4) & 0x8) | (hw & 0x7);
+  unsigned int rm = (hw >> 3) & 0xF;
+
+  switch((hw >> 8) & 0x3)
+  {
+    case 0:
+      if(rm == PC)
+      {
+        use_thumb(uop, thumb_address, (rd << 4) | rd, uop->pc + 4, ARM_COUNT_COMP, rd == PC);
+      }
+      else if(rd == PC)
+      {
+        use_thumb(uop, thumb_address, (PC << 4) | rm, uop->pc + 4, ARM_COUNT_COMP, 1);
+      }
+      else
+      {
+        use_arm(uop, ARM_DP_REG(DP_ADD, 0, rd, rd, rm, 0, 0));
+      }
+      break;
+
+    case 1:
+      if(rd == PC || rm == PC)
+      {
+        use_undefined(uop);
+        break;
+      }
+      use_arm(uop, ARM_DP_REG(DP_CMP, 1, rd, 0, rm, 0, 0));
+      break;
+
+    case 2:
+      if(rm == PC)
+      {
+        use_thumb(uop, thumb_address, (rd << 4) | PC, uop->pc + 4, ARM_COUNT_COMP, rd == PC);
+        break;
+      }
+      use_arm(uop, ARM_DP_REG(DP_MOV, 0, 0, rd, rm, 0, 0));
+      break;
+
+    default:
+      if(rm == PC)
+      {
+        use_undefined(uop);
+        break;
+      }
+      use_arm(uop, 0xE12FFF10 | (((hw >> 7) & 0b1) << 5) | rm);
+      break;
+  }
+}
+
+static void decode_miscellaneous(struct thumb_uop* uop, unsigned int hw)
+{
+  unsigned int rd = hw & 0x7;
+  unsigned int rm = (hw >> 3) & 0x7;
+  unsigned int list = hw & 0xFF;
+
+  if((hw & 0xFF00) == 0xB000)
+  {
+    use_arm(uop, ARM_DP_IMM(((hw >> 7) & 0b1) ? DP_SUB : DP_ADD, 0, SP, SP, (unsigned int) arm_immediate((hw & 0x7F) * 4)));
+  }
+  else if((hw & 0xF500) == 0xB100)
+  {
+    unsigned int target = uop->pc + 4 + (((hw >> 3) & 0x1F) << 1) + (((hw >> 9) & 0b1) << 6);
+    use_thumb(uop, thumb_compare_branch, rd | (((hw >> 11) & 0b1) << 4), target, ARM_COUNT_BR, 1);
+  }
+  else if((hw & 0xFF00) == 0xB200)
+  {
+    use_arm(uop, ARM_EXTEND(narrow_extend_op[(hw >> 6) & 0x3], PC, rd, 0, rm));
+  }
+  else if((hw & 0xFE00) == 0xB400 && (list | (hw & 0x100)) != 0)
+  {
+    use_arm(uop, 0xE92D0000 | list | (((hw >> 8) & 0b1) << LR));
+  }
+  else if((hw & 0xFE00) == 0xBC00 && (list | (hw & 0x100)) != 0)
+  {
+    use_arm(uop, 0xE8BD0000 | list | (((hw >> 8) & 0b1) << PC));
+  }
+  else if((hw & 0xFF00) == 0xBA00 && ((hw >> 6) & 0x3) != REVERSE_RBIT)
+  {
+    use_thumb(uop, thumb_reverse, (((hw >> 6) & 0x3) << 20) | (rd << 12) | rm, 0, ARM_COUNT_COMP, 0);
+  }
+  else if((hw & 0xFF00) == 0xBF00)
+  {
+    use_thumb(uop, thumb_nop, 0, 0, ARM_COUNT_COMP, 0);
+  }
+  else
+  {
+    use_undefined(uop);
+  }
+}
+
+static void decode_narrow(struct thumb_uop* uop, unsigned int hw, unsigned int s)
+{
+  static const unsigned char immediate_op[4] = {DP_MOV, DP_CMP, DP_ADD, DP_SUB};
+  static const unsigned char register_load[8][3] =
+  {
+    /* word or byte, or halfword with its sh, then L */
+    {0, 0, 0}, {1, 1, 0}, {0, 1, 0}, {1, 2, 1},
+    {0, 0, 1}, {1, 1, 1}, {0, 1, 1}, {1, 3, 1}
+  };
+  unsigned int pc = uop->pc;
+  unsigned int rd = hw & 0x7;
+  unsigned int rn = (hw >> 3) & 0x7;
+  unsigned int rm = (hw >> 6) & 0x7;
+  unsigned int imm5 = (hw >> 6) & 0x1F;
+  unsigned int rdn = (hw >> 8) & 0x7;
+  unsigned int imm8 = hw & 0xFF;
+  unsigned int l_bit = (hw >> 11) & 0b1;
+  unsigned int op;
+
+  switch(hw >> 12)
+  {
+    case 0x0:
+    case 0x1:
+      if((hw >> 11) != 0x3)
+      {
+        use_arm(uop, ARM_DP_REG(DP_MOV, s, 0, rd, rn, (hw >> 11) & 0x3, imm5));
+      }
+      else if((hw >> 10) & 0b1)
+      {
+        use_arm(uop, ARM_DP_IMM(((hw >> 9) & 0b1) ? DP_SUB : DP_ADD, s, rn, rd, rm));
+      }
+      else
+      {
+        use_arm(uop, ARM_DP_REG(((hw >> 9) & 0b1) ? DP_SUB : DP_ADD, s, rn, rd, rm, 0, 0));
+      }
+      break;
+
+    case 0x2:
+    case 0x3:
+      op = immediate_op[(hw >> 11) & 0x3];
+      use_arm(uop, ARM_DP_IMM(op, op == DP_CMP ? 1 : s, rdn, op == DP_CMP ? 0 : rdn, imm8));
+      break;
+
+    case 0x4:
+      if((hw >> 10) == 0x10)
+      {
+        decode_narrow_data(uop, hw, s);
+      }
+      else if((hw >> 10) == 0x11)
+      {
+        decode_high_registers(uop, hw);
+      }
+      else
+      {
+        use_thumb(uop, thumb_load_literal, rdn, ((pc + 4) & ~3u) + imm8 * 4, ARM_COUNT_MEM, 0);
+      }
+      break;
+
+    case 0x5:
+      op = (hw >> 9) & 0x7;
+      if(register_load[op][0])
+      {
+        use_arm(uop, ARM_HALFWORD(1, 1, 0, 0, register_load[op][2], register_load[op][1], rn, rd, rm));
+      }
+      else
+      {
+        use_arm(uop, ARM_TRANSFER_REG(register_load[op][1], register_load[op][2], rn, rd, rm, 0));
+      }
+      break;
+
+    case 0x6:
+      use_arm(uop, ARM_TRANSFER_IMM(1, 1, 0, 0, l_bit, rn, rd, imm5 * 4));
+      break;
+
+    case 0x7:
+      use_arm(uop, ARM_TRANSFER_IMM(1, 1, 1, 0, l_bit, rn, rd, imm5));
+      break;
+
+    case 0x8:
+      use_arm(uop, ARM_HALFWORD(1, 1, 1, 0, l_bit, 1, rn, rd, imm5 * 2));
+      break;
+
+    case 0x9:
+      use_arm(uop, ARM_TRANSFER_IMM(1, 1, 0, 0, l_bit, SP, rdn, imm8 * 4));
+      break;
+
+    case 0xA:
+      if(l_bit)
+      {
+        use_arm(uop, ARM_DP_IMM(DP_ADD, 0, SP, rdn, (unsigned int) arm_immediate(imm8 * 4)));
+      }
+      else
+      {
+        use_thumb(uop, thumb_address, (rdn << 4) | PC, ((pc + 4) & ~3u) + imm8 * 4, ARM_COUNT_COMP, 0);
+      }
+      break;
+
+    case 0xB:
+      decode_miscellaneous(uop, hw);
+      break;
+
+    case 0xC:
+      if(imm8 == 0)
+      {
+        use_undefined(uop);
+      }
+      else if(l_bit)
+      {
+        use_arm(uop, 0xE8900000 | ((((imm8 >> rdn) & 0b1) ^ 0b1) << 21) | (rdn << 16) | imm8);
+      }
+      else
+      {
+        use_arm(uop, 0xE8A00000 | (rdn << 16) | imm8);
+      }
+      break;
+
+    case 0xD:
+      op = (hw >> 8) & 0xF;
+      if(op == 0xF)
+      {
+        use_arm(uop, 0xEF000000 | imm8);
+      }
+      else if(op == 0xE)
+      {
+        use_undefined(uop);
+      }
+      else
+      {
+        use_thumb(uop, thumb_branch, 0, pc + 4 + SIGN_EXTEND(imm8 << 1, 9), ARM_COUNT_BR, 1);
+        uop->cond = op;
+      }
+      break;
+
+    default:
+      use_thumb(uop, thumb_branch, 0, pc + 4 + SIGN_EXTEND((hw & 0x7FF) << 1, 12), ARM_COUNT_BR, 1);
+      break;
+  }
+}
+
+/* LDM and STM, increment after or decrement before. */
+static void decode_wide_multiple(struct thumb_uop* uop, unsigned int hw1, unsigned int hw2)
+{
+  unsigned int op = (hw1 >> 7) & 0x3;
+
+  if((op != 1 && op != 2) || hw2 == 0)
+  {
+    use_undefined(uop);
+    return;
+  }
+  use_arm(uop, (op == 1 ? 0xE8800000 : 0xE9000000) | ((hw1 & 0x30) << 16) | ((hw1 & 0xF) << 16) | hw2);
+}
+
+/* LDRD and STRD, the exclusives and TBB and TBH. */
+static void decode_wide_dual(struct thumb_uop* uop, unsigned int hw1, unsigned int hw2)
+{
+  static const unsigned int exclusive_op[8] = {0, 0, 0, 0, 0x01C00F90, 0x01E00F90, 0, 0x01A00F90};
+  unsigned int rn = hw1 & 0xF;
+  unsigned int rt = hw2 >> 12;
+  unsigned int rt2 = (hw2 >> 8) & 0xF;
+  unsigned int p_bit = (hw1 >> 8) & 0b1;
+  unsigned int u_bit = (hw1 >> 7) & 0b1;
+  unsigned int w_bit = (hw1 >> 5) & 0b1;
+  unsigned int l_bit = (hw1 >> 4) & 0b1;
+  unsigned int op = (hw2 >> 4) & 0xF;
+  unsigned int offset = (hw2 & 0xFF) * 4;
+
+  if(p_bit == 0 && w_bit == 0)
+  {
+    if(u_bit == 0 && (hw2 & 0xFF) == 0)
+    {
+      use_arm(uop, l_bit ? 0xE1900F9F | (rn << 16) | (rt << 12) : 0xE1800F90 | (rn << 16) | (rt2 << 12) | rt);
+    }
+    else if(u_bit == 0)
+    {
+      use_undefined(uop);
+    }
+    else if(l_bit && op <= 1 && (hw2 & 0xFF00) == 0xF000)
+    {
+      use_thumb(uop, thumb_table_branch, (rn << 16) | (op << 4) | (hw2 & 0xF), 0, ARM_COUNT_BR, 1);
+    }
+    else if(op < 8 && exclusive_op[op] != 0 && (op != 7 || ((rt & 0b1) == 0 && rt2 == rt + 1)))
+    {
+      if(l_bit)
+      {
+        use_arm(uop, 0xE0000000 | exclusive_op[op] | 0x00100F0F | (rn << 16) | (rt << 12));
+      }
+      else
+      {
+        use_arm(uop, 0xE0000000 | exclusive_op[op] | (rn << 16) | ((hw2 & 0xF) << 12) | rt);
+      }
+    }
+    else
+    {
+      use_undefined(uop);
+    }
+    return;
+  }
+
+  if(rn == PC || rt == PC || rt2 == PC)
+  {
+    use_undefined(uop);
+  }
+  else if((rt & 0b1) == 0 && rt2 == rt + 1 && offset <= 0xFF)
+  {
+    use_arm(uop, ARM_HALFWORD(p_bit, u_bit, 1, p_bit & w_bit, 0, l_bit ? 2 : 3, rn, rt, offset));
+  }
+  else
+  {
+    use_thumb(uop, thumb_dual, (p_bit << 24) | (u_bit << 23) | (w_bit << 21) | (l_bit << 20) | (rn << 16) | (rt << 12) | (rt2 << 8),
+              offset, ARM_COUNT_MEM, 0);
+  }
+}
+
+static void decode_wide_shifted(struct thumb_uop* uop, unsigned int hw1, unsigned int hw2)
+{
+  unsigned int rn = hw1 & 0xF;
+  unsigned int rd = (hw2 >> 8) & 0xF;
+  unsigned int rm = hw2 & 0xF;
+  unsigned int s = (hw1 >> 4) & 0b1;
+  unsigned int amount = ((hw2 >> 10) & 0x1C) | ((hw2 >> 6) & 0x3);
+  int op = wide_data_op_for((hw1 >> 5) & 0xF, rn, rd, s);
+
+  if(op < 0 || rm == PC)
+  {
+    use_undefined(uop);
+    return;
+  }
+  use_arm(uop, ARM_DP_REG((unsigned int) op, s, rn == PC ? 0 : rn, rd == PC ? 0 : rd, rm, (hw2 >> 4) & 0x3, amount));
+}
+
+static void decode_wide_immediate(struct thumb_uop* uop, unsigned int hw1, unsigned int hw2)
+{
+  unsigned int rn = hw1 & 0xF;
+  unsigned int rd = (hw2 >> 8) & 0xF;
+  unsigned int s = (hw1 >> 4) & 0b1;
+  unsigned int imm12 = (((hw1 >> 10) & 0b1) << 11) | (((hw2 >> 12) & 0x7) << 8) | (hw2 & 0xFF);
+  unsigned int value = thumb_expand_imm(imm12);
+  unsigned int op = (hw1 >> 5) & 0xF;
+  int arm_op = wide_data_op_for(op, rn, rd, s);
+
+  if(op == 0x3 && rn != PC && rd != PC)
+  {
+    if(s && (imm12 >> 10) != 0)
+    {
+      use_undefined(uop);
+      return;
+    }
+    use_thumb(uop, thumb_data_value, ARM_DP_REG(DP_ORR, s, rn, rd, 0, 0, 0), ~value, ARM_COUNT_COMP, 0);
+    return;
+  }
+  if(arm_op < 0)
+  {
+    use_undefined(uop);
+    return;
+  }
+
+  rn = rn == PC ? 0 : rn;
+  rd = rd == PC ? 0 : rd;
+  use_data_value(uop, (unsigned int) arm_op, s, rn, rd, value);
+
+  /* Logical ops take C from a rotated immediate, which the ARM form only gets right if it rotates too. */
+  if(uop->thumb != NULL && s && (imm12 >> 10) != 0 && (arm_op == DP_AND || arm_op == DP_EOR || arm_op >= DP_TST) &&
+     arm_op != DP_CMP && arm_op != DP_CMN)
+  {
+    uop->thumb = thumb_data_value_carry;
+  }
+}
+
+static void decode_wide_plain(struct thumb_uop* uop, unsigned int hw1, unsigned int hw2)
+{
+  unsigned int rn = hw1 & 0xF;
+  unsigned int rd = (hw2 >> 8) & 0xF;
+  unsigned int imm12 = (((hw1 >> 10) & 0b1) << 11) | (((hw2 >> 12) & 0x7) << 8) | (hw2 & 0xFF);
+  unsigned int imm16 = ((hw1 & 0xF) << 12) | imm12;
+  unsigned int lsb = (((hw2 >> 12) & 0x7) << 2) | ((hw2 >> 6) & 0x3);
+  unsigned int width = hw2 & 0x1F;
+  unsigned int align = (uop->pc + 4) & ~3u;
+
+  if(rd == PC)
+  {
+    use_undefined(uop);
+    return;
+  }
+
+  switch((hw1 >> 4) & 0x1F)
+  {
+    case 0x00:
+    case 0x0A:
+      if(rn == PC)
+      {
+        use_thumb(uop, thumb_address, (rd << 4) | PC, (hw1 & 0x00A0) ? align - imm12 : align + imm12, ARM_COUNT_COMP, 0);
+      }
+      else
+      {
+        use_data_value(uop, (hw1 & 0x00A0) ? DP_SUB : DP_ADD, 0, rn, rd, imm12);
+      }
+      break;
+
+    case 0x04:
+      use_arm(uop, 0xE3000000 | ((imm16 & 0xF000) << 4) | (rd << 12) | (imm16 & 0xFFF));
+      break;
+
+    case 0x0C:
+      use_arm(uop, 0xE3400000 | ((imm16 & 0xF000) << 4) | (rd << 12) | (imm16 & 0xFFF));
+      break;
+
+    case 0x14:
+    case 0x1C:
+      if(lsb + width > 31)
+      {
+        use_undefined(uop);
+        break;
+      }
+      use_thumb(uop, thumb_bit_field, ((((hw1 >> 7) & 0b1) ? BITS_UBFX : BITS_SBFX) << 20) | (rn << 16) | (rd << 12),
+                lsb | ((width + 1) << 8), ARM_COUNT_COMP, 0);
+      break;
+
+    case 0x16:
+      if(width < lsb)
+      {
+        use_undefined(uop);
+        break;
+      }
+      use_thumb(uop, thumb_bit_field, ((rn == PC ? BITS_BFC : BITS_BFI) << 20) | (rn << 16) | (rd << 12),
+                lsb | ((width - lsb + 1) << 8), ARM_COUNT_COMP, 0);
+      break;
+
+    default:
+      use_undefined(uop);
+      break;
+  }
+}
+
+/* B, B<cond>, BL, BLX, the barriers and the hints. */
+static void decode_wide_branch(struct thumb_uop* uop, unsigned int hw1, unsigned int hw2)
+{
+  unsigned int s = (hw1 >> 10) & 0b1;
+  unsigned int j1 = (hw2 >> 13) & 0b1;
+  unsigned int j2 = (hw2 >> 11) & 0b1;
+  unsigned int offset;
+
+  if((hw2 & 0x5000) == 0)
+  {
+    if(((hw1 >> 6) & 0xE) != 0xE)
+    {
+      offset = SIGN_EXTEND((s << 20) | (j2 << 19) | (j1 << 18) | ((hw1 & 0x3F) << 12) | ((hw2 & 0x7FF) << 1), 21);
+      use_thumb(uop, thumb_branch, 0, uop->pc + 4 + offset, ARM_COUNT_BR, 1);
+      uop->cond = (hw1 >> 6) & 0xF;
+    }
+    else if(hw1 == 0xF3BF && (hw2 & 0xFF00) == 0x8F00 && ((hw2 >> 4) & 0xF) == 0x2)
+    {
+      use_arm(uop, 0xF57FF01F);
+    }
+    else if(hw1 == 0xF3BF && (hw2 & 0xFF00) == 0x8F00 && ((hw2 >> 4) & 0xF) >= 0x4 && ((hw2 >> 4) & 0xF) <= 0x6)
+    {
+      use_arm(uop, 0xF57FF000 | (hw2 & 0xFF));
+    }
+    else if(hw1 == 0xF3AF && (hw2 & 0xFF00) == 0x8000)
+    {
+      use_thumb(uop, thumb_nop, 0, 0, ARM_COUNT_COMP, 0);
+    }
+    else
+    {
+      use_undefined(uop);
+    }
+    return;
+  }
+
+  offset = SIGN_EXTEND((s << 24) | ((!(j1 ^ s)) << 23) | ((!(j2 ^ s)) << 22) | ((hw1 & 0x3FF) << 12) | ((hw2 & 0x7FF) << 1), 25);
+  switch(hw2 & 0x5000)
+  {
+    case 0x1000:
+      use_thumb(uop, thumb_branch, 0, uop->pc + 4 + offset, ARM_COUNT_BR, 1);
+      break;
+
+    case 0x5000:
+      use_thumb(uop, thumb_call, 0, uop->pc + 4 + offset, ARM_COUNT_BR, 1);
+      break;
+
+    default:
+      use_thumb(uop, thumb_call, 1, ((uop->pc + 4) & ~3u) + offset, ARM_COUNT_BR, 1);
+      break;
+  }
+}
+
+/* LDR, LDRB, LDRH, LDRSB, LDRSH and the stores, by immediate or shifted register. */
+static void decode_wide_single(struct thumb_uop* uop, unsigned int hw1, unsigned int hw2)
+{
+  unsigned int rn = hw1 & 0xF;
+  unsigned int rt = hw2 >> 12;
+  unsigned int size = (hw1 >> 5) & 0x3;
+  unsigned int l_bit = (hw1 >> 4) & 0b1;
+  unsigned int sign = (hw1 >> 8) & 0b1;
+  unsigned int p_bit = 1;
+  unsigned int u_bit = 1;
+  unsigned int w_bit = 0;
+  unsigned int offset = 0;
+  unsigned int rm = 0;
+  unsigned int shift = 0;
+  int by_register = 0;
+  unsigned int sh;
+
+  if(size == 3 || (sign && !l_bit) || (rt == PC && !l_bit))
+  {
+    use_undefined(uop);
+    return;
+  }
+  if(rt == PC && size != 2)
+  {
+    use_thumb(uop, thumb_nop, 0, 0, ARM_COUNT_MEM, 0);
+    return;
+  }
+
+  if(rn == PC)
+  {
+    unsigned int address = ((uop->pc + 4) & ~3u);
+
+    address = ((hw1 >> 7) & 0b1) ? address + (hw2 & 0xFFF) : address - (hw2 & 0xFFF);
+    if(size != 2 || !l_bit || rt == PC)
+    {
+      use_undefined(uop);
+      return;
+    }
+    use_thumb(uop, thumb_load_literal, rt, address, ARM_COUNT_MEM, 0);
+    return;
+  }
+
+  if((hw1 >> 7) & 0b1)
+  {
+    offset = hw2 & 0xFFF;
+  }
+  else if((hw2 >> 11) & 0b1)
+  {
+    p_bit = (hw2 >> 10) & 0b1;
+    u_bit = (hw2 >> 9) & 0b1;
+    w_bit = (hw2 >> 8) & 0b1;
+    offset = hw2 & 0xFF;
+    if(p_bit == 0 && w_bit == 0)
+    {
+      use_undefined(uop);
+      return;
+    }
+  }
+  else if((hw2 & 0xFC0) == 0)
+  {
+    by_register = 1;
+    rm = hw2 & 0xF;
+    shift = (hw2 >> 4) & 0x3;
+  }
+  else
+  {
+    use_undefined(uop);
+    return;
+  }
+
+  /* ARM writes back after indexing without W. */
+  w_bit &= p_bit;
+
+  if(size == 2 || (size == 0 && !sign))
+  {
+    if(by_register)
+    {
+      use_arm(uop, ARM_TRANSFER_REG(size == 0, l_bit, rn, rt, rm, shift));
+    }
+    else
+    {
+      use_arm(uop, ARM_TRANSFER_IMM(p_bit, u_bit, size == 0, w_bit, l_bit, rn, rt, offset));
+    }
+    return;
+  }
+
+  sh = size == 0 ? 2 : sign ? 3 : 1;
+  if(by_register && shift == 0)
+  {
+    use_arm(uop, ARM_HALFWORD(1, 1, 0, 0, l_bit, sh, rn, rt, rm));
+  }
+  else if(by_register)
+  {
+    use_thumb(uop, thumb_halfword, ARM_HALFWORD(1, 1, 0, 0, l_bit, sh, rn, rt, 0), rm | (shift << 4), ARM_COUNT_MEM, 0);
+  }
+  else if(offset <= 0xFF)
+  {
+    use_arm(uop, ARM_HALFWORD(p_bit, u_bit, 1, w_bit, l_bit, sh, rn, rt, offset));
+  }
+  else
+  {
+    use_thumb(uop, thumb_halfword, ARM_HALFWORD(p_bit, u_bit, 1, w_bit, l_bit, sh, rn, rt, 0), offset, ARM_COUNT_MEM, 0);
+  }
+}
+
+/* Shifts by a register, the extends, and the byte reversals and CLZ. */
+static void decode_wide_register(struct thumb_uop* uop, unsigned int hw1, unsigned int hw2)
+{
+  unsigned int rn = hw1 & 0xF;
+  unsigned int rd = (hw2 >> 8) & 0xF;
+  unsigned int rm = hw2 & 0xF;
+
+  if(rd == PC || rm == PC)
+  {
+    use_undefined(uop);
+  }
+  else if((hw1 & 0xFF80) == 0xFA00 && (hw2 & 0xF0F0) == 0xF000 && rn != PC)
+  {
+    use_arm(uop, ARM_DP_RSR(DP_MOV, (hw1 >> 4) & 0b1, rd, rn, (hw1 >> 5) & 0x3, rm));
+  }
+  else if((hw1 & 0xFF80) == 0xFA00 && (hw2 & 0xF0C0) == 0xF080 && wide_extend_op[(hw1 >> 4) & 0x7] != 0)
+  {
+    use_arm(uop, ARM_EXTEND(wide_extend_op[(hw1 >> 4) & 0x7], rn, rd, (hw2 >> 4) & 0x3, rm));
+  }
+  else if((hw1 & 0xFFF0) == 0xFA90 && (hw2 & 0xF0C0) == 0xF080)
+  {
+    use_thumb(uop, thumb_reverse, (((hw2 >> 4) & 0x3) << 20) | (rd << 12) | rm, 0, ARM_COUNT_COMP, 0);
+  }
+  else if((hw1 & 0xFFF0) == 0xFAB0 && (hw2 & 0xF0F0) == 0xF080)
+  {
+    use_thumb(uop, thumb_count_zeros, (rd << 12) | rm, 0, ARM_COUNT_COMP, 0);
+  }
+  else
+  {
+    use_undefined(uop);
+  }
+}
+
+/* MUL, MLA, the long multiplies and the divides. */
+static void decode_wide_multiply(struct thumb_uop* uop, unsigned int hw1, unsigned int hw2)
+{
+  unsigned int rn = hw1 & 0xF;
+  unsigned int ra = hw2 >> 12;
+  unsigned int rd = (hw2 >> 8) & 0xF;
+  unsigned int rm = hw2 & 0xF;
+
+  if(rn == PC || rd == PC || rm == PC)
+  {
+    use_undefined(uop);
+  }
+  else if((hw1 & 0xFFF0) == 0xFB00 && (hw2 & 0xF0) == 0)
+  {
+    use_arm(uop, (ra == PC ? 0xE0000090 : 0xE0200090 | (ra << 12)) | (rd << 16) | (rm << 8) | rn);
+  }
+  else if((hw1 & 0xFFD0) == 0xFB90 && (hw2 & 0xF0F0) == 0xF0F0)
+  {
+    use_thumb(uop, thumb_divide, (rn << 16) | (rd << 12) | ((((hw1 >> 5) & 0b1) ^ 0b1) << 4) | rm, 0, ARM_COUNT_COMP, 0);
+  }
+  else if((hw1 & 0xFF90) == 0xFB80 && (hw2 & 0xF0) == 0 && ra != PC)
+  {
+    use_arm(uop, 0xE0800090 | ((((hw1 >> 5) & 0b1) ^ 0b1) << 22) | (((hw1 >> 6) & 0b1) << 21) | (rd << 16) | (ra << 12) | (rm << 8) | rn);
+  }
+  else
+  {
+    use_undefined(uop);
+  }
+}
+
+static void decode_wide(struct thumb_uop* uop, unsigned int hw1, unsigned int hw2)
+{
+  if((hw1 & 0xFE40) == 0xE800)
+  {
+    decode_wide_multiple(uop, hw1, hw2);
+  }
+  else if((hw1 & 0xFE40) == 0xE840)
+  {
+    decode_wide_dual(uop, hw1, hw2);
+  }
+  else if((hw1 & 0xFE00) == 0xEA00)
+  {
+    decode_wide_shifted(uop, hw1, hw2);
+  }
+  else if((hw1 & 0xFC00) == 0xEC00 && (hw1 & 0xFF00) != 0xEF00)
+  {
+    use_arm(uop, (hw1 << 16) | hw2);
+  }
+  else if((hw1 & 0xF800) == 0xF000 && (hw2 & 0x8000) == 0)
+  {
+    if((hw1 >> 9) & 0b1)
+    {
+      decode_wide_plain(uop, hw1, hw2);
+    }
+    else
+    {
+      decode_wide_immediate(uop, hw1, hw2);
+    }
+  }
+  else if((hw1 & 0xF800) == 0xF000)
+  {
+    decode_wide_branch(uop, hw1, hw2);
+  }
+  else if((hw1 & 0xFE00) == 0xF800)
+  {
+    decode_wide_single(uop, hw1, hw2);
+  }
+  else if((hw1 & 0xFF00) == 0xFA00)
+  {
+    decode_wide_register(uop, hw1, hw2);
+  }
+  else if((hw1 & 0xFF00) == 0xFB00)
+  {
+    decode_wide_multiply(uop, hw1, hw2);
+  }
+  else
+  {
+    use_undefined(uop);
+  }
+}
+
+/*
+ * Decodes the instruction at pc given the IT state before it, and returns
+ * the IT state after it. Inside an IT block the instruction takes the
+ * block's condition and the 16-bit forms do not set flags.
+ */
+unsigned int arm_thumb_decode(struct arm_state* arm_s, unsigned int pc, unsigned int it, struct thumb_uop* uop)
+{
+  unsigned int hw = *((uint16_t *) GUEST_ACCESS(arm_s, pc, MMU_FETCH));
+  unsigned int next = 0;
+
+  uop->pc = pc;
+  uop->cond = COND_AL;
+  if((hw >> 11) >= 0x1D)
+  {
+    uop->len = 4;
+    decode_wide(uop, hw, *((uint16_t *) GUEST_ACCESS(arm_s, pc + 2, MMU_FETCH)));
+  }
+  else
+  {
+    uop->len = 2;
+    decode_narrow(uop, hw, (it & 0xF) == 0);
+  }
+
+  if((it & 0xF) != 0)
+  {
+    uop->cond = it >> 4;
+    next = (it & 0x7) == 0 ? 0 : (it & 0xE0) | ((it << 1) & 0x1F);
+  }
+  if((hw & 0xFF00) == 0xBF00 && (hw & 0xF) != 0)
+  {
+    next = hw & 0xFF;
+  }
+  uop->it = next;
+  return next;
+}
+
+/* Conditions that fail still count the instruction, as in ARM state. */
+static inline void thumb_execute(struct arm_state* arm_s, const struct thumb_uop* uop)
+{
+  switch(uop->counter)
+  {
+    case ARM_COUNT_COMP:
+      arm_s->comp_count++;
+      break;
+    case ARM_COUNT_MEM:
+      arm_s->mem_count++;
+      break;
+    case ARM_COUNT_BR:
+      arm_s->br_count++;
+      break;
+  }
+
+  arm_s->thumb_pc = uop->pc;
+  if(uop->cond != COND_AL && !check_cpsr_flags(arm_s, (unsigned int) uop->cond << 28))
+  {
+    arm_s->regs[PC] = uop->pc + uop->len;
+    return;
+  }
+
+  arm_s->regs[PC] = uop->pc + uop->len - 4;
+  if(uop->arm.run != NULL)
+  {
+    uop->arm.run(arm_s, &uop->arm);
+  }
+  else
+  {
+    uop->thumb(arm_s, uop);
+  }
+}
+
+/* Without a translation cache each instruction is decoded as it is reached. */
+void arm_thumb_step(struct arm_state* arm_s)
+{
+  struct thumb_uop uop;
+
+  arm_s->thumb_pc = arm_s->regs[PC];
+  arm_s->it_state = arm_thumb_decode(arm_s, arm_s->regs[PC], arm_s->it_state, &uop);
+  thumb_execute(arm_s, &uop);
+}
+
+void arm_thumb_flush(struct arm_tcache* tc)
+{
+  struct thumb_cache* cache = tc->thumb;
+
+  if(cache == NULL)
+  {
+    return;
+  }
+  while(cache->all_blocks != NULL)
+  {
+    struct thumb_block* next = cache->all_blocks->all_next;
+    free(cache->all_blocks);
+    cache->all_blocks = next;
+  }
+  memset(cache->buckets, 0, sizeof(cache->buckets));
+  cache->num_blocks = 0;
+}
+
+/*
+ * Blocks end like ARM ones, at the first instruction that can write PC or
+ * at the end of a page, but never inside an IT block unless that
+ * instruction ends it early or the page ends.
+ */
+static struct thumb_block* translate(struct arm_state* arm_s, struct arm_tcache* tc, unsigned int pc)
+{
+  struct thumb_cache* cache = tc->thumb;
+  struct thumb_uop uops[TCACHE_MAX_BLOCK + 4];
+  struct thumb_block* block;
+  unsigned int address = pc;
+  unsigned int it = 0;
+  unsigned int n = 0;
+
+  for(;;)
+  {
+    struct thumb_uop* uop = &uops[n++];
+
+    it = arm_thumb_decode(arm_s, address, it, uop);
+    arm_tcache_mark_code(tc, address);
+    arm_tcache_mark_code(tc, address + uop->len - 1);
+    if(uop->ends || (n >= TCACHE_MAX_BLOCK && it == 0) || n == TCACHE_MAX_BLOCK + 4)
+    {
+      break;
+    }
+    address += uop->len;
+    /* An instruction in the last halfword of a page can be wide and reach into the next one. */
+    if((address & (GUEST_PAGE_SIZE - 1)) == 0 || (address & (GUEST_PAGE_SIZE - 1)) == GUEST_PAGE_SIZE - 2)
+    {
+      break;
+    }
+  }
+
+  block = (struct thumb_block*)malloc(sizeof(struct thumb_block) + n * sizeof(struct thumb_uop));
+  if(block == NULL)
+  {
+    printf("Unable to allocate memory failed, exiting.\n");
+    exit(-1);
+  }
+
+  block->pc = pc;
+  block->num_uops = n;
+  memcpy(block->uops, uops, n * sizeof(struct thumb_uop));
+
+  block->hash_next = cache->buckets[THUMB_HASH(pc)];
+  cache->buckets[THUMB_HASH(pc)] = block;
+  block->all_next = cache->all_blocks;
+  cache->all_blocks = block;
+  cache->num_blocks++;
+
+  return block;
+}
+
+static struct thumb_block* lookup(struct arm_state* arm_s, struct arm_tcache* tc, unsigned int pc)
+{
+  struct thumb_block* block;
+
+  if(tc->thumb == NULL)
+  {
+    tc->thumb = (struct thumb_cache*)calloc(1, sizeof(struct thumb_cache));
+    if(tc->thumb == NULL)
+    {
+      printf("Unable to allocate memory failed, exiting.\n");
+      exit(-1);
+    }
+  }
+
+  for(block = tc->thumb->buckets[THUMB_HASH(pc)]; block != NULL; block = block->hash_next)
+  {
+    if(block->pc == pc)
+    {
+      return block;
+    }
+  }
+  return translate(arm_s, tc, pc);
+}
+
+/*
+ * Runs one cached Thumb block for arm_tcache_run. Blocks are only entered
+ * outside IT blocks; one left mid-way, by an SVC say, is finished by
+ * stepping.
+ */
+void arm_thumb_run_block(struct arm_state* arm_s, struct arm_tcache* tc)
+{
+  struct thumb_block* block;
+  struct thumb_uop* uop;
+  struct thumb_uop* end;
+
+  if(arm_s->it_state != 0)
+  {
+    arm_thumb_step(arm_s);
+    return;
+  }
+
+  arm_s->thumb_pc = arm_s->regs[PC];
+  block = lookup(arm_s, tc, arm_s->regs[PC]);
+  end = block->uops + block->num_uops;
+  for(uop = block->uops; uop != end; uop++)
+  {
+    thumb_execute(arm_s, uop);
+  }
+  arm_s->it_state = end[-1].it;
+}
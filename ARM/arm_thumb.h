@@ -0,0 +1,50 @@
+#ifndef ARM_THUMB_H
+#define ARM_THUMB_H
+
+#include "arm_block.h"
+
+struct arm_state;
+
+/*
+ * A decoded Thumb instruction. Most are re-encoded as the ARM instruction
+ * that does the same thing and run by the ARM handler in arm, with PC set
+ * so that the handler's step of 4 lands on the next Thumb instruction. The
+ * rest run a Thumb handler, which finds its operands in iw and imm.
+ */
+struct thumb_uop
+{
+  struct arm_uop arm;
+  void (*thumb)(struct arm_state*, const struct thumb_uop*);
+  unsigned int iw;
+  unsigned int imm;
+  unsigned int pc;
+  unsigned char len;
+  unsigned char cond;
+  unsigned char counter;
+  unsigned char ends;
+  unsigned char it;
+};
+
+/* Decoded Thumb blocks, kept next to the ARM ones and flushed with them. */
+struct thumb_block
+{
+  unsigned int pc;
+  unsigned int num_uops;
+  struct thumb_block* hash_next;
+  struct thumb_block* all_next;
+  struct thumb_uop uops[];
+};
+
+struct thumb_cache
+{
+  struct thumb_block* buckets[TCACHE_BUCKETS];
+  struct thumb_block* all_blocks;
+  unsigned int num_blocks;
+};
+
+unsigned int arm_thumb_decode(struct arm_state* arm_s, unsigned int pc, unsigned int it, struct thumb_uop* uop);
+void arm_thumb_step(struct arm_state* arm_s);
+void arm_thumb_run_block(struct arm_state* arm_s, struct arm_tcache* tc);
+void arm_thumb_flush(struct arm_tcache* tc);
+
+#endif
@@ -0,0 +1,631 @@
+#define _GNU_SOURCE
+#include <fenv.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+
+#include "arm_vm.h"
+#include "arm_vfp.h"
+
+/* Register numbers: a double register is D:Vd and a single one Vd:D. */
+#define VFP_REG(v, x, dbl)  ((dbl) ? ((x) << 4) | (v) : ((v) << 1) | (x))
+#define VFP_D(iw, dbl)  VFP_REG(((iw) >> 12) & 0xF, ((iw) >> 22) & 0b1, dbl)
+#define VFP_N(iw, dbl)  VFP_REG(((iw) >> 16) & 0xF, ((iw) >> 7) & 0b1, dbl)
+#define VFP_M(iw, dbl)  VFP_REG((iw) & 0xF, ((iw) >> 5) & 0b1, dbl)
+
+#define DEFAULT_NAN_SINGLE  0x7FC00000u
+#define DEFAULT_NAN_DOUBLE  0x7FF8000000000000ull
+
+/* Bits 23, 21:20 and 6 of a data-processing instruction. */
+enum vfp_op
+{
+  VFP_MLA = 0, VFP_MLS, VFP_NMLS, VFP_NMLA, VFP_MUL, VFP_NMUL, VFP_ADD, VFP_SUB,
+  VFP_DIV, VFP_OTHER = 14, VFP_OTHER_1
+};
+
+static const int host_rounding[4] = {FE_TONEAREST, FE_UPWARD, FE_DOWNWARD, FE_TOWARDZERO};
+
+static void set_host_mode(unsigned int fpscr)
+{
+  fesetround(host_rounding[(fpscr >> FPSCR_RMODE_SHIFT) & 0x3]);
+#if defined(__SSE2__)
+  _mm_setcsr((_mm_getcsr() & ~0x8040u) | ((fpscr & FPSCR_FZ) ? 0x8040u : 0));
+#endif
+}
+
+/* The caller's environment, MXCSR and the x87 control word included, is restored on leaving. */
+void arm_vfp_enter(struct arm_state* arm_s)
+{
+  fegetenv(&arm_s->host_fenv);
+  feclearexcept(FE_ALL_EXCEPT);
+  set_host_mode(arm_s->fpscr);
+}
+
+void arm_vfp_leave(struct arm_state* arm_s)
+{
+  arm_fpscr(arm_s);
+  fesetenv(&arm_s->host_fenv);
+}
+
+unsigned int arm_fpscr(struct arm_state* arm_s)
+{
+  int raised = fetestexcept(FE_ALL_EXCEPT);
+
+  if(raised != 0)
+  {
+    arm_s->fpscr |= ((raised & FE_INVALID) ? FPSCR_IOC : 0) | ((raised & FE_DIVBYZERO) ? FPSCR_DZC : 0) |
+                    ((raised & FE_OVERFLOW) ? FPSCR_OFC : 0) | ((raised & FE_UNDERFLOW) ? FPSCR_UFC : 0) |
+                    ((raised & FE_INEXACT) ? FPSCR_IXC : 0);
+  }
+  return arm_s->fpscr;
+}
+
+static void write_fpscr(struct arm_state* arm_s, unsigned int value)
+{
+  feclearexcept(FE_ALL_EXCEPT);
+  set_host_mode(value);
+  arm_s->fpscr = value;
+}
+
+/*
+ * The host and ARM agree on everything but NaNs: ARM prefers a signalling
+ * operand to a quiet one and makes positive default NaNs. Only called when
+ * the host result is a NaN.
+ */
+static double nan_double(const struct arm_state* arm_s, double a, double b)
+{
+  uint64_t x, y;
+  uint64_t result;
+
+  memcpy(&x, &a, 8);
+  memcpy(&y, &b, 8);
+  if(arm_s->fpscr & FPSCR_DN)
+  {
+    result = DEFAULT_NAN_DOUBLE;
+  }
+  else if(a != a && !((x >> 51) & 0b1))
+  {
+    result = x;
+  }
+  else if(b != b && !((y >> 51) & 0b1))
+  {
+    result = y;
+  }
+  else
+  {
+    result = a != a ? x : b != b ? y : DEFAULT_NAN_DOUBLE;
+  }
+  result |= 1ull << 51;
+  memcpy(&a, &result, 8);
+  return a;
+}
+
+static float nan_single(const struct arm_state* arm_s, float a, float b)
+{
+  uint32_t x, y;
+  uint32_t result;
+
+  memcpy(&x, &a, 4);
+  memcpy(&y, &b, 4);
+  if(arm_s->fpscr & FPSCR_DN)
+  {
+    result = DEFAULT_NAN_SINGLE;
+  }
+  else if(a != a && !((x >> 22) & 0b1))
+  {
+    result = x;
+  }
+  else if(b != b && !((y >> 22) & 0b1))
+  {
+    result = y;
+  }
+  else
+  {
+    result = a != a ? x : b != b ? y : DEFAULT_NAN_SINGLE;
+  }
+  result |= 1u << 22;
+  memcpy(&a, &result, 4);
+  return a;
+}
+
+static inline double checked_double(const struct arm_state* arm_s, double r, double a, double b)
+{
+  return r == r ? r : nan_double(arm_s, a, b);
+}
+
+static inline float checked_single(const struct arm_state* arm_s, float r, float a, float b)
+{
+  return r == r ? r : nan_single(arm_s, a, b);
+}
+
+/*
+ * Rounds and saturates as VCVT does. The range is checked first because
+ * ARM sets only IOC for an out of range value, and the in-range conversion
+ * then sets IXC exactly when the host's does.
+ */
+static long long to_integer(double x, int toward_zero, long long lo, long long hi)
+{
+  double r = toward_zero ? x : nearbyint(x);
+
+  if(x != x)
+  {
+    feraiseexcept(FE_INVALID);
+    return 0;
+  }
+  if(toward_zero ? x <= (double) lo - 1.0 || x >= (double) hi + 1.0 : r < (double) lo || r > (double) hi)
+  {
+    feraiseexcept(FE_INVALID);
+    return x < 0 ? lo : hi;
+  }
+  return toward_zero ? (long long) x : llrint(x);
+}
+
+static void compare(struct arm_state* arm_s, double a, double b, int signalling)
+{
+  unsigned int nzcv;
+
+  if(a == b)
+  {
+    nzcv = 0x6;
+  }
+  else if(__builtin_isless(a, b))
+  {
+    nzcv = 0x8;
+  }
+  else if(__builtin_isgreater(a, b))
+  {
+    nzcv = 0x2;
+  }
+  else
+  {
+    nzcv = 0x3;
+    if(signalling)
+    {
+      feraiseexcept(FE_INVALID);
+    }
+  }
+  arm_s->fpscr = (arm_s->fpscr & ~FPSCR_NZCV) | (nzcv << 28);
+}
+
+static unsigned long long expand_imm(unsigned int iw, int dbl)
+{
+  unsigned int imm8 = ((iw >> 12) & 0xF0) | (iw & 0xF);
+  unsigned long long sign = imm8 >> 7;
+  unsigned int b = (imm8 >> 6) & 0b1;
+  unsigned int cd = (imm8 >> 4) & 0x3;
+
+  if(dbl)
+  {
+    return (sign << 63) | ((unsigned long long)((b ? 0x3FC : 0x400) | cd) << 52) | ((unsigned long long)(imm8 & 0xF) << 48);
+  }
+  return (sign << 31) | ((unsigned long long)((b ? 0x7C : 0x80) | cd) << 23) | ((imm8 & 0xF) << 19);
+}
+
+static void arith_double(struct arm_state* arm_s, unsigned int op, unsigned int iw)
+{
+  double* regs = arm_s->vfp.d;
+  double a = regs[VFP_N(iw, 1)];
+  double b = regs[VFP_M(iw, 1)];
+  double d = regs[VFP_D(iw, 1)];
+  double p;
+  double r;
+
+  switch(op)
+  {
+    case VFP_ADD:
+      r = checked_double(arm_s, a + b, a, b);
+      break;
+
+    case VFP_SUB:
+      r = checked_double(arm_s, a - b, a, b);
+      break;
+
+    case VFP_MUL:
+      r = checked_double(arm_s, a * b, a, b);
+      break;
+
+    case VFP_NMUL:
+      r = -checked_double(arm_s, a * b, a, b);
+      break;
+
+    case VFP_DIV:
+      r = checked_double(arm_s, a / b, a, b);
+      break;
+
+    default:
+      p = checked_double(arm_s, a * b, a, b);
+      p = (op == VFP_MLS || op == VFP_NMLA) ? -p : p;
+      d = (op == VFP_NMLS || op == VFP_NMLA) ? -d : d;
+      r = checked_double(arm_s, d + p, d, p);
+      break;
+  }
+  regs[VFP_D(iw, 1)] = r;
+}
+
+static void arith_single(struct arm_state* arm_s, unsigned int op, unsigned int iw)
+{
+  float* regs = arm_s->vfp.s;
+  float a = regs[VFP_N(iw, 0)];
+  float b = regs[VFP_M(iw, 0)];
+  float d = regs[VFP_D(iw, 0)];
+  float p;
+  float r;
+
+  switch(op)
+  {
+    case VFP_ADD:
+      r = checked_single(arm_s, a + b, a, b);
+      break;
+
+    case VFP_SUB:
+      r = checked_single(arm_s, a - b, a, b);
+      break;
+
+    case VFP_MUL:
+      r = checked_single(arm_s, a * b, a, b);
+      break;
+
+    case VFP_NMUL:
+      r = -checked_single(arm_s, a * b, a, b);
+      break;
+
+    case VFP_DIV:
+      r = checked_single(arm_s, a / b, a, b);
+      break;
+
+    default:
+      p = checked_single(arm_s, a * b, a, b);
+      p = (op == VFP_MLS || op == VFP_NMLA) ? -p : p;
+      d = (op == VFP_NMLS || op == VFP_NMLA) ? -d : d;
+      r = checked_single(arm_s, d + p, d, p);
+      break;
+  }
+  regs[VFP_D(iw, 0)] = r;
+}
+
+/* Widening a single signalling NaN raises IOC, so only operations that would are given one. */
+static inline double source(const struct arm_state* arm_s, unsigned int r, int dbl)
+{
+  return dbl ? arm_s->vfp.d[r] : arm_s->vfp.s[r];
+}
+
+/* VCVT between floating point and fixed point, in place. */
+static void convert_fixed(struct arm_state* arm_s, unsigned int iw, int dbl)
+{
+  unsigned int d = VFP_D(iw, dbl);
+  unsigned int is_unsigned = (iw >> 16) & 0b1;
+  unsigned int size = ((iw >> 7) & 0b1) ? 32 : 16;
+  int frac = (int) size - (int) (((iw & 0xF) << 1) | ((iw >> 5) & 0b1));
+  long long lo = is_unsigned ? 0 : -(1ll << (size - 1));
+  long long hi = is_unsigned ? (1ll << size) - 1 : (1ll << (size - 1)) - 1;
+  long long value;
+
+  if(frac < 0)
+  {
+    guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+  }
+
+  if((iw >> 18) & 0b1)
+  {
+    double x = source(arm_s, d, dbl);
+
+    /* Scaling something this large could overflow, and it saturates anyway. */
+    if(fabs(x) < 0x1p64)
+    {
+      x *= (double) (1ull << frac);
+    }
+    value = to_integer(x, 1, lo, hi);
+    if(dbl)
+    {
+      arm_s->vfp.x[d] = (unsigned long long) value;
+    }
+    else
+    {
+      arm_s->vfp.w[d] = (unsigned int) value;
+    }
+  }
+  else
+  {
+    value = dbl ? (long long) arm_s->vfp.x[d] : (long long) arm_s->vfp.w[d];
+    value &= (1ll << size) - 1;
+    if(!is_unsigned && ((value >> (size - 1)) & 0b1))
+    {
+      value -= 1ll << size;
+    }
+    if(dbl)
+    {
+      arm_s->vfp.d[d] = (double) value / (double) (1ull << frac);
+    }
+    else
+    {
+      arm_s->vfp.s[d] = (float) ((double) value / (double) (1ull << frac));
+    }
+  }
+}
+
+/* VMOV immediate and register, VABS, VNEG, VSQRT, VCMP and VCVT. */
+static void other(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int dbl = (iw >> 8) & 0b1;
+  unsigned int d = VFP_D(iw, dbl);
+  unsigned int m = VFP_M(iw, dbl);
+  unsigned int op2 = (iw >> 16) & 0xF;
+  unsigned int op7 = (iw >> 7) & 0b1;
+
+  if(((iw >> 6) & 0b1) == 0)
+  {
+    if(dbl)
+    {
+      arm_s->vfp.x[d] = expand_imm(iw, 1);
+    }
+    else
+    {
+      arm_s->vfp.w[d] = (unsigned int) expand_imm(iw, 0);
+    }
+    return;
+  }
+
+  switch(op2)
+  {
+    case 0x0:
+    case 0x1:
+      if(op2 == 0x1 && op7 == 1)
+      {
+        if(dbl)
+        {
+          double x = arm_s->vfp.d[m];
+          arm_s->vfp.d[d] = checked_double(arm_s, sqrt(x), x, x);
+        }
+        else
+        {
+          float s = arm_s->vfp.s[m];
+          arm_s->vfp.s[d] = checked_single(arm_s, sqrtf(s), s, s);
+        }
+      }
+      else if(dbl)
+      {
+        unsigned long long bits = arm_s->vfp.x[m];
+        arm_s->vfp.x[d] = op2 == 0x1 ? bits ^ (1ull << 63) : op7 ? bits & ~(1ull << 63) : bits;
+      }
+      else
+      {
+        unsigned int bits = arm_s->vfp.w[m];
+        arm_s->vfp.w[d] = op2 == 0x1 ? bits ^ (1u << 31) : op7 ? bits & ~(1u << 31) : bits;
+      }
+      break;
+
+    case 0x4:
+    case 0x5:
+      compare(arm_s, source(arm_s, d, dbl), op2 == 0x5 ? 0.0 : source(arm_s, m, dbl), op7);
+      break;
+
+    case 0x7:
+      if(op7 == 0)
+      {
+        guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+      }
+      if(dbl)
+      {
+        float s = (float) arm_s->vfp.d[m];
+        arm_s->vfp.s[VFP_D(iw, 0)] = checked_single(arm_s, s, s, s);
+      }
+      else
+      {
+        double x = arm_s->vfp.s[m];
+        arm_s->vfp.d[VFP_D(iw, 1)] = checked_double(arm_s, x, x, x);
+      }
+      break;
+
+    case 0x8:
+    {
+      unsigned int value = arm_s->vfp.w[VFP_M(iw, 0)];
+      double y = op7 ? (double) (int) value : (double) value;
+
+      if(dbl)
+      {
+        arm_s->vfp.d[d] = y;
+      }
+      else
+      {
+        arm_s->vfp.s[d] = (float) y;
+      }
+      break;
+    }
+
+    case 0xC:
+    case 0xD:
+      arm_s->vfp.w[VFP_D(iw, 0)] = (unsigned int) (op2 == 0xD ? to_integer(source(arm_s, m, dbl), op7, INT32_MIN, INT32_MAX)
+                                                                : to_integer(source(arm_s, m, dbl), op7, 0, UINT32_MAX));
+      break;
+
+    case 0xA:
+    case 0xB:
+    case 0xE:
+    case 0xF:
+      convert_fixed(arm_s, iw, dbl);
+      break;
+
+    default:
+      guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+  }
+}
+
+static void system_register(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int rt = (iw >> 12) & 0xF;
+  unsigned int reg = (iw >> 16) & 0xF;
+  unsigned int value;
+
+  if(((iw >> 20) & 0b1) == 0)
+  {
+    if(rt == PC)
+    {
+      guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+    }
+    if(reg == 0x1)
+    {
+      write_fpscr(arm_s, arm_s->regs[rt]);
+    }
+    else if(reg == 0x8)
+    {
+      arm_s->fpexc = arm_s->regs[rt];
+    }
+    else if(reg != 0x0)
+    {
+      guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+    }
+    return;
+  }
+
+  switch(reg)
+  {
+    case 0x0:
+      value = VFP_FPSID;
+      break;
+
+    case 0x1:
+      value = arm_fpscr(arm_s);
+      break;
+
+    case 0x6:
+      value = VFP_MVFR1;
+      break;
+
+    case 0x7:
+      value = VFP_MVFR0;
+      break;
+
+    case 0x8:
+      value = arm_s->fpexc;
+      break;
+
+    default:
+      guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+  }
+
+  /* VMRS APSR_nzcv, FPSCR */
+  if(rt == PC)
+  {
+    if(reg != 0x1)
+    {
+      guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+    }
+    arm_cpsr(arm_s);
+    arm_s->cpsr = (arm_s->cpsr & ~CPSR_NZCV) | (value & FPSCR_NZCV);
+  }
+  else
+  {
+    arm_s->regs[rt] = value;
+  }
+}
+
+/* VMOV between core registers and a single register or half a double one. */
+static void core_transfer(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int rt = (iw >> 12) & 0xF;
+  unsigned int to_core = (iw >> 20) & 0b1;
+  unsigned int* word;
+
+  if(((iw >> 21) & 0x7) == 0x7 && ((iw >> 8) & 0b1) == 0)
+  {
+    system_register(arm_s, iw);
+    return;
+  }
+
+  if(((iw >> 8) & 0b1) == 0)
+  {
+    if(((iw >> 21) & 0x7) != 0)
+    {
+      guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+    }
+    word = &arm_s->vfp.w[VFP_N(iw, 0)];
+  }
+  else
+  {
+    if(((iw >> 22) & 0x3) != 0 || ((iw >> 5) & 0x3) != 0)
+    {
+      guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+    }
+    word = &arm_s->vfp.w[VFP_N(iw, 1) * 2 + ((iw >> 21) & 0b1)];
+  }
+
+  if(rt == PC)
+  {
+    guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+  }
+  if(to_core)
+  {
+    arm_s->regs[rt] = *word;
+  }
+  else
+  {
+    *word = arm_s->regs[rt];
+  }
+}
+
+/* VMOV between two core registers and two single or one double register. */
+static void core_transfer_pair(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int rt = (iw >> 12) & 0xF;
+  unsigned int rt2 = (iw >> 16) & 0xF;
+  unsigned int first = ((iw >> 8) & 0b1) ? VFP_M(iw, 1) * 2 : VFP_M(iw, 0);
+
+  if(((iw >> 21) & 0xF) != 0x2 || (iw & 0xD0) != 0x10 || rt == PC || rt2 == PC || first == 31)
+  {
+    guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+  }
+
+  if((iw >> 20) & 0b1)
+  {
+    arm_s->regs[rt] = arm_s->vfp.w[first];
+    arm_s->regs[rt2] = arm_s->vfp.w[first + 1];
+  }
+  else
+  {
+    arm_s->vfp.w[first] = arm_s->regs[rt];
+    arm_s->vfp.w[first + 1] = arm_s->regs[rt2];
+  }
+}
+
+/*
+ * A VFP instruction that does not touch memory, from the coprocessor class
+ * or the MCRR/MRRC corner of the coprocessor transfer class. The caller
+ * steps PC.
+ */
+void arm_vfp_execute(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int op = (((iw >> 21) & 0x4) | ((iw >> 20) & 0x3)) << 1 | ((iw >> 6) & 0b1);
+
+  if(((iw >> 9) & 0x7) != 0x5 || !(arm_s->fpexc & FPEXC_EN))
+  {
+    guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+  }
+
+  if(((iw >> 24) & 0xF) == 0xC)
+  {
+    core_transfer_pair(arm_s, iw);
+  }
+  else if((iw >> 4) & 0b1)
+  {
+    core_transfer(arm_s, iw);
+  }
+  else if(op >= VFP_OTHER)
+  {
+    other(arm_s, iw);
+  }
+  else if(op > VFP_DIV)
+  {
+    guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+  }
+  else if((iw >> 8) & 0b1)
+  {
+    arith_double(arm_s, op, iw);
+  }
+  else
+  {
+    arith_single(arm_s, op, iw);
+  }
+}
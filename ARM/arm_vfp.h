@@ -0,0 +1,35 @@
+#ifndef ARM_VFP_H
+#define ARM_VFP_H
+
+struct arm_state;
+
+#define FPSCR_IOC  0x00000001
+#define FPSCR_DZC  0x00000002
+#define FPSCR_OFC  0x00000004
+#define FPSCR_UFC  0x00000008
+#define FPSCR_IXC  0x00000010
+#define FPSCR_RMODE_SHIFT  22
+#define FPSCR_FZ  0x01000000
+#define FPSCR_DN  0x02000000
+#define FPSCR_NZCV  0xF0000000
+
+#define FPEXC_EN  0x40000000
+
+#define VFP_FPSID  0x41023075
+#define VFP_MVFR0  0x10110222
+#define VFP_MVFR1  0x00000011
+
+/*
+ * VFPv3 with 32 double registers, run on the host FPU. The cumulative
+ * exception bits of FPSCR are left in the host's sticky flags while the
+ * guest runs and folded in by arm_fpscr, so an operation costs what the
+ * host instruction costs unless its result is a NaN. arm_state_execute
+ * brackets a run with arm_vfp_enter and arm_vfp_leave, which gives the
+ * caller back its own floating-point environment.
+ */
+void arm_vfp_enter(struct arm_state* arm_s);
+void arm_vfp_leave(struct arm_state* arm_s);
+unsigned int arm_fpscr(struct arm_state* arm_s);
+void arm_vfp_execute(struct arm_state* arm_s, unsigned int iw);
+
+#endif
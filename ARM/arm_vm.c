@@ -1,494 +1,1909 @@
-#include <stdbool.h>
-#include <stdio.h>
-#include <stdlib.h>
-
-#define MAX_REGS  16
-#define SP  13
-#define LR  14
-#define PC  15
-#define STACK_SIZE  1024
-
-struct arm_state
-{
-  unsigned int regs[MAX_REGS];
-  unsigned int cpsr;
-  unsigned char* stack;
-  unsigned int comp_count;
-  unsigned int mem_count;
-  unsigned int br_count;
-};
-
-struct arm_state* new_arm_state(unsigned int* func, unsigned int arg0, unsigned int arg1, unsigned int arg2, unsigned int arg3)
-{
-  struct arm_state* arm_s;
-  int i;
-
-  arm_s = (struct arm_state*)malloc(sizeof(struct arm_state));
-  if(arm_s == NULL)
-  {
-    printf("Unable to allocate memory failed, exiting.\n");
-    exit(-1);
-  }
-
-  arm_s->stack = (unsigned char*)malloc(STACK_SIZE);
-  if(arm_s->stack == NULL)
-  {
-    printf("Unable to allocate memory failed, exiting.\n");
-    exit(-1);
-  }
-
-  arm_s->cpsr = 0;
-  for(i = 0; i < MAX_REGS; i++)
-  {
-    arm_s->regs[i] = 0;
-  }
-
-  arm_s->regs[PC] = (unsigned int) func;
-  arm_s->regs[SP] = (unsigned int) arm_s->stack + STACK_SIZE;
-  arm_s->regs[0] = arg0;
-  arm_s->regs[1] = arg1;
-  arm_s->regs[2] = arg2;
-  arm_s->regs[3] = arg3;
-
-  arm_s->comp_count = 0;
-  arm_s->mem_count = 0;
-  arm_s->br_count = 0;
-
-  return arm_s;
-}
-
-void free_arm_state(struct arm_state* arm_s)
-{
-  free(arm_s->stack);
-  free(arm_s);
-}
-
-void print_arm_state(struct arm_state* arm_s, unsigned int sim_result, unsigned int assembler_result)
-{
-  printf("stack size = %d\n", STACK_SIZE);
-  printf("Register values after execution:\n");
-  for (int i = 0; i < MAX_REGS; i++)
-  {
-    printf("r%d = (%X) %d\n", i, arm_s->regs[i], (int) arm_s->regs[i]);
-  }
-  printf("cpsr: 0x%x\n", arm_s->cpsr);
-  printf("Total Instructions Executed: %d\n", (arm_s->comp_count+arm_s->mem_count+arm_s->br_count));
-  printf("Total Computational Instructions Executed: %d\n", arm_s->comp_count);
-  printf("Total Memory Instructions Executed: %d\n", arm_s->mem_count);
-  printf("Total Branch Instructions Executed: %d\n", arm_s->br_count);
-  printf("ARM Emulator Result: %d\n", sim_result);
-  printf("Assembler Result: %d\n", assembler_result);
-}
-
-void set_cpsr_flag(struct arm_state* arm_s, int result, long long result_long)
-{
-  if (result > 2147483647 || result < -2147483648)
-    {
-        arm_s->cpsr = arm_s->cpsr | 0x10000000;
-    }
-    else
-    {
-        arm_s->cpsr = arm_s->cpsr & 0xEFFFFFFF;
-    }
-
-    if(result_long < 0 && result_long > 4294967295)
-    {
-        arm_s->cpsr = arm_s->cpsr | 0x20000000;
-    }
-    else
-    {
-        arm_s->cpsr = arm_s->cpsr & 0xDFFFFFFF;
-    }
-
-    if(result < 0)
-    {
-        arm_s->cpsr = arm_s->cpsr | 0x80000000;
-        arm_s->cpsr = arm_s->cpsr & 0xBFFFFFFF;
-    }
-    else if(result == 0)
-    {
-        arm_s->cpsr = arm_s->cpsr | 0x40000000;
-        arm_s->cpsr = arm_s->cpsr & 0x7FFFFFFF;
-    }
-    else
-    {
-        arm_s->cpsr = arm_s->cpsr & 0xBFFFFFFF;
-        arm_s->cpsr = arm_s->cpsr & 0x7FFFFFFF;
-    }
-}
-
-int check_cpsr_flags(struct arm_state* arm_s, unsigned int iw)
-{
-  unsigned int condition = (iw >> 28) & 0b1111;
-
-  switch(condition)
-  {
-    case 0:
-      return ((arm_s->cpsr >> 30) & 0b1) == 1;
-
-    case 1:
-      return ((arm_s->cpsr >> 30) & 0b1) == 0;
-
-    case 11:
-      return ((arm_s->cpsr >> 28) &0b1) != ((arm_s->cpsr >> 31) & 0b1);
-
-    case 12:
-      return (((arm_s->cpsr >> 30) & 0b1) == 0) && (((arm_s->cpsr >> 31) & 0b1) == ((arm_s->cpsr >> 28) & 0b1));
-
-    case 14:
-      return true;
-  }
-}
-
-bool process_data_instruction(unsigned int iw)
-{
-  return ((iw >> 26) & 0b11) == 0;
-}
-
-bool is_bx_instruction(unsigned int iw)
-{
-  return ((iw >> 4) & 0xFFFFFF) == 0b000100101111111111110001;
-}
-
-void execute_bx_instruction(struct arm_state* arm_s, unsigned int iw)
-{
-  unsigned int rn = iw & 0b1111;
-  arm_s->regs[PC] = arm_s->regs[rn];
-}
-
-bool is_branch_instruction(unsigned int iw)
-{
-  return ((iw >> 25) & 0b111) == 0b101;
-}
-
-void execute_branch_instruction(struct arm_state* arm_s, unsigned int iw)
-{
-  unsigned int signed_bit = (iw >> 23) & 0b1;
-  unsigned int l_bit = (iw >> 24) & 0b1;
-  unsigned int offset = iw & 0xFFFFFF;
-  unsigned int destination;
-
-  if(signed_bit == 0)
-  {
-    destination = offset | 0x00000000;;
-  }
-  else
-  {
-    destination = offset | 0xFF000000;
-  }
-
-  destination = destination << 2;
-
-  if(l_bit == 1)
-  {
-    arm_s->regs[LR] = arm_s->regs[PC] + 4;
-  }
-
-  arm_s->regs[PC] += (destination + 8);
-
-}
-
-bool is_data_transfer_instruction(unsigned int iw)
-{
-  return ((iw >> 26) & 0b11) == 0b01;
-}
-
-void execute_data_transfer_instruction(struct arm_state* arm_s, unsigned int iw)
-{
-  unsigned int rd = (iw>>12) & 0xF;
-  unsigned int rn = (iw>>16) & 0xF;
-  unsigned int l_bit = (iw>>20) & 0b1;
-  unsigned int w_bit = (iw>>21) & 0b1;
-  unsigned int b_bit = (iw>>22) & 0b1;
-  unsigned int u_bit = (iw>>23) & 0b1;
-  unsigned int p_bit = (iw>>24) & 0b1;
-  unsigned int i_bit = (iw>>25) & 0b1;
-  unsigned int modified_base_value = arm_s->regs[rn];
-  unsigned int offset_value;
-
-  if(i_bit == 1)
-  {
-    offset_value = arm_s->regs[(iw & 0xF)] << ((iw>>7) & 0b11111);
-  }
-  else
-  {
-    offset_value = iw & 0xFFF;
-  }
-
-  if(b_bit == 1)
-  {
-    if (l_bit == 1)
-    {
-      arm_s->regs[rd] = (unsigned int)*((char *)modified_base_value);
-    }
-  }
-  else
-  {
-    if (l_bit == 1)
-    {
-      arm_s->regs[rd] = *((unsigned int *) modified_base_value);
-    }
-    else
-    {
-      *((unsigned int *) modified_base_value) = arm_s->regs[rd];
-    }
-  }
-  if(p_bit == 0)
-  {
-    if(u_bit == 1)
-    {
-      modified_base_value += offset_value;
-    }
-    else
-    {
-      modified_base_value += offset_value;
-    }
-  }
-  if(w_bit == 1)
-  {
-    arm_s->regs[rn] = modified_base_value;
-  }
-  arm_s->regs[PC] += 4;
-}
-
-bool is_push(unsigned int iw)
-{
-  return (((iw >> 25) & 0b111) == 0b100) && (((iw >> 20) & 0b1) == 0b0);
-}
-
-bool is_pop(unsigned int iw)
-{
-  return (((iw >> 25) & 0b111) == 0b100) && (((iw>>20) & 0b1) == 0b1);
-}
-
-void execute_push(struct arm_state* arm_s, unsigned int iw)
-{
-  unsigned int register_list = iw & 0xFFFF;
-  unsigned int rn = (iw>>16) & 0xF;
-  unsigned int w_bit = (iw>>21) & 0b1;
-  unsigned int s_bit = (iw>>22) & 0b1;
-  unsigned int u_bit = (iw>>23) & 0b1;
-  unsigned int p_bit = (iw>>24) & 0b1;
-  unsigned int modified_base_value = arm_s->regs[rn];
-  unsigned int offset_value = 4;
-
-  for(int i = (MAX_REGS - 1); i >= 0; i--)
-  {
-    if(((register_list >> i) & 0b1) == 0b1)
-    {
-      if(p_bit == 1)
-      {
-        if (u_bit == 1)
-        {
-          modified_base_value += offset_value;
-        }
-        else
-        {
-          modified_base_value -= offset_value;
-        }
-      }
-      *((unsigned int *) modified_base_value) = arm_s->regs[i];
-      if(p_bit == 0)
-      {
-        if (u_bit == 1)
-        {
-          modified_base_value += offset_value;
-        }
-        else
-        {
-          modified_base_value -= offset_value;
-        }
-      }
-      if(w_bit == 1)
-      {
-        arm_s->regs[rn] = modified_base_value;
-      }
-    }
-  }
-
-  arm_s->regs[PC] += 4;
-}
-
-void execute_pop(struct arm_state* arm_s, unsigned int iw)
-{
-  unsigned int register_list = iw & 0xFFFF;
-  unsigned int rn = (iw>>16) & 0xF;
-  unsigned int w_bit = (iw>>21) & 0b1;
-  unsigned int s_bit = (iw>>22) & 0b1;
-  unsigned int u_bit = (iw>>23) & 0b1;
-  unsigned int p_bit = (iw>>24) & 0b1;
-  unsigned int modified_base_value = arm_s->regs[rn];
-  unsigned int offset_value = 4;
-
-  for(int i = 0; i < MAX_REGS; i++)
-  {
-    if(((register_list >> i) & 0b1) == 0b1)
-    {
-      if(p_bit == 1)
-      {
-        if(u_bit == 1)
-        {
-          modified_base_value += offset_value;
-        }
-        else
-        {
-          modified_base_value -= offset_value;
-        }
-      }
-      arm_s->regs[i] = *((unsigned int *) (modified_base_value));
-      if(p_bit == 0)
-      {
-        if(u_bit == 1)
-        {
-          modified_base_value += offset_value;
-        }
-        else
-        {
-          modified_base_value -= offset_value;
-        }
-      }
-      if(w_bit == 1)
-      {
-        arm_s->regs[rn] = modified_base_value;
-      }
-    }
-
-  }
-  arm_s->regs[PC] += 4;
-}
-
-void execute_process_data_instruction(struct arm_state* arm_s, unsigned int iw)
-{
-  unsigned int rm_value;
-  unsigned int i_bit = (iw>>25) & 0b1;
-  unsigned int opcode = (iw >> 21) & 0xF;
-  unsigned int s_bit = (iw >> 20) & 0b1;
-  unsigned int rd = (iw >> 12) & 0xF;
-  unsigned int rn = (iw >> 16) & 0xF;
-  int result;
-  long long result_long;
-
-  if(i_bit == 1)
-  {
-    rm_value = iw & 0xFF;
-  }
-  else
-  {
-    rm_value = arm_s->regs[(iw & 0xF)];
-  }
-
-  switch(opcode)
-  {
-    case 2:
-      arm_s->regs[rd] = arm_s->regs[rn] - rm_value;
-      result_long = (long long) arm_s->regs[rn] - (long long) rm_value;
-      result = arm_s->regs[rd];
-      break;
-
-    case 4:
-      arm_s->regs[rd] = arm_s->regs[rn] + rm_value;
-      result_long = (long long) arm_s->regs[rn] + (long long) rm_value;
-      result = arm_s->regs[rd];
-      break;
-
-    case 10:
-      result = arm_s->regs[rn] - rm_value;
-      result_long = (long long) arm_s->regs[rn] - (long long) rm_value;
-      break;
-
-    case 11:
-      result = arm_s->regs[rn] + rm_value;
-      result_long = (long long) arm_s->regs[rn] + (long long) rm_value;
-      break;
-
-    case 13:
-      arm_s->regs[rd] = rm_value;
-      result = arm_s->regs[rd];
-      result_long = (long long) arm_s->regs[rd];
-      break;
-
-    case 15:
-      arm_s->regs[rd] = ~(rm_value);
-      result = ~(rm_value);
-      result_long = (long long) arm_s->regs[rd];
-      break;
-  }
-
-  if(s_bit == 1)
-  {
-    set_cpsr_flag(arm_s, result, result_long);
-  }
-}
-
-void arm_state_first_execute(struct arm_state* arm_s)
-{
-  unsigned int iw;
-  unsigned int *pc;
-
-  pc = (unsigned int *) arm_s->regs[PC];
-  iw = *pc;
-
-  if(is_bx_instruction(iw))
-  {
-    arm_s->br_count++;
-    if(check_cpsr_flags(arm_s, iw))
-    {
-      execute_bx_instruction(arm_s, iw);
-    }
-  }
-  else if(is_branch_instruction(iw))
-  {
-    arm_s->br_count++;
-    if(check_cpsr_flags(arm_s, iw))
-    {
-      execute_branch_instruction(arm_s, iw);
-    }
-    else
-    {
-      arm_s->regs[PC] += 4;
-    }
-  }
-  else if(process_data_instruction(iw))
-  {
-    arm_s->comp_count++;
-    if(check_cpsr_flags(arm_s, iw))
-    {
-      execute_process_data_instruction(arm_s, iw);
-    }
-    arm_s->regs[PC] += 4;
-  }
-  else if(is_data_transfer_instruction(iw))
-  {
-    arm_s->mem_count++;
-    if(check_cpsr_flags(arm_s, iw))
-    {
-      execute_data_transfer_instruction(arm_s, iw);
-    }
-  }
-  else if(is_push(iw))
-  {
-    arm_s->mem_count++;
-    if(check_cpsr_flags(arm_s, iw))
-    {
-      execute_push(arm_s, iw);
-    }
-  }
-  else if(is_pop(iw))
-  {
-    arm_s->mem_count++;
-    if(check_cpsr_flags(arm_s, iw))
-    {
-      execute_pop(arm_s, iw);
-    }
-  }
-}
-
-unsigned int arm_state_execute(struct arm_state* arm_s)
-{
-  while(arm_s->regs[PC] != 0)
-  {
-    arm_state_first_execute(arm_s);
-  }
-
-  return arm_s->regs[0];
-}
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arm_vm.h"
+#include "arm_decode.h"
+#include "arm_block.h"
+#include "arm_syscall.h"
+#include "arm_profile.h"
+#include "arm_mmu.h"
+#include "arm_thumb.h"
+#include "arm_vfp.h"
+
+#define GUEST(arm_s, address) ((arm_s)->mem_base + (unsigned int)(address))
+
+/* An operand read of PC sees the instruction address plus 8. */
+#define READ_REG(arm_s, r)  ((arm_s)->regs[r] + ((r) == PC) * 8)
+
+/* With a register-specified shift the operands are read a cycle later, at plus 12. */
+#define READ_REG_SHIFTED(arm_s, r)  ((arm_s)->regs[r] + ((r) == PC) * 12)
+#define SHIFT_BY_REGISTER(iw)  (((iw) & 0x02000010) == 0x10)
+
+/*
+ * Freed instances are kept per thread with their guest stacks, so a harness
+ * that creates and frees states in a loop neither mallocs nor uses up guest
+ * address space. An instance is only reused for the memory it came from; a
+ * full pool makes room by dropping its oldest instance, so entries left by
+ * memory that has since been freed age out.
+ */
+struct arm_state_pool
+{
+  struct arm_state* head;
+  unsigned int count;
+};
+
+static _Thread_local struct arm_state_pool state_pool;
+
+static struct arm_state* pool_take(const struct arm_memory* mem)
+{
+  struct arm_state** link = &state_pool.head;
+
+  while(*link != NULL)
+  {
+    struct arm_state* arm_s = *link;
+
+    if(arm_s->memory_id == mem->id && arm_s->mem == mem)
+    {
+      *link = arm_s->pool_next;
+      state_pool.count--;
+      return arm_s;
+    }
+    link = &arm_s->pool_next;
+  }
+  return NULL;
+}
+
+static void init_registers(struct arm_state* arm_s, unsigned int func, unsigned int arg0, unsigned int arg1, unsigned int arg2, unsigned int arg3)
+{
+  int i;
+
+  arm_s->cpsr = (func & 0b1) ? CPSR_T : 0;
+  arm_s->flag_op = FLAGS_CLEAN;
+  arm_s->it_state = 0;
+  arm_s->fpscr = 0;
+  arm_s->fpexc = FPEXC_EN;
+  memset(&arm_s->vfp, 0, sizeof(arm_s->vfp));
+  for(i = 0; i < MAX_REGS; i++)
+  {
+    arm_s->regs[i] = 0;
+  }
+
+  arm_s->regs[PC] = func & ~1u;
+  arm_s->regs[SP] = arm_s->stack + STACK_SIZE;
+  arm_s->regs[0] = arg0;
+  arm_s->regs[1] = arg1;
+  arm_s->regs[2] = arg2;
+  arm_s->regs[3] = arg3;
+
+  arm_s->comp_count = 0;
+  arm_s->mem_count = 0;
+  arm_s->br_count = 0;
+  arm_s->fault.kind = GUEST_FAULT_NONE;
+  arm_s->excl_size = 0;
+}
+
+struct arm_state* new_arm_state(struct arm_memory* mem, unsigned int func, unsigned int arg0, unsigned int arg1, unsigned int arg2, unsigned int arg3)
+{
+  struct arm_state* arm_s;
+
+  arm_s = pool_take(mem);
+  if(arm_s != NULL)
+  {
+    arm_s->tcache = NULL;
+    arm_s->profile = NULL;
+    arm_s->mmu = NULL;
+    arm_state_reset(arm_s, func, arg0, arg1, arg2, arg3);
+    return arm_s;
+  }
+
+  arm_s = (struct arm_state*)malloc(sizeof(struct arm_state));
+  if(arm_s == NULL)
+  {
+    printf("Unable to allocate memory failed, exiting.\n");
+    exit(-1);
+  }
+
+  arm_s->mem = mem;
+  arm_s->mem_base = mem->base;
+  arm_s->memory_id = mem->id;
+  arm_s->stack = arm_memory_alloc(mem, STACK_SIZE);
+  arm_s->tcache = NULL;
+  arm_s->profile = NULL;
+  arm_s->mmu = NULL;
+  arm_s->pool_next = NULL;
+  init_registers(arm_s, func, arg0, arg1, arg2, arg3);
+
+  return arm_s;
+}
+
+/*
+ * Starts the instance over at func with the same memory, stack and attached
+ * tcache or profile. The stack is cleared from the lowest word the guest
+ * left non-zero up to the top, so an untouched stack is read but not written.
+ */
+void arm_state_reset(struct arm_state* arm_s, unsigned int func, unsigned int arg0, unsigned int arg1, unsigned int arg2, unsigned int arg3)
+{
+  unsigned int* stack = (unsigned int*)GUEST(arm_s, arm_s->stack);
+  unsigned int i = 0;
+
+  while(i < STACK_SIZE / 4 && stack[i] == 0)
+  {
+    i++;
+  }
+  if(i < STACK_SIZE / 4)
+  {
+    memset(&stack[i], 0, STACK_SIZE - i * 4);
+  }
+
+  init_registers(arm_s, func, arg0, arg1, arg2, arg3);
+}
+
+void free_arm_state(struct arm_state* arm_s)
+{
+  if(state_pool.count >= ARM_STATE_POOL_MAX)
+  {
+    struct arm_state** link = &state_pool.head;
+
+    while((*link)->pool_next != NULL)
+    {
+      link = &(*link)->pool_next;
+    }
+    free(*link);
+    *link = NULL;
+    state_pool.count--;
+  }
+  arm_s->pool_next = state_pool.head;
+  state_pool.head = arm_s;
+  state_pool.count++;
+}
+
+/* Frees this thread's pooled instances, e.g. before freeing their memory. */
+void arm_state_pool_drain(void)
+{
+  while(state_pool.head != NULL)
+  {
+    struct arm_state* next = state_pool.head->pool_next;
+    free(state_pool.head);
+    state_pool.head = next;
+  }
+  state_pool.count = 0;
+}
+
+void arm_state_attach_tcache(struct arm_state* arm_s, struct arm_tcache* tc)
+{
+  arm_s->tcache = tc;
+}
+
+/* A profiled run is always interpreted, whether or not a tcache is attached. */
+void arm_state_attach_profile(struct arm_state* arm_s, struct arm_profile* prof)
+{
+  arm_s->profile = prof;
+}
+
+/* Translated blocks assume flat memory, so an MMU also means interpreting. */
+void arm_state_attach_mmu(struct arm_state* arm_s, struct arm_mmu* mmu)
+{
+  arm_s->mmu = mmu;
+}
+
+void print_arm_state(struct arm_state* arm_s, unsigned int sim_result, unsigned int assembler_result)
+{
+  printf("stack size = %d\n", STACK_SIZE);
+  printf("Register values after execution:\n");
+  for (int i = 0; i < MAX_REGS; i++)
+  {
+    printf("r%d = (%X) %d\n", i, arm_s->regs[i], (int) arm_s->regs[i]);
+  }
+  printf("cpsr: 0x%x\n", arm_cpsr(arm_s));
+  printf("Total Instructions Executed: %d\n", (arm_s->comp_count+arm_s->mem_count+arm_s->br_count));
+  printf("Total Computational Instructions Executed: %d\n", arm_s->comp_count);
+  printf("Total Memory Instructions Executed: %d\n", arm_s->mem_count);
+  printf("Total Branch Instructions Executed: %d\n", arm_s->br_count);
+  printf("ARM Emulator Result: %d\n", sim_result);
+  printf("Assembler Result: %d\n", assembler_result);
+  if(arm_s->fault.kind == GUEST_FAULT_ACCESS)
+  {
+    printf("Guest memory fault at 0x%x (pc = 0x%x)\n", arm_s->fault.address, arm_s->regs[PC]);
+  }
+  else if(arm_s->fault.kind == GUEST_FAULT_UNDEFINED)
+  {
+    printf("Undefined instruction at 0x%x\n", arm_s->fault.address);
+  }
+}
+
+unsigned int arm_cpsr(struct arm_state* arm_s)
+{
+  unsigned int a = arm_s->flag_a;
+  unsigned int b = arm_s->flag_b;
+  unsigned int result = arm_s->flag_result;
+  unsigned int nzcv;
+
+  switch(arm_s->flag_op)
+  {
+    case FLAGS_LOGIC:
+      nzcv = (arm_s->cpsr & (CPSR_C | CPSR_V));
+      break;
+
+    case FLAGS_ADD:
+      nzcv = (result < a ? CPSR_C : 0) | ((((a ^ result) & (b ^ result)) >> 3) & CPSR_V);
+      break;
+
+    case FLAGS_SUB:
+      nzcv = (a >= b ? CPSR_C : 0) | ((((a ^ b) & (a ^ result)) >> 3) & CPSR_V);
+      break;
+
+    /* The carry-in is whatever result has over a + b or under a - b. */
+    case FLAGS_ADC:
+      nzcv = ((((uint64_t)a + b + (result - a - b)) >> 32) ? CPSR_C : 0) | ((((a ^ result) & (b ^ result)) >> 3) & CPSR_V);
+      break;
+
+    case FLAGS_SBC:
+      nzcv = ((uint64_t)a >= (uint64_t)b + (a - b - result) ? CPSR_C : 0) | ((((a ^ b) & (a ^ result)) >> 3) & CPSR_V);
+      break;
+
+    default:
+      return arm_s->cpsr;
+  }
+
+  nzcv |= (result & CPSR_N) | (result == 0 ? CPSR_Z : 0);
+  arm_s->cpsr = (arm_s->cpsr & ~CPSR_NZCV) | nzcv;
+  arm_s->flag_op = FLAGS_CLEAN;
+
+  return arm_s->cpsr;
+}
+
+static inline void set_flags_arith(struct arm_state* arm_s, unsigned int op, unsigned int a, unsigned int b, unsigned int result)
+{
+  arm_s->flag_op = op;
+  arm_s->flag_a = a;
+  arm_s->flag_b = b;
+  arm_s->flag_result = result;
+}
+
+/* Logical operations leave C and V alone, so those are folded in first. */
+static inline void set_flags_logic(struct arm_state* arm_s, unsigned int result)
+{
+  arm_cpsr(arm_s);
+  arm_s->flag_op = FLAGS_LOGIC;
+  arm_s->flag_result = result;
+}
+
+static inline unsigned int carry_flag(struct arm_state* arm_s)
+{
+  return (arm_cpsr(arm_s) >> 29) & 0b1;
+}
+
+/*
+ * Operand 2, one function per form picked by bit 25 and bits 6:4, so the
+ * unshifted register and the immediate forms cost no tests on the shift.
+ */
+#define OPERAND2_INDEX(iw)  ((((iw) >> 22) & 0x8) | (((iw) >> 4) & 0x7))
+
+static unsigned int operand2_imm(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int rotate = (iw >> 7) & 0x1E;
+  unsigned int value = iw & 0xFF;
+
+  (void) arm_s;
+  return (value >> rotate) | (value << ((32 - rotate) & 31));
+}
+
+static unsigned int operand2_lsl_imm(struct arm_state* arm_s, unsigned int iw)
+{
+  return READ_REG(arm_s, iw & 0xF) << ((iw >> 7) & 0x1F);
+}
+
+/* LSR #0 and ASR #0 encode a shift by 32. */
+static unsigned int operand2_lsr_imm(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int amount = (iw >> 7) & 0x1F;
+  return (unsigned int)((uint64_t)READ_REG(arm_s, iw & 0xF) >> (amount ? amount : 32));
+}
+
+static unsigned int operand2_asr_imm(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int amount = (iw >> 7) & 0x1F;
+  return (unsigned int)((int64_t)(int)READ_REG(arm_s, iw & 0xF) >> (amount ? amount : 32));
+}
+
+/* ROR #0 is RRX, a one-bit rotate through C. */
+static unsigned int operand2_ror_imm(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int amount = (iw >> 7) & 0x1F;
+  unsigned int value = READ_REG(arm_s, iw & 0xF);
+
+  if(amount == 0)
+  {
+    return (carry_flag(arm_s) << 31) | (value >> 1);
+  }
+  return (value >> amount) | (value << (32 - amount));
+}
+
+static unsigned int operand2_lsl_reg(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int amount = arm_s->regs[(iw >> 8) & 0xF] & 0xFF;
+  return amount < 32 ? READ_REG_SHIFTED(arm_s, iw & 0xF) << amount : 0;
+}
+
+static unsigned int operand2_lsr_reg(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int amount = arm_s->regs[(iw >> 8) & 0xF] & 0xFF;
+  return amount < 32 ? READ_REG_SHIFTED(arm_s, iw & 0xF) >> amount : 0;
+}
+
+static unsigned int operand2_asr_reg(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int amount = arm_s->regs[(iw >> 8) & 0xF] & 0xFF;
+  return (unsigned int)((int)READ_REG_SHIFTED(arm_s, iw & 0xF) >> (amount < 32 ? amount : 31));
+}
+
+static unsigned int operand2_ror_reg(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int amount = arm_s->regs[(iw >> 8) & 0xF] & 0x1F;
+  unsigned int value = READ_REG_SHIFTED(arm_s, iw & 0xF);
+  return (value >> amount) | (value << ((32 - amount) & 31));
+}
+
+static unsigned int (*const operand2_table[16])(struct arm_state*, unsigned int) =
+{
+  operand2_lsl_imm, operand2_lsl_reg, operand2_lsr_imm, operand2_lsr_reg,
+  operand2_asr_imm, operand2_asr_reg, operand2_ror_imm, operand2_ror_reg,
+  operand2_imm, operand2_imm, operand2_imm, operand2_imm,
+  operand2_imm, operand2_imm, operand2_imm, operand2_imm
+};
+
+/* The shifter carry-out, which only logical operations with S look at. */
+static unsigned int operand2_carry(struct arm_state* arm_s, unsigned int iw, unsigned int carry)
+{
+  unsigned int value = SHIFT_BY_REGISTER(iw) ? READ_REG_SHIFTED(arm_s, iw & 0xF) : READ_REG(arm_s, iw & 0xF);
+  unsigned int type = (iw >> 5) & 0b11;
+  unsigned int amount;
+
+  if((iw >> 25) & 0b1)
+  {
+    return ((iw >> 8) & 0xF) ? operand2_imm(arm_s, iw) >> 31 : carry;
+  }
+
+  if((iw >> 4) & 0b1)
+  {
+    amount = arm_s->regs[(iw >> 8) & 0xF] & 0xFF;
+    if(amount == 0)
+    {
+      return carry;
+    }
+  }
+  else
+  {
+    amount = (iw >> 7) & 0x1F;
+    if(amount == 0)
+    {
+      if(type == 0)
+      {
+        return carry;
+      }
+      if(type == 3)
+      {
+        return value & 0b1;
+      }
+      amount = 32;
+    }
+  }
+
+  switch(type)
+  {
+    case 0:
+      return amount > 32 ? 0 : (value >> (32 - amount)) & 0b1;
+    case 1:
+      return amount > 32 ? 0 : (value >> (amount - 1)) & 0b1;
+    case 2:
+      return amount >= 32 ? value >> 31 : (value >> (amount - 1)) & 0b1;
+  }
+  return (value >> ((amount - 1) & 31)) & 0b1;
+}
+
+/* Like set_flags_logic, with C taken from the shifter. Call before rd is written. */
+static inline void set_flags_shifter(struct arm_state* arm_s, unsigned int iw, unsigned int result)
+{
+  unsigned int cpsr = arm_cpsr(arm_s);
+  unsigned int carry = operand2_carry(arm_s, iw, (cpsr >> 29) & 0b1);
+
+  arm_s->cpsr = (cpsr & ~CPSR_C) | (carry << 29);
+  arm_s->flag_op = FLAGS_LOGIC;
+  arm_s->flag_result = result;
+}
+
+int check_cpsr_flags(struct arm_state* arm_s, unsigned int iw)
+{
+  return arm_condition_table[iw >> 28][arm_cpsr(arm_s) >> 28];
+}
+
+/* A PC written by BX or loaded from memory picks the instruction set by bit 0. */
+static inline void interwork(struct arm_state* arm_s, unsigned int destination)
+{
+  arm_s->cpsr = (arm_s->cpsr & ~CPSR_T) | ((destination & 0b1) ? CPSR_T : 0);
+  arm_s->regs[PC] = destination & ~1u;
+}
+
+/* BX, and BLX when bit 5 is set. A Thumb caller gets bit 0 set in LR. */
+void execute_bx_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int rn = iw & 0b1111;
+  unsigned int destination = READ_REG(arm_s, rn);
+
+  if((iw >> 5) & 0b1)
+  {
+    arm_s->regs[LR] = (arm_s->regs[PC] + 4) | ((arm_s->cpsr & CPSR_T) != 0);
+  }
+  interwork(arm_s, destination);
+}
+
+void execute_branch_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int signed_bit = (iw >> 23) & 0b1;
+  unsigned int l_bit = (iw >> 24) & 0b1;
+  unsigned int offset = iw & 0xFFFFFF;
+  unsigned int destination;
+
+  if(signed_bit == 0)
+  {
+    destination = offset | 0x00000000;;
+  }
+  else
+  {
+    destination = offset | 0xFF000000;
+  }
+
+  destination = destination << 2;
+
+  if(l_bit == 1)
+  {
+    arm_s->regs[LR] = arm_s->regs[PC] + 4;
+  }
+
+  arm_s->regs[PC] += (destination + 8);
+
+}
+
+void execute_data_transfer_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int rd = (iw>>12) & 0xF;
+  unsigned int rn = (iw>>16) & 0xF;
+  unsigned int l_bit = (iw>>20) & 0b1;
+  unsigned int w_bit = (iw>>21) & 0b1;
+  unsigned int b_bit = (iw>>22) & 0b1;
+  unsigned int u_bit = (iw>>23) & 0b1;
+  unsigned int p_bit = (iw>>24) & 0b1;
+  unsigned int i_bit = (iw>>25) & 0b1;
+  unsigned int modified_base_value = READ_REG(arm_s, rn);
+  unsigned int offset_value;
+
+  if(i_bit == 1)
+  {
+    offset_value = operand2_table[(iw >> 4) & 0x6](arm_s, iw);
+  }
+  else
+  {
+    offset_value = iw & 0xFFF;
+  }
+
+  if(u_bit == 0)
+  {
+    offset_value = -offset_value;
+  }
+  if(p_bit == 1)
+  {
+    modified_base_value += offset_value;
+  }
+
+  if(b_bit == 1)
+  {
+    if (l_bit == 1)
+    {
+      arm_s->regs[rd] = *GUEST_ACCESS(arm_s, modified_base_value, MMU_READ);
+    }
+    else
+    {
+      *GUEST_ACCESS(arm_s, modified_base_value, MMU_WRITE) = (unsigned char) READ_REG(arm_s, rd);
+      if(arm_s->tcache != NULL)
+      {
+        arm_tcache_note_store(arm_s->tcache, modified_base_value);
+      }
+    }
+  }
+  else
+  {
+    if (l_bit == 1)
+    {
+      arm_s->regs[rd] = GUEST_READ(arm_s, unsigned int, modified_base_value);
+    }
+    else
+    {
+      GUEST_WRITE(arm_s, unsigned int, modified_base_value, READ_REG(arm_s, rd));
+      if(arm_s->tcache != NULL)
+      {
+        arm_tcache_note_store(arm_s->tcache, modified_base_value);
+      }
+    }
+  }
+  if(p_bit == 0)
+  {
+    modified_base_value += offset_value;
+  }
+  if(p_bit == 0 || w_bit == 1)
+  {
+    arm_s->regs[rn] = modified_base_value;
+  }
+  if(l_bit == 0 || rd != PC)
+  {
+    arm_s->regs[PC] += 4;
+  }
+  else
+  {
+    interwork(arm_s, arm_s->regs[PC]);
+  }
+}
+
+/*
+ * LDRH, STRH, LDRSB, LDRSH, LDRD and STRD, picked by L and bits 6:5, with
+ * the offset already worked out. Thumb uses this directly for the offsets
+ * too wide for the ARM encoding.
+ */
+void arm_halfword_transfer(struct arm_state* arm_s, unsigned int iw, unsigned int offset)
+{
+  unsigned int rd = (iw >> 12) & 0xF;
+  unsigned int rn = (iw >> 16) & 0xF;
+  unsigned int w_bit = (iw >> 21) & 0b1;
+  unsigned int p_bit = (iw >> 24) & 0b1;
+  unsigned int address = READ_REG(arm_s, rn);
+
+  if(((iw >> 23) & 0b1) == 0)
+  {
+    offset = -offset;
+  }
+  if(p_bit == 1)
+  {
+    address += offset;
+  }
+
+  switch(((iw >> 4) & 0x6) | ((iw >> 20) & 0b1))
+  {
+    case 0x2:
+      GUEST_WRITE(arm_s, uint16_t, address, READ_REG(arm_s, rd));
+      break;
+
+    case 0x3:
+      arm_s->regs[rd] = GUEST_READ(arm_s, uint16_t, address);
+      break;
+
+    case 0x4:
+      arm_s->regs[rd] = GUEST_READ(arm_s, unsigned int, address);
+      arm_s->regs[rd + 1] = GUEST_READ(arm_s, unsigned int, address + 4);
+      break;
+
+    case 0x5:
+      arm_s->regs[rd] = (unsigned int)(int) *((int8_t *) GUEST_ACCESS(arm_s, address, MMU_READ));
+      break;
+
+    case 0x6:
+      GUEST_WRITE(arm_s, unsigned int, address, arm_s->regs[rd]);
+      GUEST_WRITE(arm_s, unsigned int, address + 4, arm_s->regs[rd + 1]);
+      break;
+
+    default:
+      arm_s->regs[rd] = (unsigned int)(int) GUEST_READ(arm_s, int16_t, address);
+      break;
+  }
+
+  if(arm_s->tcache != NULL && ((iw >> 20) & 0b1) == 0)
+  {
+    arm_tcache_note_store(arm_s->tcache, address);
+    arm_tcache_note_store(arm_s->tcache, address + 4);
+  }
+  if(p_bit == 0)
+  {
+    address += offset;
+  }
+  if(p_bit == 0 || w_bit == 1)
+  {
+    arm_s->regs[rn] = address;
+  }
+  arm_s->regs[PC] += 4;
+}
+
+void execute_halfword_transfer_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  if((iw >> 22) & 0b1)
+  {
+    arm_halfword_transfer(arm_s, iw, ((iw >> 4) & 0xF0) | (iw & 0xF));
+  }
+  else
+  {
+    arm_halfword_transfer(arm_s, iw, arm_s->regs[iw & 0xF]);
+  }
+}
+
+/*
+ * Block transfers use the lowest address first and the lowest register
+ * there, so a register list is a few runs of adjacent registers, each moved
+ * with one copy. The lowest address and the written-back base only depend
+ * on the popcount of the list.
+ */
+static unsigned int block_transfer_start(unsigned int iw, unsigned int base, unsigned int count)
+{
+  unsigned int u_bit = (iw>>23) & 0b1;
+  unsigned int p_bit = (iw>>24) & 0b1;
+
+  if(u_bit == 1)
+  {
+    return base + (p_bit ? 4 : 0);
+  }
+  return base - count * 4 + (p_bit ? 0 : 4);
+}
+
+static unsigned int block_transfer_writeback(unsigned int iw, unsigned int base, unsigned int count)
+{
+  return ((iw>>23) & 0b1) ? base + count * 4 : base - count * 4;
+}
+
+/* Under an MMU a run of words may cross into a differently mapped page. */
+static inline void copy_to_guest(struct arm_state* arm_s, unsigned int address, const unsigned int* src, unsigned int size)
+{
+  while(arm_s->mmu != NULL && (address & (GUEST_PAGE_SIZE - 1)) + size > GUEST_PAGE_SIZE)
+  {
+    unsigned int part = GUEST_PAGE_SIZE - (address & (GUEST_PAGE_SIZE - 1));
+
+    memcpy(GUEST_ACCESS(arm_s, address, MMU_WRITE), src, part);
+    address += part;
+    src += part / 4;
+    size -= part;
+  }
+  memcpy(GUEST_ACCESS(arm_s, address, MMU_WRITE), src, size);
+}
+
+static inline void copy_from_guest(struct arm_state* arm_s, unsigned int address, unsigned int* dst, unsigned int size)
+{
+  while(arm_s->mmu != NULL && (address & (GUEST_PAGE_SIZE - 1)) + size > GUEST_PAGE_SIZE)
+  {
+    unsigned int part = GUEST_PAGE_SIZE - (address & (GUEST_PAGE_SIZE - 1));
+
+    memcpy(dst, GUEST_ACCESS(arm_s, address, MMU_READ), part);
+    address += part;
+    dst += part / 4;
+    size -= part;
+  }
+  memcpy(dst, GUEST_ACCESS(arm_s, address, MMU_READ), size);
+}
+
+void execute_push(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int register_list = iw & 0xFFFF;
+  unsigned int rn = (iw>>16) & 0xF;
+  unsigned int w_bit = (iw>>21) & 0b1;
+  unsigned int count = __builtin_popcount(register_list);
+  unsigned int base = arm_s->regs[rn];
+  unsigned int address = block_transfer_start(iw, base, count);
+
+  if(arm_s->tcache != NULL && count != 0)
+  {
+    arm_tcache_note_store(arm_s->tcache, address);
+    arm_tcache_note_store(arm_s->tcache, address + (count - 1) * 4);
+  }
+
+  while(register_list != 0)
+  {
+    unsigned int first = __builtin_ctz(register_list);
+    unsigned int run = __builtin_ctz(~(register_list >> first));
+
+    copy_to_guest(arm_s, address, &arm_s->regs[first], run * 4);
+    address += run * 4;
+    register_list &= ~(((1u << run) - 1) << first);
+  }
+
+  /* PC is the highest register, so it went to the last word. */
+  if((iw >> PC) & 0b1)
+  {
+    GUEST_WRITE(arm_s, unsigned int, address - 4, READ_REG(arm_s, PC));
+  }
+
+  if(w_bit == 1)
+  {
+    arm_s->regs[rn] = block_transfer_writeback(iw, base, count);
+  }
+  arm_s->regs[PC] += 4;
+}
+
+/* A loaded PC is the next instruction, and a loaded base wins over writeback. */
+void execute_pop(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int register_list = iw & 0xFFFF;
+  unsigned int rn = (iw>>16) & 0xF;
+  unsigned int w_bit = (iw>>21) & 0b1;
+  unsigned int count = __builtin_popcount(register_list);
+  unsigned int base = arm_s->regs[rn];
+  unsigned int address = block_transfer_start(iw, base, count);
+  unsigned int next_pc = arm_s->regs[PC] + 4;
+
+  while(register_list != 0)
+  {
+    unsigned int first = __builtin_ctz(register_list);
+    unsigned int run = __builtin_ctz(~(register_list >> first));
+
+    copy_from_guest(arm_s, address, &arm_s->regs[first], run * 4);
+    address += run * 4;
+    register_list &= ~(((1u << run) - 1) << first);
+  }
+
+  if(w_bit == 1 && ((iw >> rn) & 0b1) == 0)
+  {
+    arm_s->regs[rn] = block_transfer_writeback(iw, base, count);
+  }
+
+  if(((iw >> PC) & 0b1) == 0)
+  {
+    arm_s->regs[PC] = next_pc;
+  }
+  else
+  {
+    interwork(arm_s, arm_s->regs[PC]);
+  }
+}
+
+static inline void process_data(struct arm_state* arm_s, unsigned int iw, unsigned int op2)
+{
+  unsigned int opcode = (iw >> 21) & 0xF;
+  unsigned int s_bit = (iw >> 20) & 0b1;
+  unsigned int rd = (iw >> 12) & 0xF;
+  unsigned int rn = (iw >> 16) & 0xF;
+  unsigned int rn_value = SHIFT_BY_REGISTER(iw) ? READ_REG_SHIFTED(arm_s, rn) : READ_REG(arm_s, rn);
+  unsigned int result;
+  unsigned int carry;
+
+  switch(opcode)
+  {
+    case 0x0:
+    case 0x8:
+      result = rn_value & op2;
+      if(s_bit == 1)
+      {
+        set_flags_shifter(arm_s, iw, result);
+      }
+      break;
+
+    case 0x1:
+    case 0x9:
+      result = rn_value ^ op2;
+      if(s_bit == 1)
+      {
+        set_flags_shifter(arm_s, iw, result);
+      }
+      break;
+
+    case 0x2:
+    case 0xA:
+      result = rn_value - op2;
+      if(s_bit == 1)
+      {
+        set_flags_arith(arm_s, FLAGS_SUB, rn_value, op2, result);
+      }
+      break;
+
+    case 0x3:
+      result = op2 - rn_value;
+      if(s_bit == 1)
+      {
+        set_flags_arith(arm_s, FLAGS_SUB, op2, rn_value, result);
+      }
+      break;
+
+    case 0x4:
+    case 0xB:
+      result = rn_value + op2;
+      if(s_bit == 1)
+      {
+        set_flags_arith(arm_s, FLAGS_ADD, rn_value, op2, result);
+      }
+      break;
+
+    case 0x5:
+      carry = carry_flag(arm_s);
+      result = rn_value + op2 + carry;
+      if(s_bit == 1)
+      {
+        set_flags_arith(arm_s, FLAGS_ADC, rn_value, op2, result);
+      }
+      break;
+
+    case 0x6:
+      carry = carry_flag(arm_s);
+      result = rn_value - op2 - !carry;
+      if(s_bit == 1)
+      {
+        set_flags_arith(arm_s, FLAGS_SBC, rn_value, op2, result);
+      }
+      break;
+
+    case 0x7:
+      carry = carry_flag(arm_s);
+      result = op2 - rn_value - !carry;
+      if(s_bit == 1)
+      {
+        set_flags_arith(arm_s, FLAGS_SBC, op2, rn_value, result);
+      }
+      break;
+
+    case 0xC:
+      result = rn_value | op2;
+      if(s_bit == 1)
+      {
+        set_flags_shifter(arm_s, iw, result);
+      }
+      break;
+
+    case 0xD:
+      result = op2;
+      if(s_bit == 1)
+      {
+        set_flags_shifter(arm_s, iw, result);
+      }
+      break;
+
+    case 0xE:
+      result = rn_value & ~op2;
+      if(s_bit == 1)
+      {
+        set_flags_shifter(arm_s, iw, result);
+      }
+      break;
+
+    default:
+      result = ~op2;
+      if(s_bit == 1)
+      {
+        set_flags_shifter(arm_s, iw, result);
+      }
+      break;
+  }
+
+  /* TST, TEQ, CMP and CMN only set flags. A result written to PC interworks in ARM state only. */
+  if((opcode & 0xC) != 0x8)
+  {
+    arm_s->regs[rd] = result;
+    if(rd == PC)
+    {
+      interwork(arm_s, (arm_s->cpsr & CPSR_T) ? result | 0b1 : result);
+      return;
+    }
+  }
+  arm_s->regs[PC] += 4;
+}
+
+void execute_process_data_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  process_data(arm_s, iw, operand2_table[OPERAND2_INDEX(iw)](arm_s, iw));
+}
+
+/*
+ * Data processing with operand 2 already worked out, for Thumb immediates
+ * ARM cannot encode. iw has the register form with no shift, so the shifter
+ * carry-out is the C flag unchanged.
+ */
+void arm_process_data_value(struct arm_state* arm_s, unsigned int iw, unsigned int op2)
+{
+  process_data(arm_s, iw, op2);
+}
+
+/* MUL and MLA, and the 64-bit UMULL, UMLAL, SMULL and SMLAL. S sets N and Z only. */
+void execute_multiply_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int s_bit = (iw >> 20) & 0b1;
+  unsigned int a_bit = (iw >> 21) & 0b1;
+  unsigned int rd_hi = (iw >> 16) & 0xF;
+  unsigned int rd_lo = (iw >> 12) & 0xF;
+  unsigned int rs_value = arm_s->regs[(iw >> 8) & 0xF];
+  unsigned int rm_value = arm_s->regs[iw & 0xF];
+  uint64_t result;
+
+  if(((iw >> 23) & 0b1) == 0)
+  {
+    unsigned int product = rm_value * rs_value + (a_bit ? arm_s->regs[rd_lo] : 0);
+
+    arm_s->regs[rd_hi] = product;
+    if(s_bit == 1)
+    {
+      set_flags_logic(arm_s, product);
+    }
+    arm_s->regs[PC] += 4;
+    return;
+  }
+
+  if((iw >> 22) & 0b1)
+  {
+    result = (uint64_t)((int64_t)(int)rm_value * (int)rs_value);
+  }
+  else
+  {
+    result = (uint64_t)rm_value * rs_value;
+  }
+  if(a_bit == 1)
+  {
+    result += ((uint64_t)arm_s->regs[rd_hi] << 32) | arm_s->regs[rd_lo];
+  }
+
+  arm_s->regs[rd_lo] = (unsigned int) result;
+  arm_s->regs[rd_hi] = (unsigned int)(result >> 32);
+  if(s_bit == 1)
+  {
+    unsigned int cpsr = arm_cpsr(arm_s) & ~(CPSR_N | CPSR_Z);
+    arm_s->cpsr = cpsr | ((unsigned int)(result >> 32) & CPSR_N) | (result == 0 ? CPSR_Z : 0);
+  }
+  arm_s->regs[PC] += 4;
+}
+
+/* SXTB, SXTH, UXTB and UXTH of a rotated rm, added to rn unless rn is PC. */
+void execute_extend_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int rn = (iw >> 16) & 0xF;
+  unsigned int rotate = (iw >> 7) & 0x18;
+  unsigned int value = arm_s->regs[iw & 0xF];
+
+  value = (value >> rotate) | (value << ((32 - rotate) & 31));
+  switch((iw >> 20) & 0x7)
+  {
+    case 0x2:
+      value = (unsigned int)(int)(int8_t) value;
+      break;
+    case 0x3:
+      value = (unsigned int)(int)(int16_t) value;
+      break;
+    case 0x6:
+      value &= 0xFF;
+      break;
+    default:
+      value &= 0xFFFF;
+      break;
+  }
+
+  if(rn != PC)
+  {
+    value += arm_s->regs[rn];
+  }
+  arm_s->regs[(iw >> 12) & 0xF] = value;
+  arm_s->regs[PC] += 4;
+}
+
+/* MOVW writes a 16-bit immediate to rd, MOVT to its top half. */
+void execute_move_wide_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int rd = (iw >> 12) & 0xF;
+  unsigned int imm16 = ((iw >> 4) & 0xF000) | (iw & 0xFFF);
+
+  if((iw >> 22) & 0b1)
+  {
+    arm_s->regs[rd] = (arm_s->regs[rd] & 0xFFFF) | (imm16 << 16);
+  }
+  else
+  {
+    arm_s->regs[rd] = imm16;
+  }
+  arm_s->regs[PC] += 4;
+}
+
+/* An exit system call ends the run the same way returning to 0 does. */
+void execute_svc_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  (void) iw;
+  if(arm_syscall(arm_s))
+  {
+    arm_s->regs[PC] += 4;
+  }
+  else
+  {
+    arm_s->regs[PC] = 0;
+  }
+}
+
+static const unsigned char exclusive_size[4] = {4, 8, 1, 2};
+
+static uint64_t exclusive_load(const unsigned char* host, unsigned int size)
+{
+  switch(size)
+  {
+    case 1:
+      return __atomic_load_n((const uint8_t*)host, __ATOMIC_RELAXED);
+    case 2:
+      return __atomic_load_n((const uint16_t*)host, __ATOMIC_RELAXED);
+    case 4:
+      return __atomic_load_n((const uint32_t*)host, __ATOMIC_RELAXED);
+  }
+  return __atomic_load_n((const uint64_t*)host, __ATOMIC_RELAXED);
+}
+
+static int exclusive_store(unsigned char* host, unsigned int size, uint64_t expected, uint64_t desired)
+{
+  uint8_t e8 = (uint8_t)expected;
+  uint16_t e16 = (uint16_t)expected;
+  uint32_t e32 = (uint32_t)expected;
+
+  switch(size)
+  {
+    case 1:
+      return __atomic_compare_exchange_n((uint8_t*)host, &e8, (uint8_t)desired, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    case 2:
+      return __atomic_compare_exchange_n((uint16_t*)host, &e16, (uint16_t)desired, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    case 4:
+      return __atomic_compare_exchange_n((uint32_t*)host, &e32, (uint32_t)desired, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+  }
+  return __atomic_compare_exchange_n((uint64_t*)host, &expected, desired, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/*
+ * LDREX remembers the address and the value it loaded. STREX succeeds when
+ * memory still holds that value, by one host compare-exchange, so cores
+ * never take a lock. Another core storing the same value in between goes
+ * unnoticed, as with any compare-exchange monitor.
+ */
+void execute_exclusive_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int rd = (iw >> 12) & 0xF;
+  unsigned int rt = iw & 0xF;
+  unsigned int size = exclusive_size[(iw >> 21) & 0x3];
+  unsigned int address = arm_s->regs[(iw >> 16) & 0xF];
+  unsigned char* host;
+
+  if(address % size != 0)
+  {
+    guest_fault_raise(GUEST_FAULT_ACCESS, address);
+  }
+  host = GUEST_ACCESS(arm_s, address, ((iw >> 20) & 0b1) ? MMU_READ : MMU_WRITE);
+
+  if((iw >> 20) & 0b1)
+  {
+    uint64_t value = exclusive_load(host, size);
+
+    arm_s->regs[rd] = (unsigned int)value;
+    if(size == 8)
+    {
+      arm_s->regs[rd + 1] = (unsigned int)(value >> 32);
+    }
+    arm_s->excl_address = address;
+    arm_s->excl_size = size;
+    arm_s->excl_value = value;
+  }
+  else
+  {
+    uint64_t desired = arm_s->regs[rt];
+    int stored;
+
+    if(size == 8)
+    {
+      desired |= (uint64_t)arm_s->regs[rt + 1] << 32;
+    }
+    stored = arm_s->excl_size == size && arm_s->excl_address == address && exclusive_store(host, size, arm_s->excl_value, desired);
+    arm_s->excl_size = 0;
+    arm_s->regs[rd] = !stored;
+
+    if(stored && arm_s->tcache != NULL)
+    {
+      arm_tcache_note_store(arm_s->tcache, address);
+    }
+  }
+  arm_s->regs[PC] += 4;
+}
+
+/*
+ * Of the unconditional space only the barriers, CLREX and BLX to a label,
+ * which always enters Thumb with H as bit 1 of the offset, are implemented.
+ */
+void execute_unconditional_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  if((iw >> 25) == 0x7D)
+  {
+    arm_s->regs[LR] = arm_s->regs[PC] + 4;
+    arm_s->regs[PC] += 8 + ((unsigned int)((int)(iw << 8) >> 6) | ((iw >> 23) & 0b10));
+    arm_s->cpsr |= CPSR_T;
+    return;
+  }
+
+  switch(iw & 0xFFFFFFF0)
+  {
+    case 0xF57FF010:
+      arm_s->excl_size = 0;
+      break;
+
+    case 0xF57FF040:
+    case 0xF57FF050:
+    case 0xF57FF060:
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      break;
+
+    default:
+      guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+  }
+  arm_s->regs[PC] += 4;
+}
+
+/* VFP data processing and register moves, and MCR and MRC to CP15 of an attached MMU. */
+void execute_coprocessor_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int rt = (iw >> 12) & 0xF;
+  unsigned int reg = CP15((iw >> 16) & 0xF, (iw >> 21) & 0x7, iw & 0xF, (iw >> 5) & 0x7);
+  unsigned int value;
+  int known;
+
+  if(((iw >> 9) & 0x7) == 0x5)
+  {
+    arm_vfp_execute(arm_s, iw);
+    arm_s->regs[PC] += 4;
+    return;
+  }
+
+  if(((iw >> 8) & 0xF) != 15 || ((iw >> 4) & 0b1) == 0 || arm_s->mmu == NULL || rt == PC)
+  {
+    guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+  }
+
+  if((iw >> 20) & 0b1)
+  {
+    known = arm_mmu_read_cp15(arm_s->mmu, reg, &value);
+    arm_s->regs[rt] = value;
+  }
+  else
+  {
+    known = arm_mmu_write_cp15(arm_s->mmu, reg, arm_s->regs[rt]);
+  }
+  if(!known)
+  {
+    guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+  }
+  arm_s->regs[PC] += 4;
+}
+
+/*
+ * VLDR, VSTR, VLDM and VSTM. The registers of a multiple transfer are
+ * adjacent in arm_s->vfp, so it is one copy either way.
+ */
+void execute_coprocessor_transfer_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int p_bit = (iw >> 24) & 0b1;
+  unsigned int u_bit = (iw >> 23) & 0b1;
+  unsigned int w_bit = (iw >> 21) & 0b1;
+  unsigned int rn = (iw >> 16) & 0xF;
+  unsigned int dbl = (iw >> 8) & 0b1;
+  unsigned int vd = (iw >> 12) & 0xF;
+  unsigned int first = dbl ? ((((iw >> 22) & 0b1) << 4) | vd) * 2 : (vd << 1) | ((iw >> 22) & 0b1);
+  unsigned int offset = (iw & 0xFF) * 4;
+  unsigned int size = dbl ? offset & ~7u : offset;
+  unsigned int base = arm_s->regs[rn];
+  unsigned int address;
+
+  if(p_bit == 0 && u_bit == 0 && w_bit == 0)
+  {
+    arm_vfp_execute(arm_s, iw);
+    arm_s->regs[PC] += 4;
+    return;
+  }
+
+  if(((iw >> 9) & 0x7) != 0x5 || !(arm_s->fpexc & FPEXC_EN) || (p_bit == u_bit && w_bit == 1) || (w_bit == 1 && rn == PC))
+  {
+    guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+  }
+
+  /* In Thumb state PC reads 4 less than READ_REG gives. */
+  if(rn == PC)
+  {
+    base = (READ_REG(arm_s, PC) - ((arm_s->cpsr & CPSR_T) ? 4 : 0)) & ~3u;
+  }
+
+  if(p_bit == 1 && w_bit == 0)
+  {
+    address = u_bit ? base + offset : base - offset;
+    size = dbl ? 8 : 4;
+  }
+  else
+  {
+    address = u_bit ? base : base - offset;
+    if(size == 0 || first * 4 + size > (dbl ? 256u : 128u))
+    {
+      guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+    }
+  }
+
+  if((iw >> 20) & 0b1)
+  {
+    copy_from_guest(arm_s, address, &arm_s->vfp.w[first], size);
+  }
+  else
+  {
+    if(arm_s->tcache != NULL)
+    {
+      arm_tcache_note_store(arm_s->tcache, address);
+      arm_tcache_note_store(arm_s->tcache, address + size - 4);
+    }
+    copy_to_guest(arm_s, address, &arm_s->vfp.w[first], size);
+  }
+
+  if(w_bit == 1)
+  {
+    arm_s->regs[rn] = u_bit ? base + offset : base - offset;
+  }
+  arm_s->regs[PC] += 4;
+}
+
+void execute_mrs_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int rd = (iw >> 12) & 0xF;
+  arm_s->regs[rd] = arm_cpsr(arm_s);
+  arm_s->regs[PC] += 4;
+}
+
+void execute_msr_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  unsigned int i_bit = (iw >> 25) & 0b1;
+  unsigned int field_mask = (iw >> 16) & 0xF;
+  unsigned int byte_mask = 0;
+  unsigned int value;
+
+  if(i_bit == 1)
+  {
+    unsigned int rotate = ((iw >> 8) & 0xF) * 2;
+    value = iw & 0xFF;
+    value = (value >> rotate) | (value << ((32 - rotate) & 31));
+  }
+  else
+  {
+    value = arm_s->regs[iw & 0xF];
+  }
+
+  for(int i = 0; i < 4; i++)
+  {
+    if((field_mask >> i) & 0b1)
+    {
+      byte_mask |= 0xFFu << (i * 8);
+    }
+  }
+
+  arm_cpsr(arm_s);
+  arm_s->cpsr = (arm_s->cpsr & ~byte_mask) | (value & byte_mask);
+  arm_s->regs[PC] += 4;
+}
+
+static void execute_undefined_instruction(struct arm_state* arm_s, unsigned int iw)
+{
+  (void) iw;
+  guest_fault_raise(GUEST_FAULT_UNDEFINED, arm_s->regs[PC]);
+}
+
+static void decode_undefined(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->comp_count++;
+  execute_undefined_instruction(arm_s, iw);
+}
+
+static void decode_data_processing(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->comp_count++;
+  execute_process_data_instruction(arm_s, iw);
+}
+
+static void decode_multiply(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->comp_count++;
+  execute_multiply_instruction(arm_s, iw);
+}
+
+static void decode_move_wide(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->comp_count++;
+  execute_move_wide_instruction(arm_s, iw);
+}
+
+static void decode_svc(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->comp_count++;
+  execute_svc_instruction(arm_s, iw);
+}
+
+static void decode_exclusive(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->mem_count++;
+  execute_exclusive_instruction(arm_s, iw);
+}
+
+static void decode_unconditional(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->mem_count++;
+  execute_unconditional_instruction(arm_s, iw);
+}
+
+static void decode_coprocessor(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->comp_count++;
+  execute_coprocessor_instruction(arm_s, iw);
+}
+
+static void decode_halfword_transfer(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->mem_count++;
+  execute_halfword_transfer_instruction(arm_s, iw);
+}
+
+static void decode_extend(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->comp_count++;
+  execute_extend_instruction(arm_s, iw);
+}
+
+static void decode_coprocessor_transfer(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->mem_count++;
+  execute_coprocessor_transfer_instruction(arm_s, iw);
+}
+
+static void decode_mrs(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->comp_count++;
+  execute_mrs_instruction(arm_s, iw);
+}
+
+static void decode_msr(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->comp_count++;
+  execute_msr_instruction(arm_s, iw);
+}
+
+static void decode_bx(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->br_count++;
+  execute_bx_instruction(arm_s, iw);
+}
+
+static void decode_branch(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->br_count++;
+  execute_branch_instruction(arm_s, iw);
+}
+
+static void decode_data_transfer(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->mem_count++;
+  execute_data_transfer_instruction(arm_s, iw);
+}
+
+static void decode_push(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->mem_count++;
+  execute_push(arm_s, iw);
+}
+
+static void decode_pop(struct arm_state* arm_s, unsigned int iw)
+{
+  arm_s->mem_count++;
+  execute_pop(arm_s, iw);
+}
+
+/* A conditional instruction whose condition fails still counts as executed. */
+static void skip_instruction(struct arm_state* arm_s, unsigned int cls)
+{
+  switch(arm_class_counter[cls])
+  {
+    case ARM_COUNT_COMP:
+      arm_s->comp_count++;
+      break;
+
+    case ARM_COUNT_BR:
+      arm_s->br_count++;
+      break;
+
+    case ARM_COUNT_MEM:
+      arm_s->mem_count++;
+      break;
+  }
+  arm_s->regs[PC] += 4;
+}
+
+static void (*const arm_class_handlers[ARM_CLASS_COUNT])(struct arm_state*, unsigned int) =
+{
+  [ARM_CLASS_UNDEFINED] = decode_undefined,
+  [ARM_CLASS_DATA_PROCESSING] = decode_data_processing,
+  [ARM_CLASS_MRS] = decode_mrs,
+  [ARM_CLASS_MSR] = decode_msr,
+  [ARM_CLASS_BX] = decode_bx,
+  [ARM_CLASS_BRANCH] = decode_branch,
+  [ARM_CLASS_DATA_TRANSFER] = decode_data_transfer,
+  [ARM_CLASS_PUSH] = decode_push,
+  [ARM_CLASS_POP] = decode_pop,
+  [ARM_CLASS_MULTIPLY] = decode_multiply,
+  [ARM_CLASS_MOVE_WIDE] = decode_move_wide,
+  [ARM_CLASS_SVC] = decode_svc,
+  [ARM_CLASS_EXCLUSIVE] = decode_exclusive,
+  [ARM_CLASS_UNCONDITIONAL] = decode_unconditional,
+  [ARM_CLASS_COPROCESSOR] = decode_coprocessor,
+  [ARM_CLASS_HALFWORD_TRANSFER] = decode_halfword_transfer,
+  [ARM_CLASS_EXTEND] = decode_extend,
+  [ARM_CLASS_COPROCESSOR_TRANSFER] = decode_coprocessor_transfer,
+};
+
+void (*const arm_exec_handlers[ARM_CLASS_COUNT])(struct arm_state*, unsigned int) =
+{
+  [ARM_CLASS_UNDEFINED] = execute_undefined_instruction,
+  [ARM_CLASS_DATA_PROCESSING] = execute_process_data_instruction,
+  [ARM_CLASS_MRS] = execute_mrs_instruction,
+  [ARM_CLASS_MSR] = execute_msr_instruction,
+  [ARM_CLASS_BX] = execute_bx_instruction,
+  [ARM_CLASS_BRANCH] = execute_branch_instruction,
+  [ARM_CLASS_DATA_TRANSFER] = execute_data_transfer_instruction,
+  [ARM_CLASS_PUSH] = execute_push,
+  [ARM_CLASS_POP] = execute_pop,
+  [ARM_CLASS_MULTIPLY] = execute_multiply_instruction,
+  [ARM_CLASS_MOVE_WIDE] = execute_move_wide_instruction,
+  [ARM_CLASS_SVC] = execute_svc_instruction,
+  [ARM_CLASS_EXCLUSIVE] = execute_exclusive_instruction,
+  [ARM_CLASS_UNCONDITIONAL] = execute_unconditional_instruction,
+  [ARM_CLASS_COPROCESSOR] = execute_coprocessor_instruction,
+  [ARM_CLASS_HALFWORD_TRANSFER] = execute_halfword_transfer_instruction,
+  [ARM_CLASS_EXTEND] = execute_extend_instruction,
+  [ARM_CLASS_COPROCESSOR_TRANSFER] = execute_coprocessor_transfer_instruction,
+};
+
+/*
+ * Handlers for the common forms of translated instructions, which read
+ * their registers, immediate and shift from the uop instead of iw. Forms
+ * that involve PC, a register-specified shift or the shifter carry keep
+ * the class handler.
+ */
+static void uop_generic(struct arm_state* arm_s, const struct arm_uop* uop)
+{
+  uop->handler(arm_s, uop->iw);
+}
+
+enum
+{
+  UOP_IMM,
+  UOP_REG,
+  UOP_LSL,
+  UOP_LSR,
+  UOP_ASR,
+  UOP_FORMS
+};
+
+#define UOP_OPERAND_imm(arm_s, uop)  ((uop)->imm)
+#define UOP_OPERAND_reg(arm_s, uop)  ((arm_s)->regs[(uop)->rm])
+#define UOP_OPERAND_lsl(arm_s, uop)  ((arm_s)->regs[(uop)->rm] << (uop)->shift)
+#define UOP_OPERAND_lsr(arm_s, uop)  ((arm_s)->regs[(uop)->rm] >> (uop)->shift)
+#define UOP_OPERAND_asr(arm_s, uop)  ((unsigned int)((int)(arm_s)->regs[(uop)->rm] >> (uop)->shift))
+
+#define UOP_DATA(name, form, expression, flags, write)                          \
+  static void uop_##name##_##form(struct arm_state* arm_s, const struct arm_uop* uop) \
+  {                                                                             \
+    unsigned int a = arm_s->regs[uop->rn];                                      \
+    unsigned int b = UOP_OPERAND_##form(arm_s, uop);                            \
+    unsigned int result = (expression);                                         \
+                                                                                \
+    (void) a;                                                                   \
+    flags;                                                                      \
+    if(write)                                                                   \
+    {                                                                           \
+      arm_s->regs[uop->rd] = result;                                            \
+    }                                                                           \
+    arm_s->regs[PC] += 4;                                                       \
+  }
+
+#define UOP_ARITH(op)  set_flags_arith(arm_s, op, a, b, result)
+#define UOP_REVERSE(op)  set_flags_arith(arm_s, op, b, a, result)
+#define UOP_LOGIC  set_flags_logic(arm_s, result)
+#define UOP_NONE  (void) 0
+
+#define UOP_DATA_FORM(form)                                  \
+  UOP_DATA(and, form, a & b, UOP_NONE, 1)                    \
+  UOP_DATA(ands, form, a & b, UOP_LOGIC, 1)                  \
+  UOP_DATA(eor, form, a ^ b, UOP_NONE, 1)                    \
+  UOP_DATA(eors, form, a ^ b, UOP_LOGIC, 1)                  \
+  UOP_DATA(sub, form, a - b, UOP_NONE, 1)                    \
+  UOP_DATA(subs, form, a - b, UOP_ARITH(FLAGS_SUB), 1)       \
+  UOP_DATA(rsb, form, b - a, UOP_NONE, 1)                    \
+  UOP_DATA(rsbs, form, b - a, UOP_REVERSE(FLAGS_SUB), 1)     \
+  UOP_DATA(add, form, a + b, UOP_NONE, 1)                    \
+  UOP_DATA(adds, form, a + b, UOP_ARITH(FLAGS_ADD), 1)       \
+  UOP_DATA(tst, form, a & b, UOP_LOGIC, 0)                   \
+  UOP_DATA(teq, form, a ^ b, UOP_LOGIC, 0)                   \
+  UOP_DATA(cmp, form, a - b, UOP_ARITH(FLAGS_SUB), 0)        \
+  UOP_DATA(cmn, form, a + b, UOP_ARITH(FLAGS_ADD), 0)        \
+  UOP_DATA(orr, form, a | b, UOP_NONE, 1)                    \
+  UOP_DATA(orrs, form, a | b, UOP_LOGIC, 1)                  \
+  UOP_DATA(mov, form, b, UOP_NONE, 1)                        \
+  UOP_DATA(movs, form, b, UOP_LOGIC, 1)                      \
+  UOP_DATA(bic, form, a & ~b, UOP_NONE, 1)                   \
+  UOP_DATA(bics, form, a & ~b, UOP_LOGIC, 1)                 \
+  UOP_DATA(mvn, form, ~b, UOP_NONE, 1)                       \
+  UOP_DATA(mvns, form, ~b, UOP_LOGIC, 1)
+
+UOP_DATA_FORM(imm)
+UOP_DATA_FORM(reg)
+UOP_DATA_FORM(lsl)
+UOP_DATA_FORM(lsr)
+UOP_DATA_FORM(asr)
+
+/* Indexed by the opcode and S, bits 24:20; ADC, SBC and RSC are left out. */
+#define UOP_DATA_TABLE(form)                                              \
+  {                                                                       \
+    [0x00] = uop_and_##form, [0x01] = uop_ands_##form,                    \
+    [0x02] = uop_eor_##form, [0x03] = uop_eors_##form,                    \
+    [0x04] = uop_sub_##form, [0x05] = uop_subs_##form,                    \
+    [0x06] = uop_rsb_##form, [0x07] = uop_rsbs_##form,                    \
+    [0x08] = uop_add_##form, [0x09] = uop_adds_##form,                    \
+    [0x11] = uop_tst_##form, [0x13] = uop_teq_##form,                     \
+    [0x15] = uop_cmp_##form, [0x17] = uop_cmn_##form,                     \
+    [0x18] = uop_orr_##form, [0x19] = uop_orrs_##form,                    \
+    [0x1A] = uop_mov_##form, [0x1B] = uop_movs_##form,                    \
+    [0x1C] = uop_bic_##form, [0x1D] = uop_bics_##form,                    \
+    [0x1E] = uop_mvn_##form, [0x1F] = uop_mvns_##form,                    \
+  }
+
+static void (*const uop_data_handlers[UOP_FORMS][32])(struct arm_state*, const struct arm_uop*) =
+{
+  [UOP_IMM] = UOP_DATA_TABLE(imm),
+  [UOP_REG] = UOP_DATA_TABLE(reg),
+  [UOP_LSL] = UOP_DATA_TABLE(lsl),
+  [UOP_LSR] = UOP_DATA_TABLE(lsr),
+  [UOP_ASR] = UOP_DATA_TABLE(asr),
+};
+
+/* Logical operations with S only get a handler where the shifter carry is C. */
+static int uop_decode_data(struct arm_uop* uop, unsigned int iw)
+{
+  unsigned int index = (iw >> 20) & 0x1F;
+  unsigned int logic_s = (index & 0b1) && ((0xF303 >> (index >> 1)) & 0b1);
+  unsigned int type = (iw >> 5) & 0b11;
+  unsigned int form;
+
+  if(uop->rd == PC || uop->rn == PC)
+  {
+    return 0;
+  }
+
+  if((iw >> 25) & 0b1)
+  {
+    unsigned int rotate = (iw >> 7) & 0x1E;
+
+    if(logic_s && rotate != 0)
+    {
+      return 0;
+    }
+    uop->imm = operand2_imm(NULL, iw);
+    form = UOP_IMM;
+  }
+  else
+  {
+    if(((iw >> 4) & 0b1) || uop->rm == PC || (logic_s && (iw & 0xFF0) != 0))
+    {
+      return 0;
+    }
+    if(type == 0)
+    {
+      form = uop->shift == 0 ? UOP_REG : UOP_LSL;
+    }
+    else if(type != 3 && uop->shift != 0)
+    {
+      form = type == 1 ? UOP_LSR : UOP_ASR;
+    }
+    else
+    {
+      return 0;
+    }
+  }
+
+  uop->run = uop_data_handlers[form][index];
+  return uop->run != NULL;
+}
+
+#define UOP_LOAD(name, type, address, writeback)                              \
+  static void uop_##name(struct arm_state* arm_s, const struct arm_uop* uop)  \
+  {                                                                           \
+    unsigned int base = arm_s->regs[uop->rn];                                 \
+    unsigned int value = GUEST_READ(arm_s, type, address);                    \
+                                                                              \
+    (void) base;                                                              \
+    arm_s->regs[uop->rd] = value;                                             \
+    writeback;                                                                \
+    arm_s->regs[PC] += 4;                                                     \
+  }
+
+#define UOP_STORE(name, type, address, writeback)                             \
+  static void uop_##name(struct arm_state* arm_s, const struct arm_uop* uop)  \
+  {                                                                           \
+    unsigned int base = arm_s->regs[uop->rn];                                 \
+                                                                              \
+    GUEST_WRITE(arm_s, type, address, arm_s->regs[uop->rd]);                  \
+    if(arm_s->tcache != NULL)                                                 \
+    {                                                                         \
+      arm_tcache_note_store(arm_s->tcache, address);                          \
+    }                                                                         \
+    writeback;                                                                \
+    arm_s->regs[PC] += 4;                                                     \
+  }
+
+#define UOP_TRANSFER(kind, name, type)                                                            \
+  UOP_##kind(name##_offset, type, base + uop->imm, (void) 0)                                      \
+  UOP_##kind(name##_pre, type, base + uop->imm, arm_s->regs[uop->rn] = base + uop->imm)           \
+  UOP_##kind(name##_post, type, base, arm_s->regs[uop->rn] = base + uop->imm)                     \
+  UOP_##kind(name##_register, type, base + (arm_s->regs[uop->rm] << uop->shift), (void) 0)
+
+UOP_TRANSFER(LOAD, ldr, unsigned int)
+UOP_TRANSFER(LOAD, ldrb, unsigned char)
+UOP_TRANSFER(STORE, str, unsigned int)
+UOP_TRANSFER(STORE, strb, unsigned char)
+UOP_LOAD(ldr_literal, unsigned int, uop->imm, (void) 0)
+UOP_LOAD(ldrb_literal, unsigned char, uop->imm, (void) 0)
+
+/* Indexed by L and B, then by the addressing form. */
+enum
+{
+  UOP_OFFSET,
+  UOP_PRE,
+  UOP_POST,
+  UOP_REGISTER,
+  UOP_LITERAL,
+  UOP_ADDRESSING
+};
+
+static void (*const uop_transfer_handlers[4][UOP_ADDRESSING])(struct arm_state*, const struct arm_uop*) =
+{
+  {uop_str_offset, uop_str_pre, uop_str_post, uop_str_register, NULL},
+  {uop_strb_offset, uop_strb_pre, uop_strb_post, uop_strb_register, NULL},
+  {uop_ldr_offset, uop_ldr_pre, uop_ldr_post, uop_ldr_register, uop_ldr_literal},
+  {uop_ldrb_offset, uop_ldrb_pre, uop_ldrb_post, uop_ldrb_register, uop_ldrb_literal},
+};
+
+static int uop_decode_transfer(struct arm_uop* uop, unsigned int iw, unsigned int address)
+{
+  unsigned int p_bit = (iw >> 24) & 0b1;
+  unsigned int w_bit = (iw >> 21) & 0b1;
+  unsigned int form;
+
+  if(uop->rd == PC)
+  {
+    return 0;
+  }
+
+  if((iw >> 25) & 0b1)
+  {
+    if(((iw >> 23) & 0b1) == 0 || ((iw >> 5) & 0b11) != 0 || p_bit == 0 || w_bit == 1 || uop->rn == PC || uop->rm == PC)
+    {
+      return 0;
+    }
+    form = UOP_REGISTER;
+  }
+  else
+  {
+    uop->imm = ((iw >> 23) & 0b1) ? iw & 0xFFF : -(iw & 0xFFF);
+    if(uop->rn == PC)
+    {
+      if(p_bit == 0 || w_bit == 1)
+      {
+        return 0;
+      }
+      uop->imm += address + 8;
+      form = UOP_LITERAL;
+    }
+    else
+    {
+      form = p_bit == 0 ? UOP_POST : w_bit == 1 ? UOP_PRE : UOP_OFFSET;
+    }
+  }
+
+  uop->run = uop_transfer_handlers[((iw >> 19) & 0b10) | ((iw >> 22) & 0b1)][form];
+  return uop->run != NULL;
+}
+
+static void uop_branch(struct arm_state* arm_s, const struct arm_uop* uop)
+{
+  arm_s->regs[PC] = uop->imm;
+}
+
+static void uop_branch_link(struct arm_state* arm_s, const struct arm_uop* uop)
+{
+  arm_s->regs[LR] = arm_s->regs[PC] + 4;
+  arm_s->regs[PC] = uop->imm;
+}
+
+static void uop_movw(struct arm_state* arm_s, const struct arm_uop* uop)
+{
+  arm_s->regs[uop->rd] = uop->imm;
+  arm_s->regs[PC] += 4;
+}
+
+static void uop_movt(struct arm_state* arm_s, const struct arm_uop* uop)
+{
+  arm_s->regs[uop->rd] = (arm_s->regs[uop->rd] & 0xFFFF) | uop->imm;
+  arm_s->regs[PC] += 4;
+}
+
+/* address is what PC holds when the instruction runs. */
+void arm_uop_decode(struct arm_uop* uop, unsigned int iw, unsigned int address)
+{
+  unsigned int cls = ARM_CLASSIFY(iw);
+  int decoded = 0;
+
+  uop->run = NULL;
+  uop->handler = arm_exec_handlers[cls];
+  uop->iw = iw;
+  uop->imm = 0;
+  uop->rd = (iw >> 12) & 0xF;
+  uop->rn = (iw >> 16) & 0xF;
+  uop->rm = iw & 0xF;
+  uop->shift = (iw >> 7) & 0x1F;
+
+  switch(cls)
+  {
+    case ARM_CLASS_DATA_PROCESSING:
+      decoded = uop_decode_data(uop, iw);
+      break;
+
+    case ARM_CLASS_DATA_TRANSFER:
+      decoded = uop_decode_transfer(uop, iw, address);
+      break;
+
+    case ARM_CLASS_BRANCH:
+      uop->imm = address + 8 + (((int)(iw << 8)) >> 6);
+      uop->run = ((iw >> 24) & 0b1) ? uop_branch_link : uop_branch;
+      decoded = 1;
+      break;
+
+    case ARM_CLASS_MOVE_WIDE:
+      uop->imm = ((iw >> 4) & 0xF000) | (iw & 0xFFF);
+      if((iw >> 22) & 0b1)
+      {
+        uop->imm <<= 16;
+        uop->run = uop_movt;
+      }
+      else
+      {
+        uop->run = uop_movw;
+      }
+      decoded = uop->rd != PC;
+      break;
+  }
+
+  if(!decoded)
+  {
+    uop->run = uop_generic;
+  }
+}
+
+void arm_state_first_execute(struct arm_state* arm_s)
+{
+  unsigned int iw;
+  unsigned int cls;
+
+  iw = *((unsigned int *) GUEST_ACCESS(arm_s, arm_s->regs[PC], MMU_FETCH));
+  cls = arm_decode_table[ARM_DECODE_INDEX(iw)];
+
+  if((iw >> 28) != COND_AL)
+  {
+    if((iw >> 28) == COND_NV)
+    {
+      cls = ARM_CLASS_UNCONDITIONAL;
+    }
+    else if(!check_cpsr_flags(arm_s, iw))
+    {
+      skip_instruction(arm_s, cls);
+      return;
+    }
+  }
+  arm_class_handlers[cls](arm_s, iw);
+}
+
+/* Puts a faulted run back on the faulting instruction. */
+static void fault_stop(struct arm_state* arm_s, int translated)
+{
+  if(arm_s->cpsr & CPSR_T)
+  {
+    arm_s->regs[PC] = arm_s->thumb_pc;
+  }
+  else if(translated)
+  {
+    arm_tcache_fault(arm_s);
+  }
+}
+
+/* Profiling steps the interpreter, and translated code does not go through the MMU. */
+static int runs_translated(const struct arm_state* arm_s)
+{
+  return arm_s->tcache != NULL && arm_s->profile == NULL && arm_s->mmu == NULL;
+}
+
+/*
+ * Runs until the guest returns to address 0. A load, store or fetch outside
+ * mapped guest memory stops the run and is recorded in arm_s->fault. An odd
+ * entry address starts in Thumb state, and BX and loads into PC switch.
+ */
+unsigned int arm_state_execute(struct arm_state* arm_s)
+{
+  int translated = runs_translated(arm_s);
+
+  arm_vfp_enter(arm_s);
+  if(sigsetjmp(arm_s->fault.env, 1) == 0)
+  {
+    guest_fault_enter(&arm_s->fault, arm_s->mem);
+    if(arm_s->profile != NULL)
+    {
+      arm_profile_run(arm_s);
+    }
+    else if(translated)
+    {
+      arm_tcache_run(arm_s);
+    }
+    else
+    {
+      while(arm_s->regs[PC] != 0)
+      {
+        if(arm_s->cpsr & CPSR_T)
+        {
+          arm_thumb_step(arm_s);
+        }
+        else
+        {
+          arm_state_first_execute(arm_s);
+        }
+      }
+    }
+    guest_fault_leave();
+  }
+  else
+  {
+    fault_stop(arm_s, translated);
+  }
+  arm_vfp_leave(arm_s);
+
+  return arm_s->regs[0];
+}
+
+unsigned int arm_state_instructions(struct arm_state* arm_s)
+{
+  return arm_s->comp_count + arm_s->mem_count + arm_s->br_count;
+}
+
+/*
+ * arm_state_execute that also stops once arm_state_instructions reaches
+ * limit. Interpreted, that is exactly at limit; with a tcache attached it is
+ * at the end of the block that crosses it. Calling it again continues.
+ */
+void arm_state_execute_until(struct arm_state* arm_s, unsigned int limit)
+{
+  int translated = runs_translated(arm_s);
+
+  arm_vfp_enter(arm_s);
+  if(sigsetjmp(arm_s->fault.env, 1) == 0)
+  {
+    guest_fault_enter(&arm_s->fault, arm_s->mem);
+    while(arm_s->regs[PC] != 0 && arm_state_instructions(arm_s) < limit)
+    {
+      if(translated)
+      {
+        arm_tcache_step(arm_s);
+      }
+      else if(arm_s->profile != NULL)
+      {
+        arm_profile_step(arm_s);
+      }
+      else if(arm_s->cpsr & CPSR_T)
+      {
+        arm_thumb_step(arm_s);
+      }
+      else
+      {
+        arm_state_first_execute(arm_s);
+      }
+    }
+    guest_fault_leave();
+  }
+  else
+  {
+    fault_stop(arm_s, translated);
+  }
+  arm_vfp_leave(arm_s);
+}
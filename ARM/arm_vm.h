@@ -0,0 +1,102 @@
+#ifndef ARM_VM_H
+#define ARM_VM_H
+
+#include <fenv.h>
+#include <stdbool.h>
+
+#include "arm_memory.h"
+
+struct arm_tcache;
+struct arm_profile;
+struct arm_mmu;
+
+#define MAX_REGS  16
+#define SP  13
+#define LR  14
+#define PC  15
+#define STACK_SIZE  1024
+#define ARM_STATE_POOL_MAX  64
+
+#define CPSR_N  0x80000000
+#define CPSR_Z  0x40000000
+#define CPSR_C  0x20000000
+#define CPSR_V  0x10000000
+#define CPSR_NZCV  0xF0000000
+#define CPSR_T  0x00000020
+
+/*
+ * NZCV are not written back when an instruction sets them. The instruction
+ * records what it did in flag_op/flag_a/flag_b/flag_result and arm_cpsr
+ * folds that into cpsr only when something reads the flags.
+ */
+enum flag_op
+{
+  FLAGS_CLEAN = 0,
+  FLAGS_LOGIC,
+  FLAGS_ADD,
+  FLAGS_SUB,
+  FLAGS_ADC,
+  FLAGS_SBC
+};
+
+/* S0-S31 are the low and high halves of D0-D15. */
+union arm_vfp_regs
+{
+  float s[32];
+  double d[32];
+  unsigned int w[64];
+  unsigned long long x[32];
+};
+
+struct arm_state
+{
+  unsigned int regs[MAX_REGS];
+  unsigned int cpsr;
+  unsigned int flag_op;
+  unsigned int flag_a;
+  unsigned int flag_b;
+  unsigned int flag_result;
+  unsigned char* mem_base;
+  struct arm_memory* mem;
+  unsigned int stack;
+  unsigned int comp_count;
+  unsigned int mem_count;
+  unsigned int br_count;
+  unsigned int excl_address;
+  unsigned int excl_size;
+  unsigned long long excl_value;
+  unsigned int it_state;
+  unsigned int thumb_pc;
+  union arm_vfp_regs vfp;
+  unsigned int fpscr;
+  unsigned int fpexc;
+  fenv_t host_fenv;
+  struct guest_fault fault;
+  struct arm_tcache* tcache;
+  struct arm_profile* profile;
+  struct arm_mmu* mmu;
+  unsigned int memory_id;
+  struct arm_state* pool_next;
+};
+
+struct arm_state* new_arm_state(struct arm_memory* mem, unsigned int func, unsigned int arg0, unsigned int arg1, unsigned int arg2, unsigned int arg3);
+void free_arm_state(struct arm_state* arm_s);
+void arm_state_reset(struct arm_state* arm_s, unsigned int func, unsigned int arg0, unsigned int arg1, unsigned int arg2, unsigned int arg3);
+void arm_state_pool_drain(void);
+void arm_state_attach_tcache(struct arm_state* arm_s, struct arm_tcache* tc);
+void arm_state_attach_profile(struct arm_state* arm_s, struct arm_profile* prof);
+void arm_state_attach_mmu(struct arm_state* arm_s, struct arm_mmu* mmu);
+void print_arm_state(struct arm_state* arm_s, unsigned int sim_result, unsigned int assembler_result);
+unsigned int arm_cpsr(struct arm_state* arm_s);
+int check_cpsr_flags(struct arm_state* arm_s, unsigned int iw);
+void arm_state_first_execute(struct arm_state* arm_s);
+void arm_process_data_value(struct arm_state* arm_s, unsigned int iw, unsigned int op2);
+void arm_halfword_transfer(struct arm_state* arm_s, unsigned int iw, unsigned int offset);
+unsigned int arm_state_execute(struct arm_state* arm_s);
+unsigned int arm_state_instructions(struct arm_state* arm_s);
+void arm_state_execute_until(struct arm_state* arm_s, unsigned int limit);
+
+/* Per-class handlers without the counter bumps, for arm_block.c. */
+extern void (*const arm_exec_handlers[])(struct arm_state*, unsigned int);
+
+#endif
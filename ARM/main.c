@@ -0,0 +1,126 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arm_vm.h"
+#include "arm_block.h"
+#include "arm_elf.h"
+#include "arm_memory.h"
+#include "arm_profile.h"
+
+/*
+ * Runs a static ARM Linux executable. Options come before the program; the
+ * program's own arguments follow it. The exit status is the guest's, or -1
+ * if it stopped on a fault.
+ */
+
+static void usage(void)
+{
+  printf("Usage: arm [--tcache] [--jit] [--profile=<file.json|file.pb>] [--state] <program> [arguments]...\n");
+  exit(-1);
+}
+
+int main(int argc, char* argv[])
+{
+  int tcache = 0;
+  int jit = 0;
+  int state = 0;
+  const char* profile_path = NULL;
+  struct arm_memory* mem;
+  struct arm_state* arm_s;
+  struct arm_tcache* tc = NULL;
+  struct arm_profile* prof = NULL;
+  unsigned int result;
+  int i;
+
+  for(i = 1; i < argc && !strncmp(argv[i], "--", 2); i++)
+  {
+    if(!strcmp(argv[i], "--tcache"))
+    {
+      tcache = 1;
+    }
+    else if(!strcmp(argv[i], "--jit"))
+    {
+      tcache = 1;
+      jit = 1;
+    }
+    else if(!strncmp(argv[i], "--profile=", 10))
+    {
+      profile_path = argv[i] + 10;
+    }
+    else if(!strcmp(argv[i], "--state"))
+    {
+      state = 1;
+    }
+    else
+    {
+      usage();
+    }
+  }
+  if(i == argc)
+  {
+    usage();
+  }
+
+  mem = new_arm_memory();
+  arm_s = new_arm_state_from_elf(mem, argv[i], argc - i, argv + i);
+  if(tcache)
+  {
+    tc = new_arm_tcache();
+    if(jit)
+    {
+      arm_tcache_enable_jit(tc);
+    }
+    arm_state_attach_tcache(arm_s, tc);
+  }
+  if(profile_path != NULL)
+  {
+    prof = new_arm_profile();
+    arm_state_attach_profile(arm_s, prof);
+  }
+
+  result = arm_state_execute(arm_s);
+  fflush(stdout);
+
+  if(prof != NULL)
+  {
+    FILE* out = fopen(profile_path, "wb");
+    if(out == NULL)
+    {
+      printf("Could not open %s\n", profile_path);
+      exit(-1);
+    }
+    if(strstr(profile_path, ".json") != NULL)
+    {
+      arm_profile_write_json(prof, out);
+    }
+    else
+    {
+      arm_profile_write_pprof(prof, out);
+    }
+    fclose(out);
+  }
+
+  if(state || arm_s->fault.kind != GUEST_FAULT_NONE)
+  {
+    print_arm_state(arm_s, result, result);
+  }
+  if(arm_s->fault.kind != GUEST_FAULT_NONE)
+  {
+    result = -1;
+  }
+
+  free_arm_state(arm_s);
+  if(tc != NULL)
+  {
+    free_arm_tcache(tc);
+  }
+  if(prof != NULL)
+  {
+    free_arm_profile(prof);
+  }
+  arm_state_pool_drain();
+  free_arm_memory(mem);
+  return (int)result;
+}
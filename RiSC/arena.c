@@ -0,0 +1,94 @@
+#include "arena.h"
+#include "defines.h"
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Bump allocator for objects that all die together. Chunks are chained and
+ * never returned until the arena is reset or shut down. An arena is owned by
+ * one thread; give each worker its own.
+ */
+typedef struct chunk_t chunk_t;
+
+struct chunk_t
+{
+  chunk_t*  next;
+  size_t  size;
+  size_t  used;
+  alignas(max_align_t) unsigned char  bytes[];
+};
+
+struct RiSC_Arena
+{
+  size_t  chunk_size;
+  chunk_t*  head;
+};
+
+static chunk_t* new_chunk(size_t size, chunk_t* next)
+{
+  chunk_t* c = malloc(sizeof *c + size);
+  if(c == NULL)
+  {
+    ERROR("\t%s", OUT_OF_MEMORY);
+  }
+  c->next = next;
+  c->size = size;
+  c->used = 0;
+  return c;
+}
+
+RiSC_Arena* arena_init(size_t chunk_size)
+{
+  RiSC_Arena* a = malloc(sizeof *a);
+  if(a == NULL)
+  {
+    ERROR("\t%s", OUT_OF_MEMORY);
+  }
+  a->chunk_size = chunk_size;
+  a->head = NULL;
+  return a;
+}
+
+void arena_shutdown(RiSC_Arena* a)
+{
+  if(a != NULL)
+  {
+    while(a->head != NULL)
+    {
+      chunk_t* next = a->head->next;
+      free(a->head);
+      a->head = next;
+    }
+    free(a);
+  }
+}
+
+void* arena_alloc(RiSC_Arena* a, size_t size)
+{
+  size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+
+  if(a->head == NULL || a->head->size - a->head->used < size)
+  {
+    a->head = new_chunk(size > a->chunk_size ? size : a->chunk_size, a->head);
+  }
+
+  void* p = a->head->bytes + a->head->used;
+  a->head->used += size;
+  return p;
+}
+
+void arena_reset(RiSC_Arena* a)
+{
+  while(a->head != NULL && a->head->next != NULL)
+  {
+    chunk_t* next = a->head->next;
+    free(a->head);
+    a->head = next;
+  }
+  if(a->head != NULL)
+  {
+    a->head->used = 0;
+  }
+}
@@ -0,0 +1,13 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct  RiSC_Arena RiSC_Arena;
+
+RiSC_Arena*  arena_init (size_t chunk_size);
+void arena_shutdown  (RiSC_Arena* a);
+void* arena_alloc (RiSC_Arena* a, size_t size);
+void arena_reset (RiSC_Arena* a);
+
+#endif
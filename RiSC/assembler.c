@@ -0,0 +1,481 @@
+#include "assembler.h"
+#include "defines.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Two-pass assembler for RiSC-16 source. The output uses the same layout
+ * load_from_file reads: a data header and the data words, then a text
+ * header and the instructions.
+ *
+ *   label:  op  operands   # comment
+ *
+ * Instructions: add, addi, nand, lui, sw, lw, beq, jalr.
+ * Pseudo-ops:   nop, halt, lli rA, imm, movi rA, imm.
+ * Directives:   .data, .text, .fill value[, value...], .space count.
+ *
+ * Labels resolve to absolute word addresses. A beq to a label encodes the
+ * offset from the next instruction. halt branches to a nop appended after
+ * the last instruction; the VM stops once it has executed that word.
+ */
+#define MAX_LINE  256
+#define MAX_OPERANDS  3
+#define MAX_FILL_VALUES  64
+#define MAX_LABELS  1024
+#define MAX_LABEL_LENGTH  32
+#define HALT_LABEL  "__halt"
+
+typedef struct label_t label_t;
+typedef struct section_t section_t;
+typedef struct assembler_t assembler_t;
+
+typedef enum
+{
+  SECTION_DATA,
+  SECTION_TEXT
+} section_id;
+
+struct label_t
+{
+  char  name[MAX_LABEL_LENGTH];
+  section_id  section;
+  uint16_t  offset;
+};
+
+struct section_t
+{
+  uint16_t  size;
+  uint16_t*  words;
+};
+
+struct assembler_t
+{
+  const char*  name;
+  int  line;
+  bool  emit;
+  bool  uses_halt;
+  uint16_t  data_size;
+  section_id  current;
+  section_t  sections[2];
+  label_t  labels[MAX_LABELS];
+  int  num_labels;
+};
+
+#define ASM_ERROR(as, ...)                                              \
+do {                                                                    \
+  fprintf(stderr, "%s:%d: ", (as)->name, (as)->line);                   \
+  ERROR(__VA_ARGS__);                                                   \
+} while (0)
+
+static char* trim(char* s)
+{
+  while(isspace((unsigned char)*s))
+  {
+    ++s;
+  }
+  char* end = s + strlen(s);
+  while(end > s && isspace((unsigned char)end[-1]))
+  {
+    *--end = '\0';
+  }
+  return s;
+}
+
+static label_t* find_label(assembler_t* as, const char* name)
+{
+  for(int i = 0; i < as->num_labels; ++i)
+  {
+    if(!strcmp(as->labels[i].name, name))
+    {
+      return &as->labels[i];
+    }
+  }
+  return NULL;
+}
+
+static void define_label(assembler_t* as, const char* name)
+{
+  if(!isalpha((unsigned char)*name) && *name != '_')
+  {
+    ASM_ERROR(as, "\tInvalid label \"%s\".\n", name);
+  }
+  if(strlen(name) >= MAX_LABEL_LENGTH)
+  {
+    ASM_ERROR(as, "\tLabel \"%s\" is too long.\n", name);
+  }
+  if(find_label(as, name) != NULL)
+  {
+    ASM_ERROR(as, "\tLabel \"%s\" defined twice.\n", name);
+  }
+  if(as->num_labels == MAX_LABELS)
+  {
+    ASM_ERROR(as, "\tToo many labels.\n");
+  }
+
+  label_t* l = &as->labels[as->num_labels++];
+  strcpy(l->name, name);
+  l->section = as->current;
+  l->offset = as->sections[as->current].size;
+}
+
+static uint16_t label_address(assembler_t* as, label_t* l)
+{
+  if(l->section == SECTION_DATA)
+  {
+    return 1 + l->offset;
+  }
+  return 1 + as->data_size + 1 + l->offset;
+}
+
+static int parse_register(assembler_t* as, const char* s)
+{
+  if(s == NULL || (s[0] != 'r' && s[0] != 'R') || s[1] < '0' || s[1] >= '0' + NUM_REGISTERS || s[2] != '\0')
+  {
+    ASM_ERROR(as, "\tExpected a register r0-r7, got \"%s\".\n", s ? s : "");
+  }
+  return s[1] - '0';
+}
+
+static bool is_number(const char* s)
+{
+  return isdigit((unsigned char)*s) || *s == '-' || *s == '+';
+}
+
+/* Numbers may be decimal or 0x-prefixed hex; anything else is a label. */
+static long parse_value(assembler_t* as, const char* s)
+{
+  if(s == NULL || *s == '\0')
+  {
+    ASM_ERROR(as, "\tMissing operand.\n");
+  }
+
+  if(is_number(s))
+  {
+    char* end;
+    long value = strtol(s, &end, 0);
+    if(*end != '\0')
+    {
+      ASM_ERROR(as, "\tInvalid number \"%s\".\n", s);
+    }
+    return value;
+  }
+
+  if(!as->emit)
+  {
+    return 0;
+  }
+
+  label_t* l = find_label(as, s);
+  if(l == NULL)
+  {
+    ASM_ERROR(as, "\tUndefined label \"%s\".\n", s);
+  }
+  return label_address(as, l);
+}
+
+static long check_range(assembler_t* as, long value, long min, long max)
+{
+  if(as->emit && (value < min || value > max))
+  {
+    ASM_ERROR(as, "\tValue %ld out of range [%ld, %ld].\n", value, min, max);
+  }
+  return value;
+}
+
+static void emit_word(assembler_t* as, long value)
+{
+  section_t* s = &as->sections[as->current];
+  if(s->size == MEMORY_SIZE - 2)
+  {
+    ASM_ERROR(as, "\tProgram does not fit in memory.\n");
+  }
+  if(as->emit)
+  {
+    s->words[s->size] = (uint16_t)value;
+  }
+  s->size++;
+}
+
+static uint16_t current_address(assembler_t* as)
+{
+  label_t here = {"", as->current, as->sections[as->current].size};
+  return label_address(as, &here);
+}
+
+static void emit_rrr(assembler_t* as, uint16_t opcode, char* ops[])
+{
+  emit_word(as, opcode << 13 | parse_register(as, ops[0]) << 10 | parse_register(as, ops[1]) << 7 | parse_register(as, ops[2]));
+}
+
+static void emit_rri(assembler_t* as, uint16_t opcode, int reg_a, int reg_b, long simm)
+{
+  emit_word(as, opcode << 13 | reg_a << 10 | reg_b << 7 | (check_range(as, simm, -64, 63) & MASK_SIMM));
+}
+
+static void emit_ri(assembler_t* as, uint16_t opcode, int reg_a, long uimm)
+{
+  emit_word(as, opcode << 13 | reg_a << 10 | (check_range(as, uimm, 0, MASK_UIMM) & MASK_UIMM));
+}
+
+static void expect_operands(assembler_t* as, const char* mnemonic, int count, int expected)
+{
+  if(count != expected)
+  {
+    ASM_ERROR(as, "\t%s takes %d operand(s), got %d.\n", mnemonic, expected, count);
+  }
+}
+
+static void assemble_instruction(assembler_t* as, const char* mnemonic, char* ops[], int count)
+{
+  if(as->current != SECTION_TEXT)
+  {
+    ASM_ERROR(as, "\tInstruction \"%s\" outside .text.\n", mnemonic);
+  }
+
+  if(!strcmp(mnemonic, "add") || !strcmp(mnemonic, "nand"))
+  {
+    expect_operands(as, mnemonic, count, 3);
+    emit_rrr(as, mnemonic[0] == 'a' ? ADD : NAND, ops);
+  }
+  else if(!strcmp(mnemonic, "addi") || !strcmp(mnemonic, "sw") || !strcmp(mnemonic, "lw"))
+  {
+    uint16_t opcode = mnemonic[0] == 'a' ? ADDI : mnemonic[0] == 's' ? SW : LW;
+    expect_operands(as, mnemonic, count, 3);
+    emit_rri(as, opcode, parse_register(as, ops[0]), parse_register(as, ops[1]), parse_value(as, ops[2]));
+  }
+  else if(!strcmp(mnemonic, "beq"))
+  {
+    expect_operands(as, mnemonic, count, 3);
+    long offset = parse_value(as, ops[2]);
+    if(!is_number(ops[2]))
+    {
+      offset -= current_address(as) + 1;
+    }
+    emit_rri(as, BEQ, parse_register(as, ops[0]), parse_register(as, ops[1]), offset);
+  }
+  else if(!strcmp(mnemonic, "lui"))
+  {
+    expect_operands(as, mnemonic, count, 2);
+    emit_ri(as, LUI, parse_register(as, ops[0]), parse_value(as, ops[1]));
+  }
+  else if(!strcmp(mnemonic, "jalr"))
+  {
+    expect_operands(as, mnemonic, count, 2);
+    emit_word(as, JALR << 13 | parse_register(as, ops[0]) << 10 | parse_register(as, ops[1]) << 7);
+  }
+  else if(!strcmp(mnemonic, "nop"))
+  {
+    expect_operands(as, mnemonic, count, 0);
+    emit_word(as, ADD << 13);
+  }
+  else if(!strcmp(mnemonic, "halt"))
+  {
+    expect_operands(as, mnemonic, count, 0);
+    as->uses_halt = true;
+    label_t* l = as->emit ? find_label(as, HALT_LABEL) : NULL;
+    long offset = l != NULL ? label_address(as, l) - (current_address(as) + 1) : 0;
+    emit_rri(as, BEQ, 0, 0, offset);
+  }
+  else if(!strcmp(mnemonic, "lli"))
+  {
+    expect_operands(as, mnemonic, count, 2);
+    int reg = parse_register(as, ops[0]);
+    emit_rri(as, ADDI, reg, reg, parse_value(as, ops[1]) & 0x3f);
+  }
+  else if(!strcmp(mnemonic, "movi"))
+  {
+    expect_operands(as, mnemonic, count, 2);
+    int reg = parse_register(as, ops[0]);
+    long value = check_range(as, parse_value(as, ops[1]), -32768, 65535) & 0xffff;
+    emit_ri(as, LUI, reg, value >> 6);
+    emit_rri(as, ADDI, reg, reg, value & 0x3f);
+  }
+  else
+  {
+    ASM_ERROR(as, "\tUnknown instruction \"%s\".\n", mnemonic);
+  }
+}
+
+static void assemble_directive(assembler_t* as, char* directive, char* ops[], int count)
+{
+  if(!strcmp(directive, ".data"))
+  {
+    as->current = SECTION_DATA;
+  }
+  else if(!strcmp(directive, ".text"))
+  {
+    as->current = SECTION_TEXT;
+  }
+  else if(!strcmp(directive, ".fill"))
+  {
+    if(count == 0)
+    {
+      ASM_ERROR(as, "\t.fill needs at least one value.\n");
+    }
+    for(int i = 0; i < count; ++i)
+    {
+      emit_word(as, check_range(as, parse_value(as, ops[i]), -32768, 65535));
+    }
+  }
+  else if(!strcmp(directive, ".space"))
+  {
+    expect_operands(as, directive, count, 1);
+    long words = parse_value(as, ops[0]);
+    if(words < 0 || words >= MEMORY_SIZE)
+    {
+      ASM_ERROR(as, "\tInvalid .space size %ld.\n", words);
+    }
+    for(long i = 0; i < words; ++i)
+    {
+      emit_word(as, 0);
+    }
+  }
+  else
+  {
+    ASM_ERROR(as, "\tUnknown directive \"%s\".\n", directive);
+  }
+}
+
+static void assemble_line(assembler_t* as, char* line)
+{
+  char* comment = strpbrk(line, "#;");
+  if(comment != NULL)
+  {
+    *comment = '\0';
+  }
+  line = trim(line);
+
+  char* colon;
+  while((colon = strchr(line, ':')) != NULL)
+  {
+    *colon = '\0';
+    if(!as->emit)
+    {
+      define_label(as, trim(line));
+    }
+    line = trim(colon + 1);
+  }
+
+  if(*line == '\0')
+  {
+    return;
+  }
+
+  char* mnemonic = line;
+  while(*line != '\0' && !isspace((unsigned char)*line))
+  {
+    ++line;
+  }
+  if(*line != '\0')
+  {
+    *line++ = '\0';
+  }
+
+  char* ops[MAX_FILL_VALUES];
+  int count = 0;
+  for(char* op = strtok(line, ", \t"); op != NULL; op = strtok(NULL, ", \t"))
+  {
+    if(count == (int)(sizeof ops / sizeof ops[0]))
+    {
+      ASM_ERROR(as, "\tToo many operands.\n");
+    }
+    ops[count++] = op;
+  }
+
+  for(char* c = mnemonic; *c; ++c)
+  {
+    *c = tolower((unsigned char)*c);
+  }
+
+  if(*mnemonic == '.')
+  {
+    assemble_directive(as, mnemonic, ops, count);
+  }
+  else
+  {
+    if(count > MAX_OPERANDS)
+    {
+      ASM_ERROR(as, "\tToo many operands for \"%s\".\n", mnemonic);
+    }
+    assemble_instruction(as, mnemonic, ops, count);
+  }
+}
+
+static void run_pass(assembler_t* as, const char* source, bool emit)
+{
+  char buffer[MAX_LINE];
+
+  as->emit = emit;
+  as->current = SECTION_TEXT;
+  as->sections[SECTION_DATA].size = 0;
+  as->sections[SECTION_TEXT].size = 0;
+  as->line = 0;
+
+  while(*source != '\0')
+  {
+    size_t length = strcspn(source, "\n");
+    as->line++;
+    if(length >= sizeof buffer)
+    {
+      ASM_ERROR(as, "\tLine too long.\n");
+    }
+    memcpy(buffer, source, length);
+    buffer[length] = '\0';
+    assemble_line(as, buffer);
+    source += length + (source[length] == '\n');
+  }
+
+  if(as->uses_halt)
+  {
+    as->current = SECTION_TEXT;
+    if(!emit)
+    {
+      define_label(as, HALT_LABEL);
+    }
+    emit_word(as, ADD << 13);
+  }
+}
+
+/*
+ * Returns a malloc'ed image in load_from_file layout and stores its length
+ * in num_words. Errors are reported against name and are fatal.
+ */
+uint16_t* asm_assemble(const char* source, const char* name, size_t* num_words)
+{
+  assembler_t* as = calloc(1, sizeof *as);
+  if(as == NULL)
+  {
+    ERROR("\t%s", OUT_OF_MEMORY);
+  }
+  as->name = name;
+
+  run_pass(as, source, false);
+
+  uint16_t data_size = as->sections[SECTION_DATA].size;
+  as->data_size = data_size;
+  uint16_t text_size = as->sections[SECTION_TEXT].size;
+  if(1 + data_size + 1 + text_size > MEMORY_SIZE)
+  {
+    ERROR("\t%s: Program does not fit in memory.\n", name);
+  }
+
+  uint16_t* image = calloc(1 + data_size + 1 + text_size, sizeof *image);
+  if(image == NULL)
+  {
+    ERROR("\t%s", OUT_OF_MEMORY);
+  }
+  as->sections[SECTION_DATA].words = image + 1;
+  as->sections[SECTION_TEXT].words = image + 1 + data_size + 1;
+
+  run_pass(as, source, true);
+
+  image[0] = data_size;
+  image[1 + data_size] = text_size;
+  *num_words = 1 + data_size + 1 + text_size;
+
+  free(as);
+  return image;
+}
@@ -0,0 +1,9 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint16_t*  asm_assemble (const char* source, const char* name, size_t* num_words);
+
+#endif
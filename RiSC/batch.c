@@ -0,0 +1,199 @@
+#define _GNU_SOURCE
+#include "batch.h"
+#include "defines.h"
+#include "virtual_machine.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ARENA_CHUNK_SIZE  (64 * 1024)
+
+typedef struct job_t job_t;
+typedef struct batch_t batch_t;
+
+struct job_t
+{
+  RiSC_Image*  image;
+  char*  program;
+  char*  data_set;
+  char*  report;
+  bool  halted;
+};
+
+struct batch_t
+{
+  job_t*  jobs;
+  int  num_jobs;
+  uint64_t  max_steps;
+  atomic_int  next_job;
+};
+
+static void write_json_string(FILE* out, const char* s)
+{
+  if(s == NULL)
+  {
+    fputs("null", out);
+    return;
+  }
+
+  fputc('"', out);
+  for(; *s; ++s)
+  {
+    if(*s == '"' || *s == '\\')
+    {
+      fprintf(out, "\\%c", *s);
+    }
+    else if((unsigned char)*s < 0x20)
+    {
+      fprintf(out, "\\u%04x", *s);
+    }
+    else
+    {
+      fputc(*s, out);
+    }
+  }
+  fputc('"', out);
+}
+
+static void run_job(job_t* job, uint64_t max_steps, RiSC_Arena* arena)
+{
+  RiSC_VM* vm = vm_init_from_image(job->image, arena);
+  if(job->data_set != NULL)
+  {
+    vm_load_data(vm, job->data_set);
+  }
+
+  job->halted = vm_run_for(vm, max_steps);
+
+  size_t length;
+  FILE* out = open_memstream(&job->report, &length);
+  if(out == NULL)
+  {
+    ERROR("\t%s", OUT_OF_MEMORY);
+  }
+  fprintf(out, "{\"program\": ");
+  write_json_string(out, job->program);
+  fprintf(out, ", \"data_set\": ");
+  write_json_string(out, job->data_set);
+  fprintf(out, ", \"halted\": %s, \"state\": ", job->halted ? "true" : "false");
+  vm_dump_json(vm, out);
+  fprintf(out, "}");
+  fclose(out);
+
+  vm_shutdown(vm);
+}
+
+static void* worker(void* arg)
+{
+  batch_t* batch = arg;
+  RiSC_Arena* arena = arena_init(ARENA_CHUNK_SIZE);
+
+  for(;;)
+  {
+    int i = atomic_fetch_add_explicit(&batch->next_job, 1, memory_order_relaxed);
+    if(i >= batch->num_jobs)
+    {
+      break;
+    }
+    run_job(&batch->jobs[i], batch->max_steps, arena);
+    arena_reset(arena);
+  }
+
+  arena_shutdown(arena);
+  return NULL;
+}
+
+/*
+ * Runs every program once, or every program over every data set when data
+ * sets are given, on a pool of num_threads workers (0 picks one per online
+ * CPU). Each program file is loaded once and its image shared by all of its
+ * runs. A run that has not halted after max_steps instructions is stopped
+ * and reported with "halted": false. Results are written to out as one
+ * JSON document in job order. Returns how many runs were stopped.
+ */
+int batch_run(char* programs[], int num_programs, char* data_sets[], int num_data_sets, int num_threads, uint64_t max_steps, FILE* out)
+{
+  int num_stopped = 0;
+  int runs_per_program = num_data_sets > 0 ? num_data_sets : 1;
+  batch_t batch;
+
+  batch.num_jobs = num_programs * runs_per_program;
+  batch.jobs = calloc(batch.num_jobs, sizeof *batch.jobs);
+  batch.max_steps = max_steps;
+  atomic_init(&batch.next_job, 0);
+  if(batch.jobs == NULL)
+  {
+    ERROR("\t%s", OUT_OF_MEMORY);
+  }
+
+  RiSC_Image** images = malloc(num_programs * sizeof *images);
+  if(images == NULL)
+  {
+    ERROR("\t%s", OUT_OF_MEMORY);
+  }
+
+  for(int p = 0; p < num_programs; ++p)
+  {
+    images[p] = vm_load_image(programs[p]);
+    for(int d = 0; d < runs_per_program; ++d)
+    {
+      job_t* job = &batch.jobs[p * runs_per_program + d];
+      job->image = images[p];
+      job->program = programs[p];
+      job->data_set = num_data_sets > 0 ? data_sets[d] : NULL;
+    }
+  }
+
+  if(num_threads <= 0)
+  {
+    num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if(num_threads > batch.num_jobs)
+  {
+    num_threads = batch.num_jobs;
+  }
+  if(num_threads < 1)
+  {
+    num_threads = 1;
+  }
+
+  pthread_t* threads = malloc(num_threads * sizeof *threads);
+  if(threads == NULL)
+  {
+    ERROR("\t%s", OUT_OF_MEMORY);
+  }
+  for(int t = 0; t < num_threads; ++t)
+  {
+    if(pthread_create(&threads[t], NULL, worker, &batch) != 0)
+    {
+      ERROR("\tCould not start worker thread %d.\n", t);
+    }
+  }
+  for(int t = 0; t < num_threads; ++t)
+  {
+    pthread_join(threads[t], NULL);
+  }
+  free(threads);
+
+  fprintf(out, "{\"runs\": [\n");
+  for(int i = 0; i < batch.num_jobs; ++i)
+  {
+    fprintf(out, "  %s%s\n", batch.jobs[i].report, i + 1 < batch.num_jobs ? "," : "");
+    free(batch.jobs[i].report);
+    num_stopped += !batch.jobs[i].halted;
+  }
+  fprintf(out, "], \"max_steps\": %"PRIu64", \"stopped\": %d}\n", max_steps, num_stopped);
+
+  for(int p = 0; p < num_programs; ++p)
+  {
+    vm_release_image(images[p]);
+  }
+  free(images);
+  free(batch.jobs);
+
+  return num_stopped;
+}
@@ -0,0 +1,12 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+
+#include <stdint.h>
+
+#define BATCH_DEFAULT_MAX_STEPS  100000000
+
+int batch_run (char* programs[], int num_programs, char* data_sets[], int num_data_sets, int num_threads, uint64_t max_steps, FILE* out);
+
+#endif
@@ -0,0 +1,154 @@
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "assembler.h"
+#include "benchmarks.h"
+#include "virtual_machine.h"
+
+#define DEFAULT_REPEAT  5
+
+bool print_output;
+
+typedef struct engine_t engine_t;
+
+struct engine_t
+{
+  const char*  name;
+  bool  pipeline;
+  bool  models;
+};
+
+static const engine_t engines[] =
+{
+  {"interpreter", false, false},
+  {"pipeline",    true,  false},
+  {"pipeline+dcache+gshare", true, true},
+};
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool selected(const char* name, char* filters[], int num_filters)
+{
+  if(num_filters == 0)
+  {
+    return true;
+  }
+  for(int i = 0; i < num_filters; ++i)
+  {
+    if(!strcmp(filters[i], name))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool run_engine(const engine_t* engine, const RiSC_Benchmark* b, RiSC_Image* image, int repeat)
+{
+  uint64_t instructions = 0;
+  double seconds = 0;
+
+  for(int r = 0; r < repeat; ++r)
+  {
+    RiSC_VM* vm = vm_init_from_image(image, NULL);
+    RiSC_Pipeline* pipeline = engine->pipeline ? pipeline_init() : NULL;
+    RiSC_Cache* dcache = engine->models ? cache_init(256, 4, 2, CACHE_LRU) : NULL;
+    RiSC_Predictor* predictor = engine->models ? predictor_init(PREDICT_GSHARE, 10) : NULL;
+
+    vm_attach_pipeline(vm, pipeline);
+    vm_attach_dcache(vm, dcache);
+    vm_attach_predictor(vm, predictor);
+
+    double start = now();
+    vm_run(vm);
+    seconds += now() - start;
+    instructions += vm_instructions(vm);
+
+    uint16_t result = vm_read_word(vm, BENCHMARK_RESULT_ADDRESS);
+    vm_shutdown(vm);
+    pipeline_shutdown(pipeline);
+    cache_shutdown(dcache);
+    predictor_shutdown(predictor);
+
+    if(result != b->expected)
+    {
+      printf("%-10s %-24s FAILED: result %"PRIu16", expected %"PRIu16"\n", b->name, engine->name, result, b->expected);
+      return false;
+    }
+  }
+
+  printf("%-10s %-24s %14"PRIu64" %10.4f %14.0f\n", b->name, engine->name, instructions, seconds,
+         seconds > 0 ? instructions / seconds : 0.0);
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  int repeat = DEFAULT_REPEAT;
+  char** filters = malloc(argc * sizeof *filters);
+  int num_filters = 0;
+  bool passed = true;
+
+  if(filters == NULL)
+  {
+    printf("Error: Out of memory.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if(!strncmp(argv[i], "--repeat=", 9))
+    {
+      repeat = atoi(argv[i] + 9);
+    }
+    else if(!strncmp(argv[i], "--", 2))
+    {
+      printf("Usage: bench [--repeat=<n>] [kernel]...\n");
+      exit(EXIT_FAILURE);
+    }
+    else
+    {
+      filters[num_filters++] = argv[i];
+    }
+  }
+
+  if(repeat < 1)
+  {
+    repeat = 1;
+  }
+
+  printf("%-10s %-24s %14s %10s %14s\n", "kernel", "engine", "instructions", "seconds", "instr/s");
+  for(int k = 0; k < num_benchmarks; ++k)
+  {
+    const RiSC_Benchmark* b = &benchmarks[k];
+    if(!selected(b->name, filters, num_filters))
+    {
+      continue;
+    }
+
+    size_t num_words;
+    uint16_t* words = asm_assemble(b->source, b->name, &num_words);
+    RiSC_Image* image = vm_create_image(words, num_words);
+    free(words);
+
+    for(size_t e = 0; e < sizeof engines / sizeof engines[0]; ++e)
+    {
+      passed &= run_engine(&engines[e], b, image, repeat);
+    }
+
+    vm_release_image(image);
+  }
+
+  free(filters);
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
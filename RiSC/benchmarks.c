@@ -0,0 +1,192 @@
+#include "benchmarks.h"
+
+/*
+ * Fixed workloads for the benchmark harness. Every kernel keeps its
+ * checksum in the first data word (BENCHMARK_RESULT_ADDRESS) so a run can
+ * be validated against the expected value before its timing is trusted.
+ */
+
+static const char sort_source[] =
+  "# Bubble sort of 32 pseudo-random words, repeated. r7 holds the sign\n"
+  "# mask since the kernel makes no calls.\n"
+  "        .data\n"
+  "result: .fill 0\n"
+  "reps:   .fill 40\n"
+  "seed:   .fill 12345\n"
+  "array:  .space 32\n"
+  "        .text\n"
+  "        lui  r7, 512\n"
+  "outer:  movi r1, array\n"
+  "        addi r2, r0, 32\n"
+  "        lw   r3, r0, seed\n"
+  "fill:   add  r4, r3, r3\n"
+  "        add  r4, r4, r4\n"
+  "        add  r3, r4, r3\n"
+  "        addi r3, r3, 13\n"
+  "        movi r4, 0x3fff\n"
+  "        nand r5, r3, r4\n"
+  "        nand r5, r5, r5\n"
+  "        sw   r5, r1, 0\n"
+  "        addi r1, r1, 1\n"
+  "        addi r2, r2, -1\n"
+  "        beq  r2, r0, sort\n"
+  "        beq  r0, r0, fill\n"
+  "sort:   sw   r3, r0, seed\n"
+  "        addi r2, r0, 31\n"
+  "pass:   movi r1, array\n"
+  "        add  r3, r2, r0\n"
+  "inner:  lw   r4, r1, 0\n"
+  "        lw   r5, r1, 1\n"
+  "        nand r6, r4, r4\n"
+  "        addi r6, r6, 1\n"
+  "        add  r6, r5, r6\n"
+  "        nand r6, r6, r7\n"
+  "        nand r6, r6, r6\n"
+  "        beq  r6, r0, noswap\n"
+  "        sw   r5, r1, 0\n"
+  "        sw   r4, r1, 1\n"
+  "noswap: addi r1, r1, 1\n"
+  "        addi r3, r3, -1\n"
+  "        beq  r3, r0, endpass\n"
+  "        beq  r0, r0, inner\n"
+  "endpass: addi r2, r2, -1\n"
+  "        beq  r2, r0, check\n"
+  "        beq  r0, r0, pass\n"
+  "check:  lw   r4, r0, result\n"
+  "        movi r1, array\n"
+  "        lw   r5, r1, 0\n"
+  "        add  r4, r4, r5\n"
+  "        lw   r5, r1, 16\n"
+  "        add  r4, r4, r5\n"
+  "        lw   r5, r1, 31\n"
+  "        add  r4, r4, r5\n"
+  "        sw   r4, r0, result\n"
+  "        lw   r6, r0, reps\n"
+  "        addi r6, r6, -1\n"
+  "        sw   r6, r0, reps\n"
+  "        beq  r6, r0, done\n"
+  "        movi r5, outer\n"
+  "        jalr r6, r5\n"
+  "done:   halt\n";
+
+static const char multiply_source[] =
+  "# Shift-and-add 16x16 multiply of (n, n + 37) for n = reps..1.\n"
+  "        .data\n"
+  "result: .fill 0\n"
+  "reps:   .fill 2000\n"
+  "        .text\n"
+  "        lw   r6, r0, reps\n"
+  "outer:  add  r1, r6, r0\n"
+  "        addi r2, r6, 37\n"
+  "        addi r3, r0, 0\n"
+  "        addi r4, r0, 1\n"
+  "mul:    nand r5, r2, r4\n"
+  "        nand r5, r5, r5\n"
+  "        beq  r5, r0, skip\n"
+  "        add  r3, r3, r1\n"
+  "skip:   add  r1, r1, r1\n"
+  "        add  r4, r4, r4\n"
+  "        beq  r4, r0, next\n"
+  "        beq  r0, r0, mul\n"
+  "next:   lw   r5, r0, result\n"
+  "        add  r5, r5, r3\n"
+  "        sw   r5, r0, result\n"
+  "        addi r6, r6, -1\n"
+  "        beq  r6, r0, done\n"
+  "        beq  r0, r0, outer\n"
+  "done:   halt\n";
+
+static const char memcpy_source[] =
+  "# Word-by-word copy of a 64-word block, repeated, then a checksum.\n"
+  "        .data\n"
+  "result: .fill 0\n"
+  "reps:   .fill 2000\n"
+  "src:    .space 64\n"
+  "dst:    .space 64\n"
+  "        .text\n"
+  "        movi r1, src\n"
+  "        addi r2, r0, 0\n"
+  "        addi r3, r0, 32\n"
+  "        add  r3, r3, r3\n"
+  "init:   sw   r2, r1, 0\n"
+  "        addi r2, r2, 3\n"
+  "        addi r1, r1, 1\n"
+  "        addi r3, r3, -1\n"
+  "        beq  r3, r0, start\n"
+  "        beq  r0, r0, init\n"
+  "start:  lw   r6, r0, reps\n"
+  "outer:  movi r1, src\n"
+  "        movi r2, dst\n"
+  "        addi r3, r0, 16\n"
+  "copy:   lw   r4, r1, 0\n"
+  "        sw   r4, r2, 0\n"
+  "        lw   r4, r1, 1\n"
+  "        sw   r4, r2, 1\n"
+  "        lw   r4, r1, 2\n"
+  "        sw   r4, r2, 2\n"
+  "        lw   r4, r1, 3\n"
+  "        sw   r4, r2, 3\n"
+  "        addi r1, r1, 4\n"
+  "        addi r2, r2, 4\n"
+  "        addi r3, r3, -1\n"
+  "        beq  r3, r0, next\n"
+  "        beq  r0, r0, copy\n"
+  "next:   lw   r5, r0, result\n"
+  "        lw   r4, r2, -1\n"
+  "        add  r5, r5, r4\n"
+  "        sw   r5, r0, result\n"
+  "        addi r6, r6, -1\n"
+  "        beq  r6, r0, done\n"
+  "        beq  r0, r0, outer\n"
+  "done:   halt\n";
+
+static const char fibonacci_source[] =
+  "# Naive recursive fib(15) through jalr, with frames on the r7 stack.\n"
+  "# Argument and result in r1, return address in r6.\n"
+  "        .data\n"
+  "result: .fill 0\n"
+  "reps:   .fill 20\n"
+  "        .text\n"
+  "        lui  r5, 512\n"
+  "        lw   r4, r0, reps\n"
+  "loop:   addi r1, r0, 15\n"
+  "        movi r2, fib\n"
+  "        jalr r6, r2\n"
+  "        lw   r3, r0, result\n"
+  "        add  r3, r3, r1\n"
+  "        sw   r3, r0, result\n"
+  "        addi r4, r4, -1\n"
+  "        beq  r4, r0, done\n"
+  "        beq  r0, r0, loop\n"
+  "done:   halt\n"
+  "fib:    addi r2, r1, -2\n"
+  "        nand r2, r2, r5\n"
+  "        nand r2, r2, r2\n"
+  "        beq  r2, r0, recurse\n"
+  "        jalr r0, r6\n"
+  "recurse: addi r7, r7, -3\n"
+  "        sw   r6, r7, 0\n"
+  "        sw   r1, r7, 1\n"
+  "        addi r1, r1, -1\n"
+  "        movi r2, fib\n"
+  "        jalr r6, r2\n"
+  "        sw   r1, r7, 2\n"
+  "        lw   r1, r7, 1\n"
+  "        addi r1, r1, -2\n"
+  "        movi r2, fib\n"
+  "        jalr r6, r2\n"
+  "        lw   r2, r7, 2\n"
+  "        add  r1, r1, r2\n"
+  "        lw   r6, r7, 0\n"
+  "        addi r7, r7, 3\n"
+  "        jalr r0, r6\n";
+
+const RiSC_Benchmark benchmarks[] =
+{
+  {"sort",      sort_source,      52529},
+  {"multiply",  multiply_source,  22400},
+  {"memcpy",    memcpy_source,    50320},
+  {"fibonacci", fibonacci_source, 12200},
+};
+
+const int num_benchmarks = sizeof benchmarks / sizeof benchmarks[0];
@@ -0,0 +1,20 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <stdint.h>
+
+#define BENCHMARK_RESULT_ADDRESS  1
+
+typedef struct  RiSC_Benchmark RiSC_Benchmark;
+
+struct RiSC_Benchmark
+{
+  const char*  name;
+  const char*  source;
+  uint16_t  expected;
+};
+
+extern const RiSC_Benchmark benchmarks[];
+extern const int num_benchmarks;
+
+#endif
@@ -0,0 +1,162 @@
+#include "branch_predictor.h"
+#include "defines.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PC_SPACE  (UINT16_MAX + 1)
+#define MAX_INDEX_BITS  16
+#define WEAKLY_TAKEN  2
+
+typedef struct outcome_t outcome_t;
+
+struct outcome_t
+{
+  uint32_t  branches;
+  uint32_t  taken;
+  uint32_t  mispredicts;
+};
+
+struct RiSC_Predictor
+{
+  predictor_type  type;
+  unsigned int  index_mask;
+  uint16_t  history;
+  uint64_t  branches;
+  uint64_t  mispredicts;
+  uint8_t*  counters;
+  outcome_t*  per_pc;
+};
+
+static const char* predictor_name(predictor_type type)
+{
+  switch(type)
+  {
+    case PREDICT_STATIC:
+      return "static (backward taken)";
+    case PREDICT_BIMODAL:
+      return "bimodal";
+    case PREDICT_GSHARE:
+      return "gshare";
+  }
+  return "unknown";
+}
+
+RiSC_Predictor* predictor_init(predictor_type type, unsigned int index_bits)
+{
+  if(index_bits == 0 || index_bits > MAX_INDEX_BITS)
+  {
+    ERROR("\tPredictor index must be 1 to %d bits, got %u.\n", MAX_INDEX_BITS, index_bits);
+  }
+
+  RiSC_Predictor* bp = malloc(sizeof *bp);
+  if(bp == NULL)
+  {
+    ERROR("\t%s", OUT_OF_MEMORY);
+  }
+
+  bp->type = type;
+  bp->index_mask = (1u << index_bits) - 1;
+  bp->history = 0;
+  bp->branches = 0;
+  bp->mispredicts = 0;
+
+  bp->counters = malloc(bp->index_mask + 1);
+  bp->per_pc = calloc(PC_SPACE, sizeof *bp->per_pc);
+  if(bp->counters == NULL || bp->per_pc == NULL)
+  {
+    ERROR("\t%s", OUT_OF_MEMORY);
+  }
+  memset(bp->counters, WEAKLY_TAKEN, bp->index_mask + 1);
+
+  return bp;
+}
+
+void predictor_shutdown(RiSC_Predictor* bp)
+{
+  if(bp != NULL)
+  {
+    free(bp->counters);
+    free(bp->per_pc);
+    free(bp);
+  }
+}
+
+/* Returns true when the branch was predicted correctly. */
+bool predictor_update(RiSC_Predictor* bp, uint16_t pc, uint16_t target, bool taken)
+{
+  bool prediction;
+  uint8_t* counter = NULL;
+
+  switch(bp->type)
+  {
+    case PREDICT_STATIC:
+      prediction = target <= pc;
+      break;
+
+    case PREDICT_BIMODAL:
+      counter = &bp->counters[pc & bp->index_mask];
+      prediction = *counter >= WEAKLY_TAKEN;
+      break;
+
+    case PREDICT_GSHARE:
+      counter = &bp->counters[(pc ^ bp->history) & bp->index_mask];
+      prediction = *counter >= WEAKLY_TAKEN;
+      bp->history = (bp->history << 1) | taken;
+      break;
+
+    default:
+      prediction = false;
+      break;
+  }
+
+  if(counter != NULL)
+  {
+    if(taken && *counter < 3)
+    {
+      ++*counter;
+    }
+    else if(!taken && *counter > 0)
+    {
+      --*counter;
+    }
+  }
+
+  outcome_t* o = &bp->per_pc[pc];
+  o->branches++;
+  o->taken += taken;
+  bp->branches++;
+
+  if(prediction != taken)
+  {
+    o->mispredicts++;
+    bp->mispredicts++;
+    return false;
+  }
+  return true;
+}
+
+void predictor_print_stats(RiSC_Predictor* bp)
+{
+  printf("Branch predictor: %s, %u entries\n", predictor_name(bp->type), bp->index_mask + 1);
+  printf("  Branches: %"PRIu64" (%"PRIu64" mispredicted)\n", bp->branches, bp->mispredicts);
+  printf("  Accuracy: %.2f%%\n", bp->branches ? 100.0 * (bp->branches - bp->mispredicts) / bp->branches : 0.0);
+
+  if(bp->branches == 0)
+  {
+    return;
+  }
+
+  printf("-------------\n");
+  printf("    Address    Branches     Taken  Mispredicts\n");
+  for(int pc = 0; pc < PC_SPACE; ++pc)
+  {
+    outcome_t* o = &bp->per_pc[pc];
+    if(o->branches != 0)
+    {
+      printf("    %6d:  %10"PRIu32"  %8"PRIu32"  %11"PRIu32"\n", pc, o->branches, o->taken, o->mispredicts);
+    }
+  }
+  printf("-------------\n");
+}
@@ -0,0 +1,21 @@
+#ifndef BRANCH_PREDICTOR_H
+#define BRANCH_PREDICTOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct  RiSC_Predictor RiSC_Predictor;
+
+typedef enum
+{
+  PREDICT_STATIC,
+  PREDICT_BIMODAL,
+  PREDICT_GSHARE
+} predictor_type;
+
+RiSC_Predictor*  predictor_init (predictor_type type, unsigned int index_bits);
+void predictor_shutdown  (RiSC_Predictor* bp);
+bool predictor_update (RiSC_Predictor* bp, uint16_t pc, uint16_t target, bool taken);
+void predictor_print_stats (RiSC_Predictor* bp);
+
+#endif
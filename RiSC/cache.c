@@ -0,0 +1,197 @@
+#include "cache.h"
+#include "defines.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PC_SPACE  (UINT16_MAX + 1)
+
+typedef struct line_t line_t;
+typedef struct access_t access_t;
+
+struct line_t
+{
+  uint16_t  tag;
+  bool  valid;
+  uint64_t  last_use;
+};
+
+struct access_t
+{
+  uint64_t  accesses;
+  uint64_t  misses;
+};
+
+struct RiSC_Cache
+{
+  unsigned int  sets;
+  unsigned int  ways;
+  unsigned int  line_shift;
+  unsigned int  set_mask;
+  cache_policy  policy;
+  uint64_t  clock;
+  uint32_t  random_state;
+  uint64_t  reads;
+  uint64_t  writes;
+  uint64_t  read_misses;
+  uint64_t  write_misses;
+  line_t*  lines;
+  access_t*  per_pc;
+};
+
+static bool is_power_of_two(unsigned int n)
+{
+  return n != 0 && (n & (n - 1)) == 0;
+}
+
+static unsigned int log2_of(unsigned int n)
+{
+  unsigned int shift = 0;
+  while((1u << shift) < n)
+  {
+    ++shift;
+  }
+  return shift;
+}
+
+static uint32_t next_random(RiSC_Cache* c)
+{
+  uint32_t x = c->random_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  c->random_state = x;
+  return x;
+}
+
+RiSC_Cache* cache_init(unsigned int size_words, unsigned int line_words, unsigned int ways, cache_policy policy)
+{
+  if(!is_power_of_two(size_words) || !is_power_of_two(line_words) || !is_power_of_two(ways) || line_words * ways > size_words)
+  {
+    ERROR("\tInvalid cache geometry: %u words, %u-word lines, %u ways.\n", size_words, line_words, ways);
+  }
+
+  RiSC_Cache* c = malloc(sizeof *c);
+  if(c == NULL)
+  {
+    ERROR("\t%s", OUT_OF_MEMORY);
+  }
+
+  c->sets = size_words / (line_words * ways);
+  c->ways = ways;
+  c->line_shift = log2_of(line_words);
+  c->set_mask = c->sets - 1;
+  c->policy = policy;
+  c->clock = 0;
+  c->random_state = 0x2545f491;
+  c->reads = 0;
+  c->writes = 0;
+  c->read_misses = 0;
+  c->write_misses = 0;
+
+  c->lines = calloc(c->sets * c->ways, sizeof *c->lines);
+  c->per_pc = calloc(PC_SPACE, sizeof *c->per_pc);
+  if(c->lines == NULL || c->per_pc == NULL)
+  {
+    ERROR("\t%s", OUT_OF_MEMORY);
+  }
+
+  return c;
+}
+
+void cache_shutdown(RiSC_Cache* c)
+{
+  if(c != NULL)
+  {
+    free(c->lines);
+    free(c->per_pc);
+    free(c);
+  }
+}
+
+/* Write-allocate: stores fill the line just like loads do. */
+bool cache_access(RiSC_Cache* c, uint16_t pc, uint16_t address, bool is_write)
+{
+  uint16_t block = address >> c->line_shift;
+  line_t* set = &c->lines[(block & c->set_mask) * c->ways];
+  line_t* victim = &set[0];
+
+  c->clock++;
+  c->per_pc[pc].accesses++;
+  if(is_write)
+  {
+    c->writes++;
+  }
+  else
+  {
+    c->reads++;
+  }
+
+  for(unsigned int i = 0; i < c->ways; ++i)
+  {
+    if(set[i].valid && set[i].tag == block)
+    {
+      set[i].last_use = c->clock;
+      return true;
+    }
+    if(!set[i].valid)
+    {
+      victim = &set[i];
+    }
+    else if(victim->valid && set[i].last_use < victim->last_use)
+    {
+      victim = &set[i];
+    }
+  }
+
+  if(victim->valid && c->policy == CACHE_RANDOM)
+  {
+    victim = &set[next_random(c) & (c->ways - 1)];
+  }
+
+  victim->tag = block;
+  victim->valid = true;
+  victim->last_use = c->clock;
+
+  c->per_pc[pc].misses++;
+  if(is_write)
+  {
+    c->write_misses++;
+  }
+  else
+  {
+    c->read_misses++;
+  }
+
+  return false;
+}
+
+void cache_print_stats(RiSC_Cache* c)
+{
+  uint64_t accesses = c->reads + c->writes;
+  uint64_t misses = c->read_misses + c->write_misses;
+
+  printf("Data cache: %u sets x %u ways, %u-word lines, %s replacement\n",
+         c->sets, c->ways, 1u << c->line_shift, c->policy == CACHE_LRU ? "LRU" : "random");
+  printf("  Reads:  %"PRIu64" (%"PRIu64" misses)\n", c->reads, c->read_misses);
+  printf("  Writes: %"PRIu64" (%"PRIu64" misses)\n", c->writes, c->write_misses);
+  printf("  Hit rate: %.2f%%\n", accesses ? 100.0 * (accesses - misses) / accesses : 0.0);
+
+  if(accesses == 0)
+  {
+    return;
+  }
+
+  printf("-------------\n");
+  printf("    Address    Accesses    Misses\n");
+  for(int pc = 0; pc < PC_SPACE; ++pc)
+  {
+    access_t* a = &c->per_pc[pc];
+    if(a->accesses != 0)
+    {
+      printf("    %6d:  %10"PRIu64"  %8"PRIu64"\n", pc, a->accesses, a->misses);
+    }
+  }
+  printf("-------------\n");
+}
@@ -0,0 +1,20 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct  RiSC_Cache RiSC_Cache;
+
+typedef enum
+{
+  CACHE_LRU,
+  CACHE_RANDOM
+} cache_policy;
+
+RiSC_Cache*  cache_init (unsigned int size_words, unsigned int line_words, unsigned int ways, cache_policy policy);
+void cache_shutdown  (RiSC_Cache* c);
+bool cache_access (RiSC_Cache* c, uint16_t pc, uint16_t address, bool is_write);
+void cache_print_stats (RiSC_Cache* c);
+
+#endif
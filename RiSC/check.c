@@ -0,0 +1,387 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defines.h"
+#include "virtual_machine.h"
+
+/*
+ * Lock-step differential checker. Random programs run on the plain
+ * interpreter and on every engine in the table below, and the two are
+ * compared every --interval instructions; a difference is narrowed down to
+ * the first instruction that diverged by running the program again one
+ * instruction at a time. The engines share vm_execute today and differ in
+ * the models attached to it, so a new execution path only needs a row here.
+ */
+
+#define DATA_SIZE  64
+#define TEXT_SIZE  256
+
+#define DEFAULT_PROGRAMS  2000
+#define DEFAULT_INTERVAL  64
+#define DEFAULT_STEPS  20000
+
+bool print_output;
+
+typedef struct engine_t engine_t;
+typedef struct side_t side_t;
+
+struct engine_t
+{
+  const char*  name;
+  bool  pipeline;
+  bool  models;
+};
+
+static const engine_t engines[] =
+{
+  {"interpreter", false, false},
+  {"pipeline",    true,  false},
+  {"pipeline+dcache+gshare", true, true},
+};
+
+#define NUM_ENGINES  (sizeof engines / sizeof engines[0])
+
+struct side_t
+{
+  const engine_t*  engine;
+  RiSC_VM*  vm;
+  RiSC_Pipeline*  pipeline;
+  RiSC_Cache*  dcache;
+  RiSC_Predictor*  predictor;
+};
+
+typedef enum
+{
+  OUTCOME_STOPPED,
+  OUTCOME_STEP_LIMIT,
+  OUTCOME_DIVERGED
+} outcome_t;
+
+static uint64_t rng;
+
+static unsigned int rnd(unsigned int n)
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return (unsigned int)(rng >> 32) % n;
+}
+
+static uint16_t encode(unsigned int opcode, unsigned int a, unsigned int b, unsigned int low)
+{
+  return (uint16_t)((opcode << 13) | (a << 10) | (b << 7) | low);
+}
+
+/*
+ * Mostly arithmetic and short branches; loads and stores go through r6,
+ * which the program points at the data segment first, and r7 keeps the
+ * stack pointer the VM starts with apart from the odd JALR link.
+ */
+static uint16_t instruction(unsigned int index)
+{
+  unsigned int a = rnd(6);
+  unsigned int b = rnd(8);
+
+  switch(rnd(16))
+  {
+    case 0:
+    case 1:
+    case 2:
+      return encode(ADD, a, b, rnd(8));
+    case 3:
+    case 4:
+      return encode(ADDI, a, b, rnd(128));
+    case 5:
+    case 6:
+      return encode(NAND, a, b, rnd(8));
+    case 7:
+      return encode(LUI, a, 0, 0) | rnd(1024);
+    case 8:
+    case 9:
+      return encode(SW, rnd(8), 6, rnd(DATA_SIZE / 2));
+    case 10:
+    case 11:
+      return encode(LW, a, 6, rnd(DATA_SIZE / 2));
+    case 12:
+      return encode(SW, rnd(8), b, rnd(128));
+    case 13:
+    case 14:
+    {
+      /*Short hops either way; backwards ones usually become loops*/
+      int offset = rnd(8) ? (int)rnd(9) : -(int)rnd(9);
+      if((int)index + 1 + offset < 0)
+      {
+        offset = 0;
+      }
+      return encode(BEQ, rnd(8), rnd(8), (uint16_t)offset & MASK_SIMM);
+    }
+    default:
+      return rnd(4) ? encode(LW, a, b, rnd(128)) : encode(JALR, rnd(2) ? a : 7, rnd(8), 0);
+  }
+}
+
+static RiSC_Image* generate(uint64_t seed)
+{
+  uint16_t words[1 + DATA_SIZE + 1 + TEXT_SIZE];
+  uint16_t* data = words + 1;
+  uint16_t* text = data + DATA_SIZE + 1;
+
+  rng = seed * 0x9E3779B97F4A7C15ull + 1;
+
+  words[0] = DATA_SIZE;
+  for(int i = 0; i < DATA_SIZE; ++i)
+  {
+    data[i] = rnd(4) ? rnd(64) : rnd(0x10000);
+  }
+  text[-1] = TEXT_SIZE;
+
+  /* lui r6, 0 and addi r6, r6, DATA_SIZE / 2 + 1 */
+  text[0] = encode(LUI, 6, 0, 0);
+  text[1] = encode(ADDI, 6, 6, DATA_SIZE / 2 + 1);
+  for(int i = 2; i < TEXT_SIZE; ++i)
+  {
+    text[i] = instruction(i);
+  }
+
+  return vm_create_image(words, sizeof words / sizeof words[0]);
+}
+
+static void open_side(side_t* side, const engine_t* engine, RiSC_Image* image)
+{
+  side->engine = engine;
+  side->vm = vm_init_from_image(image, NULL);
+  side->pipeline = engine->pipeline ? pipeline_init() : NULL;
+  side->dcache = engine->models ? cache_init(256, 4, 2, CACHE_LRU) : NULL;
+  side->predictor = engine->models ? predictor_init(PREDICT_GSHARE, 10) : NULL;
+
+  vm_attach_pipeline(side->vm, side->pipeline);
+  vm_attach_dcache(side->vm, side->dcache);
+  vm_attach_predictor(side->vm, side->predictor);
+}
+
+static void close_side(side_t* side)
+{
+  vm_shutdown(side->vm);
+  pipeline_shutdown(side->pipeline);
+  cache_shutdown(side->dcache);
+  predictor_shutdown(side->predictor);
+}
+
+static void run(side_t* side, uint64_t limit)
+{
+  while(vm_running(side->vm) && vm_instructions(side->vm) < limit)
+  {
+    vm_fetch(side->vm);
+    vm_decode(side->vm);
+    vm_execute(side->vm);
+  }
+}
+
+/*
+ * Stores can reach any address, but comparing all of memory after every
+ * interval would cost far more than running it, so only the data segment
+ * is compared until the programs stop.
+ */
+static bool same(side_t* a, side_t* b, bool all_memory)
+{
+  if(vm_running(a->vm) != vm_running(b->vm) || vm_pc(a->vm) != vm_pc(b->vm) ||
+     vm_instructions(a->vm) != vm_instructions(b->vm))
+  {
+    return false;
+  }
+  for(int r = 0; r < NUM_REGISTERS; ++r)
+  {
+    if(vm_read_register(a->vm, r) != vm_read_register(b->vm, r))
+    {
+      return false;
+    }
+  }
+  for(int address = 0; address < (all_memory ? MEMORY_SIZE : 1 + DATA_SIZE); ++address)
+  {
+    if(vm_read_word(a->vm, address) != vm_read_word(b->vm, address))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void print_differences(side_t* a, side_t* b)
+{
+  if(vm_running(a->vm) != vm_running(b->vm))
+  {
+    printf("  %s %s, %s %s\n", a->engine->name, vm_running(a->vm) ? "is running" : "stopped",
+           b->engine->name, vm_running(b->vm) ? "is running" : "stopped");
+  }
+  if(vm_pc(a->vm) != vm_pc(b->vm))
+  {
+    printf("  pc: %s %"PRIu16", %s %"PRIu16"\n", a->engine->name, vm_pc(a->vm), b->engine->name, vm_pc(b->vm));
+  }
+  if(vm_instructions(a->vm) != vm_instructions(b->vm))
+  {
+    printf("  instructions: %s %"PRIu64", %s %"PRIu64"\n", a->engine->name, vm_instructions(a->vm),
+           b->engine->name, vm_instructions(b->vm));
+  }
+  for(int r = 0; r < NUM_REGISTERS; ++r)
+  {
+    if(vm_read_register(a->vm, r) != vm_read_register(b->vm, r))
+    {
+      printf("  r%d: %s "PRINT_FORMAT", %s "PRINT_FORMAT"\n", r, a->engine->name, vm_read_register(a->vm, r),
+             b->engine->name, vm_read_register(b->vm, r));
+    }
+  }
+  for(int address = 0; address < MEMORY_SIZE; ++address)
+  {
+    if(vm_read_word(a->vm, address) != vm_read_word(b->vm, address))
+    {
+      printf("  memory[%d]: %s "PRINT_FORMAT", %s "PRINT_FORMAT"\n", address, a->engine->name, vm_read_word(a->vm, address),
+             b->engine->name, vm_read_word(b->vm, address));
+      break;
+    }
+  }
+}
+
+static outcome_t lockstep(const engine_t* fast_engine, RiSC_Image* image, int interval, uint64_t steps, uint64_t* instructions)
+{
+  side_t ref;
+  side_t fast;
+  uint64_t limit = 0;
+  outcome_t outcome = OUTCOME_STOPPED;
+
+  open_side(&ref, &engines[0], image);
+  open_side(&fast, fast_engine, image);
+  while(vm_running(ref.vm) && vm_running(fast.vm))
+  {
+    if(limit >= steps)
+    {
+      outcome = OUTCOME_STEP_LIMIT;
+      break;
+    }
+    limit = steps - limit > (uint64_t)interval ? limit + interval : steps;
+    run(&ref, limit);
+    run(&fast, limit);
+    if(!same(&ref, &fast, false))
+    {
+      outcome = OUTCOME_DIVERGED;
+      break;
+    }
+  }
+  if(outcome != OUTCOME_DIVERGED && !same(&ref, &fast, true))
+  {
+    outcome = OUTCOME_DIVERGED;
+  }
+
+  *instructions += vm_instructions(fast.vm);
+  close_side(&ref);
+  close_side(&fast);
+  return outcome;
+}
+
+/*
+ * Finds the first interval after which all of memory differs, then runs
+ * that interval again one instruction at a time.
+ */
+static void pinpoint(const engine_t* fast_engine, RiSC_Image* image, int interval, uint64_t steps)
+{
+  side_t ref;
+  side_t fast;
+  uint64_t limit = 0;
+
+  open_side(&ref, &engines[0], image);
+  open_side(&fast, fast_engine, image);
+  while(limit < steps && vm_running(ref.vm) && vm_running(fast.vm) && same(&ref, &fast, true))
+  {
+    limit = steps - limit > (uint64_t)interval ? limit + interval : steps;
+    run(&ref, limit);
+    run(&fast, limit);
+  }
+  close_side(&ref);
+  close_side(&fast);
+
+  open_side(&ref, &engines[0], image);
+  open_side(&fast, fast_engine, image);
+  run(&ref, limit > (uint64_t)interval ? limit - interval : 0);
+  run(&fast, limit > (uint64_t)interval ? limit - interval : 0);
+  for(uint64_t i = vm_instructions(ref.vm); i < limit; ++i)
+  {
+    uint16_t pc = vm_pc(ref.vm);
+    uint16_t instr = vm_read_word(ref.vm, pc);
+
+    run(&ref, i + 1);
+    run(&fast, i + 1);
+    if(!same(&ref, &fast, true))
+    {
+      printf("The first difference is after instruction %"PRIu64", 0x%04x at %"PRIu16":\n", i + 1, instr, pc);
+      print_differences(&ref, &fast);
+      break;
+    }
+  }
+  close_side(&ref);
+  close_side(&fast);
+}
+
+int main(int argc, char* argv[])
+{
+  uint64_t seed = 1;
+  int num_programs = DEFAULT_PROGRAMS;
+  int interval = DEFAULT_INTERVAL;
+  uint64_t steps = DEFAULT_STEPS;
+  int outcomes[OUTCOME_DIVERGED + 1] = {0};
+  uint64_t instructions = 0;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if(!strncmp(argv[i], "--seed=", 7))
+    {
+      seed = strtoull(argv[i] + 7, NULL, 0);
+    }
+    else if(!strncmp(argv[i], "--programs=", 11))
+    {
+      num_programs = atoi(argv[i] + 11);
+    }
+    else if(!strncmp(argv[i], "--interval=", 11))
+    {
+      interval = atoi(argv[i] + 11);
+    }
+    else if(!strncmp(argv[i], "--steps=", 8))
+    {
+      steps = strtoull(argv[i] + 8, NULL, 0);
+    }
+    else
+    {
+      printf("Usage: check [--seed=<n>] [--programs=<n>] [--interval=<instructions>] [--steps=<n>]\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if(interval < 1)
+  {
+    interval = 1;
+  }
+
+  for(int i = 0; i < num_programs; ++i)
+  {
+    RiSC_Image* image = generate(seed + i);
+
+    for(size_t e = 1; e < NUM_ENGINES; ++e)
+    {
+      outcome_t outcome = lockstep(&engines[e], image, interval, steps, &instructions);
+      outcomes[outcome]++;
+      if(outcome == OUTCOME_DIVERGED)
+      {
+        printf("%s and %s diverged on program %d (--seed=%"PRIu64" --programs=1).\n", engines[0].name, engines[e].name, i, seed + i);
+        pinpoint(&engines[e], image, interval, steps);
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    vm_release_image(image);
+  }
+
+  printf("%d programs, %d runs, %"PRIu64" instructions: %d stopped, %d hit the step limit\n", num_programs,
+         outcomes[OUTCOME_STOPPED] + outcomes[OUTCOME_STEP_LIMIT], instructions, outcomes[OUTCOME_STOPPED], outcomes[OUTCOME_STEP_LIMIT]);
+  return EXIT_SUCCESS;
+}
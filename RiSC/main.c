@@ -1,71 +1,280 @@
-#include <stdlib.h>
-#include <string.h>
-#include <stdio.h>
-#include <stdbool.h>
-
-#include "virtual_machine.h"
-
-#define EXIT_MESSAGE  "Program exited successfully.\n"
-
-bool step_through_program;
-bool print_output;
-
-int main(int argc, char* argv[])
-{
-  if(argc < 2)
-  {
-    printf("Usage: run <input_filename>\n");
-    exit(EXIT_FAILURE);
-  }
-
-  char* program_name = argv[1];
-
-  for(int i = 2; i < argc; ++i)
-  {
-    if(!strcmp(argv[i], "--step"))
-    {
-      step_through_program = true;
-    }
-    else if(!strcmp(argv[i], "--verbose"))
-    {
-      print_output = true;
-    }
-    else
-    {
-      printf("Error: Unknown selection \"%s\". Available " "options are:\n" " --step  Step through the program.\n" "  --verbose Print more information.\n", argv[i]);
-      exit(EXIT_FAILURE);
-    }
-  }
-
-  printf("Welcome to the RiSC Virtual Machine");
-
-  RiSC_VM* vm = vm_init(program_name);
-
-  while(vm_running(vm))
-  {
-    vm_fetch(vm);
-    vm_decode(vm);
-    vm_execute(vm);
-
-    if(step_through_program)
-    {
-      vm_print_regs(vm);
-      vm_print_data(vm);
-      printf("[PRESS ENTER]");
-      getchar();
-      printf("\n");
-    }
-  }
-
-  if(!step_through_program)
-  {
-    vm_print_regs(vm);
-    vm_print_data(vm);
-  }
-
-  vm_shutdown(vm);
-  vm = NULL;
-
-  printf(EXIT_MESSAGE);
-  return EXIT_SUCCESS;
-}
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "virtual_machine.h"
+#include "batch.h"
+#include "shm_console.h"
+
+#define EXIT_MESSAGE  "Program exited successfully.\n"
+
+bool step_through_program;
+bool print_output;
+bool model_pipeline;
+
+static RiSC_Cache* parse_dcache(const char* spec)
+{
+  unsigned int size_words = 256;
+  unsigned int line_words = 4;
+  unsigned int ways = 2;
+  char policy[8] = "lru";
+  int end = 0;
+
+  if(*spec == '=')
+  {
+    int fields = sscanf(spec + 1, "%u:%u:%u%n:%7[a-z]%n", &size_words, &line_words, &ways, &end, policy, &end);
+    if(fields < 3 || spec[1 + end] != '\0')
+    {
+      printf("Error: --dcache expects =<words>:<line words>:<ways>[:lru|random].\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if(strcmp(policy, "lru") && strcmp(policy, "random"))
+  {
+    printf("Error: Unknown replacement policy \"%s\".\n", policy);
+    exit(EXIT_FAILURE);
+  }
+
+  return cache_init(size_words, line_words, ways, strcmp(policy, "lru") ? CACHE_RANDOM : CACHE_LRU);
+}
+
+static RiSC_Predictor* parse_predictor(const char* spec)
+{
+  char name[8] = "gshare";
+  unsigned int index_bits = 10;
+  int end = 0;
+
+  if(*spec == '=')
+  {
+    int fields = sscanf(spec + 1, "%7[a-z]%n:%u%n", name, &end, &index_bits, &end);
+    if(fields < 1 || spec[1 + end] != '\0')
+    {
+      printf("Error: --bpred expects =<static|bimodal|gshare>[:<index bits>].\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if(!strcmp(name, "static"))
+  {
+    return predictor_init(PREDICT_STATIC, index_bits);
+  }
+  if(!strcmp(name, "bimodal"))
+  {
+    return predictor_init(PREDICT_BIMODAL, index_bits);
+  }
+  if(!strcmp(name, "gshare"))
+  {
+    return predictor_init(PREDICT_GSHARE, index_bits);
+  }
+
+  printf("Error: Unknown branch predictor \"%s\".\n", name);
+  exit(EXIT_FAILURE);
+}
+
+static int batch_main(int argc, char* argv[])
+{
+  char** programs = malloc(argc * sizeof *programs);
+  char** data_sets = malloc(argc * sizeof *data_sets);
+  int num_programs = 0;
+  int num_data_sets = 0;
+  int num_threads = 0;
+  uint64_t max_steps = BATCH_DEFAULT_MAX_STEPS;
+
+  if(programs == NULL || data_sets == NULL)
+  {
+    printf("Error: Out of memory.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for(int i = 2; i < argc; ++i)
+  {
+    if(!strncmp(argv[i], "--data=", 7))
+    {
+      data_sets[num_data_sets++] = argv[i] + 7;
+    }
+    else if(!strncmp(argv[i], "--threads=", 10))
+    {
+      num_threads = atoi(argv[i] + 10);
+    }
+    else if(!strncmp(argv[i], "--max-steps=", 12))
+    {
+      char* end;
+      max_steps = strtoull(argv[i] + 12, &end, 10);
+      if(max_steps == 0 || *end != '\0')
+      {
+        printf("Error: --max-steps expects a positive number of instructions.\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if(!strncmp(argv[i], "--", 2))
+    {
+      printf("Error: Unknown selection \"%s\". Available " "options are:\n" "  --data=<file> Run every program over this data set (repeatable).\n" "  --threads=<n> Number of worker threads.\n" "  --max-steps=<n> Stop any run still going after n instructions.\n", argv[i]);
+      exit(EXIT_FAILURE);
+    }
+    else
+    {
+      programs[num_programs++] = argv[i];
+    }
+  }
+
+  if(num_programs == 0)
+  {
+    printf("Usage: run --batch <input_filename>... [--data=<file>]... [--threads=<n>] [--max-steps=<n>]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int num_stopped = batch_run(programs, num_programs, data_sets, num_data_sets, num_threads, max_steps, stdout);
+  if(num_stopped > 0)
+  {
+    fprintf(stderr, "%d run(s) did not halt within %"PRIu64" instructions.\n", num_stopped, max_steps);
+  }
+
+  free(programs);
+  free(data_sets);
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[])
+{
+  if(argc < 2)
+  {
+    printf("Usage: run <input_filename>\n" "       run --batch <input_filename>... [--data=<file>]... [--threads=<n>] [--max-steps=<n>]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if(!strcmp(argv[1], "--batch"))
+  {
+    return batch_main(argc, argv);
+  }
+
+  char* program_name = argv[1];
+  RiSC_Cache* dcache = NULL;
+  RiSC_Predictor* predictor = NULL;
+  struct shm_console* console = NULL;
+
+  for(int i = 2; i < argc; ++i)
+  {
+    if(!strcmp(argv[i], "--step"))
+    {
+      step_through_program = true;
+    }
+    else if(!strcmp(argv[i], "--verbose"))
+    {
+      print_output = true;
+    }
+    else if(!strcmp(argv[i], "--pipeline"))
+    {
+      model_pipeline = true;
+    }
+    else if(!strncmp(argv[i], "--dcache", 8) && (argv[i][8] == '\0' || argv[i][8] == '='))
+    {
+      cache_shutdown(dcache);
+      dcache = parse_dcache(argv[i] + 8);
+    }
+    else if(!strncmp(argv[i], "--bpred", 7) && (argv[i][7] == '\0' || argv[i][7] == '='))
+    {
+      predictor_shutdown(predictor);
+      predictor = parse_predictor(argv[i] + 7);
+    }
+    else if(!strncmp(argv[i], "--console=", 10) && console == NULL)
+    {
+      console = shm_console_attach(atoi(argv[i] + 10));
+      if(console == NULL)
+      {
+        printf("Error: Could not attach console \"%s\".\n", argv[i] + 10);
+        exit(EXIT_FAILURE);
+      }
+      shm_console_close_on_exit(console);
+    }
+    else
+    {
+      printf("Error: Unknown selection \"%s\". Available " "options are:\n" " --step  Step through the program.\n" "  --verbose Print more information.\n" "  --pipeline Model a 5-stage pipeline and report cycles.\n" "  --dcache[=<words>:<line>:<ways>:<lru|random>] Simulate a data cache.\n" "  --bpred[=<static|bimodal|gshare>:<bits>] Simulate a branch predictor.\n" "  --console=<fd> Use a harness's shared memory console for stdin and stdout.\n", argv[i]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if(console != NULL)
+  {
+    FILE* in = shm_console_fopen(console, "r");
+    FILE* out = shm_console_fopen(console, "w");
+    if(in == NULL || out == NULL)
+    {
+      printf("Error: Could not open the console streams.\n");
+      exit(EXIT_FAILURE);
+    }
+    stdin = in;
+    stdout = out;
+  }
+
+  printf("Welcome to the RiSC Virtual Machine");
+
+  RiSC_VM* vm = vm_init(program_name);
+  RiSC_Pipeline* pipeline = NULL;
+
+  if(model_pipeline)
+  {
+    pipeline = pipeline_init();
+    vm_attach_pipeline(vm, pipeline);
+  }
+  vm_attach_dcache(vm, dcache);
+  vm_attach_predictor(vm, predictor);
+
+  while(vm_running(vm))
+  {
+    vm_fetch(vm);
+    vm_decode(vm);
+    vm_execute(vm);
+
+    if(step_through_program)
+    {
+      vm_print_regs(vm);
+      vm_print_data(vm);
+      printf("[PRESS ENTER]");
+      getchar();
+      printf("\n");
+    }
+  }
+
+  if(!step_through_program)
+  {
+    vm_print_regs(vm);
+    vm_print_data(vm);
+  }
+
+  if(pipeline != NULL)
+  {
+    pipeline_print_stats(pipeline);
+    pipeline_shutdown(pipeline);
+    pipeline = NULL;
+  }
+
+  if(dcache != NULL)
+  {
+    cache_print_stats(dcache);
+    cache_shutdown(dcache);
+    dcache = NULL;
+  }
+
+  if(predictor != NULL)
+  {
+    predictor_print_stats(predictor);
+    predictor_shutdown(predictor);
+    predictor = NULL;
+  }
+
+  vm_shutdown(vm);
+  vm = NULL;
+
+  printf(EXIT_MESSAGE);
+
+  if(console != NULL)
+  {
+    fclose(stdout);
+    fclose(stdin);
+    shm_console_free(console);
+  }
+  return EXIT_SUCCESS;
+}
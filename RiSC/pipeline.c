@@ -0,0 +1,166 @@
+#include "pipeline.h"
+#include "defines.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Trace-driven model of the classic IF/ID/EX/MEM/WB pipeline. Every retired
+ * instruction issues one cycle after the previous one, plus:
+ *  - LOAD_USE_PENALTY when it needs the result of the LW directly ahead of it
+ *    in EX (the MEM->EX forward arrives one cycle late). SW only needs its
+ *    store value in MEM, so forwarding covers a loaded reg0.
+ *  - BRANCH_PENALTY for the IF/ID bubbles squashed when a branch resolves in
+ *    EX. The caller decides whether a branch flushes: BEQ is predicted
+ *    not-taken unless a branch predictor is attached, JALR always redirects.
+ * All other hazards are covered by EX->EX and MEM->EX forwarding.
+ */
+#define PIPELINE_DEPTH  5
+#define LOAD_USE_PENALTY  1
+#define BRANCH_PENALTY  2
+#define PC_SPACE  (UINT16_MAX + 1)
+#define NO_REG  NUM_REGISTERS
+
+typedef struct stall_t stall_t;
+
+struct stall_t
+{
+  uint32_t  load_use;
+  uint32_t  flush;
+};
+
+struct RiSC_Pipeline
+{
+  uint64_t  instructions;
+  uint64_t  load_use_stalls;
+  uint64_t  flush_cycles;
+  uint16_t  load_dest;
+  stall_t*  stalls;
+};
+
+RiSC_Pipeline* pipeline_init(void)
+{
+  RiSC_Pipeline* p = malloc(sizeof *p);
+  if(p == NULL)
+  {
+    ERROR("\t%s", OUT_OF_MEMORY);
+  }
+
+  p->stalls = calloc(PC_SPACE, sizeof *p->stalls);
+  if(p->stalls == NULL)
+  {
+    ERROR("\t%s", OUT_OF_MEMORY);
+  }
+
+  p->instructions = 0;
+  p->load_use_stalls = 0;
+  p->flush_cycles = 0;
+  p->load_dest = NO_REG;
+
+  return p;
+}
+
+void pipeline_shutdown(RiSC_Pipeline* p)
+{
+  if(p != NULL)
+  {
+    free(p->stalls);
+    free(p);
+  }
+}
+
+void pipeline_retire(RiSC_Pipeline* p, uint16_t pc, uint16_t opcode, uint16_t reg0, uint16_t reg1, uint16_t reg2, bool flush)
+{
+  uint16_t ex_src0 = NO_REG;
+  uint16_t ex_src1 = NO_REG;
+  uint16_t dest = NO_REG;
+
+  switch(opcode)
+  {
+    case ADD:
+    case NAND:
+      ex_src0 = reg1;
+      ex_src1 = reg2;
+      dest = reg0;
+      break;
+
+    case ADDI:
+    case LW:
+    case JALR:
+      ex_src0 = reg1;
+      dest = reg0;
+      break;
+
+    case LUI:
+      dest = reg0;
+      break;
+
+    case SW:
+      ex_src0 = reg1;
+      break;
+
+    case BEQ:
+      ex_src0 = reg0;
+      ex_src1 = reg1;
+      break;
+  }
+
+  p->instructions++;
+
+  if(p->load_dest != NO_REG && (ex_src0 == p->load_dest || ex_src1 == p->load_dest))
+  {
+    p->load_use_stalls += LOAD_USE_PENALTY;
+    p->stalls[pc].load_use += LOAD_USE_PENALTY;
+  }
+
+  if(flush)
+  {
+    p->flush_cycles += BRANCH_PENALTY;
+    p->stalls[pc].flush += BRANCH_PENALTY;
+  }
+
+  p->load_dest = (opcode == LW && dest != 0) ? dest : NO_REG;
+}
+
+uint64_t pipeline_cycles(RiSC_Pipeline* p)
+{
+  if(p->instructions == 0)
+  {
+    return 0;
+  }
+  return p->instructions + (PIPELINE_DEPTH - 1) + p->load_use_stalls + p->flush_cycles;
+}
+
+uint64_t pipeline_instructions(RiSC_Pipeline* p)
+{
+  return p->instructions;
+}
+
+void pipeline_print_stats(RiSC_Pipeline* p)
+{
+  uint64_t cycles = pipeline_cycles(p);
+
+  printf("Pipeline: %"PRIu64" cycles, %"PRIu64" instructions, CPI %.3f\n",
+         cycles, p->instructions,
+         p->instructions ? (double)cycles / p->instructions : 0.0);
+  printf("  Load-use stalls: %"PRIu64" cycles\n", p->load_use_stalls);
+  printf("  Branch flushes:  %"PRIu64" cycles\n", p->flush_cycles);
+
+  if(p->load_use_stalls + p->flush_cycles == 0)
+  {
+    return;
+  }
+
+  printf("-------------\n");
+  printf("    Address    Load-use     Flush\n");
+  for(int pc = 0; pc < PC_SPACE; ++pc)
+  {
+    stall_t* s = &p->stalls[pc];
+    if(s->load_use != 0 || s->flush != 0)
+    {
+      printf("    %6d:  %10"PRIu32"  %8"PRIu32"\n", pc, s->load_use, s->flush);
+    }
+  }
+  printf("-------------\n");
+}
@@ -0,0 +1,16 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct  RiSC_Pipeline RiSC_Pipeline;
+
+RiSC_Pipeline*  pipeline_init (void);
+void pipeline_shutdown  (RiSC_Pipeline* p);
+void pipeline_retire (RiSC_Pipeline* p, uint16_t pc, uint16_t opcode, uint16_t reg0, uint16_t reg1, uint16_t reg2, bool flush);
+uint64_t pipeline_cycles (RiSC_Pipeline* p);
+uint64_t pipeline_instructions (RiSC_Pipeline* p);
+void pipeline_print_stats (RiSC_Pipeline* p);
+
+#endif
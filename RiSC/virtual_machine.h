@@ -1,18 +1,42 @@
-#ifndef VIRTUAL_MACHINE_H
-#define VIRTUAL_MACHINE_H
-
-#include <stdbool.h>
-#include <stdint.h>
-
-typedef struct  RiSC_VM RiSC_VM;
-
-RiSC_VM*  vm_init (char filename[]);
-void vm_shutdown  (RiSC_VM* vm);
-void vm_fetch (RiSC_VM* vm);
-void vm_decode (RiSC_VM* vm);
-void vm_execute (RiSC_VM* vm);
-bool vm_running (RiSC_VM* vm);
-void vm_print_regs (RiSC_VM* vm);
-void vm_print_data (RiSC_VM* vm);
-
-#endif
+#ifndef VIRTUAL_MACHINE_H
+#define VIRTUAL_MACHINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "arena.h"
+
+#include "pipeline.h"
+#include "cache.h"
+#include "branch_predictor.h"
+
+typedef struct  RiSC_VM RiSC_VM;
+typedef struct  RiSC_Image RiSC_Image;
+
+RiSC_Image*  vm_load_image (char filename[]);
+RiSC_Image*  vm_create_image (const uint16_t words[], size_t num_words);
+void vm_release_image  (RiSC_Image* image);
+RiSC_VM*  vm_init (char filename[]);
+RiSC_VM*  vm_init_from_image (RiSC_Image* image, RiSC_Arena* arena);
+void vm_shutdown  (RiSC_VM* vm);
+void vm_load_data (RiSC_VM* vm, char filename[]);
+void vm_run (RiSC_VM* vm);
+bool vm_run_for (RiSC_VM* vm, uint64_t max_instructions);
+void vm_fetch (RiSC_VM* vm);
+void vm_decode (RiSC_VM* vm);
+void vm_execute (RiSC_VM* vm);
+bool vm_running (RiSC_VM* vm);
+uint64_t vm_instructions (RiSC_VM* vm);
+uint16_t vm_read_word (RiSC_VM* vm, uint16_t address);
+uint16_t vm_read_register (RiSC_VM* vm, int reg);
+uint16_t vm_pc (RiSC_VM* vm);
+void vm_attach_pipeline (RiSC_VM* vm, RiSC_Pipeline* p);
+void vm_attach_dcache (RiSC_VM* vm, RiSC_Cache* c);
+void vm_attach_predictor (RiSC_VM* vm, RiSC_Predictor* bp);
+void vm_print_regs (RiSC_VM* vm);
+void vm_print_data (RiSC_VM* vm);
+void vm_dump_json (RiSC_VM* vm, FILE* out);
+
+#endif
@@ -0,0 +1,111 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include "perf_counters.h"
+
+#define CACHE_READ_MISSES(cache)  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+const char* const perf_counter_names[PERF_NUM_COUNTERS] =
+{
+  "cycles", "instructions", "branch-misses", "L1I-misses", "L1D-misses"
+};
+
+static const struct
+{
+  uint32_t  type;
+  uint64_t  config;
+} events[PERF_NUM_COUNTERS] =
+{
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  {PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_L1I)},
+  {PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_L1D)},
+};
+
+/* Opens every counter that is available; returns how many are. */
+int perf_counters_open(perf_counters_t* counters)
+{
+  int num_open = 0;
+
+  for(int i = 0; i < PERF_NUM_COUNTERS; ++i)
+  {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    counters->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    num_open += counters->fds[i] >= 0;
+  }
+
+  counters->opened = true;
+  return num_open;
+}
+
+void perf_counters_close(perf_counters_t* counters)
+{
+  if(!counters->opened)
+  {
+    return;
+  }
+  for(int i = 0; i < PERF_NUM_COUNTERS; ++i)
+  {
+    if(counters->fds[i] >= 0)
+    {
+      close(counters->fds[i]);
+    }
+  }
+  counters->opened = false;
+}
+
+void perf_counters_start(perf_counters_t* counters)
+{
+  if(!counters->opened)
+  {
+    return;
+  }
+  for(int i = 0; i < PERF_NUM_COUNTERS; ++i)
+  {
+    if(counters->fds[i] >= 0)
+    {
+      ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+/*
+ * Stops the counters and reads them. When the kernel had to multiplex
+ * more events than the PMU has counters, the counts are scaled up to the
+ * whole run.
+ */
+void perf_counters_stop(perf_counters_t* counters, uint64_t values[PERF_NUM_COUNTERS])
+{
+  for(int i = 0; i < PERF_NUM_COUNTERS; ++i)
+  {
+    uint64_t data[3];
+
+    values[i] = PERF_COUNTER_UNAVAILABLE;
+    if(!counters->opened || counters->fds[i] < 0)
+    {
+      continue;
+    }
+
+    ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    if(read(counters->fds[i], data, sizeof data) != sizeof data || data[2] == 0)
+    {
+      continue;
+    }
+    values[i] = data[2] < data[1] ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+  }
+}
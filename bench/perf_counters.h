@@ -0,0 +1,40 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Host hardware counters read through perf_event_open for the calling
+ * thread, user space only. A counter the kernel or CPU does not provide
+ * reads as PERF_COUNTER_UNAVAILABLE.
+ */
+
+#define PERF_COUNTER_UNAVAILABLE  UINT64_MAX
+
+enum
+{
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_BRANCH_MISSES,
+  PERF_L1I_MISSES,
+  PERF_L1D_MISSES,
+  PERF_NUM_COUNTERS
+};
+
+typedef struct perf_counters_t perf_counters_t;
+
+struct perf_counters_t
+{
+  bool  opened;
+  int  fds[PERF_NUM_COUNTERS];
+};
+
+extern const char* const perf_counter_names[PERF_NUM_COUNTERS];
+
+int perf_counters_open(perf_counters_t* counters);
+void perf_counters_close(perf_counters_t* counters);
+void perf_counters_start(perf_counters_t* counters);
+void perf_counters_stop(perf_counters_t* counters, uint64_t values[PERF_NUM_COUNTERS]);
+
+#endif
@@ -0,0 +1,546 @@
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "lc-3.h"
+#include "lc3_benchmarks.h"
+
+#include "assembler.h"
+#include "benchmarks.h"
+#include "virtual_machine.h"
+
+#include "arm_vm.h"
+#include "arm_block.h"
+#include "arm_memory.h"
+#include "arm_benchmarks.h"
+
+#include "perf_counters.h"
+
+/*
+ * Runs the fixed corpus of every VM on every engine and reports guest MIPS
+ * and ns per guest instruction of the fastest of --repeat runs, and peak
+ * RSS. Each engine runs in a child process so that its peak RSS is its
+ * own. A kernel that returns the wrong checksum fails. With --baseline the
+ * results are compared with a baseline written earlier by --write-baseline
+ * on the same machine, and a run that is more than --tolerance percent
+ * slower fails too. Shared or frequency-scaled machines need a wider
+ * tolerance than the default.
+ *
+ * --counters also reads host hardware counters around the same run loop
+ * and reports them per guest instruction, to tell dispatch mispredictions
+ * from I-cache and D-cache misses.
+ */
+
+#define DEFAULT_REPEAT  5
+#define DEFAULT_TOLERANCE  10.0
+#define MAX_ROWS  64
+
+bool print_output;
+
+typedef struct result_t result_t;
+typedef struct row_t row_t;
+typedef struct vm_t vm_t;
+
+struct result_t
+{
+  bool  passed;
+  uint64_t  instructions;
+  double  seconds;
+  uint64_t  counters[PERF_NUM_COUNTERS];
+};
+
+struct row_t
+{
+  const char*  vm;
+  const char*  kernel;
+  const char*  engine;
+  double  mips;
+};
+
+/* One VM: its kernels, its engines, and how to run kernel k on engine e. */
+struct vm_t
+{
+  const char*  name;
+  int  (*num_kernels)(void);
+  const char*  (*kernel_name)(int k);
+  int  num_engines;
+  const char* const*  engine_names;
+  void  (*run)(int k, int e, result_t* result);
+};
+
+/* Opened in each child when --counters is given. */
+static perf_counters_t counters;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Bracket the run loop only, so setup and checking are not measured. */
+static void begin_run(result_t* result)
+{
+  perf_counters_start(&counters);
+  result->seconds = now();
+}
+
+static void end_run(result_t* result)
+{
+  result->seconds = now() - result->seconds;
+  perf_counters_stop(&counters, result->counters);
+}
+
+/* LC-3 */
+
+static const struct lc3_engine* const lc3_engines[] = {&lc3_switch_engine, &lc3_table_engine};
+static const char* const lc3_engine_names[] = {"switch", "table"};
+
+static int quiet_ready(void* ctx)
+{
+  (void)ctx;
+  return 0;
+}
+
+static int quiet_read(void* ctx)
+{
+  (void)ctx;
+  return 0;
+}
+
+static void quiet_write(void* ctx, int c)
+{
+  (void)ctx;
+  (void)c;
+}
+
+static void quiet_flush(void* ctx)
+{
+  (void)ctx;
+}
+
+static const struct lc3_console quiet_console = {quiet_ready, quiet_read, quiet_write, quiet_flush, NULL};
+
+static int lc3_num_kernels(void)
+{
+  return lc3_num_benchmarks;
+}
+
+static const char* lc3_kernel_name(int k)
+{
+  return lc3_benchmarks[k].name;
+}
+
+static void lc3_run(int k, int e, result_t* result)
+{
+  const struct lc3_benchmark* b = &lc3_benchmarks[k];
+  const struct lc3_engine* engine = lc3_engines[e];
+
+  memset(engine->memory, 0, LC3_MEMORY_SIZE * sizeof(uint16_t));
+  memcpy(engine->memory + LC3_PC_START, b->code, b->size * sizeof(uint16_t));
+  engine->reset(&quiet_console);
+
+  begin_run(result);
+  uint64_t instructions = 1;
+  while(engine->step())
+  {
+    instructions++;
+  }
+  end_run(result);
+  result->instructions = instructions;
+  result->passed = engine->reg[R_R0] == b->expected;
+}
+
+/* RiSC */
+
+static const char* const risc_engine_names[] = {"interpreter", "pipeline", "pipeline+dcache+gshare"};
+
+static int risc_num_kernels(void)
+{
+  return num_benchmarks;
+}
+
+static const char* risc_kernel_name(int k)
+{
+  return benchmarks[k].name;
+}
+
+static void risc_run(int k, int e, result_t* result)
+{
+  const RiSC_Benchmark* b = &benchmarks[k];
+  size_t num_words;
+  uint16_t* words = asm_assemble(b->source, b->name, &num_words);
+  RiSC_Image* image = vm_create_image(words, num_words);
+  free(words);
+
+  RiSC_VM* vm = vm_init_from_image(image, NULL);
+  RiSC_Pipeline* pipeline = e >= 1 ? pipeline_init() : NULL;
+  RiSC_Cache* dcache = e >= 2 ? cache_init(256, 4, 2, CACHE_LRU) : NULL;
+  RiSC_Predictor* predictor = e >= 2 ? predictor_init(PREDICT_GSHARE, 10) : NULL;
+
+  vm_attach_pipeline(vm, pipeline);
+  vm_attach_dcache(vm, dcache);
+  vm_attach_predictor(vm, predictor);
+
+  begin_run(result);
+  vm_run(vm);
+  end_run(result);
+  result->instructions = vm_instructions(vm);
+  result->passed = vm_read_word(vm, BENCHMARK_RESULT_ADDRESS) == b->expected;
+
+  vm_shutdown(vm);
+  pipeline_shutdown(pipeline);
+  cache_shutdown(dcache);
+  predictor_shutdown(predictor);
+  vm_release_image(image);
+}
+
+/* ARM */
+
+static const char* const arm_engine_names[] = {"interpreter", "tcache", "jit"};
+
+static int arm_num_kernels(void)
+{
+  return arm_num_benchmarks;
+}
+
+static const char* arm_kernel_name(int k)
+{
+  return arm_benchmarks[k].name;
+}
+
+static void arm_run(int k, int e, result_t* result)
+{
+  const struct arm_benchmark* b = &arm_benchmarks[k];
+  struct arm_memory* mem = new_arm_memory();
+  struct arm_tcache* tc = NULL;
+
+  arm_memory_map(mem, ARM_BENCHMARK_CODE_ADDRESS, b->size * 4);
+  arm_memory_write(mem, ARM_BENCHMARK_CODE_ADDRESS, b->code, b->size * 4);
+  unsigned int buffer = arm_memory_alloc(mem, ARM_BENCHMARK_BUFFER_SIZE);
+  struct arm_state* arm_s = new_arm_state(mem, ARM_BENCHMARK_CODE_ADDRESS, buffer, 0, 0, 0);
+  if(e >= 1)
+  {
+    tc = new_arm_tcache();
+    if(e >= 2)
+    {
+      arm_tcache_enable_jit(tc);
+    }
+    arm_state_attach_tcache(arm_s, tc);
+  }
+
+  begin_run(result);
+  unsigned int checksum = arm_state_execute(arm_s);
+  end_run(result);
+  result->instructions = arm_state_instructions(arm_s);
+  result->passed = arm_s->fault.kind == GUEST_FAULT_NONE && checksum == b->expected;
+
+  free_arm_state(arm_s);
+  if(tc != NULL)
+  {
+    free_arm_tcache(tc);
+  }
+  arm_state_pool_drain();
+  free_arm_memory(mem);
+}
+
+static const vm_t vms[] =
+{
+  {"lc3",  lc3_num_kernels,  lc3_kernel_name,  2, lc3_engine_names,  lc3_run},
+  {"risc", risc_num_kernels, risc_kernel_name, 3, risc_engine_names, risc_run},
+  {"arm",  arm_num_kernels,  arm_kernel_name,  3, arm_engine_names,  arm_run},
+};
+
+/*
+ * Runs one kernel on one engine repeat times in a child process, which
+ * hands back the fastest run through a pipe; the parent collects the
+ * child's peak RSS in KB.
+ */
+static bool run_isolated(const vm_t* vm, int k, int e, int repeat, bool use_counters, result_t* result, long* peak_rss)
+{
+  int fds[2];
+  if(pipe(fds) != 0)
+  {
+    printf("Error: Could not create a pipe.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  pid_t pid = fork();
+  if(pid < 0)
+  {
+    printf("Error: Could not fork.\n");
+    exit(EXIT_FAILURE);
+  }
+  if(pid == 0)
+  {
+    result_t best = {true, 0, 0, {0}};
+    close(fds[0]);
+    if(use_counters)
+    {
+      perf_counters_open(&counters);
+    }
+    for(int r = 0; r < repeat; ++r)
+    {
+      result_t run;
+      vm->run(k, e, &run);
+      if(r == 0 || run.seconds < best.seconds)
+      {
+        best.instructions = run.instructions;
+        best.seconds = run.seconds;
+        memcpy(best.counters, run.counters, sizeof best.counters);
+      }
+      best.passed &= run.passed;
+    }
+    perf_counters_close(&counters);
+    _exit(write(fds[1], &best, sizeof best) == sizeof best ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  close(fds[1]);
+  bool received = read(fds[0], result, sizeof *result) == sizeof *result;
+  close(fds[0]);
+
+  int status;
+  struct rusage usage;
+  if(wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+  {
+    received = false;
+  }
+  *peak_rss = usage.ru_maxrss;
+  return received;
+}
+
+static int read_baseline(const char* path, row_t rows[], char names[][3][32])
+{
+  FILE* file = fopen(path, "r");
+  int num_rows = 0;
+  char line[256];
+
+  if(file == NULL)
+  {
+    printf("Error: Could not open baseline \"%s\".\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  while(num_rows < MAX_ROWS && fgets(line, sizeof line, file))
+  {
+    row_t* row = &rows[num_rows];
+    if(line[0] == '#' ||
+       sscanf(line, "%31s %31s %31s %lf", names[num_rows][0], names[num_rows][1], names[num_rows][2], &row->mips) != 4)
+    {
+      continue;
+    }
+    row->vm = names[num_rows][0];
+    row->kernel = names[num_rows][1];
+    row->engine = names[num_rows][2];
+    num_rows++;
+  }
+
+  fclose(file);
+  return num_rows;
+}
+
+static const row_t* find_row(const row_t rows[], int num_rows, const char* vm, const char* kernel, const char* engine)
+{
+  for(int i = 0; i < num_rows; ++i)
+  {
+    if(!strcmp(rows[i].vm, vm) && !strcmp(rows[i].kernel, kernel) && !strcmp(rows[i].engine, engine))
+    {
+      return &rows[i];
+    }
+  }
+  return NULL;
+}
+
+static void print_counters(const result_t* result)
+{
+  printf("%-5s %-10s %-24s", "", "", "per guest instruction:");
+  for(int i = 0; i < PERF_NUM_COUNTERS; ++i)
+  {
+    if(result->counters[i] == PERF_COUNTER_UNAVAILABLE || result->instructions == 0)
+    {
+      printf(" %s -", perf_counter_names[i]);
+    }
+    else
+    {
+      printf(" %s %.4f", perf_counter_names[i], (double)result->counters[i] / result->instructions);
+    }
+  }
+  printf("\n");
+}
+
+static bool selected(const char* vm, const char* kernel, char* filters[], int num_filters)
+{
+  if(num_filters == 0)
+  {
+    return true;
+  }
+  for(int i = 0; i < num_filters; ++i)
+  {
+    if(!strcmp(filters[i], vm) || !strcmp(filters[i], kernel))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char* argv[])
+{
+  int repeat = DEFAULT_REPEAT;
+  double tolerance = DEFAULT_TOLERANCE;
+  bool use_counters = false;
+  const char* baseline_path = NULL;
+  const char* write_path = NULL;
+  char** filters = malloc(argc * sizeof *filters);
+  int num_filters = 0;
+  static row_t baseline[MAX_ROWS];
+  static char baseline_names[MAX_ROWS][3][32];
+  int num_baseline = 0;
+  static row_t current[MAX_ROWS];
+  int num_current = 0;
+  int failed = 0;
+  int slower = 0;
+
+  if(filters == NULL)
+  {
+    printf("Error: Out of memory.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if(!strncmp(argv[i], "--repeat=", 9))
+    {
+      repeat = atoi(argv[i] + 9);
+    }
+    else if(!strncmp(argv[i], "--baseline=", 11))
+    {
+      baseline_path = argv[i] + 11;
+    }
+    else if(!strcmp(argv[i], "--no-baseline"))
+    {
+      baseline_path = NULL;
+    }
+    else if(!strncmp(argv[i], "--write-baseline=", 17))
+    {
+      write_path = argv[i] + 17;
+    }
+    else if(!strncmp(argv[i], "--tolerance=", 12))
+    {
+      tolerance = atof(argv[i] + 12);
+    }
+    else if(!strcmp(argv[i], "--counters"))
+    {
+      use_counters = true;
+    }
+    else if(!strncmp(argv[i], "--", 2))
+    {
+      printf("Usage: vm_bench [--repeat=<n>] [--baseline=<file>|--no-baseline] [--write-baseline=<file>] [--tolerance=<percent>] [--counters] [vm|kernel]...\n");
+      exit(EXIT_FAILURE);
+    }
+    else
+    {
+      filters[num_filters++] = argv[i];
+    }
+  }
+
+  if(repeat < 1)
+  {
+    repeat = 1;
+  }
+  if(baseline_path != NULL && write_path == NULL)
+  {
+    num_baseline = read_baseline(baseline_path, baseline, baseline_names);
+  }
+  if(use_counters)
+  {
+    if(perf_counters_open(&counters) == 0)
+    {
+      printf("Warning: No hardware counters are available (perf_event_open, perf_event_paranoid).\n");
+    }
+    perf_counters_close(&counters);
+  }
+
+  printf("%-5s %-10s %-24s %14s %10s %10s %10s %10s\n", "vm", "kernel", "engine", "instructions", "MIPS", "ns/instr", "peak RSS", "baseline");
+  for(size_t v = 0; v < sizeof vms / sizeof vms[0]; ++v)
+  {
+    const vm_t* vm = &vms[v];
+    for(int k = 0; k < vm->num_kernels(); ++k)
+    {
+      const char* kernel = vm->kernel_name(k);
+      if(!selected(vm->name, kernel, filters, num_filters))
+      {
+        continue;
+      }
+
+      for(int e = 0; e < vm->num_engines; ++e)
+      {
+        const char* engine = vm->engine_names[e];
+        result_t result = {false, 0, 0, {0}};
+        long peak_rss = 0;
+
+        if(!run_isolated(vm, k, e, repeat, use_counters, &result, &peak_rss) || !result.passed)
+        {
+          printf("%-5s %-10s %-24s FAILED: wrong checksum or crashed\n", vm->name, kernel, engine);
+          failed++;
+          continue;
+        }
+
+        double mips = result.seconds > 0 ? result.instructions / result.seconds / 1e6 : 0.0;
+        double ns = result.instructions > 0 ? result.seconds * 1e9 / result.instructions : 0.0;
+        printf("%-5s %-10s %-24s %14"PRIu64" %10.1f %10.2f %7ld KB", vm->name, kernel, engine,
+               result.instructions, mips, ns, peak_rss);
+
+        const row_t* base = find_row(baseline, num_baseline, vm->name, kernel, engine);
+        if(base != NULL && base->mips > 0)
+        {
+          double change = (mips / base->mips - 1.0) * 100.0;
+          printf(" %+9.1f%%%s", change, change < -tolerance ? " SLOWER" : "");
+          slower += change < -tolerance;
+        }
+        printf("\n");
+        if(use_counters)
+        {
+          print_counters(&result);
+        }
+
+        if(num_current < MAX_ROWS)
+        {
+          current[num_current++] = (row_t) {vm->name, kernel, engine, mips};
+        }
+      }
+    }
+  }
+
+  if(write_path != NULL)
+  {
+    FILE* out = fopen(write_path, "w");
+    if(out == NULL)
+    {
+      printf("Error: Could not write baseline \"%s\".\n", write_path);
+      exit(EXIT_FAILURE);
+    }
+    fprintf(out, "# vm_bench baseline: guest MIPS per kernel and engine, --repeat=%d.\n", repeat);
+    fprintf(out, "# Only comparable on the machine and build that wrote it.\n");
+    for(int i = 0; i < num_current; ++i)
+    {
+      fprintf(out, "%s %s %s %.1f\n", current[i].vm, current[i].kernel, current[i].engine, current[i].mips);
+    }
+    fclose(out);
+  }
+
+  if(failed || slower)
+  {
+    printf("%d failed, %d more than %.0f%% slower than the baseline.\n", failed, slower, tolerance);
+  }
+
+  free(filters);
+  return failed || slower ? EXIT_FAILURE : EXIT_SUCCESS;
+}
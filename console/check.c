@@ -0,0 +1,303 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include "shm_console.h"
+
+/*
+ * Drives lc3 and risc through the shared memory console the way a harness
+ * does: create the console, spawn the VM with --console=<fd>, feed the
+ * input, close it, and read until the VM closes its output. The output is
+ * compared with what the program should print. Runs that end in exit() or
+ * abort() must still close the output ring; the child is polled so that a
+ * ring left open is reported instead of waited on forever.
+ *
+ * The VM binaries default to the ones built next to this checker; the
+ * programs are written to a temporary directory.
+ */
+
+#define OUTPUT_SIZE  4096
+
+struct run
+{
+  char output[OUTPUT_SIZE];
+  size_t size;
+  int closed;
+  int status;
+};
+
+static unsigned int failures;
+
+static void fail(const char* what, const char* why)
+{
+  printf("%s: %s\n", what, why);
+  ++failures;
+}
+
+static void drive(struct run* run, const char* const argv[], const char* input)
+{
+  struct shm_console* console = shm_console_create(SHM_CONSOLE_DEFAULT_CAPACITY);
+  if(console == NULL)
+  {
+    printf("failed to create a console\n");
+    exit(1);
+  }
+
+  char fd_option[32];
+  snprintf(fd_option, sizeof fd_option, "--console=%d", shm_console_fd(console));
+
+  const char* args[8];
+  int num_args = 0;
+  for(; argv[num_args] != NULL; ++num_args)
+  {
+    args[num_args] = strcmp(argv[num_args], "--console") ? argv[num_args] : fd_option;
+  }
+  args[num_args] = NULL;
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == 0)
+  {
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+    execv(args[0], (char* const*)args);
+    _exit(127);
+  }
+
+  size_t length = strlen(input);
+  size_t sent = 0;
+  int exited = 0;
+  run->size = 0;
+  run->closed = 0;
+  if(length == 0)
+  {
+    shm_console_close_input(console);
+  }
+
+  for(;;)
+  {
+    if(sent < length)
+    {
+      sent += shm_console_send(console, input + sent, length - sent);
+      if(sent == length)
+      {
+        shm_console_close_input(console);
+      }
+    }
+
+    char buffer[256];
+    size_t n = shm_console_receive(console, buffer, sizeof buffer);
+    if(run->size + n > OUTPUT_SIZE)
+    {
+      n = OUTPUT_SIZE - run->size;
+    }
+    memcpy(run->output + run->size, buffer, n);
+    run->size += n;
+
+    if(n == 0)
+    {
+      run->closed = shm_console_output_closed(console);
+      /* An exited child gets one more pass to drain what it wrote last. */
+      if(run->closed || exited)
+      {
+        break;
+      }
+      exited = waitpid(pid, &run->status, WNOHANG) == pid;
+    }
+  }
+
+  if(!exited)
+  {
+    waitpid(pid, &run->status, 0);
+  }
+  shm_console_free(console);
+}
+
+static void expect_output(const char* what, const char* const argv[], const char* input, const char* expected)
+{
+  struct run run;
+  drive(&run, argv, input);
+
+  if(!run.closed)
+  {
+    fail(what, "exited without closing its output");
+  }
+  else if(!WIFEXITED(run.status) || WEXITSTATUS(run.status) != 0)
+  {
+    fail(what, "did not exit cleanly");
+  }
+  else if(run.size != strlen(expected) || memcmp(run.output, expected, run.size))
+  {
+    fail(what, "printed something else");
+    printf("  expected \"%s\"\n  received \"%.*s\"\n", expected, (int)run.size, run.output);
+  }
+}
+
+static void expect_closed(const char* what, const char* const argv[], int signal)
+{
+  struct run run;
+  drive(&run, argv, "");
+
+  if(!run.closed)
+  {
+    fail(what, "exited without closing its output");
+  }
+  else if(signal ? !WIFSIGNALED(run.status) || WTERMSIG(run.status) != signal :
+                   !WIFEXITED(run.status) || WEXITSTATUS(run.status) == 0)
+  {
+    fail(what, "did not fail the way it should");
+  }
+}
+
+static void write_lc3_image(const char* path, const uint16_t* words, size_t num_words)
+{
+  FILE* file = fopen(path, "wb");
+  for(size_t i = 0; i < num_words; ++i)
+  {
+    fputc(words[i] >> 8, file);
+    fputc(words[i] & 0xFF, file);
+  }
+  fclose(file);
+}
+
+static void write_risc_program(const char* path, const uint16_t* words, size_t num_words)
+{
+  FILE* file = fopen(path, "w");
+  for(size_t i = 0; i < num_words; ++i)
+  {
+    fprintf(file, "%04x\n", words[i]);
+  }
+  fclose(file);
+}
+
+static void check_lc3(const char* lc3, const char* directory)
+{
+  /* GETC, stop on EOF, OUT, loop; then HALT. */
+  static const uint16_t echo[] = {0x3000, 0xF020, 0x1221, 0x0402, 0xF021, 0x0FFB, 0xF025};
+  /* RTI is not implemented and aborts. */
+  static const uint16_t rti[] = {0x3000, 0x8000};
+
+  char echo_path[256], rti_path[256], missing_path[256];
+  snprintf(echo_path, sizeof echo_path, "%s/echo.obj", directory);
+  snprintf(rti_path, sizeof rti_path, "%s/rti.obj", directory);
+  snprintf(missing_path, sizeof missing_path, "%s/missing.obj", directory);
+  write_lc3_image(echo_path, echo, sizeof echo / sizeof *echo);
+  write_lc3_image(rti_path, rti, sizeof rti / sizeof *rti);
+
+  const char* engines[] = {"--engine=switch", "--engine=table"};
+  for(int e = 0; e < 2; ++e)
+  {
+    const char* echo_args[] = {lc3, engines[e], "--console", echo_path, NULL};
+    const char* rti_args[] = {lc3, engines[e], "--console", rti_path, NULL};
+
+    expect_output("lc3 echo", echo_args, "", "HALT\n");
+    expect_output("lc3 echo", echo_args, "hello, console", "hello, consoleHALT\n");
+    expect_closed("lc3 abort", rti_args, SIGABRT);
+  }
+
+  const char* missing_args[] = {lc3, "--console", missing_path, NULL};
+  expect_closed("lc3 missing image", missing_args, 0);
+
+  remove(echo_path);
+  remove(rti_path);
+}
+
+static void check_risc(const char* risc, const char* directory)
+{
+  /* One data word, then four words of text: "addi r1, r0, 7",
+     "sw r1, r0, 0", "halt" and the extra word the loader counts. */
+  static const uint16_t store[] = {0x0001, 0x0000, 0x0004, 0x2407, 0x8401, 0xc000, 0x0000};
+
+  char store_path[256], missing_path[256];
+  snprintf(store_path, sizeof store_path, "%s/store.hex", directory);
+  snprintf(missing_path, sizeof missing_path, "%s/missing.hex", directory);
+  write_risc_program(store_path, store, sizeof store / sizeof *store);
+
+  const char* args[] = {risc, store_path, "--console", NULL};
+  const char* step_args[] = {risc, store_path, "--step", "--console", NULL};
+  const char* missing_args[] = {risc, missing_path, "--console", NULL};
+
+  struct run run;
+  drive(&run, args, "");
+  const char* welcome = "Welcome to the RiSC Virtual Machine";
+  const char* data = "Data[  0 ] = 7\n";
+  const char* bye = "Program exited successfully.\n";
+  size_t bye_length = strlen(bye);
+  if(!run.closed)
+  {
+    fail("risc", "exited without closing its output");
+  }
+  else if(run.size < bye_length || strncmp(run.output, welcome, strlen(welcome)) ||
+          !memmem(run.output, run.size, data, strlen(data)) ||
+          memcmp(run.output + run.size - bye_length, bye, bye_length))
+  {
+    fail("risc", "printed something else");
+    printf("  received \"%.*s\"\n", (int)run.size, run.output);
+  }
+
+  /* --step waits for a line of input after each of the four text words. */
+  drive(&run, step_args, "\n\n\n\n");
+  unsigned int prompts = 0;
+  for(const char* p = run.output; (p = memmem(p, run.output + run.size - p, "[PRESS ENTER]", 13)) != NULL; p += 13)
+  {
+    ++prompts;
+  }
+  if(!run.closed)
+  {
+    fail("risc --step", "exited without closing its output");
+  }
+  else if(prompts != 4 || run.size < bye_length || memcmp(run.output + run.size - bye_length, bye, bye_length))
+  {
+    fail("risc --step", "printed something else");
+  }
+
+  expect_closed("risc missing program", missing_args, 0);
+  remove(store_path);
+}
+
+int main(int argc, char* argv[])
+{
+  const char* lc3 = LC3_PATH;
+  const char* risc = RISC_PATH;
+  char directory[] = "/tmp/console_check.XXXXXX";
+
+  for(int i = 1; i < argc; ++i)
+  {
+    if(!strncmp(argv[i], "--lc3=", 6))
+    {
+      lc3 = argv[i] + 6;
+    }
+    else if(!strncmp(argv[i], "--risc=", 7))
+    {
+      risc = argv[i] + 7;
+    }
+    else
+    {
+      printf("console_check [--lc3=<path>] [--risc=<path>]\n");
+      return 2;
+    }
+  }
+
+  if(mkdtemp(directory) == NULL)
+  {
+    printf("failed to create %s\n", directory);
+    return 1;
+  }
+  check_lc3(lc3, directory);
+  check_risc(risc, directory);
+  rmdir(directory);
+
+  if(failures != 0)
+  {
+    printf("%u console checks failed.\n", failures);
+    return 1;
+  }
+  printf("lc3 and risc agree with their output through the console.\n");
+  return 0;
+}
@@ -0,0 +1,380 @@
+#define _GNU_SOURCE
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm_console.h"
+
+#define SHM_CONSOLE_MAGIC  0x52434853 /* "SHCR" */
+#define CACHE_LINE  64
+#define SPINS_BEFORE_YIELD  1024
+
+enum
+{
+  RING_INPUT,
+  RING_OUTPUT,
+  NUM_RINGS
+};
+
+/* head only moves in the producer, tail only in the consumer; both count
+   bytes since creation and are masked on use. */
+struct ring
+{
+  _Alignas(CACHE_LINE) atomic_uint_fast64_t head;
+  atomic_uint closed;
+  _Alignas(CACHE_LINE) atomic_uint_fast64_t tail;
+};
+
+/* The start of the memfd, followed by the input bytes and the output bytes. */
+struct shared
+{
+  uint32_t magic;
+  uint32_t capacity;
+  struct ring rings[NUM_RINGS];
+};
+
+struct shm_console
+{
+  int fd;
+  size_t map_size;
+  struct shared* shared;
+  uint8_t* data[NUM_RINGS];
+  uint64_t mask;
+};
+
+static struct shm_console* map_console(int fd, size_t map_size)
+{
+  struct shm_console* console = malloc(sizeof *console);
+  if(console == NULL)
+  {
+    return NULL;
+  }
+
+  void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(map == MAP_FAILED)
+  {
+    free(console);
+    return NULL;
+  }
+
+  console->fd = fd;
+  console->map_size = map_size;
+  console->shared = map;
+  return console;
+}
+
+static void set_rings(struct shm_console* console)
+{
+  uint32_t capacity = console->shared->capacity;
+  uint8_t* data = (uint8_t*)(console->shared + 1);
+
+  console->data[RING_INPUT] = data;
+  console->data[RING_OUTPUT] = data + capacity;
+  console->mask = capacity - 1;
+}
+
+struct shm_console* shm_console_create(size_t capacity)
+{
+  size_t rounded = CACHE_LINE;
+  while(rounded < capacity && rounded < (1u << 30))
+  {
+    rounded <<= 1;
+  }
+
+  int fd = memfd_create("shm_console", 0);
+  if(fd < 0)
+  {
+    return NULL;
+  }
+
+  size_t map_size = sizeof(struct shared) + NUM_RINGS * rounded;
+  struct shm_console* console = ftruncate(fd, map_size) == 0 ? map_console(fd, map_size) : NULL;
+  if(console == NULL)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  console->shared->magic = SHM_CONSOLE_MAGIC;
+  console->shared->capacity = rounded;
+  for(int r = 0; r < NUM_RINGS; ++r)
+  {
+    atomic_init(&console->shared->rings[r].head, 0);
+    atomic_init(&console->shared->rings[r].tail, 0);
+    atomic_init(&console->shared->rings[r].closed, 0);
+  }
+  set_rings(console);
+  return console;
+}
+
+struct shm_console* shm_console_attach(int fd)
+{
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct shared))
+  {
+    return NULL;
+  }
+
+  struct shm_console* console = map_console(fd, st.st_size);
+  if(console == NULL)
+  {
+    return NULL;
+  }
+
+  uint32_t capacity = console->shared->capacity;
+  if(console->shared->magic != SHM_CONSOLE_MAGIC || capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+     sizeof(struct shared) + NUM_RINGS * (size_t)capacity > console->map_size)
+  {
+    munmap(console->shared, console->map_size);
+    free(console);
+    return NULL;
+  }
+
+  set_rings(console);
+  return console;
+}
+
+static struct shm_console* exiting_console;
+
+void shm_console_free(struct shm_console* console)
+{
+  if(console == NULL)
+  {
+    return;
+  }
+  if(console == exiting_console)
+  {
+    exiting_console = NULL;
+  }
+  munmap(console->shared, console->map_size);
+  close(console->fd);
+  free(console);
+}
+
+int shm_console_fd(const struct shm_console* console)
+{
+  return console->fd;
+}
+
+static size_t ring_write(struct shm_console* console, int r, const void* data, size_t size)
+{
+  struct ring* ring = &console->shared->rings[r];
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  uint64_t space = console->mask + 1 - (head - tail);
+  size_t n = size < space ? size : space;
+  size_t offset = head & console->mask;
+  size_t first = n < console->mask + 1 - offset ? n : console->mask + 1 - offset;
+
+  memcpy(console->data[r] + offset, data, first);
+  memcpy(console->data[r], (const uint8_t*)data + first, n - first);
+  atomic_store_explicit(&ring->head, head + n, memory_order_release);
+  return n;
+}
+
+static size_t ring_read(struct shm_console* console, int r, void* data, size_t size)
+{
+  struct ring* ring = &console->shared->rings[r];
+  uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  size_t n = size < head - tail ? size : head - tail;
+  size_t offset = tail & console->mask;
+  size_t first = n < console->mask + 1 - offset ? n : console->mask + 1 - offset;
+
+  memcpy(data, console->data[r] + offset, first);
+  memcpy((uint8_t*)data + first, console->data[r], n - first);
+  atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+  return n;
+}
+
+static int ring_empty(const struct shm_console* console, int r)
+{
+  const struct ring* ring = &console->shared->rings[r];
+  return atomic_load_explicit(&ring->head, memory_order_acquire) ==
+         atomic_load_explicit(&ring->tail, memory_order_relaxed);
+}
+
+static int ring_closed(const struct shm_console* console, int r)
+{
+  return atomic_load_explicit(&console->shared->rings[r].closed, memory_order_acquire);
+}
+
+static void ring_close(struct shm_console* console, int r)
+{
+  atomic_store_explicit(&console->shared->rings[r].closed, 1, memory_order_release);
+}
+
+/* Only reached while the other side is behind; data never waits here. */
+static void wait_for_peer(unsigned int* spins)
+{
+  if(++*spins >= SPINS_BEFORE_YIELD)
+  {
+    *spins = 0;
+    sched_yield();
+  }
+}
+
+size_t shm_console_send(struct shm_console* console, const void* data, size_t size)
+{
+  return ring_write(console, RING_INPUT, data, size);
+}
+
+size_t shm_console_receive(struct shm_console* console, void* data, size_t size)
+{
+  return ring_read(console, RING_OUTPUT, data, size);
+}
+
+void shm_console_close_input(struct shm_console* console)
+{
+  ring_close(console, RING_INPUT);
+}
+
+/* True once the guest closed its output and everything in it was received. */
+int shm_console_output_closed(const struct shm_console* console)
+{
+  return ring_closed(console, RING_OUTPUT) && ring_empty(console, RING_OUTPUT);
+}
+
+int shm_console_ready(const struct shm_console* console)
+{
+  return !ring_empty(console, RING_INPUT);
+}
+
+/* Waits for a byte; returns EOF once the harness closed the input and it
+   is drained. */
+int shm_console_getc(struct shm_console* console)
+{
+  unsigned int spins = 0;
+  uint8_t c;
+
+  for(;;)
+  {
+    int closed = ring_closed(console, RING_INPUT);
+    if(ring_read(console, RING_INPUT, &c, 1) == 1)
+    {
+      return c;
+    }
+    if(closed)
+    {
+      return EOF;
+    }
+    wait_for_peer(&spins);
+  }
+}
+
+/* Waits while the output ring is full. */
+void shm_console_putc(struct shm_console* console, int c)
+{
+  unsigned int spins = 0;
+  uint8_t byte = c;
+
+  while(ring_write(console, RING_OUTPUT, &byte, 1) == 0)
+  {
+    wait_for_peer(&spins);
+  }
+}
+
+void shm_console_close_output(struct shm_console* console)
+{
+  ring_close(console, RING_OUTPUT);
+}
+
+static void close_at_exit(void)
+{
+  if(exiting_console != NULL)
+  {
+    fflush(NULL);
+    shm_console_close_output(exiting_console);
+  }
+}
+
+static void close_on_signal(int sig)
+{
+  if(exiting_console != NULL)
+  {
+    shm_console_close_output(exiting_console);
+  }
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+/*
+ * Closes the output ring when the guest leaves through exit(), abort() or
+ * a fault signal, so a harness waiting for it does not spin forever. Only
+ * one console can be registered per process.
+ */
+void shm_console_close_on_exit(struct shm_console* console)
+{
+  static const int signals[] = {SIGABRT, SIGSEGV, SIGBUS, SIGFPE, SIGILL};
+
+  exiting_console = console;
+  atexit(close_at_exit);
+  for(size_t i = 0; i < sizeof signals / sizeof *signals; ++i)
+  {
+    signal(signals[i], close_on_signal);
+  }
+}
+
+static ssize_t cookie_read(void* cookie, char* buffer, size_t size)
+{
+  struct shm_console* console = cookie;
+  int c = shm_console_getc(console);
+  if(c == EOF)
+  {
+    return 0;
+  }
+
+  buffer[0] = c;
+  return 1 + ring_read(console, RING_INPUT, buffer + 1, size - 1);
+}
+
+static ssize_t cookie_write(void* cookie, const char* buffer, size_t size)
+{
+  struct shm_console* console = cookie;
+  unsigned int spins = 0;
+  size_t written = 0;
+
+  while(written < size)
+  {
+    size_t n = ring_write(console, RING_OUTPUT, buffer + written, size - written);
+    if(n == 0)
+    {
+      wait_for_peer(&spins);
+    }
+    written += n;
+  }
+  return size;
+}
+
+static int cookie_close(void* cookie)
+{
+  shm_console_close_output(cookie);
+  return 0;
+}
+
+/*
+ * Wraps the guest side in a stdio stream: "r" reads the input ring, "w"
+ * writes the output ring and closes it on fclose.
+ */
+FILE* shm_console_fopen(struct shm_console* console, const char* mode)
+{
+  cookie_io_functions_t io = {NULL, NULL, NULL, NULL};
+
+  if(mode[0] == 'r')
+  {
+    io.read = cookie_read;
+  }
+  else
+  {
+    io.write = cookie_write;
+    io.close = cookie_close;
+  }
+  return fopencookie(console, mode, io);
+}
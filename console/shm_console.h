@@ -0,0 +1,44 @@
+#ifndef SHM_CONSOLE_H
+#define SHM_CONSOLE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * A console made of two single-producer/single-consumer byte rings in one
+ * memfd: input runs from the harness to the guest, output from the guest
+ * to the harness. The harness creates the console and passes its fd to a
+ * VM it spawns (e.g. lc3 --console=<fd>); the VM attaches to the same fd.
+ * Reads and writes only touch the shared mapping, so moving bytes costs no
+ * system calls. Each ring can be closed by its producer, which the
+ * consumer sees as end of file once the ring is drained.
+ *
+ * A guest that is killed outright never closes its output, so a harness
+ * that waits for shm_console_output_closed() should also poll the child
+ * with waitpid(WNOHANG).
+ */
+
+#define SHM_CONSOLE_DEFAULT_CAPACITY  (64 * 1024)
+
+struct shm_console;
+
+/* Harness side. capacity is rounded up to a power of two. */
+struct shm_console* shm_console_create(size_t capacity);
+int shm_console_fd(const struct shm_console* console);
+size_t shm_console_send(struct shm_console* console, const void* data, size_t size);
+size_t shm_console_receive(struct shm_console* console, void* data, size_t size);
+void shm_console_close_input(struct shm_console* console);
+int shm_console_output_closed(const struct shm_console* console);
+
+/* Guest side. */
+struct shm_console* shm_console_attach(int fd);
+int shm_console_ready(const struct shm_console* console);
+int shm_console_getc(struct shm_console* console);
+void shm_console_putc(struct shm_console* console, int c);
+void shm_console_close_output(struct shm_console* console);
+void shm_console_close_on_exit(struct shm_console* console);
+FILE* shm_console_fopen(struct shm_console* console, const char* mode);
+
+void shm_console_free(struct shm_console* console);
+
+#endif
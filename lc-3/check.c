@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "lc-3.h"
+
+/*
+ * Lock-step differential checker. Random programs run on the switch
+ * interpreter (lc-3.c) and on the opcode table (lc-3.cpp), which are
+ * compared every --interval instructions. A difference is narrowed down to
+ * the first instruction that diverged by running the program again one
+ * instruction at a time.
+ *
+ * The programs only ever store into a small data window, so they can not
+ * write a reserved opcode into their own code. Everything else is zero,
+ * which is a BR that is never taken, apart from a HALT at the end of the
+ * code and one at address 0 for a RET that has nowhere to return to.
+ */
+
+#define CODE_SIZE  160
+#define DATA_ADDRESS  (LC3_PC_START + CODE_SIZE)
+#define DATA_SIZE  64
+#define POINTERS_ADDRESS  (DATA_ADDRESS + DATA_SIZE)
+#define POINTERS_SIZE  32
+#define DATA_BASE  (DATA_ADDRESS + DATA_SIZE / 2)
+#define OUTPUT_SIZE  4096
+
+#define DEFAULT_PROGRAMS  10000
+#define DEFAULT_INTERVAL  64
+#define DEFAULT_STEPS  20000
+
+#define HALT  0xF025
+
+enum
+{
+  OUTCOME_HALTED = 0,
+  OUTCOME_STEP_LIMIT,
+  OUTCOME_DIVERGED
+};
+
+/*The keyboard and the traps read from a fixed string and write to a buffer*/
+struct capture
+{
+  const char* input;
+  unsigned int read;
+  char output[OUTPUT_SIZE];
+  unsigned int count;
+};
+
+struct side
+{
+  const struct lc3_engine* engine;
+  struct capture capture;
+  struct lc3_console console;
+  unsigned int instructions;
+  int running;
+};
+
+static const char* const register_names[R_COUNT] =
+{
+  "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7", "pc", "cond"
+};
+
+static const char input[] = "lc-3 differential check";
+
+static uint16_t program[LC3_MEMORY_SIZE];
+
+static unsigned long long rng;
+
+static unsigned int rnd(unsigned int n)
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return (unsigned int)(rng >> 32) % n;
+}
+
+static int capture_ready(void* ctx)
+{
+  struct capture* c = ctx;
+  return c->input[c->read] != '\0';
+}
+
+static int capture_read(void* ctx)
+{
+  struct capture* c = ctx;
+  return c->input[c->read] ? c->input[c->read++] : 0;
+}
+
+static void capture_write(void* ctx, int ch)
+{
+  struct capture* c = ctx;
+  if(c->count < OUTPUT_SIZE)
+  {
+    c->output[c->count] = (char)ch;
+  }
+  c->count++;
+}
+
+static void capture_flush(void* ctx)
+{
+  (void)ctx;
+}
+
+/*R6 holds DATA_BASE for the whole program and R7 only ever holds a return address*/
+static unsigned int dest(void)
+{
+  return rnd(6);
+}
+
+static uint16_t pc_offset(unsigned int pc, unsigned int target)
+{
+  return (uint16_t)(target - (pc + 1)) & 0x1FF;
+}
+
+static unsigned int instruction(unsigned int pc, unsigned int end)
+{
+  unsigned int op = rnd(16);
+
+  switch(op)
+  {
+    case 1:
+    case 5:
+      /*ADD and AND*/
+      if(rnd(2))
+      {
+        return (op << 12) | (dest() << 9) | (rnd(8) << 6) | (1 << 5) | rnd(32);
+      }
+      return (op << 12) | (dest() << 9) | (rnd(8) << 6) | rnd(8);
+
+    case 9:
+      return 0x903F | (dest() << 9) | (rnd(8) << 6);
+
+    case 0:
+    case 8:
+    {
+      /*BR, mostly short hops that stay inside the program*/
+      int offset = rnd(8) ? (int)rnd(17) - 8 : (int)rnd(512) - 256;
+      if(pc + 1 + offset >= end)
+      {
+        offset = -(int)rnd(8);
+      }
+      return (rnd(8) << 9) | ((uint16_t)offset & 0x1FF);
+    }
+
+    case 2:
+      return 0x2000 | (dest() << 9) | pc_offset(pc, DATA_ADDRESS + rnd(DATA_SIZE));
+
+    case 3:
+      return 0x3000 | (rnd(8) << 9) | pc_offset(pc, DATA_ADDRESS + rnd(DATA_SIZE));
+
+    case 10:
+      return 0xA000 | (dest() << 9) | pc_offset(pc, (rnd(2) ? POINTERS_ADDRESS : DATA_ADDRESS) + rnd(POINTERS_SIZE));
+
+    case 11:
+      return 0xB000 | (rnd(8) << 9) | pc_offset(pc, POINTERS_ADDRESS + rnd(POINTERS_SIZE - 1));
+
+    case 6:
+      return 0x6000 | (dest() << 9) | (R_R6 << 6) | rnd(64);
+
+    case 7:
+      return 0x7000 | (rnd(8) << 9) | (R_R6 << 6) | rnd(64);
+
+    case 14:
+      return 0xE000 | (dest() << 9) | pc_offset(pc, DATA_ADDRESS + rnd(DATA_SIZE + POINTERS_SIZE));
+
+    case 4:
+      /*JSR a little way forward, or JSRR R7 and RET*/
+      if(rnd(4))
+      {
+        unsigned int offset = 1 + rnd(8);
+        if(pc + 1 + offset > end)
+        {
+          offset = end - pc - 1;
+        }
+        return 0x4800 | offset;
+      }
+      return rnd(2) ? 0x41C0 : 0xC1C0;
+
+    default:
+      /*GETC, OUT, IN, HALT and an unknown vector; PUTS and PUTSP come with their own LEA*/
+      {
+        static const unsigned int vectors[] = {0x20, 0x21, 0x23, 0x25, 0x26};
+        return 0xF000 | vectors[rnd(5)];
+      }
+  }
+}
+
+static void generate(unsigned long long seed)
+{
+  unsigned int pc = LC3_PC_START;
+  unsigned int end = LC3_PC_START + CODE_SIZE - 1;
+  unsigned int i;
+
+  rng = seed * 0x9E3779B97F4A7C15ull + 1;
+
+  memset(program, 0, sizeof(program));
+  program[0] = HALT;
+  program[end] = HALT;
+
+  program[pc] = 0xE000 | (R_R6 << 9) | pc_offset(pc, DATA_BASE);
+  pc++;
+  while(pc < end)
+  {
+    if(rnd(16) == 0 && pc + 1 < end)
+    {
+      program[pc] = 0xE000 | pc_offset(pc, DATA_ADDRESS + rnd(DATA_SIZE));
+      pc++;
+      program[pc++] = rnd(2) ? 0xF022 : 0xF024;
+    }
+    else
+    {
+      program[pc] = instruction(pc, end);
+      pc++;
+    }
+  }
+
+  for(i = 0; i < DATA_SIZE; i++)
+  {
+    program[DATA_ADDRESS + i] = rnd(4) ? rnd(128) : rnd(0x10000);
+  }
+  for(i = 0; i < POINTERS_SIZE - 1; i++)
+  {
+    program[POINTERS_ADDRESS + i] = DATA_ADDRESS + rnd(DATA_SIZE);
+  }
+  program[POINTERS_ADDRESS + rnd(POINTERS_SIZE - 1)] = 0xFE00;
+  program[POINTERS_ADDRESS + rnd(POINTERS_SIZE - 1)] = 0xFE02;
+  program[POINTERS_ADDRESS + POINTERS_SIZE - 1] = 0;
+}
+
+static void load(struct side* side)
+{
+  memcpy(side->engine->memory, program, sizeof(program));
+  memset(&side->capture, 0, sizeof(side->capture));
+  side->capture.input = input;
+  side->console.ready = capture_ready;
+  side->console.read = capture_read;
+  side->console.write = capture_write;
+  side->console.flush = capture_flush;
+  side->console.ctx = &side->capture;
+  side->engine->reset(&side->console);
+  side->instructions = 0;
+  side->running = 1;
+}
+
+static void run(struct side* side, unsigned int limit)
+{
+  while(side->running && side->instructions < limit)
+  {
+    side->running = side->engine->step();
+    side->instructions++;
+  }
+}
+
+static unsigned int output_size(const struct side* side)
+{
+  return side->capture.count < OUTPUT_SIZE ? side->capture.count : OUTPUT_SIZE;
+}
+
+/*Stores only reach the data window, the pointers and the keyboard registers, so
+  the whole of memory is compared once the programs stop*/
+static int same_memory(const struct side* a, const struct side* b, unsigned int address, unsigned int size)
+{
+  return !memcmp(a->engine->memory + address, b->engine->memory + address, size * sizeof(uint16_t));
+}
+
+static int same(const struct side* a, const struct side* b)
+{
+  return a->running == b->running &&
+    !memcmp(a->engine->reg, b->engine->reg, R_COUNT * sizeof(uint16_t)) &&
+    same_memory(a, b, DATA_ADDRESS, DATA_SIZE + POINTERS_SIZE) &&
+    same_memory(a, b, 0xFE00, 3) &&
+    (a->running || same_memory(a, b, 0, LC3_MEMORY_SIZE)) &&
+    a->capture.count == b->capture.count &&
+    !memcmp(a->capture.output, b->capture.output, output_size(a));
+}
+
+static void print_differences(const struct side* a, const struct side* b)
+{
+  unsigned int i;
+
+  for(i = 0; i < R_COUNT; i++)
+  {
+    if(a->engine->reg[i] != b->engine->reg[i])
+    {
+      printf("  %s: %s 0x%04x, %s 0x%04x\n", register_names[i], a->engine->name, a->engine->reg[i], b->engine->name, b->engine->reg[i]);
+    }
+  }
+  for(i = 0; i < LC3_MEMORY_SIZE; i++)
+  {
+    if(a->engine->memory[i] != b->engine->memory[i])
+    {
+      printf("  memory at 0x%04x: %s 0x%04x, %s 0x%04x\n", i, a->engine->name, a->engine->memory[i], b->engine->name, b->engine->memory[i]);
+      break;
+    }
+  }
+  if(a->capture.count != b->capture.count || memcmp(a->capture.output, b->capture.output, output_size(a)))
+  {
+    printf("  output: %s wrote %u characters, %s wrote %u\n", a->engine->name, a->capture.count, b->engine->name, b->capture.count);
+  }
+  if(a->running != b->running)
+  {
+    printf("  %s %s, %s %s\n", a->engine->name, a->running ? "is running" : "halted", b->engine->name, b->running ? "is running" : "halted");
+  }
+}
+
+static int lockstep(struct side* ref, struct side* fast, unsigned int interval, unsigned int steps)
+{
+  unsigned int limit = 0;
+
+  load(ref);
+  load(fast);
+  while(ref->running && fast->running && limit < steps)
+  {
+    limit = steps - limit > interval ? limit + interval : steps;
+    run(ref, limit);
+    run(fast, limit);
+    if(!same(ref, fast))
+    {
+      return OUTCOME_DIVERGED;
+    }
+  }
+  if(!same_memory(ref, fast, 0, LC3_MEMORY_SIZE))
+  {
+    return OUTCOME_DIVERGED;
+  }
+  return ref->running ? OUTCOME_STEP_LIMIT : OUTCOME_HALTED;
+}
+
+static void pinpoint(struct side* ref, struct side* fast, unsigned int steps)
+{
+  unsigned int instructions;
+
+  load(ref);
+  load(fast);
+  for(instructions = 0; instructions < steps && ref->running && fast->running; instructions++)
+  {
+    uint16_t pc = ref->engine->reg[R_PC];
+    uint16_t instr = ref->engine->memory[pc];
+
+    run(ref, instructions + 1);
+    run(fast, instructions + 1);
+    if(!same(ref, fast))
+    {
+      printf("The first difference is after instruction %u, 0x%04x at 0x%04x:\n", instructions + 1, instr, pc);
+      print_differences(ref, fast);
+      return;
+    }
+  }
+  printf("The difference did not show up one instruction at a time.\n");
+}
+
+static void print_program(void)
+{
+  unsigned int i;
+
+  printf("Program:\n");
+  for(i = 0; i < CODE_SIZE; i++)
+  {
+    printf("%s%04x", i % 8 ? " " : i ? "\n  " : "  ", program[LC3_PC_START + i]);
+  }
+  printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+  unsigned long long seed = 1;
+  unsigned int num_programs = DEFAULT_PROGRAMS;
+  unsigned int interval = DEFAULT_INTERVAL;
+  unsigned int steps = DEFAULT_STEPS;
+  unsigned int outcomes[OUTCOME_DIVERGED + 1] = {0};
+  unsigned long long instructions = 0;
+  static struct side ref;
+  static struct side fast;
+  unsigned int i;
+
+  for(i = 1; i < (unsigned int) argc; i++)
+  {
+    if(!strncmp(argv[i], "--seed=", 7))
+    {
+      seed = strtoull(argv[i] + 7, NULL, 0);
+    }
+    else if(!strncmp(argv[i], "--programs=", 11))
+    {
+      num_programs = strtoul(argv[i] + 11, NULL, 0);
+    }
+    else if(!strncmp(argv[i], "--interval=", 11))
+    {
+      interval = strtoul(argv[i] + 11, NULL, 0);
+    }
+    else if(!strncmp(argv[i], "--steps=", 8))
+    {
+      steps = strtoul(argv[i] + 8, NULL, 0);
+    }
+    else
+    {
+      printf("lc3_check [--seed=<n>] [--programs=<n>] [--interval=<instructions>] [--steps=<n>]\n");
+      exit(2);
+    }
+  }
+  if(interval < 1)
+  {
+    interval = 1;
+  }
+
+  ref.engine = &lc3_switch_engine;
+  fast.engine = &lc3_table_engine;
+
+  for(i = 0; i < num_programs; i++)
+  {
+    int outcome;
+
+    generate(seed + i);
+    outcome = lockstep(&ref, &fast, interval, steps);
+    outcomes[outcome]++;
+    instructions += fast.instructions;
+    if(outcome == OUTCOME_DIVERGED)
+    {
+      printf("%s and %s diverged on program %u (--seed=%llu --programs=1).\n", ref.engine->name, fast.engine->name, i, seed + i);
+      pinpoint(&ref, &fast, steps);
+      print_program();
+      exit(1);
+    }
+  }
+
+  printf("%u programs, %u runs, %llu instructions: %u halted, %u hit the step limit\n", num_programs,
+    outcomes[OUTCOME_HALTED] + outcomes[OUTCOME_STEP_LIMIT], instructions, outcomes[OUTCOME_HALTED], outcomes[OUTCOME_STEP_LIMIT]);
+  return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef LC3_H
+#define LC3_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LC3_MEMORY_SIZE (UINT16_MAX + 1)
+#define LC3_PC_START 0x3000
+
+/*Registers*/
+enum
+{
+  R_R0 = 0,
+  R_R1,
+  R_R2,
+  R_R3,
+  R_R4,
+  R_R5,
+  R_R6,
+  R_R7,
+  R_PC,
+  R_COND,
+  R_COUNT
+};
+
+/*Where the traps and the keyboard registers read and write characters*/
+struct lc3_console
+{
+  int (*ready)(void* ctx);
+  int (*read)(void* ctx);
+  void (*write)(void* ctx, int c);
+  void (*flush)(void* ctx);
+  void* ctx;
+};
+
+/*An interchangeable implementation of the machine. step runs one
+  instruction and returns 0 once the program has halted.*/
+struct lc3_engine
+{
+  const char* name;
+  uint16_t* memory;
+  uint16_t* reg;
+  void (*reset)(const struct lc3_console* console);
+  int (*step)(void);
+};
+
+extern const struct lc3_engine lc3_switch_engine;
+extern const struct lc3_engine lc3_table_engine;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
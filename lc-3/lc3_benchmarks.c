@@ -0,0 +1,137 @@
+#include "lc3_benchmarks.h"
+
+/*
+ * Fixed workloads for vm_bench. Each kernel is loaded at LC3_PC_START into
+ * zeroed memory and leaves a checksum in R0 when it halts, which is checked
+ * before its timing is trusted.
+ */
+
+/* Sums 1000 + 999 + ... + 1 into R0, 1000 times. */
+static const uint16_t sum_code[] =
+{
+  0x5020,  /*         AND  R0, R0, #0 */
+  0x2607,  /*         LD   R3, REPS */
+  0x2207,  /* OUTER:  LD   R1, COUNT */
+  0x1001,  /* INNER:  ADD  R0, R0, R1 */
+  0x127f,  /*         ADD  R1, R1, #-1 */
+  0x03fd,  /*         BRp  INNER */
+  0x16ff,  /*         ADD  R3, R3, #-1 */
+  0x03fa,  /*         BRp  OUTER */
+  0xf025,  /*         HALT */
+  0x03e8,  /* REPS:   .FILL #1000 */
+  0x03e8,  /* COUNT:  .FILL #1000 */
+};
+
+/* Shift-and-add 16x16 multiply of n by n + 37 for n = 20000..1, summed in R0. */
+static const uint16_t multiply_code[] =
+{
+  0x5020,  /*         AND  R0, R0, #0 */
+  0x2c12,  /*         LD   R6, REPS */
+  0x13a0,  /* NEXT:   ADD  R1, R6, #0 */
+  0x2411,  /*         LD   R2, K37 */
+  0x1486,  /*         ADD  R2, R2, R6 */
+  0x56e0,  /*         AND  R3, R3, #0 */
+  0x5920,  /*         AND  R4, R4, #0 */
+  0x1921,  /*         ADD  R4, R4, #1 */
+  0x2a0d,  /*         LD   R5, BITS */
+  0x5e84,  /* MLOOP:  AND  R7, R2, R4 */
+  0x0401,  /*         BRz  SKIP */
+  0x16c1,  /*         ADD  R3, R3, R1 */
+  0x1241,  /* SKIP:   ADD  R1, R1, R1 */
+  0x1904,  /*         ADD  R4, R4, R4 */
+  0x1b7f,  /*         ADD  R5, R5, #-1 */
+  0x03f9,  /*         BRp  MLOOP */
+  0x1003,  /*         ADD  R0, R0, R3 */
+  0x1dbf,  /*         ADD  R6, R6, #-1 */
+  0x03ef,  /*         BRp  NEXT */
+  0xf025,  /*         HALT */
+  0x4e20,  /* REPS:   .FILL #20000 */
+  0x0025,  /* K37:    .FILL #37 */
+  0x0010,  /* BITS:   .FILL #16 */
+};
+
+/* Sums fib(n) mod 2^16 for n = 1..1000 in R0, computing each from scratch. */
+static const uint16_t fibonacci_code[] =
+{
+  0x5020,  /*         AND  R0, R0, #0 */
+  0x5260,  /*         AND  R1, R1, #0 */
+  0x1261,  /*         ADD  R1, R1, #1 */
+  0x54a0,  /* NEXT:   AND  R2, R2, #0 */
+  0x56e0,  /*         AND  R3, R3, #0 */
+  0x16e1,  /*         ADD  R3, R3, #1 */
+  0x1860,  /*         ADD  R4, R1, #0 */
+  0x1a83,  /* LOOP:   ADD  R5, R2, R3 */
+  0x14e0,  /*         ADD  R2, R3, #0 */
+  0x1760,  /*         ADD  R3, R5, #0 */
+  0x193f,  /*         ADD  R4, R4, #-1 */
+  0x03fb,  /*         BRp  LOOP */
+  0x1002,  /*         ADD  R0, R0, R2 */
+  0x1261,  /*         ADD  R1, R1, #1 */
+  0x2c03,  /*         LD   R6, LIMIT */
+  0x1c46,  /*         ADD  R6, R1, R6 */
+  0x09f2,  /*         BRn  NEXT */
+  0xf025,  /*         HALT */
+  0xfc17,  /* LIMIT:  .FILL #-1001 */
+};
+
+/* Bubble sort of 32 pseudo-random words, 400 times; R0 sums three of each sorted array. */
+static const uint16_t sort_code[] =
+{
+  0x5020,  /*         AND  R0, R0, #0 */
+  0x2e26,  /*         LD   R7, REPS */
+  0xe229,  /* REP:    LEA  R1, ARRAY */
+  0x2425,  /*         LD   R2, N */
+  0x2626,  /*         LD   R3, SEED */
+  0x18c3,  /* FILL:   ADD  R4, R3, R3 */
+  0x1904,  /*         ADD  R4, R4, R4 */
+  0x1703,  /*         ADD  R3, R4, R3 */
+  0x16ed,  /*         ADD  R3, R3, #13 */
+  0x7640,  /*         STR  R3, R1, #0 */
+  0x1261,  /*         ADD  R1, R1, #1 */
+  0x14bf,  /*         ADD  R2, R2, #-1 */
+  0x03f8,  /*         BRp  FILL */
+  0x361d,  /*         ST   R3, SEED */
+  0x241b,  /*         LD   R2, PASSES */
+  0xe21c,  /* PASS:   LEA  R1, ARRAY */
+  0x16a0,  /*         ADD  R3, R2, #0 */
+  0x6840,  /* INNER:  LDR  R4, R1, #0 */
+  0x6a41,  /*         LDR  R5, R1, #1 */
+  0x9d3f,  /*         NOT  R6, R4 */
+  0x1da1,  /*         ADD  R6, R6, #1 */
+  0x1d46,  /*         ADD  R6, R5, R6 */
+  0x0602,  /*         BRzp NOSWAP */
+  0x7a40,  /*         STR  R5, R1, #0 */
+  0x7841,  /*         STR  R4, R1, #1 */
+  0x1261,  /* NOSWAP: ADD  R1, R1, #1 */
+  0x16ff,  /*         ADD  R3, R3, #-1 */
+  0x03f5,  /*         BRp  INNER */
+  0x14bf,  /*         ADD  R2, R2, #-1 */
+  0x03f1,  /*         BRp  PASS */
+  0xe20d,  /*         LEA  R1, ARRAY */
+  0x6840,  /*         LDR  R4, R1, #0 */
+  0x1004,  /*         ADD  R0, R0, R4 */
+  0x6850,  /*         LDR  R4, R1, #16 */
+  0x1004,  /*         ADD  R0, R0, R4 */
+  0x685f,  /*         LDR  R4, R1, #31 */
+  0x1004,  /*         ADD  R0, R0, R4 */
+  0x1fff,  /*         ADD  R7, R7, #-1 */
+  0x03db,  /*         BRp  REP */
+  0xf025,  /*         HALT */
+  0x0190,  /* REPS:   .FILL #400 */
+  0x0020,  /* N:      .FILL #32 */
+  0x001f,  /* PASSES: .FILL #31 */
+  0x3039,  /* SEED:   .FILL #12345 */
+  /* ARRAY: .BLKW 32, left to the zeroed memory */
+};
+
+#define KERNEL(name)  name##_code, sizeof(name##_code) / sizeof(name##_code[0])
+
+const struct lc3_benchmark lc3_benchmarks[] =
+{
+  {"sum",       KERNEL(sum),       1568},
+  {"multiply",  KERNEL(multiply),  43264},
+  {"fibonacci", KERNEL(fibonacci), 49463},
+  {"sort",      KERNEL(sort),      30456},
+};
+
+const int lc3_num_benchmarks = sizeof(lc3_benchmarks) / sizeof(lc3_benchmarks[0]);
@@ -0,0 +1,17 @@
+#ifndef LC3_BENCHMARKS_H
+#define LC3_BENCHMARKS_H
+
+#include <stdint.h>
+
+struct lc3_benchmark
+{
+  const char* name;
+  const uint16_t* code;
+  unsigned int size;
+  uint16_t expected;
+};
+
+extern const struct lc3_benchmark lc3_benchmarks[];
+extern const int lc3_num_benchmarks;
+
+#endif
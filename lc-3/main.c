@@ -0,0 +1,204 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#include <termios.h>
+#include "lc-3.h"
+#include "shm_console.h"
+
+static const struct lc3_engine* engine = &lc3_table_engine;
+
+struct termios original_tio;
+
+void disable_input_buffering()
+{
+  tcgetattr(STDIN_FILENO, &original_tio);
+  struct termios new_tio = original_tio;
+  new_tio.c_lflag &= ~ICANON & ~ECHO;
+  tcsetattr(STDIN_FILENO, TCSANOW, &new_tio);
+}
+
+void restore_input_buffering()
+{
+  tcsetattr(STDIN_FILENO, TCSANOW, &original_tio);
+}
+
+void handle_interrupt(int signal)
+{
+  (void)signal;
+  restore_input_buffering();
+  printf("\n");
+  exit(-2);
+}
+
+static int stdio_ready(void* ctx)
+{
+  (void)ctx;
+  fd_set readfds;
+  FD_ZERO(&readfds);
+  FD_SET(STDIN_FILENO, &readfds);
+
+  struct timeval timeout;
+  timeout.tv_sec = 0;
+  timeout.tv_usec = 0;
+  return select(1, &readfds, NULL, NULL, &timeout) != 0;
+}
+
+static int stdio_read(void* ctx)
+{
+  (void)ctx;
+  return getchar();
+}
+
+static void stdio_write(void* ctx, int c)
+{
+  (void)ctx;
+  putc(c, stdout);
+}
+
+static void stdio_flush(void* ctx)
+{
+  (void)ctx;
+  fflush(stdout);
+}
+
+static const struct lc3_console stdio_console =
+{
+  stdio_ready, stdio_read, stdio_write, stdio_flush, NULL
+};
+
+static int shm_ready(void* ctx)
+{
+  return shm_console_ready(ctx);
+}
+
+static int shm_read(void* ctx)
+{
+  return shm_console_getc(ctx);
+}
+
+static void shm_write(void* ctx, int c)
+{
+  shm_console_putc(ctx, c);
+}
+
+static void shm_flush(void* ctx)
+{
+  (void)ctx;
+}
+
+uint16_t swap16(uint16_t x)
+{
+  return (x << 8) | (x >> 8);
+}
+
+void read_image_file(FILE* file)
+{
+  uint16_t origin;
+  if(fread(&origin, sizeof(origin), 1, file) != 1)
+  {
+    return;
+  }
+  origin = swap16(origin);
+
+  size_t max_read = LC3_MEMORY_SIZE - origin;
+  uint16_t* p = engine->memory + origin;
+  size_t read = fread(p, sizeof(uint16_t), max_read, file);
+
+  while(read-- > 0)
+  {
+    *p = swap16(*p);
+    ++p;
+  }
+}
+
+int read_image(const char* image_path)
+{
+  FILE* file = fopen(image_path, "rb");
+  if(!file)
+  {
+    return 0;
+  }
+  read_image_file(file);
+  fclose(file);
+  return 1;
+}
+
+int main(int argc, const char* argv[])
+{
+  int first_image = 1;
+  struct shm_console* shm = NULL;
+  struct lc3_console console = stdio_console;
+
+  for(; first_image < argc && !strncmp(argv[first_image], "--", 2); ++first_image)
+  {
+    const char* option = argv[first_image];
+    if(!strcmp(option, "--engine=switch"))
+    {
+      engine = &lc3_switch_engine;
+    }
+    else if(!strcmp(option, "--engine=table"))
+    {
+      engine = &lc3_table_engine;
+    }
+    else if(!strncmp(option, "--console=", 10))
+    {
+      /*A harness passes the fd of a shared memory console it created*/
+      shm = shm_console_attach(atoi(option + 10));
+      if(shm == NULL)
+      {
+        printf("failed to attach console: %s\n", option + 10);
+        exit(2);
+      }
+      shm_console_close_on_exit(shm);
+      console = (struct lc3_console) {shm_ready, shm_read, shm_write, shm_flush, shm};
+    }
+    else
+    {
+      printf("unknown option: %s\n", option);
+      exit(2);
+    }
+  }
+
+  if(argc <= first_image)
+  {
+    printf("lc3 [--engine=switch|table] [--console=<fd>] [image-file1] ...\n");
+    exit(2);
+  }
+
+  for(int i = first_image; i < argc; ++i)
+  {
+    if(!read_image(argv[i]))
+    {
+      printf("failed to load image: %s\n", argv[i]);
+      exit(1);
+    }
+  }
+
+  if(shm == NULL)
+  {
+    signal(SIGINT, handle_interrupt);
+    disable_input_buffering();
+  }
+
+  engine->reset(&console);
+  while(engine->step())
+  {
+  }
+
+  if(shm == NULL)
+  {
+    restore_input_buffering();
+  }
+  else
+  {
+    shm_console_close_output(shm);
+    shm_console_free(shm);
+  }
+}